@@ -85,6 +85,44 @@ func ConvertSubscription(data *C.char) *C.char {
 	return C.CString(string(result))
 }
 
+// ConvertSubscriptionBinary parses like ConvertSubscription but writes the
+// result in the binary layout of result_binary.go into out, reading exactly
+// length bytes of data without copying them. It returns the result size; when
+// that exceeds capacity nothing usable was written and the caller retries with
+// a buffer of that size.
+//
+//export ConvertSubscriptionBinary
+func ConvertSubscriptionBinary(data *C.char, length C.size_t, out unsafe.Pointer, capacity C.size_t) C.size_t {
+	// Appending into the caller's memory writes the result in place; append
+	// only moves to Go memory once the result outgrows capacity.
+	var target []byte
+	if out != nil && capacity > 0 {
+		target = unsafe.Slice((*byte)(out), int(capacity))[:0]
+	}
+	buf := target
+
+	if data == nil {
+		buf = appendResultError(buf, "null input")
+		return C.size_t(len(buf))
+	}
+
+	// The subscription is only read during this call, and everything the
+	// parser keeps is copied out of it first.
+	subscription := unsafe.String((*byte)(unsafe.Pointer(data)), int(length))
+
+	proxies, err := parseSubscriptionWithMihomo(subscription)
+	if err != nil {
+		buf = appendResultError(buf, err.Error())
+		return C.size_t(len(buf))
+	}
+
+	buf, err = appendResultProxies(buf, proxies)
+	if err != nil {
+		buf = appendResultError(target, "failed to marshal result: "+err.Error())
+	}
+	return C.size_t(len(buf))
+}
+
 // FreeString frees memory allocated by Go (must be called from C++ after using the result)
 //
 //export FreeString
@@ -91,6 +91,7 @@ extern void ReleaseUnusedMemory(void);
 extern char* ResolveAgeRecipient(char* key);
 extern char* EncryptAgeArmored(char* data, char* recipient);
 extern char* ConvertSubscription(char* data);
+extern size_t ConvertSubscriptionBinary(char* data, size_t length, void* out, size_t capacity);
 extern void FreeString(char* s);
 
 #ifdef __cplusplus
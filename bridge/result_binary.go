@@ -0,0 +1,361 @@
+package main
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"math"
+	"sort"
+	"strconv"
+	"strings"
+	"unicode/utf8"
+)
+
+// Binary result layout written by ConvertSubscriptionBinary, little endian:
+//
+//	"MHR1" u8 status
+//	status 1: u32 length, error message
+//	status 0: u32 node count, per node u32 field count, per field
+//	          u8 kind, u32 key length, key, u32 value length, value
+//
+// Values carry the text the JSON ABI produced after nlohmann::json parsed and
+// dumped it, so both ABIs hand the C++ side identical nodes: strings raw,
+// numbers, booleans and null as JSON literals, maps and arrays as compact JSON
+// with sorted keys. src/parser/mihomo_result.h decodes it.
+const (
+	resultMagic = "MHR1"
+
+	resultStatusOK    = 0
+	resultStatusError = 1
+
+	fieldString  = 0
+	fieldInteger = 1
+	fieldFloat   = 2
+	fieldBool    = 3
+	fieldNull    = 4
+	fieldJSON    = 5
+)
+
+// appendResultError appends an error result carrying message.
+func appendResultError(buf []byte, message string) []byte {
+	buf = append(buf, resultMagic...)
+	buf = append(buf, resultStatusError)
+	return appendResultBytes(buf, message)
+}
+
+// appendResultProxies appends a successful result for proxies. A value the
+// JSON ABI could not marshal fails the whole result the same way.
+func appendResultProxies(buf []byte, proxies []map[string]any) ([]byte, error) {
+	buf = append(buf, resultMagic...)
+	buf = append(buf, resultStatusOK)
+	buf = binary.LittleEndian.AppendUint32(buf, uint32(len(proxies)))
+	for _, mapping := range proxies {
+		buf = binary.LittleEndian.AppendUint32(buf, uint32(len(mapping)))
+		for key, value := range mapping {
+			var err error
+			if buf, err = appendResultField(buf, key, value); err != nil {
+				return buf, err
+			}
+		}
+	}
+	return buf, nil
+}
+
+func appendResultBytes(buf []byte, text string) []byte {
+	buf = binary.LittleEndian.AppendUint32(buf, uint32(len(text)))
+	return append(buf, text...)
+}
+
+// appendResultField writes one field, reserving the value length and patching
+// it afterwards so JSON values are written straight into buf.
+func appendResultField(buf []byte, key string, value any) ([]byte, error) {
+	kind, value, err := resultFieldKind(value)
+	if err != nil {
+		return buf, err
+	}
+	buf = append(buf, kind)
+	buf = appendResultBytes(buf, validUTF8(key))
+	lengthAt := len(buf)
+	buf = append(buf, 0, 0, 0, 0)
+	switch kind {
+	case fieldString:
+		buf = append(buf, validUTF8(value.(string))...)
+	case fieldNull:
+	default:
+		if buf, err = appendJSONValue(buf, value); err != nil {
+			return buf, err
+		}
+	}
+	binary.LittleEndian.PutUint32(buf[lengthAt:], uint32(len(buf)-lengthAt-4))
+	return buf, nil
+}
+
+// resultFieldKind classifies value as nlohmann::json would after parsing its
+// encoding/json form, converting types encoding/json alone understands.
+func resultFieldKind(value any) (byte, any, error) {
+	switch typed := value.(type) {
+	case nil:
+		return fieldNull, nil, nil
+	case string:
+		return fieldString, typed, nil
+	case bool:
+		return fieldBool, typed, nil
+	case int, int8, int16, int32, int64, uint, uint8, uint16, uint32, uint64:
+		return fieldInteger, typed, nil
+	case float32:
+		return resultFieldKind(float32AsFloat64(typed))
+	case float64:
+		if _, integral := floatAsInteger(typed); integral {
+			return fieldInteger, typed, nil
+		}
+		return fieldFloat, typed, nil
+	case map[string]any, []any:
+		return fieldJSON, typed, nil
+	}
+	roundTripped, err := jsonRoundTrip(value)
+	if err != nil {
+		return 0, nil, err
+	}
+	return resultFieldKind(roundTripped)
+}
+
+// jsonRoundTrip turns any other value into what encoding/json makes of it.
+func jsonRoundTrip(value any) (any, error) {
+	data, err := json.Marshal(value)
+	if err != nil {
+		return nil, err
+	}
+	var decoded any
+	if err := json.Unmarshal(data, &decoded); err != nil {
+		return nil, err
+	}
+	return decoded, nil
+}
+
+// appendJSONValue writes value as nlohmann::json dumps it.
+func appendJSONValue(buf []byte, value any) ([]byte, error) {
+	switch typed := value.(type) {
+	case nil:
+		return append(buf, "null"...), nil
+	case string:
+		return appendJSONString(buf, typed), nil
+	case bool:
+		return strconv.AppendBool(buf, typed), nil
+	case int:
+		return strconv.AppendInt(buf, int64(typed), 10), nil
+	case int8:
+		return strconv.AppendInt(buf, int64(typed), 10), nil
+	case int16:
+		return strconv.AppendInt(buf, int64(typed), 10), nil
+	case int32:
+		return strconv.AppendInt(buf, int64(typed), 10), nil
+	case int64:
+		return strconv.AppendInt(buf, typed, 10), nil
+	case uint:
+		return strconv.AppendUint(buf, uint64(typed), 10), nil
+	case uint8:
+		return strconv.AppendUint(buf, uint64(typed), 10), nil
+	case uint16:
+		return strconv.AppendUint(buf, uint64(typed), 10), nil
+	case uint32:
+		return strconv.AppendUint(buf, uint64(typed), 10), nil
+	case uint64:
+		return strconv.AppendUint(buf, typed, 10), nil
+	case float32:
+		return appendJSONValue(buf, float32AsFloat64(typed))
+	case float64:
+		return appendJSONFloat(buf, typed)
+	case []any:
+		buf = append(buf, '[')
+		for index, item := range typed {
+			if index > 0 {
+				buf = append(buf, ',')
+			}
+			var err error
+			if buf, err = appendJSONValue(buf, item); err != nil {
+				return buf, err
+			}
+		}
+		return append(buf, ']'), nil
+	case map[string]any:
+		// nlohmann keeps objects in a std::map, ordered by raw bytes; keys
+		// repaired to the same UTF-8 collapse into one entry there as well
+		keys := make([]string, 0, len(typed))
+		values := make(map[string]any, len(typed))
+		for key, item := range typed {
+			valid := validUTF8(key)
+			if _, exists := values[valid]; !exists {
+				keys = append(keys, valid)
+			}
+			values[valid] = item
+		}
+		sort.Strings(keys)
+		buf = append(buf, '{')
+		for index, key := range keys {
+			if index > 0 {
+				buf = append(buf, ',')
+			}
+			buf = appendJSONString(buf, key)
+			buf = append(buf, ':')
+			var err error
+			if buf, err = appendJSONValue(buf, values[key]); err != nil {
+				return buf, err
+			}
+		}
+		return append(buf, '}'), nil
+	}
+	roundTripped, err := jsonRoundTrip(value)
+	if err != nil {
+		return buf, err
+	}
+	return appendJSONValue(buf, roundTripped)
+}
+
+// appendJSONString escapes like nlohmann::json::dump: short escapes where
+// JSON has them, \u00xx for other control bytes, everything else raw.
+func appendJSONString(buf []byte, text string) []byte {
+	const hex = "0123456789abcdef"
+	text = validUTF8(text)
+	buf = append(buf, '"')
+	for index := 0; index < len(text); index++ {
+		c := text[index]
+		switch c {
+		case '"':
+			buf = append(buf, '\\', '"')
+		case '\\':
+			buf = append(buf, '\\', '\\')
+		case '\b':
+			buf = append(buf, '\\', 'b')
+		case '\f':
+			buf = append(buf, '\\', 'f')
+		case '\n':
+			buf = append(buf, '\\', 'n')
+		case '\r':
+			buf = append(buf, '\\', 'r')
+		case '\t':
+			buf = append(buf, '\\', 't')
+		default:
+			if c < 0x20 {
+				buf = append(buf, '\\', 'u', '0', '0', hex[c>>4], hex[c&0xF])
+			} else {
+				buf = append(buf, c)
+			}
+		}
+	}
+	return append(buf, '"')
+}
+
+// appendJSONFloat writes value as encoding/json's text reads back into
+// nlohmann::json: integral values in 64-bit range become integers, others a
+// double in nlohmann's shortest-digits layout.
+func appendJSONFloat(buf []byte, value float64) ([]byte, error) {
+	if math.IsNaN(value) || math.IsInf(value, 0) {
+		return buf, &json.UnsupportedValueError{
+			Str: strconv.FormatFloat(value, 'g', -1, 64),
+		}
+	}
+	if integer, integral := floatAsInteger(value); integral {
+		if value < 0 {
+			return strconv.AppendInt(buf, int64(integer), 10), nil
+		}
+		return strconv.AppendUint(buf, integer, 10), nil
+	}
+
+	// digits d1..dn with the value being 0.d1..dn * 10^point
+	scientific := strconv.FormatFloat(math.Abs(value), 'e', -1, 64)
+	mantissa, exponentText, _ := strings.Cut(scientific, "e")
+	exponent, _ := strconv.Atoi(exponentText)
+	digits := mantissa[:1]
+	if len(mantissa) > 2 {
+		digits += mantissa[2:]
+	}
+	point := exponent + 1
+	if value < 0 {
+		buf = append(buf, '-')
+	}
+	switch {
+	case len(digits) <= point && point <= 15:
+		buf = append(buf, digits...)
+		for index := len(digits); index < point; index++ {
+			buf = append(buf, '0')
+		}
+		return append(buf, '.', '0'), nil
+	case 0 < point && point <= 15:
+		buf = append(buf, digits[:point]...)
+		buf = append(buf, '.')
+		return append(buf, digits[point:]...), nil
+	case -4 < point && point <= 0:
+		buf = append(buf, '0', '.')
+		for index := point; index < 0; index++ {
+			buf = append(buf, '0')
+		}
+		return append(buf, digits...), nil
+	}
+	buf = append(buf, digits[0])
+	if len(digits) > 1 {
+		buf = append(buf, '.')
+		buf = append(buf, digits[1:]...)
+	}
+	buf = append(buf, 'e')
+	if exponent < 0 {
+		buf = append(buf, '-')
+		exponent = -exponent
+	} else {
+		buf = append(buf, '+')
+	}
+	if exponent < 10 {
+		buf = append(buf, '0')
+	}
+	return strconv.AppendInt(buf, int64(exponent), 10), nil
+}
+
+// floatAsInteger reports whether encoding/json writes value without fraction
+// or exponent and nlohmann::json then reads it as a 64-bit integer. The
+// magnitude is returned for negative values as their two's complement.
+func floatAsInteger(value float64) (uint64, bool) {
+	if value != math.Trunc(value) || math.IsInf(value, 0) {
+		return 0, false
+	}
+	magnitude := math.Abs(value)
+	if magnitude != 0 && magnitude < 1e-6 || magnitude >= 1e21 {
+		return 0, false
+	}
+	if value < 0 {
+		if value < math.MinInt64 {
+			return 0, false
+		}
+		return uint64(int64(value)), true
+	}
+	if value >= 1<<64 {
+		return 0, false
+	}
+	return uint64(value), true
+}
+
+// float32AsFloat64 is the double nlohmann::json reads from encoding/json's
+// shortest float32 text.
+func float32AsFloat64(value float32) float64 {
+	widened, err := strconv.ParseFloat(strconv.FormatFloat(float64(value), 'g', -1, 32), 64)
+	if err != nil {
+		return float64(value)
+	}
+	return widened
+}
+
+// validUTF8 replaces every byte outside valid UTF-8 with U+FFFD, as
+// encoding/json does, since nlohmann::json refuses to dump such strings.
+func validUTF8(text string) string {
+	if utf8.ValidString(text) {
+		return text
+	}
+	repaired := make([]byte, 0, len(text)+8)
+	for index := 0; index < len(text); {
+		r, size := utf8.DecodeRuneInString(text[index:])
+		if r == utf8.RuneError && size == 1 {
+			repaired = append(repaired, "�"...)
+		} else {
+			repaired = append(repaired, text[index:index+size]...)
+		}
+		index += size
+	}
+	return string(repaired)
+}
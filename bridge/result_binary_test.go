@@ -0,0 +1,156 @@
+package main
+
+import (
+	"encoding/binary"
+	"math"
+	"strings"
+	"testing"
+)
+
+type resultField struct {
+	kind  byte
+	value string
+}
+
+func decodeResultForTest(t *testing.T, buf []byte) ([]map[string]resultField, string) {
+	t.Helper()
+	read := func(size int) []byte {
+		if len(buf) < size {
+			t.Fatalf("result truncated")
+		}
+		data := buf[:size]
+		buf = buf[size:]
+		return data
+	}
+	readUint32 := func() uint32 { return binary.LittleEndian.Uint32(read(4)) }
+	readText := func() string { return string(read(int(readUint32()))) }
+
+	if string(read(4)) != resultMagic {
+		t.Fatalf("bad magic")
+	}
+	if read(1)[0] == resultStatusError {
+		return nil, readText()
+	}
+	nodes := make([]map[string]resultField, readUint32())
+	for index := range nodes {
+		nodes[index] = map[string]resultField{}
+		for fields := readUint32(); fields > 0; fields-- {
+			kind := read(1)[0]
+			key := readText()
+			nodes[index][key] = resultField{kind, readText()}
+		}
+	}
+	if len(buf) != 0 {
+		t.Fatalf("%d trailing bytes", len(buf))
+	}
+	return nodes, ""
+}
+
+func TestResultBinaryFields(t *testing.T) {
+	proxies := []map[string]any{{
+		"name":     "节点 \"A\"",
+		"type":     "vmess",
+		"port":     443,
+		"alterId":  uint64(math.MaxUint64),
+		"weight":   float64(2),
+		"ratio":    0.5,
+		"udp":      true,
+		"dialer":   nil,
+		"broken":   "a\xffb",
+		"alpn":     []any{"h2", "http/1.1"},
+		"ws-opts":  map[string]any{"path": "/<ws>\n", "headers": map[string]any{"Host": "x"}, "early": 2048.0},
+		"reserved": []any{1, 2.5, false, nil},
+	}}
+	buf, err := appendResultProxies(nil, proxies)
+	if err != nil {
+		t.Fatalf("encode error: %v", err)
+	}
+	nodes, message := decodeResultForTest(t, buf)
+	if message != "" || len(nodes) != 1 {
+		t.Fatalf("unexpected result %q %#v", message, nodes)
+	}
+
+	want := map[string]resultField{
+		"name":     {fieldString, "节点 \"A\""},
+		"type":     {fieldString, "vmess"},
+		"port":     {fieldInteger, "443"},
+		"alterId":  {fieldInteger, "18446744073709551615"},
+		"weight":   {fieldInteger, "2"},
+		"ratio":    {fieldFloat, "0.5"},
+		"udp":      {fieldBool, "true"},
+		"dialer":   {fieldNull, ""},
+		"broken":   {fieldString, "a�b"},
+		"alpn":     {fieldJSON, `["h2","http/1.1"]`},
+		"ws-opts":  {fieldJSON, `{"early":2048,"headers":{"Host":"x"},"path":"/<ws>\n"}`},
+		"reserved": {fieldJSON, `[1,2.5,false,null]`},
+	}
+	if len(nodes[0]) != len(want) {
+		t.Fatalf("got %d fields: %#v", len(nodes[0]), nodes[0])
+	}
+	for key, field := range want {
+		if nodes[0][key] != field {
+			t.Errorf("%s: want %#v, got %#v", key, field, nodes[0][key])
+		}
+	}
+}
+
+func TestResultBinaryFloatLayout(t *testing.T) {
+	// nlohmann::json::dump output for the double parsed from encoding/json
+	cases := map[float64]string{
+		0:                         "0",
+		math.Copysign(0, -1):      "0",
+		-3:                        "-3",
+		1.5:                       "1.5",
+		-0.25:                     "-0.25",
+		0.001:                     "0.001",
+		0.0001:                    "0.0001",
+		0.00001:                   "1e-05",
+		1e-7:                      "1e-07",
+		123456.789:                "123456.789",
+		1e19:                      "10000000000000000000",
+		1e20:                      "1e+20",
+		1e21:                      "1e+21",
+		2e64:                      "2e+64",
+		1.5e300:                   "1.5e+300",
+		12345678901234567890123.0: "1.2345678901234568e+22",
+	}
+	for value, want := range cases {
+		got, err := appendJSONFloat(nil, value)
+		if err != nil {
+			t.Fatalf("%v: %v", value, err)
+		}
+		if string(got) != want {
+			t.Errorf("%v: want %s, got %s", value, want, got)
+		}
+	}
+}
+
+func TestResultBinaryErrors(t *testing.T) {
+	_, err := appendResultProxies(nil, []map[string]any{{"name": "n", "x": math.NaN()}})
+	if err == nil || err.Error() != "json: unsupported value: NaN" {
+		t.Fatalf("unexpected error: %v", err)
+	}
+
+	nodes, message := decodeResultForTest(t, appendResultError(nil, "file doesn't have any proxy"))
+	if nodes != nil || message != "file doesn't have any proxy" {
+		t.Fatalf("unexpected error result %q", message)
+	}
+}
+
+func TestResultBinaryWritesInPlace(t *testing.T) {
+	proxies := []map[string]any{{"name": strings.Repeat("n", 64), "type": "ss"}}
+	target := make([]byte, 0, 256)
+	buf, err := appendResultProxies(target, proxies)
+	if err != nil {
+		t.Fatalf("encode error: %v", err)
+	}
+	if &buf[:1][0] != &target[:1][0] {
+		t.Fatalf("result fitting the buffer was moved")
+	}
+
+	small := make([]byte, 0, 16)
+	buf, _ = appendResultProxies(small, proxies)
+	if len(buf) <= cap(small) {
+		t.Fatalf("oversized result reported %d bytes", len(buf))
+	}
+}
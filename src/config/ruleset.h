@@ -1,6 +1,8 @@
 #ifndef RULESET_H_INCLUDED
 #define RULESET_H_INCLUDED
 
+#include <memory>
+
 #include "def.h"
 
 enum ruleset_type
@@ -12,6 +14,9 @@ enum ruleset_type
     RULESET_CLASH_CLASSICAL
 };
 
+/// a fetched ruleset, shared read-only by every request holding it
+using RulesetBody = std::shared_ptr<const std::string>;
+
 struct RulesetOptions
 {
     bool no_resolve = false;
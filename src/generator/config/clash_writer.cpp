@@ -0,0 +1,168 @@
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#include "generator/config/clash_writer.h"
+
+namespace {
+
+/// appends text shifted right by two columns, as a section under its key;
+/// empty lines stay empty
+void appendIndented(std::string &out, const std::string &text) {
+  bool line_start = true;
+  for (char c : text) {
+    if (line_start && c != '\n')
+      out += "  ";
+    out += c;
+    line_start = c == '\n';
+  }
+}
+
+/// the line in text that holds the top level key, or npos
+size_t findKeyLine(const std::string &text, const std::string &key) {
+  for (size_t pos = 0; pos < text.size();) {
+    const size_t end = pos + key.size();
+    if (text.compare(pos, key.size(), key) == 0 && end < text.size() &&
+        text[end] == ':' &&
+        (end + 1 == text.size() || text[end + 1] == ' ' ||
+         text[end + 1] == '\n'))
+      return pos;
+    pos = text.find('\n', pos);
+    if (pos == std::string::npos)
+      break;
+    pos++;
+  }
+  return std::string::npos;
+}
+
+/// YAML::Dump writes nothing at all for a null document, such a section was
+/// left out
+void appendSection(std::string &out, const std::string &key,
+                   const YAML::Node &value) {
+  if (value.IsNull())
+    return;
+  out.append(key).append(":\n");
+  appendIndented(out, YAML::Dump(value));
+  out += '\n';
+}
+
+} // namespace
+
+/// what the proxy emitter writes lands in the writer's text already indented
+/// under the proxies key
+class ClashYamlWriter::IndentedBuffer : public std::streambuf {
+public:
+  explicit IndentedBuffer(std::string &out) : out_(out) {}
+
+protected:
+  int_type overflow(int_type c) override {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      put(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *data, std::streamsize count) override {
+    for (std::streamsize i = 0; i < count; i++)
+      put(data[i]);
+    return count;
+  }
+
+private:
+  void put(char c) {
+    if (line_start_ && c != '\n')
+      out_ += "  ";
+    out_ += c;
+    line_start_ = c == '\n';
+  }
+
+  std::string &out_;
+  bool line_start_ = true;
+};
+
+ClashYamlWriter::ClashYamlWriter(bool new_field_name, bool proxy_compact,
+                                 bool group_compact)
+    : proxies_key_(new_field_name ? "proxies" : "Proxy"),
+      groups_key_(new_field_name ? "proxy-groups" : "Proxy Group"),
+      proxy_compact_(proxy_compact), group_compact_(group_compact) {}
+
+ClashYamlWriter::~ClashYamlWriter() = default;
+
+void ClashYamlWriter::addProxy(const YAML::Node &proxy) {
+  /// one emitter for the whole list, so the items are laid out as YAML::Dump
+  /// lays out a sequence of them
+  if (!proxy_emitter_) {
+    proxy_buffer_ = std::make_unique<IndentedBuffer>(proxies_);
+    proxy_stream_ = std::make_unique<std::ostream>(proxy_buffer_.get());
+    proxy_emitter_ = std::make_unique<YAML::Emitter>(*proxy_stream_);
+    *proxy_emitter_ << (proxy_compact_ ? YAML::Flow : YAML::Block)
+                    << YAML::BeginSeq;
+  }
+  *proxy_emitter_ << proxy;
+  proxy_count_++;
+}
+
+void ClashYamlWriter::setProviders(const YAML::Node &providers) {
+  providers_.reset(providers);
+  providers_defined_ = true;
+}
+
+void ClashYamlWriter::addGroup(const std::string &name,
+                               const YAML::Node &group) {
+  for (const auto &existing : groups_)
+    if (existing.first == name)
+      return;
+  groups_.emplace_back(name, group);
+}
+
+void ClashYamlWriter::takeSections(YAML::Node &base) {
+  if (base.Style() == YAML::EmitterStyle::Flow)
+    base.SetStyle(YAML::EmitterStyle::Block);
+  if (!proxies_defined_ && !proxy_count_ && base[proxies_key_].IsDefined()) {
+    base_proxies_.reset(base[proxies_key_]);
+    base_proxies_defined_ = true;
+  }
+  if (!providers_defined_ && base["proxy-providers"].IsDefined())
+    setProviders(base["proxy-providers"]);
+  base.remove(proxies_key_);
+  base.remove("proxy-providers");
+
+  if (groups_.empty())
+    return;
+  YAML::Node groups(YAML::NodeType::Sequence);
+  for (const auto &group : groups_)
+    groups.push_back(group.second);
+  if (group_compact_)
+    groups.SetStyle(YAML::EmitterStyle::Flow);
+  base[groups_key_] = groups;
+  groups_.clear();
+}
+
+std::string ClashYamlWriter::compose(const YAML::Node &base,
+                                     const std::string &rules) {
+  const std::string head = YAML::Dump(base);
+  const size_t groups_pos = findKeyLine(head, groups_key_);
+
+  std::string out;
+  out.reserve(head.size() + proxies_.size() + rules.size() + 4096);
+  if (groups_pos == std::string::npos) {
+    out += head;
+    if (!out.empty())
+      out += '\n';
+  } else {
+    out.append(head, 0, groups_pos);
+  }
+
+  if (providers_defined_)
+    appendSection(out, "proxy-providers", providers_);
+  if (proxy_count_) {
+    *proxy_emitter_ << YAML::EndSeq;
+    out.append(proxies_key_).append(":\n").append(proxies_).append("\n");
+  } else if (base_proxies_defined_) {
+    appendSection(out, proxies_key_, base_proxies_);
+  }
+
+  if (groups_pos != std::string::npos)
+    out.append(head, groups_pos);
+  out += rules;
+  return out;
+}
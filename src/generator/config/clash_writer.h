@@ -0,0 +1,58 @@
+#ifndef CLASH_WRITER_H_INCLUDED
+#define CLASH_WRITER_H_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+/// Clash output written as it is generated: each proxy is streamed through one
+/// YAML::Emitter into a single text buffer as soon as it is built instead of
+/// joining a YAML tree that is dumped, split into lines, re-indented and
+/// spliced back. compose() lays everything out exactly as the old
+/// dump-and-splice did: proxy-providers and proxies right before the proxy
+/// group list.
+class ClashYamlWriter {
+public:
+  ClashYamlWriter(bool new_field_name, bool proxy_compact, bool group_compact);
+  ~ClashYamlWriter();
+
+  void addProxy(const YAML::Node &proxy);
+  size_t proxyCount() const { return proxy_count_; }
+  /// the base document's own proxies are dropped even when every node was
+  /// filtered out
+  void defineProxies() { proxies_defined_ = true; }
+  void setProviders(const YAML::Node &providers);
+  /// a group named like an earlier one is dropped, the first one has always
+  /// been the one written
+  void addGroup(const std::string &name, const YAML::Node &group);
+
+  const std::string &groupsKey() const { return groups_key_; }
+  /// puts the groups into base and moves the proxies and proxy-providers the
+  /// base document itself carries in front of them when nothing was
+  /// generated for them
+  void takeSections(YAML::Node &base);
+  /// base dumped with the sections in front of its proxy group list, then
+  /// rules, which is already text. Ends the proxy list, so it is called once.
+  std::string compose(const YAML::Node &base, const std::string &rules = "");
+
+private:
+  class IndentedBuffer;
+
+  std::string proxies_key_, groups_key_;
+  bool proxy_compact_, group_compact_;
+  bool proxies_defined_ = false, base_proxies_defined_ = false,
+       providers_defined_ = false;
+  size_t proxy_count_ = 0;
+  std::string proxies_;
+  std::unique_ptr<IndentedBuffer> proxy_buffer_;
+  std::unique_ptr<std::ostream> proxy_stream_;
+  std::unique_ptr<YAML::Emitter> proxy_emitter_;
+  YAML::Node base_proxies_, providers_;
+  std::vector<std::pair<std::string, YAML::Node>> groups_;
+};
+
+#endif // CLASH_WRITER_H_INCLUDED
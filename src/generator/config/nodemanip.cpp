@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <utility>
@@ -12,8 +13,11 @@
 #include "parser/mihomo_bridge.h"
 #include "parser/mihomo_scheme_utils.h"
 #include "parser/subparser.h"
+#include "regmatch_program.h"
+#include "script/script_cache.h"
 #include "script/script_quickjs.h"
 #include "subexport.h"
+#include "utils/bounded_executor.h"
 #include "utils/file_extra.h"
 #include "utils/logger.h"
 #include "utils/map_extra.h"
@@ -123,13 +127,12 @@ int addNodes(std::string link, std::vector<Proxy> &allNodes, int groupID,
             writeLog(0, "发现脚本链接，开始执行...", LOG_LEVEL_INFO);
             string_array args = split(link.substr(7), ",");
             if (args.size() >= 1) {
-              std::string script = fileGet(args[0], false);
+              std::string script = script_file_source(args[0]);
               try {
-                ctx.eval(script);
                 args.erase(args.begin()); /// remove script path
                 auto parse = (std::function<std::string(const std::string &,
                                                         const string_array &)>)
-                                 ctx.eval("parse");
+                    script_function(ctx, script, "parse");
                 switch (args.size()) {
                 case 0:
                   link = parse("", string_array());
@@ -488,47 +491,72 @@ int addNodes(std::string link, std::vector<Proxy> &allNodes, int groupID,
   return 0;
 }
 
-bool chkIgnore(const Proxy &node, string_array &exclude_remarks,
-               string_array &include_remarks) {
-  bool excluded = false, included = false;
-  // std::string remarks = UTF8ToACP(node.remarks);
-  // std::string remarks = node.remarks;
-  // writeLog(LOG_TYPE_INFO, "正在匹配排除规则...");
-  excluded = std::any_of(exclude_remarks.cbegin(), exclude_remarks.cend(),
-                         [&node](const auto &x) {
-                           std::string real_rule;
-                           if (applyMatcher(x, real_rule, node)) {
-                             if (real_rule.empty())
-                               return true;
-                             return regFind(node.Remark, real_rule);
-                           } else
-                             return false;
-                         });
-  if (include_remarks.size() != 0) {
-    // writeLog(LOG_TYPE_INFO, "正在匹配包含规则...");
-    included = std::any_of(include_remarks.cbegin(), include_remarks.cend(),
-                           [&node](const auto &x) {
-                             std::string real_rule;
-                             if (applyMatcher(x, real_rule, node)) {
-                               if (real_rule.empty())
-                                 return true;
-                               return regFind(node.Remark, real_rule);
-                             } else
-                               return false;
-                           });
-  } else {
-    included = true;
+static BoundedExecutor &subscriptionExecutor() {
+  static BoundedExecutor executor(
+      static_cast<size_t>(std::clamp(global.maxConcurThreads, 2, 16)), 64);
+  return executor;
+}
+
+void addNodesConcurrently(std::vector<NodeSource> &sources,
+                          parse_settings &parse_set, size_t max_parallel,
+                          bool stop_on_failure) {
+  /// scripts share one QuickJS context, which must not be entered from
+  /// two threads
+  if (parse_set.authorized) {
+    for (const NodeSource &source : sources) {
+      if (source.link.find("script:") != std::string::npos) {
+        max_parallel = 1;
+        break;
+      }
+    }
+  }
+
+  /// sub info and request headers are written by addNodes, so every source
+  /// works on its own copy and the copies are folded back in link order
+  std::vector<std::string> sub_infos(sources.size());
+  std::vector<string_icase_map> headers(sources.size());
+  /// a failure ends the request, so links still queued are not fetched
+  std::atomic<bool> failed{false};
+  parallelFor(subscriptionExecutor(), sources.size(), max_parallel,
+              [&](size_t index) {
+                if (parse_set.request_header)
+                  headers[index] = *parse_set.request_header;
+                if (stop_on_failure && failed.load())
+                  return;
+                parse_settings source_set = parse_set;
+                source_set.sub_info = &sub_infos[index];
+                if (parse_set.request_header)
+                  source_set.request_header = &headers[index];
+                NodeSource &source = sources[index];
+                source.result = addNodes(source.link, source.nodes,
+                                         source.group_id, source_set);
+                if (source.result == -1)
+                  failed = true;
+              });
+
+  for (size_t index = 0; index < sources.size(); ++index) {
+    if (!sub_infos[index].empty() && parse_set.sub_info)
+      *parse_set.sub_info = std::move(sub_infos[index]);
+    if (parse_set.request_header && headers[index] != *parse_set.request_header)
+      *parse_set.request_header = std::move(headers[index]);
   }
+}
 
-  return excluded || !included;
+static bool chkIgnore(const Proxy &node, const RemarkFilter &exclude_filter,
+                      const RemarkFilter &include_filter) {
+  if (exclude_filter.matches(node))
+    return true;
+  return !include_filter.empty() && !include_filter.matches(node);
 }
 
 void filterNodes(std::vector<Proxy> &nodes, string_array &exclude_remarks,
                  string_array &include_remarks, int groupID) {
+  const RemarkFilter exclude_filter(exclude_remarks),
+      include_filter(include_remarks);
   int node_index = 0;
   auto write_iter = nodes.begin();
   for (auto iter = nodes.begin(); iter != nodes.end(); ++iter) {
-    if (chkIgnore(*iter, exclude_remarks, include_remarks)) {
+    if (chkIgnore(*iter, exclude_filter, include_filter)) {
       writeLog(LOG_TYPE_INFO, "节点 " + iter->Group + " - " + iter->Remark +
                                   " 已被忽略，不会添加。");
       continue;
@@ -641,41 +669,6 @@ void filterNodes(std::vector<Proxy> &nodes, string_array &exclude_remarks,
   writeLog(LOG_TYPE_INFO, "过滤完成。");
 }
 
-void nodeRename(Proxy &node, const RegexMatchConfigs &rename_array,
-                extra_settings &ext) {
-  std::string &remark = node.Remark, original_remark = node.Remark,
-              returned_remark, real_rule;
-
-  for (const RegexMatchConfig &x : rename_array) {
-    if (!x.Script.empty() && ext.authorized) {
-      script_safe_runner(
-          ext.js_runtime, ext.js_context,
-          [&](qjs::Context &ctx) {
-            std::string script = x.Script;
-            if (startsWith(script, "path:"))
-              script = fileGet(script.substr(5), true);
-            try {
-              ctx.eval(script);
-              auto rename =
-                  (std::function<std::string(const Proxy &)>)ctx.eval("rename");
-              returned_remark = rename(node);
-              if (!returned_remark.empty())
-                remark = returned_remark;
-            } catch (qjs::exception) {
-              script_print_stack(ctx);
-            }
-          },
-          global.scriptCleanContext);
-      continue;
-    }
-    if (applyMatcher(x.Match, real_rule, node) && real_rule.size())
-      remark = regReplace(remark, real_rule, x.Replace);
-  }
-  if (remark.empty())
-    remark = original_remark;
-  return;
-}
-
 std::string removeEmoji(const std::string &orig_remark) {
   char emoji_id[2] = {(char)-16, (char)-97};
   std::string remark = orig_remark;
@@ -690,70 +683,112 @@ std::string removeEmoji(const std::string &orig_remark) {
   return remark;
 }
 
-std::string addEmoji(const Proxy &node, const RegexMatchConfigs &emoji_array,
-                     extra_settings &ext) {
-  std::string real_rule, ret;
+namespace {
 
-  for (const RegexMatchConfig &x : emoji_array) {
-    if (!x.Script.empty() && ext.authorized) {
-      std::string result;
-      script_safe_runner(
-          ext.js_runtime, ext.js_context,
-          [&](qjs::Context &ctx) {
-            std::string script = x.Script;
-            if (startsWith(script, "path:"))
-              script = fileGet(script.substr(5), true);
-            try {
-              ctx.eval(script);
-              auto getEmoji =
-                  (std::function<std::string(const Proxy &)>)ctx.eval(
-                      "getEmoji");
-              ret = getEmoji(node);
-              if (!ret.empty())
-                result = ret + " " + node.Remark;
-            } catch (qjs::exception) {
-              script_print_stack(ctx);
-            }
-          },
-          global.scriptCleanContext);
-      if (!result.empty())
-        return result;
-      continue;
-    }
-    if (x.Replace.empty())
-      continue;
-    if (applyMatcher(x.Match, real_rule, node) && real_rule.size() &&
-        regFind(node.Remark, real_rule))
-      return x.Replace + " " + node.Remark;
-  }
-  return node.Remark;
+/// the source of a script rule, a `path:` script read again only when the file
+/// changed since
+std::string ruleScriptSource(const RegexMatchRule &rule) {
+  if (startsWith(rule.script, "path:"))
+    return script_file_source(rule.script.substr(5), true);
+  return rule.script;
+}
+
+/// the per node hook of a script rule, e.g. rename(node); empty when the
+/// script fails
+std::string runNodeHook(const std::string &script, const char *name,
+                        const Proxy &node, extra_settings &ext) {
+  std::string result;
+  script_safe_runner(
+      ext.js_runtime, ext.js_context,
+      [&](qjs::Context &ctx) {
+        try {
+          auto hook = (std::function<std::string(const Proxy &)>)
+              script_function(ctx, script, name);
+          result = hook(node);
+        } catch (qjs::exception) {
+          script_print_stack(ctx);
+        }
+      },
+      global.scriptCleanContext);
+  return result;
 }
 
+/// the batch hook of a script rule, e.g. renameAll(nodes), called once with
+/// every node. Returns false when the script does not define it, so the rule
+/// falls back to its per node hook.
+bool runBatchHook(const std::string &script, const char *name,
+                  const std::vector<Proxy> &nodes, extra_settings &ext,
+                  string_array &results) {
+  bool defined = false;
+  script_safe_runner(
+      ext.js_runtime, ext.js_context,
+      [&](qjs::Context &ctx) {
+        try {
+          qjs::Value hook = script_function(ctx, script, name, true);
+          if (!JS_IsFunction(ctx.ctx, hook.v))
+            return;
+          defined = true;
+          results = script_batch_strings(ctx, hook, nodes);
+        } catch (qjs::exception) {
+          /// a broken script would fail the per node hook for every node too
+          defined = true;
+          script_print_stack(ctx);
+        }
+      },
+      global.scriptCleanContext);
+  return defined;
+}
+
+/// the script side of rename/emoji rules: the batch hook when the script
+/// defines one, the per node hook for every node still needing a result
+/// otherwise. Nothing without authorization, as script rules are then skipped.
+ScriptRuleHook scriptRuleHook(const char *batch_name, const char *node_name,
+                              const std::vector<Proxy> &nodes,
+                              extra_settings &ext) {
+  if (!ext.authorized)
+    return nullptr;
+  return [batch_name, node_name, &nodes,
+          &ext](const RegexMatchRule &rule, const std::vector<char> *skip) {
+    const std::string script = ruleScriptSource(rule);
+    string_array results;
+    if (runBatchHook(script, batch_name, nodes, ext, results))
+      return results;
+    results.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+      if (!skip || !(*skip)[i])
+        results[i] = runNodeHook(script, node_name, nodes[i], ext);
+    return results;
+  };
+}
+
+} // namespace
+
 void preprocessNodes(std::vector<Proxy> &nodes, extra_settings &ext) {
-  std::for_each(nodes.begin(), nodes.end(), [&ext](Proxy &x) {
-    if (ext.remove_emoji)
+  if (ext.remove_emoji)
+    for (Proxy &x : nodes)
       x.Remark = trim(removeEmoji(x.Remark));
 
-    nodeRename(x, ext.rename_array, ext);
+  if (ext.rename_program)
+    applyRenameProgram(*ext.rename_program, nodes,
+                       scriptRuleHook("renameAll", "rename", nodes, ext));
 
-    if (ext.add_emoji)
-      x.Remark = addEmoji(x, ext.emoji_array, ext);
-  });
+  if (ext.add_emoji && ext.emoji_program)
+    applyEmojiProgram(*ext.emoji_program, nodes,
+                      scriptRuleHook("getEmojiAll", "getEmoji", nodes, ext));
 
   if (ext.sort_flag) {
     bool failed = true;
     if (ext.sort_script.size() && ext.authorized) {
       std::string script = ext.sort_script;
       if (startsWith(script, "path:"))
-        script = fileGet(script.substr(5), false);
+        script = script_file_source(script.substr(5));
       script_safe_runner(
           ext.js_runtime, ext.js_context,
           [&](qjs::Context &ctx) {
             try {
-              ctx.eval(script);
               auto compare =
-                  (std::function<int(const Proxy &, const Proxy &)>)ctx.eval(
-                      "compare");
+                  (std::function<int(const Proxy &, const Proxy &)>)
+                      script_function(ctx, script, "compare");
               auto comparer = [&](const Proxy &a, const Proxy &b) {
                 if (a.Type == ProxyType::Unknown)
                   return 1;
@@ -34,7 +34,22 @@ struct parse_settings
 #endif // NO_JS_RUNTIME
 };
 
+/// one link of a multi-link request and what addNodes produced for it
+struct NodeSource
+{
+    std::string link;
+    int group_id = 0;
+    std::vector<Proxy> nodes;
+    int result = 0;
+};
+
 int addNodes(std::string link, std::vector<Proxy> &allNodes, int groupID, parse_settings &parse_set);
+/// addNodes for every source, up to max_parallel at a time. Each source keeps its own nodes and
+/// result so the caller merges them in order; sub info and request header changes are applied
+/// to parse_set as if the links had been processed one after another. With stop_on_failure, sources
+/// that have not started once one has failed are skipped, keeping a result of 0 and no nodes.
+void addNodesConcurrently(std::vector<NodeSource> &sources, parse_settings &parse_set, size_t max_parallel,
+                          bool stop_on_failure = false);
 void filterNodes(std::vector<Proxy> &nodes, string_array &exclude_remarks, string_array &include_remarks, int groupID);
 bool applyMatcher(const std::string &rule, std::string &real_rule, const Proxy &node);
 void preprocessNodes(std::vector<Proxy> &nodes, extra_settings &ext);
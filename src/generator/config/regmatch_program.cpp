@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "generator/config/regmatch_program.h"
+#include "utils/regexp.h"
+#include "utils/string.h"
+
+bool matchRange(const std::string &range, int target) {
+  string_array vArray = split(range, ",");
+  bool match = false;
+  std::string range_begin_str, range_end_str;
+  int range_begin, range_end;
+  static const std::string reg_num = "-?\\d+", reg_range = "(\\d+)-(\\d+)",
+                           reg_not = "\\!-?(\\d+)",
+                           reg_not_range = "\\!(\\d+)-(\\d+)",
+                           reg_less = "(\\d+)-", reg_more = "(\\d+)\\+";
+  for (std::string &x : vArray) {
+    if (regMatch(x, reg_num)) {
+      if (to_int(x, INT_MAX) == target)
+        match = true;
+    } else if (regMatch(x, reg_range)) {
+      regGetMatch(x, reg_range, 3, 0, &range_begin_str, &range_end_str);
+      range_begin = to_int(range_begin_str, INT_MAX);
+      range_end = to_int(range_end_str, INT_MIN);
+      if (target >= range_begin && target <= range_end)
+        match = true;
+    } else if (regMatch(x, reg_not)) {
+      match = true;
+      if (to_int(regReplace(x, reg_not, "$1"), INT_MAX) == target)
+        match = false;
+    } else if (regMatch(x, reg_not_range)) {
+      match = true;
+      regGetMatch(x, reg_range, 3, 0, &range_begin_str, &range_end_str);
+      range_begin = to_int(range_begin_str, INT_MAX);
+      range_end = to_int(range_end_str, INT_MIN);
+      if (target >= range_begin && target <= range_end)
+        match = false;
+    } else if (regMatch(x, reg_less)) {
+      if (to_int(regReplace(x, reg_less, "$1"), INT_MAX) >= target)
+        match = true;
+    } else if (regMatch(x, reg_more)) {
+      if (to_int(regReplace(x, reg_more, "$1"), INT_MIN) <= target)
+        match = true;
+    }
+  }
+  return match;
+}
+
+NodeMatcher parseNodeMatcher(const std::string &rule, std::string &real_rule) {
+  static const std::string
+      groupid_regex = R"(^!!(?:GROUPID|INSERT)=([\d\-+!,]+)(?:!!(.*))?$)",
+      group_regex = R"(^!!(?:GROUP)=(.+?)(?:!!(.*))?$)";
+  static const std::string type_regex = R"(^!!(?:TYPE)=(.+?)(?:!!(.*))?$)",
+                           port_regex = R"(^!!(?:PORT)=(.+?)(?:!!(.*))?$)",
+                           server_regex = R"(^!!(?:SERVER)=(.+?)(?:!!(.*))?$)";
+  NodeMatcher matcher;
+  const std::string *selector_regex = nullptr;
+  if (startsWith(rule, "!!GROUP=")) {
+    matcher.kind = NodeMatcher::Kind::Group;
+    selector_regex = &group_regex;
+  } else if (startsWith(rule, "!!GROUPID=")) {
+    matcher.kind = NodeMatcher::Kind::GroupId;
+    selector_regex = &groupid_regex;
+  } else if (startsWith(rule, "!!INSERT=")) {
+    matcher.kind = NodeMatcher::Kind::Insert;
+    selector_regex = &groupid_regex;
+  } else if (startsWith(rule, "!!TYPE=")) {
+    matcher.kind = NodeMatcher::Kind::Type;
+    selector_regex = &type_regex;
+  } else if (startsWith(rule, "!!PORT=")) {
+    matcher.kind = NodeMatcher::Kind::Port;
+    selector_regex = &port_regex;
+  } else if (startsWith(rule, "!!SERVER=")) {
+    matcher.kind = NodeMatcher::Kind::Server;
+    selector_regex = &server_regex;
+  }
+
+  if (selector_regex == nullptr) {
+    real_rule = rule;
+    return matcher;
+  }
+  std::string ret_real_rule;
+  regGetMatch(rule, *selector_regex, 3, 0, &matcher.target, &ret_real_rule);
+  real_rule = ret_real_rule;
+  return matcher;
+}
+
+bool NodeMatcher::matches(const Proxy &node) const {
+  static const std::map<ProxyType, const char *> types = {
+      {ProxyType::Shadowsocks, "SS"},      {ProxyType::ShadowsocksR, "SSR"},
+      {ProxyType::VMess, "VMESS"},         {ProxyType::Trojan, "TROJAN"},
+      {ProxyType::Snell, "SNELL"},         {ProxyType::HTTP, "HTTP"},
+      {ProxyType::HTTPS, "HTTPS"},         {ProxyType::SOCKS5, "SOCKS5"},
+      {ProxyType::WireGuard, "WIREGUARD"}, {ProxyType::VLESS, "VLESS"},
+      {ProxyType::Hysteria, "HYSTERIA"},   {ProxyType::Hysteria2, "HYSTERIA2"}};
+  switch (kind) {
+  case Kind::Group:
+    return regFind(node.Group, target);
+  case Kind::GroupId:
+    return matchRange(target, node.GroupId);
+  case Kind::Insert:
+    return matchRange(target, -node.GroupId);
+  case Kind::Type: {
+    auto type = types.find(node.Type);
+    if (type == types.end())
+      return false;
+    return regMatch(type->second, target);
+  }
+  case Kind::Port:
+    return matchRange(target, node.Port);
+  case Kind::Server:
+    return regFind(node.Hostname, target);
+  case Kind::Any:
+    break;
+  }
+  return true;
+}
+
+RegexMatchProgramPtr compileRegexMatchProgram(const RegexMatchConfigs &configs,
+                                              unsigned long long generation,
+                                              bool load_scripts) {
+  auto program = std::make_shared<RegexMatchProgram>();
+  program->generation = generation;
+  program->rules.reserve(configs.size());
+  for (const RegexMatchConfig &config : configs) {
+    RegexMatchRule rule;
+    rule.config = config;
+    /// script rules still fall back to the matcher for unauthorized requests
+    std::string real_rule;
+    rule.matcher = parseNodeMatcher(config.Match, real_rule);
+    if (!real_rule.empty())
+      rule.pattern = RegexPattern(real_rule);
+    if (!config.Script.empty() && load_scripts)
+      rule.script = config.Script;
+    program->rules.emplace_back(std::move(rule));
+  }
+  return program;
+}
+
+void applyRenameProgram(const RegexMatchProgram &program,
+                        std::vector<Proxy> &nodes, const ScriptRuleHook &script) {
+  string_array original_remarks;
+  original_remarks.reserve(nodes.size());
+  for (const Proxy &node : nodes)
+    original_remarks.push_back(node.Remark);
+
+  for (const RegexMatchRule &x : program.rules) {
+    if (!x.config.Script.empty() && script) {
+      string_array remarks = script(x, nullptr);
+      for (size_t i = 0; i < remarks.size() && i < nodes.size(); ++i)
+        if (!remarks[i].empty())
+          nodes[i].Remark = std::move(remarks[i]);
+      continue;
+    }
+    if (x.pattern.pattern().empty())
+      continue;
+    for (Proxy &node : nodes)
+      if (x.matcher.matches(node))
+        node.Remark = x.pattern.replace(node.Remark, x.config.Replace);
+  }
+  for (size_t i = 0; i < nodes.size(); ++i)
+    if (nodes[i].Remark.empty())
+      nodes[i].Remark = std::move(original_remarks[i]);
+}
+
+void applyEmojiProgram(const RegexMatchProgram &program,
+                       std::vector<Proxy> &nodes, const ScriptRuleHook &script) {
+  string_array remarks(nodes.size());
+  std::vector<char> decided(nodes.size(), 0);
+  auto decide = [&](size_t i, const std::string &emoji) {
+    remarks[i] = emoji + " " + nodes[i].Remark;
+    decided[i] = 1;
+  };
+
+  for (const RegexMatchRule &x : program.rules) {
+    if (!x.config.Script.empty() && script) {
+      const string_array emojis = script(x, &decided);
+      for (size_t i = 0; i < emojis.size() && i < nodes.size(); ++i)
+        if (!decided[i] && !emojis[i].empty())
+          decide(i, emojis[i]);
+      continue;
+    }
+    if (x.config.Replace.empty() || x.pattern.pattern().empty())
+      continue;
+    for (size_t i = 0; i < nodes.size(); ++i)
+      if (!decided[i] && x.matcher.matches(nodes[i]) &&
+          x.pattern.find(nodes[i].Remark))
+        decide(i, x.config.Replace);
+  }
+  for (size_t i = 0; i < nodes.size(); ++i)
+    if (decided[i])
+      nodes[i].Remark = std::move(remarks[i]);
+}
+
+namespace {
+
+/// a pattern without metacharacters matches exactly where it occurs as a substring
+bool isPlainKeyword(const std::string &pattern) {
+  return pattern.find_first_of(std::string("\\^$.|?*+()[]{}\0", 15)) ==
+             std::string::npos &&
+         regValidUTF8(pattern);
+}
+
+/// whether wrapping the pattern in (?:...) next to others keeps its meaning:
+/// no group references or recursion, no verbs, no \Q or extended mode that
+/// could swallow the closing parenthesis, no named groups that could clash
+bool isJoinable(const std::string &pattern) {
+  if (pattern.find('\0') != std::string::npos)
+    return false;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    char c = pattern[i];
+    if (c == '\\') {
+      if (i + 1 >= pattern.size())
+        return false;
+      char next = pattern[++i];
+      if ((next >= '0' && next <= '9') || next == 'g' || next == 'k' ||
+          next == 'Q' || next == 'E')
+        return false;
+      continue;
+    }
+    if (c != '(' || i + 1 >= pattern.size())
+      continue;
+    if (pattern[i + 1] == '*')
+      return false;
+    if (pattern[i + 1] != '?')
+      continue;
+    if (i + 2 >= pattern.size())
+      return false;
+    char kind = pattern[i + 2];
+    if (kind == ':' || kind == '=' || kind == '!' || kind == '>')
+      continue;
+    if (kind == '<' && i + 3 < pattern.size() &&
+        (pattern[i + 3] == '=' || pattern[i + 3] == '!'))
+      continue;
+    /// inline options such as (?i) or (?-i:...), extended mode excluded
+    size_t j = i + 2;
+    while (j < pattern.size() && std::string("imnsU-").find(pattern[j]) !=
+                                     std::string::npos)
+      j++;
+    if (j == i + 2 || j >= pattern.size() ||
+        (pattern[j] != ')' && pattern[j] != ':'))
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+RemarkFilter::RemarkFilter(const string_array &patterns)
+    : configured_(patterns.size()) {
+  std::string joined;
+  std::vector<std::string> joined_patterns;
+  for (const std::string &pattern : patterns) {
+    std::string real_rule;
+    NodeMatcher matcher = parseNodeMatcher(pattern, real_rule);
+    if (real_rule.empty()) {
+      if (matcher.kind == NodeMatcher::Kind::Any)
+        match_all_ = true;
+      else
+        entries_.push_back({std::move(matcher), RegexPattern()});
+      continue;
+    }
+    RegexPattern compiled(real_rule);
+    if (!compiled.valid()) {
+      /// never matches, but selectors are still evaluated as before
+      if (matcher.kind != NodeMatcher::Kind::Any)
+        entries_.push_back({std::move(matcher), std::move(compiled)});
+      continue;
+    }
+    if (matcher.kind != NodeMatcher::Kind::Any)
+      entries_.push_back({std::move(matcher), std::move(compiled)});
+    else if (isPlainKeyword(real_rule))
+      literals_.emplace_back(std::move(real_rule));
+    else if (isJoinable(real_rule))
+      joined_patterns.emplace_back(std::move(real_rule));
+    else
+      entries_.push_back({std::move(matcher), std::move(compiled)});
+  }
+
+  if (joined_patterns.size() == 1) {
+    combined_ = RegexPattern(joined_patterns.front());
+  } else if (!joined_patterns.empty()) {
+    for (const std::string &pattern : joined_patterns) {
+      if (!joined.empty())
+        joined += '|';
+      joined += "(?:" + pattern + ")";
+    }
+    combined_ = RegexPattern(joined);
+    if (!combined_.valid()) {
+      combined_ = RegexPattern();
+      for (const std::string &pattern : joined_patterns)
+        entries_.push_back({NodeMatcher(), RegexPattern(pattern)});
+    }
+  }
+}
+
+bool RemarkFilter::matches(const Proxy &node) const {
+  if (match_all_)
+    return true;
+  /// every regex fails on a remark that is not valid UTF-8
+  const bool remark_valid = regValidUTF8(node.Remark);
+  if (remark_valid) {
+    for (const std::string &literal : literals_)
+      if (node.Remark.find(literal) != std::string::npos)
+        return true;
+    if (combined_.find(node.Remark))
+      return true;
+  }
+  for (const Entry &entry : entries_) {
+    if (!entry.matcher.matches(node))
+      continue;
+    if (entry.pattern.pattern().empty() || entry.pattern.find(node.Remark))
+      return true;
+  }
+  return false;
+}
+
+namespace {
+
+template <typename Key, typename Extract>
+void tabulate(const std::vector<Proxy> &nodes, std::vector<uint32_t> &value_of,
+              std::vector<uint32_t> &representative, Extract extract) {
+  std::unordered_map<Key, uint32_t> ids;
+  value_of.reserve(nodes.size());
+  for (uint32_t i = 0; i < nodes.size(); i++) {
+    auto inserted = ids.emplace(extract(nodes[i]),
+                                static_cast<uint32_t>(representative.size()));
+    if (inserted.second)
+      representative.push_back(i);
+    value_of.push_back(inserted.first->second);
+  }
+}
+
+} // namespace
+
+NodeIndex::NodeIndex(const std::vector<Proxy> &nodes) : nodes_(nodes) {
+  remark_id_.reserve(nodes.size());
+  remark_valid_.reserve(nodes.size());
+  remark_ids_.reserve(nodes.size());
+  for (const Proxy &node : nodes) {
+    auto inserted = remark_ids_.emplace(
+        node.Remark, static_cast<uint32_t>(remark_ids_.size()));
+    remark_id_.push_back(inserted.first->second);
+    remark_valid_.push_back(regValidUTF8(node.Remark));
+  }
+  seen_.assign(remark_ids_.size(), 0);
+}
+
+const NodeIndex::Attribute &NodeIndex::attribute(NodeMatcher::Kind kind) {
+  /// both read the group id, only the range they test it against differs
+  if (kind == NodeMatcher::Kind::Insert)
+    kind = NodeMatcher::Kind::GroupId;
+  std::unique_ptr<Attribute> &table = attributes_[static_cast<size_t>(kind)];
+  if (table)
+    return *table;
+  table = std::make_unique<Attribute>();
+  std::vector<uint32_t> &value_of = table->value_of,
+                        &representative = table->representative;
+  switch (kind) {
+  case NodeMatcher::Kind::Group:
+    tabulate<std::string_view>(
+        nodes_, value_of, representative,
+        [](const Proxy &node) { return std::string_view(node.Group); });
+    break;
+  case NodeMatcher::Kind::Server:
+    tabulate<std::string_view>(
+        nodes_, value_of, representative,
+        [](const Proxy &node) { return std::string_view(node.Hostname); });
+    break;
+  case NodeMatcher::Kind::Type:
+    tabulate<ProxyType>(nodes_, value_of, representative,
+                        [](const Proxy &node) { return node.Type; });
+    break;
+  case NodeMatcher::Kind::Port:
+    tabulate<uint16_t>(nodes_, value_of, representative,
+                       [](const Proxy &node) { return node.Port; });
+    break;
+  default:
+    tabulate<uint32_t>(nodes_, value_of, representative,
+                       [](const Proxy &node) { return node.GroupId; });
+    break;
+  }
+  return *table;
+}
+
+bool NodeIndex::remarkMatches(const RegexPattern &pattern,
+                              const std::string &literal, uint32_t node) const {
+  if (literal.empty())
+    return pattern.find(nodes_[node].Remark);
+  /// every regex fails on a remark that is not valid UTF-8
+  return remark_valid_[node] &&
+         nodes_[node].Remark.find(literal) != std::string::npos;
+}
+
+const std::vector<uint32_t> &NodeIndex::select(const std::string &rule) {
+  auto iter = selections_.find(rule);
+  if (iter != selections_.end()) {
+    reused_++;
+    return iter->second;
+  }
+
+  std::string real_rule;
+  const NodeMatcher matcher = parseNodeMatcher(rule, real_rule);
+  const Attribute *table = nullptr;
+  std::vector<char> accepted;
+  if (matcher.kind != NodeMatcher::Kind::Any) {
+    table = &attribute(matcher.kind);
+    accepted.reserve(table->representative.size());
+    for (uint32_t node : table->representative)
+      accepted.push_back(matcher.matches(nodes_[node]));
+  }
+  RegexPattern pattern;
+  std::string literal;
+  if (!real_rule.empty() && isPlainKeyword(real_rule))
+    literal = real_rule;
+  else if (!real_rule.empty())
+    pattern = RegexPattern(real_rule);
+
+  std::vector<uint32_t> selected;
+  for (uint32_t i = 0; i < nodes_.size(); i++) {
+    if (table && !accepted[table->value_of[i]])
+      continue;
+    if (!real_rule.empty() && !remarkMatches(pattern, literal, i))
+      continue;
+    selected.push_back(i);
+  }
+  return selections_.emplace(rule, std::move(selected)).first->second;
+}
+
+void NodeIndex::appendRemarks(const std::string &rule, string_array &list) {
+  const std::vector<uint32_t> &selected = select(rule);
+  if (selected.empty())
+    return;
+  /// a fresh stamp forgets the remarks marked for the previous list
+  if (++seen_stamp_ == 0) {
+    std::fill(seen_.begin(), seen_.end(), 0);
+    seen_stamp_ = 1;
+  }
+  for (const std::string &entry : list) {
+    auto iter = remark_ids_.find(entry);
+    if (iter != remark_ids_.end())
+      seen_[iter->second] = seen_stamp_;
+  }
+  for (uint32_t node : selected) {
+    uint32_t &seen = seen_[remark_id_[node]];
+    if (seen == seen_stamp_)
+      continue;
+    seen = seen_stamp_;
+    list.emplace_back(nodes_[node].Remark);
+  }
+}
@@ -0,0 +1,134 @@
+#ifndef REGMATCH_PROGRAM_H_INCLUDED
+#define REGMATCH_PROGRAM_H_INCLUDED
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "config/regmatch.h"
+#include "parser/config/proxy.h"
+#include "utils/regexp.h"
+#include "utils/string.h"
+
+/// node selector in front of a rename/emoji rule, e.g. `!!GROUPID=1-3!!`
+struct NodeMatcher {
+  enum class Kind { Any, Group, GroupId, Insert, Type, Port, Server };
+
+  Kind kind = Kind::Any;
+  std::string target;
+
+  bool matches(const Proxy &node) const;
+};
+
+NodeMatcher parseNodeMatcher(const std::string &rule, std::string &real_rule);
+bool matchRange(const std::string &range, int target);
+
+struct RegexMatchRule {
+  RegexMatchConfig config;
+  NodeMatcher matcher;
+  RegexPattern pattern; /// the rule with its `!!` selector stripped, unset if empty
+  std::string script;   /// Script, a `path:` one is read when the rule is applied
+};
+
+/// rename/emoji rules parsed and compiled once, shared read-only by requests
+struct RegexMatchProgram {
+  std::vector<RegexMatchRule> rules;
+  unsigned long long generation = 0;
+
+  bool empty() const { return rules.empty(); }
+  size_t size() const { return rules.size(); }
+};
+
+using RegexMatchProgramPtr = std::shared_ptr<const RegexMatchProgram>;
+
+/// include/exclude remark list answering "does any pattern match" in one pass:
+/// plain keywords become substring searches, selector-free regexes are joined
+/// into one alternation, everything else is checked one by one as before
+class RemarkFilter {
+public:
+  explicit RemarkFilter(const string_array &patterns);
+
+  /// true when the configured list is empty, even if no entry can ever match
+  bool empty() const { return configured_ == 0; }
+  bool matches(const Proxy &node) const;
+
+private:
+  struct Entry {
+    NodeMatcher matcher;
+    RegexPattern pattern; /// unset when the selector alone decides
+  };
+
+  size_t configured_ = 0;
+  bool match_all_ = false;
+  std::vector<std::string> literals_;
+  RegexPattern combined_;
+  std::vector<Entry> entries_;
+};
+
+/// node list of one generated config indexed for proxy group rules. Selector
+/// attributes are tabled by distinct value, so `!!GROUP=` and friends run once
+/// per distinct group, type, port or server instead of once per node, and the
+/// nodes a rule selects are remembered so a rule shared by several groups is
+/// matched once. The list must outlive the index and stay unchanged.
+class NodeIndex {
+public:
+  explicit NodeIndex(const std::vector<Proxy> &nodes);
+
+  const std::vector<Proxy> &nodes() const { return nodes_; }
+  /// positions of the nodes the rule selects, in node order
+  const std::vector<uint32_t> &select(const std::string &rule);
+  /// appends the remarks of the selected nodes that the list does not hold yet
+  void appendRemarks(const std::string &rule, string_array &list);
+
+  size_t evaluated() const { return selections_.size(); }
+  size_t reused() const { return reused_; }
+
+private:
+  struct Attribute {
+    std::vector<uint32_t> value_of;       /// node position to distinct value
+    std::vector<uint32_t> representative; /// distinct value to a node with it
+  };
+
+  const Attribute &attribute(NodeMatcher::Kind kind);
+  bool remarkMatches(const RegexPattern &pattern, const std::string &literal,
+                     uint32_t node) const;
+
+  const std::vector<Proxy> &nodes_;
+  std::vector<uint32_t> remark_id_;
+  std::unordered_map<std::string_view, uint32_t> remark_ids_;
+  std::vector<char> remark_valid_;
+  std::vector<uint32_t> seen_;
+  uint32_t seen_stamp_ = 0;
+  std::array<std::unique_ptr<Attribute>, 7> attributes_;
+  std::unordered_map<std::string, std::vector<uint32_t>> selections_;
+  size_t reused_ = 0;
+};
+
+/// results of a script rule for every node, one entry per node and empty where
+/// the script yields nothing. Nodes flagged in skip, when given, need no result.
+using ScriptRuleHook = std::function<string_array(
+    const RegexMatchRule &rule, const std::vector<char> *skip)>;
+
+/// rename rules applied in order, one rule across all nodes at a time so a
+/// script rule can handle every node in one call. Each node ends up as a pass
+/// over the rules would leave it; a remark renamed to nothing is restored.
+/// Script rules are skipped without a hook.
+void applyRenameProgram(const RegexMatchProgram &program,
+                        std::vector<Proxy> &nodes, const ScriptRuleHook &script);
+/// prefixes each remark with the emoji of the first rule that yields one for it
+void applyEmojiProgram(const RegexMatchProgram &program,
+                       std::vector<Proxy> &nodes, const ScriptRuleHook &script);
+
+/// scripts are only kept when load_scripts is set, i.e. for callers that may
+/// run them
+RegexMatchProgramPtr
+compileRegexMatchProgram(const RegexMatchConfigs &configs,
+                         unsigned long long generation = 0,
+                         bool load_scripts = true);
+
+#endif // REGMATCH_PROGRAM_H_INCLUDED
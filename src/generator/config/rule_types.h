@@ -0,0 +1,295 @@
+#ifndef RULE_TYPES_H_INCLUDED
+#define RULE_TYPES_H_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// every rule type one of the targets accepts
+enum class RuleType : uint8_t
+{
+    Unknown,
+    Domain,
+    DomainSuffix,
+    DomainKeyword,
+    IpCidr,
+    SrcIpCidr,
+    GeoIp,
+    Match,
+    Final,
+    IpCidr6,
+    SrcPort,
+    DstPort,
+    ProcessName,
+    DomainRegex,
+    GeoSite,
+    IpSuffix,
+    IpAsn,
+    SrcGeoIp,
+    SrcIpAsn,
+    SrcIpSuffix,
+    InPort,
+    InType,
+    InUser,
+    InName,
+    ProcessPathRegex,
+    ProcessPath,
+    ProcessNameRegex,
+    Uid,
+    Network,
+    Dscp,
+    SubRule,
+    RuleSet,
+    And,
+    Or,
+    Not,
+    UserAgent,
+    UrlRegex,
+    DestPort,
+    SrcIp,
+    Host,
+    HostSuffix,
+    HostKeyword,
+    IpVersion,
+    Inbound,
+    Protocol,
+    PackageName,
+    Port,
+    PortRange,
+    SrcPortRange,
+    User,
+    UserId
+};
+
+/// targets with their own list of rule types, one bit each so a type records all lists it is on
+enum rule_target : uint8_t
+{
+    RULE_TARGET_CLASH = 1 << 0,
+    RULE_TARGET_SURGE2 = 1 << 1,
+    RULE_TARGET_SURGE = 1 << 2,
+    RULE_TARGET_QUANX = 1 << 3,
+    RULE_TARGET_SURF = 1 << 4,
+    RULE_TARGET_SINGBOX = 1 << 5
+};
+
+struct RuleTypeEntry
+{
+    std::string_view name;
+    RuleType type;
+    uint8_t targets;
+};
+
+namespace rule_types_detail
+{
+
+constexpr uint8_t kAll = RULE_TARGET_CLASH | RULE_TARGET_SURGE2 | RULE_TARGET_SURGE | RULE_TARGET_QUANX | RULE_TARGET_SURF | RULE_TARGET_SINGBOX;
+constexpr uint8_t kSurges = RULE_TARGET_SURGE2 | RULE_TARGET_SURGE;
+
+/// indexed by RuleType - 1
+constexpr RuleTypeEntry kEntries[] = {
+    {"DOMAIN", RuleType::Domain, kAll},
+    {"DOMAIN-SUFFIX", RuleType::DomainSuffix, kAll},
+    {"DOMAIN-KEYWORD", RuleType::DomainKeyword, kAll},
+    {"IP-CIDR", RuleType::IpCidr, kAll},
+    {"SRC-IP-CIDR", RuleType::SrcIpCidr, kAll},
+    {"GEOIP", RuleType::GeoIp, kAll},
+    {"MATCH", RuleType::Match, kAll},
+    {"FINAL", RuleType::Final, kAll},
+    {"IP-CIDR6", RuleType::IpCidr6, RULE_TARGET_CLASH | kSurges | RULE_TARGET_SURF},
+    {"SRC-PORT", RuleType::SrcPort, RULE_TARGET_CLASH | RULE_TARGET_SINGBOX},
+    {"DST-PORT", RuleType::DstPort, RULE_TARGET_CLASH},
+    {"PROCESS-NAME", RuleType::ProcessName, RULE_TARGET_CLASH | kSurges | RULE_TARGET_SURF | RULE_TARGET_SINGBOX},
+    {"DOMAIN-REGEX", RuleType::DomainRegex, RULE_TARGET_CLASH | RULE_TARGET_SINGBOX},
+    {"GEOSITE", RuleType::GeoSite, RULE_TARGET_CLASH | RULE_TARGET_SINGBOX},
+    {"IP-SUFFIX", RuleType::IpSuffix, RULE_TARGET_CLASH},
+    {"IP-ASN", RuleType::IpAsn, RULE_TARGET_CLASH},
+    {"SRC-GEOIP", RuleType::SrcGeoIp, RULE_TARGET_CLASH | RULE_TARGET_SINGBOX},
+    {"SRC-IP-ASN", RuleType::SrcIpAsn, RULE_TARGET_CLASH},
+    {"SRC-IP-SUFFIX", RuleType::SrcIpSuffix, RULE_TARGET_CLASH},
+    {"IN-PORT", RuleType::InPort, RULE_TARGET_CLASH | kSurges | RULE_TARGET_SURF},
+    {"IN-TYPE", RuleType::InType, RULE_TARGET_CLASH},
+    {"IN-USER", RuleType::InUser, RULE_TARGET_CLASH},
+    {"IN-NAME", RuleType::InName, RULE_TARGET_CLASH},
+    {"PROCESS-PATH-REGEX", RuleType::ProcessPathRegex, RULE_TARGET_CLASH},
+    {"PROCESS-PATH", RuleType::ProcessPath, RULE_TARGET_CLASH | RULE_TARGET_SINGBOX},
+    {"PROCESS-NAME-REGEX", RuleType::ProcessNameRegex, RULE_TARGET_CLASH},
+    {"UID", RuleType::Uid, RULE_TARGET_CLASH},
+    {"NETWORK", RuleType::Network, RULE_TARGET_CLASH | RULE_TARGET_SINGBOX},
+    {"DSCP", RuleType::Dscp, RULE_TARGET_CLASH},
+    {"SUB-RULE", RuleType::SubRule, RULE_TARGET_CLASH},
+    {"RULE-SET", RuleType::RuleSet, RULE_TARGET_CLASH},
+    {"AND", RuleType::And, RULE_TARGET_CLASH | RULE_TARGET_SURGE},
+    {"OR", RuleType::Or, RULE_TARGET_CLASH | RULE_TARGET_SURGE},
+    {"NOT", RuleType::Not, RULE_TARGET_CLASH | RULE_TARGET_SURGE},
+    {"USER-AGENT", RuleType::UserAgent, kSurges | RULE_TARGET_QUANX},
+    {"URL-REGEX", RuleType::UrlRegex, kSurges},
+    {"DEST-PORT", RuleType::DestPort, kSurges | RULE_TARGET_SURF},
+    {"SRC-IP", RuleType::SrcIp, kSurges | RULE_TARGET_SURF},
+    {"HOST", RuleType::Host, RULE_TARGET_QUANX},
+    {"HOST-SUFFIX", RuleType::HostSuffix, RULE_TARGET_QUANX},
+    {"HOST-KEYWORD", RuleType::HostKeyword, RULE_TARGET_QUANX},
+    {"IP-VERSION", RuleType::IpVersion, RULE_TARGET_SINGBOX},
+    {"INBOUND", RuleType::Inbound, RULE_TARGET_SINGBOX},
+    {"PROTOCOL", RuleType::Protocol, RULE_TARGET_SINGBOX},
+    {"PACKAGE-NAME", RuleType::PackageName, RULE_TARGET_SINGBOX},
+    {"PORT", RuleType::Port, RULE_TARGET_SINGBOX},
+    {"PORT-RANGE", RuleType::PortRange, RULE_TARGET_SINGBOX},
+    {"SRC-PORT-RANGE", RuleType::SrcPortRange, RULE_TARGET_SINGBOX},
+    {"USER", RuleType::User, RULE_TARGET_SINGBOX},
+    {"USER-ID", RuleType::UserId, RULE_TARGET_SINGBOX}};
+
+constexpr size_t kEntryCount = sizeof(kEntries) / sizeof(kEntries[0]);
+constexpr size_t kSlots = 256;
+constexpr uint8_t kEmptySlot = 0xFF;
+
+constexpr uint32_t hashName(std::string_view name, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for(char c : name)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/// the first seed placing every name into a slot of its own
+constexpr uint32_t findSeed()
+{
+    for(uint32_t seed = 0;; seed++)
+    {
+        std::array<bool, kSlots> used{};
+        bool collided = false;
+        for(const RuleTypeEntry &entry : kEntries)
+        {
+            bool &slot = used[hashName(entry.name, seed) % kSlots];
+            if(slot)
+            {
+                collided = true;
+                break;
+            }
+            slot = true;
+        }
+        if(!collided)
+            return seed;
+    }
+}
+
+constexpr uint32_t kSeed = findSeed();
+
+constexpr std::array<uint8_t, kSlots> buildSlots()
+{
+    std::array<uint8_t, kSlots> slots{};
+    for(uint8_t &slot : slots)
+        slot = kEmptySlot;
+    for(size_t i = 0; i < kEntryCount; i++)
+        slots[hashName(kEntries[i].name, kSeed) % kSlots] = static_cast<uint8_t>(i);
+    return slots;
+}
+
+constexpr std::array<uint8_t, kSlots> kSlotEntries = buildSlots();
+
+constexpr bool startsWith(std::string_view text, std::string_view prefix)
+{
+    return text.size() >= prefix.size() && text.substr(0, prefix.size()) == prefix;
+}
+
+/// the targets listing this type or any type its name starts with: the lists have always been
+/// matched by prefix, which lets IP-CIDR6 through to QuanX on the strength of IP-CIDR
+constexpr std::array<uint8_t, kEntryCount> buildPrefixTargets()
+{
+    std::array<uint8_t, kEntryCount> targets{};
+    for(size_t i = 0; i < kEntryCount; i++)
+        for(const RuleTypeEntry &entry : kEntries)
+            if(startsWith(kEntries[i].name, entry.name))
+                targets[i] |= entry.targets;
+    return targets;
+}
+
+constexpr std::array<uint8_t, kEntryCount> kPrefixTargets = buildPrefixTargets();
+
+constexpr size_t buildMaxLength()
+{
+    size_t length = 0;
+    for(const RuleTypeEntry &entry : kEntries)
+        length = entry.name.size() > length ? entry.name.size() : length;
+    return length;
+}
+
+constexpr size_t kMaxLength = buildMaxLength();
+
+/// bit n set when some name is n characters long, so prefixes of other lengths skip the lookup
+constexpr uint32_t buildLengths()
+{
+    uint32_t lengths = 0;
+    for(const RuleTypeEntry &entry : kEntries)
+        lengths |= 1u << entry.name.size();
+    return lengths;
+}
+
+constexpr uint32_t kLengths = buildLengths();
+
+constexpr bool entriesFollowEnum()
+{
+    for(size_t i = 0; i < kEntryCount; i++)
+        if(static_cast<size_t>(kEntries[i].type) != i + 1)
+            return false;
+    return static_cast<size_t>(RuleType::UserId) == kEntryCount;
+}
+
+constexpr int findEntry(std::string_view name)
+{
+    if(name.empty() || name.size() > kMaxLength)
+        return -1;
+    const uint8_t index = kSlotEntries[hashName(name, kSeed) % kSlots];
+    return index != kEmptySlot && kEntries[index].name == name ? index : -1;
+}
+
+static_assert(kEntryCount < kEmptySlot && kMaxLength < 32);
+static_assert(entriesFollowEnum(), "kEntries must list the types in RuleType order");
+static_assert(findEntry("IP-CIDR6") >= 0 && kEntries[findEntry("IP-CIDR6")].type == RuleType::IpCidr6);
+
+} // namespace rule_types_detail
+
+/// the type named before the first comma of rule, matched exactly
+constexpr RuleType ruleTypeOf(std::string_view rule)
+{
+    const int index = rule_types_detail::findEntry(rule.substr(0, rule.find(',')));
+    return index < 0 ? RuleType::Unknown : rule_types_detail::kEntries[index].type;
+}
+
+/// its name as rules spell it, empty for Unknown
+constexpr std::string_view ruleTypeName(RuleType type)
+{
+    return type == RuleType::Unknown ? std::string_view() : rule_types_detail::kEntries[static_cast<size_t>(type) - 1].name;
+}
+
+/// whether the lists of target list the type exactly
+constexpr bool ruleTypeListed(RuleType type, uint8_t target)
+{
+    return type != RuleType::Unknown && (rule_types_detail::kEntries[static_cast<size_t>(type) - 1].targets & target);
+}
+
+/// whether a list of target has a type rule starts with, the check the lists have always been
+/// used for; the longest known type rule starts with answers for every shorter one
+constexpr bool ruleTypeAllowed(std::string_view rule, uint8_t target)
+{
+    using namespace rule_types_detail;
+    size_t length = rule.find(',');
+    if(length == std::string_view::npos)
+        length = rule.size();
+    if(length > kMaxLength)
+        length = kMaxLength;
+    for(; length > 0; length--)
+    {
+        if(!(kLengths & (1u << length)))
+            continue;
+        const int index = findEntry(rule.substr(0, length));
+        if(index >= 0)
+            return kPrefixTargets[index] & target;
+    }
+    return false;
+}
+
+#endif // RULE_TYPES_H_INCLUDED
@@ -1,124 +1,91 @@
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 
 #include "handler/settings.h"
 #include "utils/logger.h"
 #include "utils/concurrent_lru_cache.h"
-#include "utils/md5/md5_interface.h"
+#include "utils/content_store.h"
 #include "utils/network.h"
 #include "utils/regexp.h"
 #include "utils/string.h"
 #include "utils/rapidjson_extra.h"
+#include "utils/xxhash.h"
+#include "rule_types.h"
+#include "ruleset_scanner.h"
 #include "subexport.h"
 
-/// rule type lists
-#define basic_types "DOMAIN", "DOMAIN-SUFFIX", "DOMAIN-KEYWORD", "IP-CIDR", "SRC-IP-CIDR", "GEOIP", "MATCH", "FINAL"
-// 新增meta路由规则
-//string_array ClashRuleTypes = {basic_types, "IP-CIDR6", "SRC-PORT", "DST-PORT", "PROCESS-NAME"};
-string_array ClashRuleTypes = {basic_types, "IP-CIDR6", "SRC-PORT", "DST-PORT", "PROCESS-NAME", "DOMAIN-REGEX", "GEOSITE", "IP-SUFFIX", "IP-ASN", "SRC-GEOIP", "SRC-IP-ASN", "SRC-IP-SUFFIX", "IN-PORT", "IN-TYPE", "IN-USER", "IN-NAME", "PROCESS-PATH-REGEX", "PROCESS-PATH", "PROCESS-NAME-REGEX", "UID", "NETWORK", "DSCP", "SUB-RULE", "RULE-SET", "AND", "OR", "NOT"};
-string_array Surge2RuleTypes = {basic_types, "IP-CIDR6", "USER-AGENT", "URL-REGEX", "PROCESS-NAME", "IN-PORT", "DEST-PORT", "SRC-IP"};
-string_array SurgeRuleTypes = {basic_types, "IP-CIDR6", "USER-AGENT", "URL-REGEX", "AND", "OR", "NOT", "PROCESS-NAME", "IN-PORT", "DEST-PORT", "SRC-IP"};
-string_array QuanXRuleTypes = {basic_types, "USER-AGENT", "HOST", "HOST-SUFFIX", "HOST-KEYWORD"};
-string_array SurfRuleTypes = {basic_types, "IP-CIDR6", "PROCESS-NAME", "IN-PORT", "DEST-PORT", "SRC-IP"};
-string_array SingBoxRuleTypes = {basic_types, "IP-VERSION", "INBOUND", "PROTOCOL", "NETWORK", "GEOSITE", "SRC-GEOIP", "DOMAIN-REGEX", "PROCESS-NAME", "PROCESS-PATH", "PACKAGE-NAME", "PORT", "PORT-RANGE", "SRC-PORT", "SRC-PORT-RANGE", "USER", "USER-ID"};
-
-static std::string convertRulesetUncached(const std::string &content, int type)
+/// the Clash rule types by name, which external rule sources are validated against
+string_array ClashRuleTypes = []
 {
-    /// Target: Surge type,pattern[,flag]
-    /// Source: QuanX type,pattern[,group]
-    ///         Clash payload:\n  - 'ipcidr/domain/classic(Surge-like)'
+    string_array types;
+    for(uint8_t type = 1; type <= static_cast<uint8_t>(RuleType::UserId); type++)
+        if(ruleTypeListed(static_cast<RuleType>(type), RULE_TARGET_CLASH))
+            types.emplace_back(ruleTypeName(static_cast<RuleType>(type)));
+    return types;
+}();
 
-    std::string output, strLine;
+namespace {
 
-    if(type == RULESET_SURGE)
-        return content;
+constexpr size_t kRulesetConversionCacheEntries = 256;
+constexpr size_t kRulesetConversionCacheBytes = 16 * 1024 * 1024;
+ShardedLruCache<std::string, std::string> ruleset_conversion_cache(
+    kRulesetConversionCacheEntries, kRulesetConversionCacheBytes);
 
-    if(regFind(content, "^payload:\\r?\\n")) /// Clash
-    {
-        output = regReplace(regReplace(content, "payload:\\r?\\n", "", true), R"(\s?^\s*-\s+('|"?)(.*)\1$)", "\n$2", true);
-        if(type == RULESET_CLASH_CLASSICAL) /// classical type
-            return output;
-        std::stringstream ss;
-        ss << output;
-        char delimiter = getLineBreak(output);
-        output.clear();
-        string_size pos, lineSize;
-        while(getline(ss, strLine, delimiter))
-        {
-            strLine = trim(strLine);
-            lineSize = strLine.size();
-            if(lineSize && strLine[lineSize - 1] == '\r') //remove line break
-                strLine.erase(--lineSize);
+/// every rule of one ruleset as one target writes it for one policy group, each followed by '\n'
+struct RuleBlock
+{
+    std::string lines;
+    size_t count = 0;
+};
 
-            if(strFind(strLine, "//"))
-            {
-                strLine.erase(strLine.find("//"));
-                strLine = trimWhitespace(strLine);
-            }
+using RuleBlockPtr = std::shared_ptr<const RuleBlock>;
 
-            if(!strLine.empty() && (strLine[0] != ';' && strLine[0] != '#' && !(lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')))
-            {
-                pos = strLine.find('/');
-                if(pos != std::string::npos) /// ipcidr
-                {
-                    if(isIPv4(strLine.substr(0, pos)))
-                        output += "IP-CIDR,";
-                    else
-                        output += "IP-CIDR6,";
-                }
-                else
-                {
-                    if(strLine[0] == '.' || (lineSize >= 2 && strLine[0] == '+' && strLine[1] == '.')) /// suffix
-                    {
-                        bool keyword_flag = false;
-                        while(endsWith(strLine, ".*"))
-                        {
-                            keyword_flag = true;
-                            strLine.erase(strLine.size() - 2);
-                        }
-                        output += "DOMAIN-";
-                        if(keyword_flag)
-                            output += "KEYWORD,";
-                        else
-                            output += "SUFFIX,";
-                        strLine.erase(0, 2 - (strLine[0] == '.'));
-                    }
-                    else
-                        output += "DOMAIN,";
-                }
-            }
-            output += strLine;
-            output += '\n';
-        }
-        return output;
-    }
-    else /// QuanX
-    {
-        output = regReplace(regReplace(content, "^(?i:host)", "DOMAIN", true), "^(?i:ip6-cidr)", "IP-CIDR6", true); //translate type
-        output = regReplace(output, "^((?i:DOMAIN(?:-(?:SUFFIX|KEYWORD))?|IP-CIDR6?|USER-AGENT),)\\s*?(\\S*?)(?:,(?!no-resolve).*?)(,no-resolve)?$", "\\U$1\\E$2${3:-}", true); //remove group
-        return output;
-    }
-}
+constexpr size_t kRuleBlockCacheEntries = 512;
+constexpr size_t kRuleBlockCacheBytes = 32 * 1024 * 1024;
+ShardedLruCache<std::string, RuleBlock> rule_block_cache(kRuleBlockCacheEntries, kRuleBlockCacheBytes);
 
-namespace {
+/// bump whenever scanRuleset output changes, so entries written by older builds are never served
+constexpr const char *kRulesetDiskCacheVersion = "v1";
+constexpr uint64_t kRulesetDiskCacheBytes = 256ull * 1024 * 1024;
+std::mutex ruleset_disk_cache_mutex;
+std::shared_ptr<ContentStore> ruleset_disk_cache;
 
-constexpr size_t kRulesetConversionCacheEntries = 256;
-constexpr size_t kRulesetConversionCacheBytes = 16 * 1024 * 1024;
-ConcurrentLruCache<std::string, std::string> ruleset_conversion_cache(
-    kRulesetConversionCacheEntries, kRulesetConversionCacheBytes);
+/// follows ruleset_cache_dir across reloads; null while it is empty
+std::shared_ptr<ContentStore> rulesetDiskCache()
+{
+    std::lock_guard<std::mutex> lock(ruleset_disk_cache_mutex);
+    const std::string directory = global.rulesetCacheDir;
+    if(directory.empty())
+        ruleset_disk_cache.reset();
+    else if(!ruleset_disk_cache || ruleset_disk_cache->directory() != directory)
+        ruleset_disk_cache = std::make_shared<ContentStore>(directory, kRulesetDiskCacheBytes);
+    return ruleset_disk_cache;
+}
 
 } // namespace
 
-std::string convertRuleset(const std::string &content, int type)
+std::string convertRuleset(std::string_view content, int type)
 {
     if(type == RULESET_SURGE)
-        return content;
-
-    const std::string key =
-        getMD5(content) + ":" + std::to_string(type);
-    return ruleset_conversion_cache.getOrCompute(
-        key, true, [&] { return convertRulesetUncached(content, type); },
+        return std::string(content);
+
+    const std::string key = std::string(kRulesetDiskCacheVersion) + "-" + xxHash64Hex(content) + "-" +
+                            std::to_string(content.size()) + "-" + std::to_string(type);
+    return *ruleset_conversion_cache.getOrCompute(
+        key, true, [&] {
+            std::shared_ptr<ContentStore> disk_cache = rulesetDiskCache();
+            std::string converted;
+            if(disk_cache && disk_cache->get(key, converted))
+                return converted;
+            converted = scanRuleset(content, type);
+            if(disk_cache && !disk_cache->put(key, converted))
+                writeLog(0, "规则集转换结果写入磁盘缓存失败：'" + disk_cache->directory() + "'。", LOG_LEVEL_WARNING);
+            return converted;
+        },
         [](const std::string &value)
-            -> ConcurrentLruCache<std::string, std::string>::CacheSize {
+            -> ShardedLruCache<std::string, std::string>::CacheSize {
             return value.size();
         });
 }
@@ -133,20 +100,116 @@ size_t rulesetConversionCacheMaxBytes()
     return kRulesetConversionCacheBytes;
 }
 
-static bool isClashCommaPayloadRule(const std::string &rule_type)
+LruCacheStats rulesetConversionCacheStats()
+{
+    return ruleset_conversion_cache.stats();
+}
+
+ContentStore::Stats rulesetDiskCacheStats()
+{
+    std::shared_ptr<ContentStore> disk_cache;
+    {
+        std::lock_guard<std::mutex> lock(ruleset_disk_cache_mutex);
+        disk_cache = ruleset_disk_cache;
+    }
+    return disk_cache ? disk_cache->stats() : ContentStore::Stats();
+}
+
+LruCacheStats ruleBlockCacheStats()
+{
+    return rule_block_cache.stats();
+}
+
+/// the rules of a ruleset rendered once per content, target, policy group and options, so a
+/// request only concatenates blocks. render gets every trimmed line that is not a comment and
+/// rewrites it into the target's text, false leaves the line out.
+template <class Render>
+static RuleBlockPtr renderRuleBlock(const std::string &content, const RulesetContent &ruleset,
+                                    const std::string &target, Render &&render)
+{
+    const std::string key = target + "-" + xxHash64Hex(content) + "-" + std::to_string(content.size()) + "-" +
+                            std::to_string(ruleset.rule_type) + "-" + (ruleset.options.no_resolve ? "1" : "0") +
+                            "-" + ruleset.rule_group;
+    return rule_block_cache.getOrCompute(
+        key, true, [&] {
+            RuleBlock block;
+            /// a Surge ruleset is read where it lies, the shared body is not copied
+            std::string converted;
+            std::string_view rules = content;
+            if(ruleset.rule_type != RULESET_SURGE)
+                rules = converted = convertRuleset(content, ruleset.rule_type);
+            const char delimiter = getLineBreak(rules);
+            std::string line;
+            for(std::string_view::size_type begin = 0, end; begin < rules.size(); begin = end + 1)
+            {
+                end = rules.find(delimiter, begin);
+                if(end == std::string_view::npos)
+                    end = rules.size();
+                line = trimWhitespace(std::string(rules.substr(begin, end - begin)), true, true); //remove whitespaces
+                if(line.empty() || line[0] == ';' || line[0] == '#' || (line.size() >= 2 && line[0] == '/' && line[1] == '/')) //empty lines and comments are ignored
+                    continue;
+                if(!render(line))
+                    continue;
+                block.lines += line;
+                block.lines += '\n';
+                block.count++;
+            }
+            return block;
+        },
+        [](const RuleBlock &block)
+            -> ShardedLruCache<std::string, RuleBlock>::CacheSize {
+            return block.lines.size();
+        });
+}
+
+/// the leading rules of block a request may still add: a ruleset adds rules while the running
+/// total has not passed max_allowed_rules, which the caller checked before this ruleset
+static std::string_view allowedRules(const RuleBlock &block, size_t total_rules, size_t &count)
+{
+    count = block.count;
+    if(!global.maxAllowedRules || count <= global.maxAllowedRules - total_rules + 1)
+        return block.lines;
+    count = global.maxAllowedRules - total_rules + 1;
+    std::string::size_type end = 0;
+    for(size_t i = 0; i < count; i++)
+        end = block.lines.find('\n', end) + 1;
+    return std::string_view(block.lines).substr(0, end);
+}
+
+template <class Visit>
+static void forEachRule(std::string_view lines, Visit &&visit)
 {
-    return rule_type == "AND" || rule_type == "OR" || rule_type == "NOT" ||
-           rule_type == "SUB-RULE" || rule_type == "DOMAIN-REGEX" ||
-           rule_type == "PROCESS-NAME-REGEX" || rule_type == "PROCESS-PATH-REGEX";
+    for(std::string_view::size_type begin = 0, end; begin < lines.size(); begin = end + 1)
+    {
+        end = lines.find('\n', begin);
+        visit(lines.substr(begin, end - begin));
+    }
+}
+
+static bool isClashCommaPayloadRule(RuleType rule_type)
+{
+    switch(rule_type)
+    {
+    case RuleType::And:
+    case RuleType::Or:
+    case RuleType::Not:
+    case RuleType::SubRule:
+    case RuleType::DomainRegex:
+    case RuleType::ProcessNameRegex:
+    case RuleType::ProcessPathRegex:
+        return true;
+    default:
+        return false;
+    }
 }
 
 std::string appendClashRuleTarget(const std::string &rule, const std::string &target, bool no_resolve_only)
 {
     std::string strLine = trimWhitespace(rule, true, true);
     std::string::size_type pos = strLine.find(',');
-    std::string rule_type = toUpper(trimWhitespace(pos == std::string::npos ? strLine : strLine.substr(0, pos), true, true));
+    const RuleType rule_type = ruleTypeOf(toUpper(trimWhitespace(pos == std::string::npos ? strLine : strLine.substr(0, pos), true, true)));
 
-    if(rule_type == "FINAL" || rule_type == "MATCH")
+    if(rule_type == RuleType::Final || rule_type == RuleType::Match)
         return "MATCH," + target;
 
     if(pos == std::string::npos || isClashCommaPayloadRule(rule_type))
@@ -210,12 +273,28 @@ static void warnNoResolveIgnoredForTarget(
     }
 }
 
+/// "  - " list items, as rulesetToClashStr writes them
+static RuleBlockPtr renderClashRuleBlock(const std::string &content, const RulesetContent &ruleset)
+{
+    return renderRuleBlock(content, ruleset, "clash", [&](std::string &strLine) {
+        if(!ruleTypeAllowed(strLine, RULE_TARGET_CLASH))
+            return false;
+        if(strFind(strLine, "//"))
+        {
+            strLine.erase(strLine.find("//"));
+            strLine = trimWhitespace(strLine);
+        }
+        strLine = appendClashRuleTarget(strLine, ruleset.rule_group);
+        strLine = "  - " + appendClashIpCidrNoResolve(strLine, ruleset.rule_type, ruleset.options);
+        return true;
+    });
+}
+
 void rulesetToClash(YAML::Node &base_rule, std::vector<RulesetContent> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name, RuleConversionStats *stats)
 {
     RuleConversionStats local_stats;
     string_array allRules;
-    std::string rule_group, retrieved_rules, strLine;
-    std::stringstream strStrm;
+    std::string rule_group, strLine;
     const std::string field_name = new_field_name ? "rules" : "Rule";
     YAML::Node rules;
     size_t total_rules = 0;
@@ -228,7 +307,7 @@ void rulesetToClash(YAML::Node &base_rule, std::vector<RulesetContent> &ruleset_
         if(global.maxAllowedRules && total_rules > global.maxAllowedRules)
             break;
         rule_group = x.rule_group;
-        retrieved_rules = x.rule_content.get();
+        const std::string &retrieved_rules = *x.rule_content.get();
         if(retrieved_rules.empty())
         {
             writeLog(0, "获取规则集失败或规则集为空：'" + x.rule_path + "'。", LOG_LEVEL_WARNING);
@@ -243,34 +322,11 @@ void rulesetToClash(YAML::Node &base_rule, std::vector<RulesetContent> &ruleset_
             local_stats.add();
             continue;
         }
-        retrieved_rules = convertRuleset(retrieved_rules, x.rule_type);
-        char delimiter = getLineBreak(retrieved_rules);
-
-        strStrm.clear();
-        strStrm<<retrieved_rules;
-        std::string::size_type lineSize;
-        while(getline(strStrm, strLine, delimiter))
-        {
-            if(global.maxAllowedRules && total_rules > global.maxAllowedRules)
-                break;
-            strLine = trimWhitespace(strLine, true, true); //remove whitespaces
-            lineSize = strLine.size();
-            if(!lineSize || strLine[0] == ';' || strLine[0] == '#' || (lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')) //empty lines and comments are ignored
-                continue;
-            if(std::none_of(ClashRuleTypes.begin(), ClashRuleTypes.end(), [strLine](const std::string& type){return startsWith(strLine, type);}))
-                continue;
-            if(strFind(strLine, "//"))
-            {
-                strLine.erase(strLine.find("//"));
-                strLine = trimWhitespace(strLine);
-            }
-            strLine = appendClashRuleTarget(strLine, rule_group);
-            strLine =
-                appendClashIpCidrNoResolve(strLine, x.rule_type, x.options);
-            allRules.emplace_back(strLine);
-            total_rules++;
-            local_stats.add();
-        }
+        size_t count;
+        forEachRule(allowedRules(*renderClashRuleBlock(retrieved_rules, x), total_rules, count),
+                    [&](std::string_view rule) { allRules.emplace_back(rule.substr(4)); });
+        total_rules += count;
+        local_stats.add(count);
     }
 
     for(std::string &x : allRules)
@@ -286,8 +342,7 @@ void rulesetToClash(YAML::Node &base_rule, std::vector<RulesetContent> &ruleset_
 std::string rulesetToClashStr(YAML::Node &base_rule, std::vector<RulesetContent> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name, RuleConversionStats *stats)
 {
     RuleConversionStats local_stats;
-    std::string rule_group, retrieved_rules, strLine;
-    std::stringstream strStrm;
+    std::string rule_group, strLine;
     const std::string field_name = new_field_name ? "rules" : "Rule";
     std::string output_content = "\n" + field_name + ":\n";
     size_t total_rules = 0;
@@ -304,7 +359,7 @@ std::string rulesetToClashStr(YAML::Node &base_rule, std::vector<RulesetContent>
         if(global.maxAllowedRules && total_rules > global.maxAllowedRules)
             break;
         rule_group = x.rule_group;
-        retrieved_rules = x.rule_content.get();
+        const std::string &retrieved_rules = *x.rule_content.get();
         if(retrieved_rules.empty())
         {
             writeLog(0, "获取规则集失败或规则集为空：'" + x.rule_path + "'。", LOG_LEVEL_WARNING);
@@ -319,39 +374,68 @@ std::string rulesetToClashStr(YAML::Node &base_rule, std::vector<RulesetContent>
             local_stats.add();
             continue;
         }
-        retrieved_rules = convertRuleset(retrieved_rules, x.rule_type);
-        char delimiter = getLineBreak(retrieved_rules);
+        size_t count;
+        output_content.append(allowedRules(*renderClashRuleBlock(retrieved_rules, x), total_rules, count));
+        total_rules += count;
+        local_stats.add(count);
+    }
+    if(stats)
+        stats->add(local_stats.rules);
+    return output_content;
+}
 
-        strStrm.clear();
-        strStrm<<retrieved_rules;
-        std::string::size_type lineSize;
-        while(getline(strStrm, strLine, delimiter))
+/// rules for section [Rule] of Surge and its relatives, surge_ver picks which of them
+static RuleBlockPtr renderSurgeRuleBlock(const std::string &content, const RulesetContent &ruleset, int surge_ver)
+{
+    string_view_array temp(4);
+    return renderRuleBlock(content, ruleset, "surge" + std::to_string(surge_ver), [&](std::string &strLine) {
+        /// remove unsupported types
+        switch(surge_ver)
         {
-            if(global.maxAllowedRules && total_rules > global.maxAllowedRules)
-                break;
-            strLine = trimWhitespace(strLine, true, true); //remove whitespaces
-            lineSize = strLine.size();
-            if(!lineSize || strLine[0] == ';' || strLine[0] == '#' || (lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')) //empty lines and comments are ignored
-                continue;
-            if(std::none_of(ClashRuleTypes.begin(), ClashRuleTypes.end(), [strLine](const std::string& type){ return startsWith(strLine, type); }))
-                continue;
-            if(strFind(strLine, "//"))
+        case -2:
+            if(startsWith(strLine, "IP-CIDR6"))
+                return false;
+            [[fallthrough]];
+        case -1:
+            if(!ruleTypeAllowed(strLine, RULE_TARGET_QUANX))
+                return false;
+            break;
+        case -3:
+            if(!ruleTypeAllowed(strLine, RULE_TARGET_SURF))
+                return false;
+            break;
+        default:
+            if(surge_ver > 2)
             {
-                strLine.erase(strLine.find("//"));
-                strLine = trimWhitespace(strLine);
+                if(!ruleTypeAllowed(strLine, RULE_TARGET_SURGE))
+                    return false;
             }
+            else
+            {
+                if(!ruleTypeAllowed(strLine, RULE_TARGET_SURGE2))
+                    return false;
+            }
+        }
 
-            strLine = appendClashRuleTarget(strLine, rule_group);
-            strLine =
-                appendClashIpCidrNoResolve(strLine, x.rule_type, x.options);
-            output_content += "  - " + strLine + "\n";
-            total_rules++;
-            local_stats.add();
+        if(strFind(strLine, "//"))
+        {
+            strLine.erase(strLine.find("//"));
+            strLine = trimWhitespace(strLine);
         }
-    }
-    if(stats)
-        stats->add(local_stats.rules);
-    return output_content;
+
+        if(surge_ver == -1 || surge_ver == -2)
+        {
+            if(startsWith(strLine, "IP-CIDR6"))
+                strLine.replace(0, 8, "IP6-CIDR");
+            strLine = transformRuleToCommon(temp, strLine, ruleset.rule_group, true);
+        }
+        else
+        {
+            if(!startsWith(strLine, "AND") && !startsWith(strLine, "OR") && !startsWith(strLine, "NOT"))
+                strLine = transformRuleToCommon(temp, strLine, ruleset.rule_group);
+        }
+        return true;
+    });
 }
 
 void rulesetToSurge(INIReader &base_rule, std::vector<RulesetContent> &ruleset_content_array, int surge_ver, bool overwrite_original_rules, const std::string &remote_path_prefix, RuleConversionStats *stats)
@@ -359,8 +443,7 @@ void rulesetToSurge(INIReader &base_rule, std::vector<RulesetContent> &ruleset_c
     RuleConversionStats local_stats;
     warnNoResolveIgnoredForTarget(ruleset_content_array, "非 Clash");
     string_array allRules;
-    std::string rule_group, rule_path, rule_path_typed, retrieved_rules, strLine;
-    std::stringstream strStrm;
+    std::string rule_group, rule_path, rule_path_typed, strLine;
     size_t total_rules = 0;
 
     switch(surge_ver) //other version: -3 for Surfboard, -4 for Loon
@@ -406,7 +489,7 @@ void rulesetToSurge(INIReader &base_rule, std::vector<RulesetContent> &ruleset_c
         rule_path_typed = x.rule_path_typed;
         if(rule_path.empty())
         {
-            strLine = x.rule_content.get().substr(2);
+            strLine = x.rule_content.get()->substr(2);
             if(strLine == "MATCH")
                 strLine = "FINAL";
             if(surge_ver == -1 || surge_ver == -2)
@@ -499,77 +582,18 @@ void rulesetToSurge(INIReader &base_rule, std::vector<RulesetContent> &ruleset_c
             }
             else
                 continue;
-            retrieved_rules = x.rule_content.get();
+            const std::string &retrieved_rules = *x.rule_content.get();
             if(retrieved_rules.empty())
             {
                 writeLog(0, "获取规则集失败或规则集为空：'" + x.rule_path + "'。", LOG_LEVEL_WARNING);
                 continue;
             }
 
-            retrieved_rules = convertRuleset(retrieved_rules, x.rule_type);
-            char delimiter = getLineBreak(retrieved_rules);
-
-            strStrm.clear();
-            strStrm<<retrieved_rules;
-            std::string::size_type lineSize;
-            while(getline(strStrm, strLine, delimiter))
-            {
-                if(global.maxAllowedRules && total_rules > global.maxAllowedRules)
-                    break;
-                strLine = trimWhitespace(strLine, true, true);
-                lineSize = strLine.size();
-                if(!lineSize || strLine[0] == ';' || strLine[0] == '#' || (lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')) //empty lines and comments are ignored
-                    continue;
-
-                /// remove unsupported types
-                switch(surge_ver)
-                {
-                case -2:
-                    if(startsWith(strLine, "IP-CIDR6"))
-                        continue;
-                    [[fallthrough]];
-                case -1:
-                    if(!std::any_of(QuanXRuleTypes.begin(), QuanXRuleTypes.end(), [strLine](const std::string& type){return startsWith(strLine, type);}))
-                        continue;
-                    break;
-                case -3:
-                    if(!std::any_of(SurfRuleTypes.begin(), SurfRuleTypes.end(), [strLine](const std::string& type){return startsWith(strLine, type);}))
-                        continue;
-                    break;
-                default:
-                    if(surge_ver > 2)
-                    {
-                        if(!std::any_of(SurgeRuleTypes.begin(), SurgeRuleTypes.end(), [strLine](const std::string& type){return startsWith(strLine, type);}))
-                            continue;
-                    }
-                    else
-                    {
-                        if(!std::any_of(Surge2RuleTypes.begin(), Surge2RuleTypes.end(), [strLine](const std::string& type){return startsWith(strLine, type);}))
-                            continue;
-                    }
-                }
-
-                if(strFind(strLine, "//"))
-                {
-                    strLine.erase(strLine.find("//"));
-                    strLine = trimWhitespace(strLine);
-                }
-
-                if(surge_ver == -1 || surge_ver == -2)
-                {
-                    if(startsWith(strLine, "IP-CIDR6"))
-                        strLine.replace(0, 8, "IP6-CIDR");
-                    strLine = transformRuleToCommon(temp, strLine, rule_group, true);
-                }
-                else
-                {
-                    if(!startsWith(strLine, "AND") && !startsWith(strLine, "OR") && !startsWith(strLine, "NOT"))
-                        strLine = transformRuleToCommon(temp, strLine, rule_group);
-                }
-                allRules.emplace_back(strLine);
-                total_rules++;
-                local_stats.add();
-            }
+            size_t count;
+            forEachRule(allowedRules(*renderSurgeRuleBlock(retrieved_rules, x, surge_ver), total_rules, count),
+                        [&](std::string_view rule) { allRules.emplace_back(rule); });
+            total_rules += count;
+            local_stats.add(count);
         }
     }
 
@@ -607,35 +631,46 @@ static rapidjson::Value transformRuleToSingBox(std::vector<std::string_view> &ar
     return rule_obj;
 }
 
-static bool appendSingBoxRule(std::vector<std::string_view> &args, rapidjson::Value &rules, const std::string& rule, rapidjson::MemoryPoolAllocator<>& allocator)
+/// rewrites rule into "type,value" as sing-box names them, false for a type sing-box lacks
+static bool renderSingBoxRule(std::vector<std::string_view> &args, std::string &rule)
 {
-    using namespace rapidjson_ext;
     args.clear();
     split(args, rule, ',');
     if (args.size() < 2) return false;
-    auto type = args[0];
+    const RuleType type = ruleTypeOf(args[0]);
 //    std::string_view option;
 //    if (args.size() >= 3) option = args[2];
 
-    if (none_of(SingBoxRuleTypes, [&](const std::string& t){ return type == t; }))
+    if (!ruleTypeListed(type, RULE_TARGET_SINGBOX))
         return false;
 
-    auto realType = toLower(std::string(type));
-    auto value = toLower(std::string(args[1]));
-    realType = replaceAllDistinct(realType, "-", "_");
-    realType = replaceAllDistinct(realType, "ip_cidr6", "ip_cidr");
-
-    rules | AppendToArray(realType.c_str(), rapidjson::Value(value.c_str(), value.size(), allocator), allocator);
+    std::string realType;
+    for (char c : ruleTypeName(type))
+        realType += c == '-' ? '_' : static_cast<char>(tolower(c));
+    rule = realType + "," + toLower(std::string(args[1]));
     return true;
 }
 
+/// "type,value" pairs of the rules sing-box supports, grouped into one rule object per ruleset
+static RuleBlockPtr renderSingBoxRuleBlock(const std::string &content, const RulesetContent &ruleset)
+{
+    std::vector<std::string_view> args(4);
+    return renderRuleBlock(content, ruleset, "singbox", [&](std::string &strLine) {
+        if(strFind(strLine, "//"))
+        {
+            strLine.erase(strLine.find("//"));
+            strLine = trimWhitespace(strLine);
+        }
+        return renderSingBoxRule(args, strLine);
+    });
+}
+
 void rulesetToSingBox(rapidjson::Document &base_rule, std::vector<RulesetContent> &ruleset_content_array, bool overwrite_original_rules, RuleConversionStats *stats)
 {
     RuleConversionStats local_stats;
     warnNoResolveIgnoredForTarget(ruleset_content_array, "sing-box");
     using namespace rapidjson_ext;
-    std::string rule_group, retrieved_rules, strLine, final;
-    std::stringstream strStrm;
+    std::string rule_group, strLine, final;
     size_t total_rules = 0;
     auto &allocator = base_rule.GetAllocator();
 
@@ -663,7 +698,7 @@ void rulesetToSingBox(rapidjson::Document &base_rule, std::vector<RulesetContent
         if(global.maxAllowedRules && total_rules > global.maxAllowedRules)
             break;
         rule_group = x.rule_group;
-        retrieved_rules = x.rule_content.get();
+        const std::string &retrieved_rules = *x.rule_content.get();
         if(retrieved_rules.empty())
         {
             writeLog(0, "获取规则集失败或规则集为空：'" + x.rule_path + "'。", LOG_LEVEL_WARNING);
@@ -682,34 +717,16 @@ void rulesetToSingBox(rapidjson::Document &base_rule, std::vector<RulesetContent
             local_stats.add();
             continue;
         }
-        retrieved_rules = convertRuleset(retrieved_rules, x.rule_type);
-        char delimiter = getLineBreak(retrieved_rules);
-
-        strStrm.clear();
-        strStrm<<retrieved_rules;
-
-        std::string::size_type lineSize;
         rapidjson::Value rule(rapidjson::kObjectType);
-
-        while(getline(strStrm, strLine, delimiter))
-        {
-            if(global.maxAllowedRules && total_rules > global.maxAllowedRules)
-                break;
-            strLine = trimWhitespace(strLine, true, true); //remove whitespaces
-            lineSize = strLine.size();
-            if(!lineSize || strLine[0] == ';' || strLine[0] == '#' || (lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')) //empty lines and comments are ignored
-                continue;
-            if(strFind(strLine, "//"))
-            {
-                strLine.erase(strLine.find("//"));
-                strLine = trimWhitespace(strLine);
-            }
-            if (appendSingBoxRule(temp, rule, strLine, allocator))
-            {
-                total_rules++;
-                local_stats.add();
-            }
-        }
+        size_t count;
+        forEachRule(allowedRules(*renderSingBoxRuleBlock(retrieved_rules, x), total_rules, count),
+                    [&](std::string_view line) {
+                        std::string_view::size_type comma = line.find(',');
+                        std::string_view value = line.substr(comma + 1);
+                        rule | AppendToArray(line.data(), comma, rapidjson::Value(value.data(), value.size(), allocator), allocator);
+                    });
+        total_rules += count;
+        local_stats.add(count);
         if (rule.ObjectEmpty()) continue;
         rule.AddMember("outbound", rapidjson::Value(rule_group.c_str(), allocator), allocator);
         rules.PushBack(rule, allocator);
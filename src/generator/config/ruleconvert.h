@@ -2,6 +2,7 @@
 #define RULECONVERT_H_INCLUDED
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <future>
 #include <cstdint>
@@ -11,6 +12,8 @@
 #include <rapidjson/document.h>
 
 #include "config/ruleset.h"
+#include "utils/concurrent_lru_cache.h"
+#include "utils/content_store.h"
 #include "utils/ini_reader/ini_reader.h"
 
 struct RulesetContent
@@ -19,7 +22,7 @@ struct RulesetContent
     std::string rule_path;
     std::string rule_path_typed;
     ruleset_type rule_type = RULESET_SURGE;
-    std::shared_future<std::string> rule_content;
+    std::shared_future<RulesetBody> rule_content;
     int update_interval = 0;
     RulesetOptions options;
 };
@@ -33,9 +36,14 @@ struct RuleConversionStats
     }
 };
 
-std::string convertRuleset(const std::string &content, int type);
+std::string convertRuleset(std::string_view content, int type);
 size_t rulesetConversionCacheMaxEntries();
 size_t rulesetConversionCacheMaxBytes();
+LruCacheStats rulesetConversionCacheStats();
+/// optional on-disk copy of conversion results (ruleset_cache_dir), zeros while disabled
+ContentStore::Stats rulesetDiskCacheStats();
+/// rules of one ruleset already rendered for one target and policy group
+LruCacheStats ruleBlockCacheStats();
 std::string appendClashRuleTarget(const std::string &rule, const std::string &target, bool no_resolve_only = false);
 void rulesetToClash(YAML::Node &base_rule, std::vector<RulesetContent> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name, RuleConversionStats *stats = nullptr);
 std::string rulesetToClashStr(YAML::Node &base_rule, std::vector<RulesetContent> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name, RuleConversionStats *stats = nullptr);
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "config/ruleset.h"
+#include "utils/regexp.h"
+#include "ruleset_scanner.h"
+
+/// Each step below reproduces one regex of the former convertRulesetUncached,
+/// including how PCRE2 (UTF mode, multiline, LF line breaks) handled the corner cases.
+
+namespace
+{
+
+using LineList = std::vector<std::string_view>;
+
+constexpr std::string_view kPayloadHeader = "payload:";
+constexpr std::string_view kNoResolve = ",no-resolve";
+/// alternation order of "DOMAIN(?:-(?:SUFFIX|KEYWORD))?|IP-CIDR6?|USER-AGENT"
+constexpr std::string_view kQuanXGroupTypes[] = {"domain-suffix", "domain-keyword", "domain", "ip-cidr6", "ip-cidr", "user-agent"};
+
+/// \s without UCP
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+inline char toLowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+inline char toUpperAscii(char c)
+{
+    return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+/// length of "payload:\r?\n" starting at pos, 0 if it does not continue into a line break
+size_t payloadHeaderAt(std::string_view content, size_t pos)
+{
+    size_t end = pos + kPayloadHeader.size();
+    if(end < content.size() && content[end] == '\r')
+        end++;
+    return end < content.size() && content[end] == '\n' ? end + 1 - pos : 0;
+}
+
+/// "payload:\r?\n" was stripped wherever it appeared, but only one at a line start marks a Clash payload
+struct PayloadHeaders
+{
+    bool at_line_start = false;
+    bool whole_lines_only = true;
+};
+
+PayloadHeaders findPayloadHeaders(std::string_view content)
+{
+    PayloadHeaders headers;
+    size_t pos = 0;
+    while((pos = content.find(kPayloadHeader, pos)) != std::string_view::npos)
+    {
+        size_t length = payloadHeaderAt(content, pos);
+        if(!length)
+        {
+            pos++;
+            continue;
+        }
+        if(pos == 0 || content[pos - 1] == '\n')
+            headers.at_line_start = true;
+        else
+            headers.whole_lines_only = false;
+        pos += length;
+    }
+    return headers;
+}
+
+/// only needed when a header trails other text on its line, which joins two lines
+std::string stripPayloadHeaders(std::string_view content)
+{
+    std::string stripped;
+    stripped.reserve(content.size());
+    size_t begin = 0, pos = 0;
+    while((pos = content.find(kPayloadHeader, pos)) != std::string_view::npos)
+    {
+        size_t length = payloadHeaderAt(content, pos);
+        if(!length)
+        {
+            pos++;
+            continue;
+        }
+        stripped.append(content.substr(begin, pos - begin));
+        pos += length;
+        begin = pos;
+    }
+    stripped.append(content.substr(begin));
+    return stripped;
+}
+
+/// split on '\n' the way multiline ^/$ see lines; with skip_headers set, whole "payload:" lines are dropped
+void splitLines(std::string_view text, LineList &lines, bool skip_headers)
+{
+    lines.reserve(std::count(text.begin(), text.end(), '\n') + 1);
+    size_t begin = 0;
+    while(true)
+    {
+        size_t end = text.find('\n', begin);
+        if(end == std::string_view::npos)
+        {
+            lines.push_back(text.substr(begin));
+            return;
+        }
+        std::string_view line = text.substr(begin, end - begin);
+        if(!skip_headers || (line != "payload:" && line != "payload:\r"))
+            lines.push_back(line);
+        begin = end + 1;
+    }
+}
+
+/// advance over whitespace, crossing line breaks; false when the text ends first
+bool skipSpaces(const LineList &lines, size_t &line, size_t &col)
+{
+    while(true)
+    {
+        std::string_view text = lines[line];
+        while(col < text.size() && isSpace(text[col]))
+            col++;
+        if(col < text.size())
+            return true;
+        if(line + 1 >= lines.size())
+            return false;
+        line++;
+        col = 0;
+    }
+}
+
+/// ('|"?)(.*)\1$ keeps the inside of a value quoted on both ends, anything else verbatim
+std::string_view unquoteItem(std::string_view value)
+{
+    if(value.size() >= 2 && (value[0] == '\'' || value[0] == '"') && value.back() == value[0])
+        return value.substr(1, value.size() - 2);
+    return value;
+}
+
+/// "\s?^\s*-\s+('|"?)(.*)\1$" -> "\n$2": starting at a line break (or the very beginning), whitespace up to a
+/// '-' followed by more whitespace begins an item; its value is the rest of the line holding the next
+/// non-space character, and everything before it collapses into a single line break.
+/// emit() receives the lines of the substituted text in order, so nothing is assembled in between.
+template <typename Emit>
+void scanPayloadItems(const LineList &lines, Emit &&emit)
+{
+    size_t i = 0;
+    while(i < lines.size())
+    {
+        size_t line = i, col = 0;
+        bool item = skipSpaces(lines, line, col) && lines[line][col] == '-';
+        if(item)
+        {
+            col++;
+            item = col < lines[line].size() ? isSpace(lines[line][col]) : line + 1 < lines.size();
+        }
+        if(!item)
+        {
+            /// every later start up to this line runs into the same character, so they fail too
+            for(; i <= line; i++)
+                emit(lines[i]);
+            continue;
+        }
+        if(i == 0)
+            emit(std::string_view());
+        if(!skipSpaces(lines, line, col))
+        {
+            emit(std::string_view());
+            return;
+        }
+        emit(unquoteItem(lines[line].substr(col)));
+        i = line + 1;
+    }
+}
+
+/// exactly ^(25[0-5]|2[0-4]\d|[0-1]?\d?\d)(\.(25[0-5]|2[0-4]\d|[0-1]?\d?\d)){3}$
+bool isIPv4Literal(std::string_view address)
+{
+    size_t pos = 0;
+    for(int part = 0; part < 4; part++)
+    {
+        if(part)
+        {
+            if(pos >= address.size() || address[pos] != '.')
+                return false;
+            pos++;
+        }
+        size_t begin = pos;
+        int value = 0;
+        while(pos < address.size() && address[pos] >= '0' && address[pos] <= '9' && pos - begin < 3)
+            value = value * 10 + (address[pos++] - '0');
+        if(pos == begin || value > 255)
+            return false;
+    }
+    return pos == address.size();
+}
+
+/// one line of a domain/ipcidr payload; keeps the quirks of the trim()/trimWhitespace() sequence it replaces
+void appendPayloadRule(std::string &output, std::string_view line)
+{
+    size_t first = line.find_first_not_of(' ');
+    if(first != std::string_view::npos) /// trim() returns an all-space line untouched
+        line = line.substr(first, line.find_last_not_of(' ') - first + 1);
+    if(!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+
+    size_t comment = line.find("//");
+    if(comment != std::string_view::npos)
+    {
+        line = line.substr(0, comment);
+        size_t last = line.find_last_not_of(" \t\f\v\n\r");
+        line = last == std::string_view::npos ? std::string_view() : line.substr(0, last + 1);
+    }
+
+    if(!line.empty() && line[0] != ';' && line[0] != '#')
+    {
+        size_t slash = line.find('/');
+        if(slash != std::string_view::npos) /// ipcidr
+            output += isIPv4Literal(line.substr(0, slash)) ? "IP-CIDR," : "IP-CIDR6,";
+        else if(line[0] == '.' || (line.size() >= 2 && line[0] == '+' && line[1] == '.')) /// suffix
+        {
+            bool keyword_flag = false;
+            while(line.ends_with(".*"))
+            {
+                keyword_flag = true;
+                line.remove_suffix(2);
+            }
+            output += keyword_flag ? "DOMAIN-KEYWORD," : "DOMAIN-SUFFIX,";
+            size_t prefix = !line.empty() && line[0] == '.' ? 1 : 2;
+            line.remove_prefix(std::min(prefix, line.size()));
+        }
+        else
+            output += "DOMAIN,";
+    }
+    output += line;
+    output += '\n';
+}
+
+std::string joinPayloadItems(const LineList &lines, size_t size_hint)
+{
+    std::string output;
+    output.reserve(size_hint + 1);
+    bool first = true;
+    scanPayloadItems(lines, [&](std::string_view line)
+    {
+        if(!first)
+            output += '\n';
+        first = false;
+        output += line;
+    });
+    return output;
+}
+
+/// getline() never produced the empty piece after a trailing delimiter, and split on '\r'
+/// when the substituted text had no '\n' at all
+std::string convertPayloadRules(const LineList &lines, size_t size_hint)
+{
+    std::string output;
+    output.reserve(size_hint + lines.size() * 8);
+    std::string_view pending;
+    size_t count = 0;
+    scanPayloadItems(lines, [&](std::string_view line)
+    {
+        if(count++)
+            appendPayloadRule(output, pending);
+        pending = line;
+    });
+    if(count > 1)
+    {
+        if(!pending.empty())
+            appendPayloadRule(output, pending);
+        return output;
+    }
+    size_t begin = 0;
+    while(begin < pending.size())
+    {
+        size_t end = pending.find('\r', begin);
+        if(end == std::string_view::npos)
+            end = pending.size();
+        appendPayloadRule(output, pending.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return output;
+}
+
+/// caseless prefix the way PCRE2 folds in UTF mode: ASCII, plus U+017F for 's' and U+212A for 'k';
+/// returns the end of the prefix or npos
+size_t foldedPrefix(std::string_view text, size_t pos, std::string_view word)
+{
+    for(char expected : word)
+    {
+        if(pos < text.size() && toLowerAscii(text[pos]) == expected)
+            pos++;
+        else if(expected == 's' && text.substr(pos, 2) == "\xC5\xBF")
+            pos += 2;
+        else if(expected == 'k' && text.substr(pos, 3) == "\xE2\x84\xAA")
+            pos += 3;
+        else
+            return std::string_view::npos;
+    }
+    return pos;
+}
+
+/// "^(?i:host)" -> "DOMAIN", then "^(?i:ip6-cidr)" -> "IP-CIDR6"
+std::string_view renameQuanXType(std::string_view line, std::string &scratch)
+{
+    size_t end = foldedPrefix(line, 0, "host");
+    const char *type = "DOMAIN";
+    if(end == std::string_view::npos)
+    {
+        end = foldedPrefix(line, 0, "ip6-cidr");
+        type = "IP-CIDR6";
+    }
+    if(end == std::string_view::npos)
+        return line;
+    scratch.assign(type);
+    scratch.append(line.substr(end));
+    return scratch;
+}
+
+/// \U of the extended replacement; PCRE2 maps U+017F, the only non-ASCII lower case letter the types
+/// can hold, to its other case 's' rather than 'S'
+void appendUpper(std::string &output, std::string_view text)
+{
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        if(text.substr(i, 2) == "\xC5\xBF")
+        {
+            output += 's';
+            i++;
+        }
+        else
+            output += toUpperAscii(text[i]);
+    }
+}
+
+/// "^((?i:DOMAIN(?:-(?:SUFFIX|KEYWORD))?|IP-CIDR6?|USER-AGENT),)\s*?(\S*?)(?:,(?!no-resolve).*?)(,no-resolve)?$"
+/// -> "\U$1\E$2${3:-}": drops the policy group. The lazy \s*? only succeeds after the whole whitespace run,
+/// which may cross line breaks, so the rule can end on a later line (last is moved there).
+bool appendQuanXRule(std::string &output, const LineList &lines, std::string_view head, size_t &last, std::string &scratch)
+{
+    size_t type_end = std::string_view::npos;
+    for(std::string_view type : kQuanXGroupTypes)
+    {
+        size_t end = foldedPrefix(head, 0, type);
+        if(end != std::string_view::npos && end < head.size() && head[end] == ',')
+        {
+            type_end = end + 1;
+            break;
+        }
+    }
+    if(type_end == std::string_view::npos)
+        return false;
+
+    size_t line = last, col = type_end;
+    std::string_view value = head;
+    while(col < value.size() && isSpace(value[col]))
+        col++;
+    if(col == value.size())
+    {
+        if(last + 1 >= lines.size())
+            return false;
+        line = last + 1;
+        col = 0;
+        if(!skipSpaces(lines, line, col))
+            return false;
+        /// a renamed line starts with its type, so the column stays valid
+        value = renameQuanXType(lines[line], scratch);
+    }
+
+    size_t run_end = col;
+    while(run_end < value.size() && !isSpace(value[run_end]))
+        run_end++;
+    size_t comma = col;
+    while(comma < run_end && (value[comma] != ',' || value.substr(comma + 1, 10) == "no-resolve"))
+        comma++;
+    if(comma == run_end)
+        return false;
+
+    appendUpper(output, head.substr(0, type_end));
+    output += value.substr(col, comma - col);
+    if(value.size() >= comma + 1 + kNoResolve.size() && value.ends_with(kNoResolve))
+        output += kNoResolve;
+    last = line;
+    return true;
+}
+
+std::string convertQuanXList(std::string_view content)
+{
+    LineList lines;
+    splitLines(content, lines, false);
+    std::string output, head_scratch, value_scratch;
+    output.reserve(content.size());
+    size_t i = 0;
+    while(i < lines.size())
+    {
+        std::string_view head = renameQuanXType(lines[i], head_scratch);
+        size_t last = i;
+        if(!appendQuanXRule(output, lines, head, last, value_scratch))
+            output += head;
+        if(last + 1 < lines.size())
+            output += '\n';
+        i = last + 1;
+    }
+    return output;
+}
+
+} // namespace
+
+std::string scanRuleset(std::string_view content, int type)
+{
+    /// Target: Surge type,pattern[,flag]
+    /// Source: QuanX type,pattern[,group]
+    ///         Clash payload:\n  - 'ipcidr/domain/classic(Surge-like)'
+
+    /// every former regex step left invalid UTF-8 untouched
+    if(type == RULESET_SURGE || !regValidUTF8(content))
+        return std::string(content);
+
+    PayloadHeaders headers = findPayloadHeaders(content);
+    if(!headers.at_line_start) /// QuanX
+        return convertQuanXList(content);
+
+    /// Clash
+    std::string stripped;
+    if(!headers.whole_lines_only)
+        stripped = stripPayloadHeaders(content);
+    LineList lines;
+    splitLines(headers.whole_lines_only ? content : std::string_view(stripped), lines, headers.whole_lines_only);
+    if(type == RULESET_CLASH_CLASSICAL) /// classical type
+        return joinPayloadItems(lines, content.size());
+    return convertPayloadRules(lines, content.size());
+}
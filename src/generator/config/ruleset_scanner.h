@@ -0,0 +1,11 @@
+#ifndef RULESET_SCANNER_H_INCLUDED
+#define RULESET_SCANNER_H_INCLUDED
+
+#include <string>
+#include <string_view>
+
+/// convert a Clash payload or QuanX list into Surge syntax in one pass over its lines,
+/// producing the same text as the regex pipeline it replaced
+std::string scanRuleset(std::string_view content, int type);
+
+#endif // RULESET_SCANNER_H_INCLUDED
@@ -1,5 +1,4 @@
 #include <algorithm>
-#include <climits>
 #include <cmath>
 #include <iostream>
 #include <numeric>
@@ -8,6 +7,8 @@
 
 #include "config/regmatch.h"
 #include "external_rules.h"
+#include "generator/config/clash_writer.h"
+#include "generator/config/regmatch_program.h"
 #include "generator/config/subexport.h"
 #include "generator/template/templates.h"
 #include "handler/settings.h"
@@ -15,6 +16,7 @@
 #include "parser/config/proxy.h"
 #include "parser/param_compat.h"
 #include "ruleconvert.h"
+#include "script/script_cache.h"
 #include "script/script_quickjs.h"
 #include "utils/bitwise.h"
 #include "utils/file_extra.h"
@@ -43,10 +45,11 @@ static bool splitRenameGroupRule(const std::string &match,
 static YAML::Node buildProviderProxyNameOverride(const ProxyProvider &provider,
                                                  const extra_settings &ext) {
   YAML::Node proxy_name_node(YAML::NodeType::Sequence);
-  if (!ext.rename_for_providers || ext.rename_array.empty())
+  if (!ext.rename_for_providers || !ext.rename_program)
     return proxy_name_node;
 
-  for (const RegexMatchConfig &rule : ext.rename_array) {
+  for (const RegexMatchRule &compiled : ext.rename_program->rules) {
+    const RegexMatchConfig &rule = compiled.config;
     if (!rule.Script.empty() || rule.Match.empty())
       continue;
 
@@ -75,87 +78,6 @@ static YAML::Node buildProviderProxyNameOverride(const ProxyProvider &provider,
   return proxy_name_node;
 }
 
-// Helper function to insert proxy-providers before proxy-groups
-static void insertProxyProvidersBeforeGroups(std::string &yaml_str,
-                                             const std::string &providers_yaml,
-                                             bool new_field_name) {
-  std::string providers_content = providers_yaml;
-  if (providers_content.find("---") == 0) {
-    size_t newline_pos = providers_content.find('\n');
-    if (newline_pos != std::string::npos) {
-      providers_content = providers_content.substr(newline_pos + 1);
-    }
-  }
-
-  // 为每一行添加2个空格的缩进（YAML格式要求）
-  std::string indented_content;
-  std::istringstream stream(providers_content);
-  std::string line;
-  while (std::getline(stream, line)) {
-    if (!line.empty()) {
-      indented_content += "  " + line + "\n"; // 添加2个空格缩进
-    } else {
-      indented_content += "\n";
-    }
-  }
-
-  std::string providers_str = "proxy-providers:\n" + indented_content;
-  // 确保末尾有换行符，避免与 proxy-groups 连在一起
-  if (!providers_str.empty() && providers_str.back() != '\n') {
-    providers_str += "\n";
-  }
-  std::string groups_key = new_field_name ? "proxy-groups:" : "Proxy Group:";
-
-  size_t groups_pos = yaml_str.find(groups_key);
-  if (groups_pos != std::string::npos) {
-    yaml_str.insert(groups_pos, providers_str);
-  }
-}
-
-// Helper function to insert proxies before proxy-groups
-static void insertProxiesBeforeTarget(std::string &yaml_str,
-                                      const std::string &proxies_yaml,
-                                      bool new_field_name) {
-  std::string proxies_content = proxies_yaml;
-  // 移除 YAML 文档分隔符 "---"
-  if (proxies_content.find("---") == 0) {
-    size_t newline_pos = proxies_content.find('\n');
-    if (newline_pos != std::string::npos) {
-      proxies_content = proxies_content.substr(newline_pos + 1);
-    }
-  }
-
-  // 为每一行添加2个空格的缩进（YAML格式要求）
-  std::string indented_content;
-  std::istringstream stream(proxies_content);
-  std::string line;
-  while (std::getline(stream, line)) {
-    if (!line.empty()) {
-      indented_content += "  " + line + "\n";
-    } else {
-      indented_content += "\n";
-    }
-  }
-
-  // 构建完整的 proxies 字符串
-  std::string proxies_key = new_field_name ? "proxies" : "Proxy";
-  std::string proxies_str = proxies_key + ":\n" + indented_content;
-
-  // 确保末尾有换行符
-  if (!proxies_str.empty() && proxies_str.back() != '\n') {
-    proxies_str += "\n";
-  }
-
-  // 始终在 proxy-groups 之前插入
-  // 这样顺序是：proxy-providers → proxies → proxy-groups
-  std::string target_key = new_field_name ? "proxy-groups:" : "Proxy Group:";
-
-  size_t target_pos = yaml_str.find(target_key);
-  if (target_pos != std::string::npos) {
-    yaml_str.insert(target_pos, proxies_str);
-  }
-}
-
 const string_array clashr_protocols = {"origin",          "auth_sha1_v4",
                                        "auth_aes128_md5", "auth_aes128_sha1",
                                        "auth_chain_a",    "auth_chain_b"};
@@ -209,89 +131,9 @@ std::string vmessLinkConstruct(const std::string &remarks,
   return sb.GetString();
 }
 
-bool matchRange(const std::string &range, int target) {
-  string_array vArray = split(range, ",");
-  bool match = false;
-  std::string range_begin_str, range_end_str;
-  int range_begin, range_end;
-  static const std::string reg_num = "-?\\d+", reg_range = "(\\d+)-(\\d+)",
-                           reg_not = "\\!-?(\\d+)",
-                           reg_not_range = "\\!(\\d+)-(\\d+)",
-                           reg_less = "(\\d+)-", reg_more = "(\\d+)\\+";
-  for (std::string &x : vArray) {
-    if (regMatch(x, reg_num)) {
-      if (to_int(x, INT_MAX) == target)
-        match = true;
-    } else if (regMatch(x, reg_range)) {
-      regGetMatch(x, reg_range, 3, 0, &range_begin_str, &range_end_str);
-      range_begin = to_int(range_begin_str, INT_MAX);
-      range_end = to_int(range_end_str, INT_MIN);
-      if (target >= range_begin && target <= range_end)
-        match = true;
-    } else if (regMatch(x, reg_not)) {
-      match = true;
-      if (to_int(regReplace(x, reg_not, "$1"), INT_MAX) == target)
-        match = false;
-    } else if (regMatch(x, reg_not_range)) {
-      match = true;
-      regGetMatch(x, reg_range, 3, 0, &range_begin_str, &range_end_str);
-      range_begin = to_int(range_begin_str, INT_MAX);
-      range_end = to_int(range_end_str, INT_MIN);
-      if (target >= range_begin && target <= range_end)
-        match = false;
-    } else if (regMatch(x, reg_less)) {
-      if (to_int(regReplace(x, reg_less, "$1"), INT_MAX) >= target)
-        match = true;
-    } else if (regMatch(x, reg_more)) {
-      if (to_int(regReplace(x, reg_more, "$1"), INT_MIN) <= target)
-        match = true;
-    }
-  }
-  return match;
-}
-
 bool applyMatcher(const std::string &rule, std::string &real_rule,
                   const Proxy &node) {
-  std::string target, ret_real_rule;
-  static const std::string
-      groupid_regex = R"(^!!(?:GROUPID|INSERT)=([\d\-+!,]+)(?:!!(.*))?$)",
-      group_regex = R"(^!!(?:GROUP)=(.+?)(?:!!(.*))?$)";
-  static const std::string type_regex = R"(^!!(?:TYPE)=(.+?)(?:!!(.*))?$)",
-                           port_regex = R"(^!!(?:PORT)=(.+?)(?:!!(.*))?$)",
-                           server_regex = R"(^!!(?:SERVER)=(.+?)(?:!!(.*))?$)";
-  static const std::map<ProxyType, const char *> types = {
-      {ProxyType::Shadowsocks, "SS"},      {ProxyType::ShadowsocksR, "SSR"},
-      {ProxyType::VMess, "VMESS"},         {ProxyType::Trojan, "TROJAN"},
-      {ProxyType::Snell, "SNELL"},         {ProxyType::HTTP, "HTTP"},
-      {ProxyType::HTTPS, "HTTPS"},         {ProxyType::SOCKS5, "SOCKS5"},
-      {ProxyType::WireGuard, "WIREGUARD"}, {ProxyType::VLESS, "VLESS"},
-      {ProxyType::Hysteria, "HYSTERIA"},   {ProxyType::Hysteria2, "HYSTERIA2"}};
-  if (startsWith(rule, "!!GROUP=")) {
-    regGetMatch(rule, group_regex, 3, 0, &target, &ret_real_rule);
-    real_rule = ret_real_rule;
-    return regFind(node.Group, target);
-  } else if (startsWith(rule, "!!GROUPID=") || startsWith(rule, "!!INSERT=")) {
-    int dir = startsWith(rule, "!!INSERT=") ? -1 : 1;
-    regGetMatch(rule, groupid_regex, 3, 0, &target, &ret_real_rule);
-    real_rule = ret_real_rule;
-    return matchRange(target, dir * node.GroupId);
-  } else if (startsWith(rule, "!!TYPE=")) {
-    regGetMatch(rule, type_regex, 3, 0, &target, &ret_real_rule);
-    real_rule = ret_real_rule;
-    if (node.Type == ProxyType::Unknown)
-      return false;
-    return regMatch(types.at(node.Type), target);
-  } else if (startsWith(rule, "!!PORT=")) {
-    regGetMatch(rule, port_regex, 3, 0, &target, &ret_real_rule);
-    real_rule = ret_real_rule;
-    return matchRange(target, node.Port);
-  } else if (startsWith(rule, "!!SERVER=")) {
-    regGetMatch(rule, server_regex, 3, 0, &target, &ret_real_rule);
-    real_rule = ret_real_rule;
-    return regFind(node.Hostname, target);
-  } else
-    real_rule = rule;
-  return true;
+  return parseNodeMatcher(rule, real_rule).matches(node);
 }
 
 static bool parseProviderGroupIdMatcher(const std::string &rule,
@@ -349,10 +191,9 @@ void processRemark(std::string &remark, const RemarkSet &used_remarks,
   remark = tempRemark;
 }
 
-void groupGenerate(const std::string &rule, std::vector<Proxy> &nodelist,
+void groupGenerate(const std::string &rule, NodeIndex &node_index,
                    string_array &filtered_nodelist, bool add_direct,
                    extra_settings &ext) {
-  std::string real_rule;
   if (startsWith(rule, "[]") && add_direct) {
     filtered_nodelist.emplace_back(rule.substr(2));
   }
@@ -361,13 +202,12 @@ void groupGenerate(const std::string &rule, std::vector<Proxy> &nodelist,
     script_safe_runner(
         ext.js_runtime, ext.js_context,
         [&](qjs::Context &ctx) {
-          std::string script = fileGet(rule.substr(7), true);
+          std::string script = script_file_source(rule.substr(7), true);
           try {
-            ctx.eval(script);
             auto filter =
                 (std::function<std::string(const std::vector<Proxy> &)>)
-                    ctx.eval("filter");
-            std::string result_list = filter(nodelist);
+                    script_function(ctx, script, "filter");
+            std::string result_list = filter(node_index.nodes());
             filtered_nodelist = split(regTrim(result_list), "\n");
           } catch (qjs::exception) {
             script_print_stack(ctx);
@@ -377,20 +217,16 @@ void groupGenerate(const std::string &rule, std::vector<Proxy> &nodelist,
   }
 #endif // NO_JS_RUNTIME
   else {
-    std::unordered_set<std::string> seen(filtered_nodelist.begin(),
-                                         filtered_nodelist.end());
-    for (Proxy &x : nodelist) {
-      if (applyMatcher(rule, real_rule, x) &&
-          (real_rule.empty() || regFind(x.Remark, real_rule)) &&
-          seen.insert(x.Remark).second)
-        filtered_nodelist.emplace_back(x.Remark);
-    }
+    node_index.appendRemarks(rule, filtered_nodelist);
   }
 }
 
-void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
-                  const ProxyGroupConfigs &extra_proxy_group, bool clashR,
-                  extra_settings &ext) {
+/// with a writer, proxies, providers and groups go to it instead of yamlnode,
+/// which keeps a null proxy group list to mark where they belong
+static void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
+                         const ProxyGroupConfigs &extra_proxy_group,
+                         bool clashR, extra_settings &ext,
+                         ClashYamlWriter *writer) {
   YAML::Node proxies, original_groups;
   std::vector<Proxy> nodelist;
   RemarkSet used_remarks;
@@ -422,6 +258,13 @@ void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
     break;
   }
 
+  auto add_proxy = [&](const YAML::Node &proxy) {
+    if (writer)
+      writer->addProxy(proxy);
+    else
+      proxies.push_back(proxy);
+  };
+
   for (Proxy &x : nodes) {
     YAML::Node singleproxy;
 
@@ -519,7 +362,7 @@ void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
       // CRITICAL: Add the node to output before continuing!
       // Force Flow style for consistent, compact output
       singleproxy.SetStyle(YAML::EmitterStyle::Flow);
-      proxies.push_back(singleproxy);
+      add_proxy(singleproxy);
       nodelist.emplace_back(x);
       used_remarks.emplace(x.Remark);
 
@@ -959,7 +802,7 @@ void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
       singleproxy.SetStyle(YAML::EmitterStyle::Block);
     else
       singleproxy.SetStyle(YAML::EmitterStyle::Flow);
-    proxies.push_back(singleproxy);
+    add_proxy(singleproxy);
     used_remarks.emplace(x.Remark);
     nodelist.emplace_back(x);
   }
@@ -976,7 +819,10 @@ void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
 
   // 只有当存在节点时才写入 proxies 字段
   // 纯 proxy-provider 模式下不生成 proxies 字段（模板中已移除占位符）
-  if (!nodes.empty() || proxies.size() > 0) {
+  if (writer) {
+    if (!nodes.empty() || writer->proxyCount() > 0)
+      writer->defineProxies();
+  } else if (!nodes.empty() || proxies.size() > 0) {
     if (ext.clash_new_field_name)
       yamlnode["proxies"] = proxies;
     else
@@ -1044,13 +890,17 @@ void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
       provider_node[p.name] = single_provider;
     }
 
-    yamlnode["proxy-providers"] = provider_node;
+    if (writer)
+      writer->setProviders(provider_node);
+    else
+      yamlnode["proxy-providers"] = provider_node;
     writeLog(0,
              "已生成 " + std::to_string(ext.providers.size()) +
                  " 个 proxy provider。",
              LOG_LEVEL_INFO);
   }
 
+  NodeIndex node_index(nodelist);
   for (const ProxyGroupConfig &x : extra_proxy_group) {
     YAML::Node singlegroup;
     string_array filtered_nodelist;
@@ -1088,7 +938,7 @@ void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
       singlegroup["disable-udp"] = x.DisableUdp.get();
 
     for (const auto &y : x.Proxies)
-      groupGenerate(y, nodelist, filtered_nodelist, true, ext);
+      groupGenerate(y, node_index, filtered_nodelist, true, ext);
 
     // 对于 proxy-provider 模式的处理
     if (ext.use_proxy_provider && !ext.providers.empty()) {
@@ -1160,6 +1010,10 @@ void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
     else
       singlegroup.SetStyle(YAML::EmitterStyle::Flow);
 
+    if (writer) {
+      writer->addGroup(x.Name, singlegroup);
+      continue;
+    }
     bool replace_flag = false;
     for (auto &&original_group : original_groups) {
       if (original_group["name"].as<std::string>() == x.Name) {
@@ -1181,6 +1035,12 @@ void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
     yamlnode["Proxy Group"] = original_groups;
 }
 
+void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
+                  const ProxyGroupConfigs &extra_proxy_group, bool clashR,
+                  extra_settings &ext) {
+  proxyToClash(nodes, yamlnode, extra_proxy_group, clashR, ext, nullptr);
+}
+
 void formatterShortId(std::string &input) {
   std::string target = "short-id:";
   size_t startPos = input.find(target);
@@ -1216,50 +1076,28 @@ std::string proxyToClash(std::vector<Proxy> &nodes,
                          const std::string &base_conf,
                          std::vector<RulesetContent> &ruleset_content_array,
                          const ProxyGroupConfigs &extra_proxy_group,
-                         bool clashR, extra_settings &ext) {
+                         bool clashR, extra_settings &ext,
+                         const YAML::Node *parsed_base) {
   YAML::Node yamlnode;
 
   try {
-    yamlnode = YAML::Load(base_conf);
+    yamlnode = parsed_base ? YAML::Clone(*parsed_base) : YAML::Load(base_conf);
   } catch (std::exception &e) {
     writeLog(0, std::string("Clash 基础配置加载失败：") + e.what(),
              LOG_LEVEL_ERROR);
     return "";
   }
 
-  proxyToClash(nodes, yamlnode, extra_proxy_group, clashR, ext);
-
-  // 关键修复：在所有早期返回之前提取 proxy-providers
-  // 这样所有返回路径都会使用正确的顺序
-  std::string proxy_providers_yaml;
-  if (yamlnode["proxy-providers"].IsDefined()) {
-    YAML::Node providers_node = yamlnode["proxy-providers"];
-    proxy_providers_yaml = YAML::Dump(providers_node);
-    yamlnode.remove("proxy-providers"); // 从 yamlnode 中移除
-  }
-
-  // 提取 proxies 字段，用于手动控制输出顺序
-  std::string proxies_yaml;
-  std::string proxies_field_name =
-      ext.clash_new_field_name ? "proxies" : "Proxy";
-  if (yamlnode[proxies_field_name].IsDefined()) {
-    YAML::Node proxies_node = yamlnode[proxies_field_name];
-    proxies_yaml = YAML::Dump(proxies_node);
-    yamlnode.remove(proxies_field_name); // 从 yamlnode 中移除
-  }
-
-  auto dump_with_extracted_fields = [&]() {
-    std::string result = YAML::Dump(yamlnode);
-    if (!proxy_providers_yaml.empty()) {
-      insertProxyProvidersBeforeGroups(result, proxy_providers_yaml,
-                                       ext.clash_new_field_name);
-    }
-    if (!proxies_yaml.empty()) {
-      insertProxiesBeforeTarget(result, proxies_yaml,
-                                ext.clash_new_field_name);
-    }
-    return result;
-  };
+  /// proxy-providers and proxies are written right before the proxy group
+  /// list however the base document orders them
+  ClashYamlWriter writer(ext.clash_new_field_name,
+                         ext.clash_proxies_style == "compact",
+                         ext.clash_proxy_groups_style == "compact");
+  proxyToClash(nodes, yamlnode, extra_proxy_group, clashR, ext,
+               ext.nodelist ? nullptr : &writer);
+  if (ext.nodelist)
+    return YAML::Dump(yamlnode);
+  writer.takeSections(yamlnode);
 
   const bool has_external_rules =
       !ext.rule_prepend.empty() || !ext.rule_append.empty();
@@ -1292,10 +1130,6 @@ std::string proxyToClash(std::vector<Proxy> &nodes,
     return true;
   };
 
-  if (ext.nodelist) {
-    return dump_with_extracted_fields();
-  }
-
   /*
   if(ext.enable_rule_generator)
       rulesetToClash(yamlnode, ruleset_content_array,
@@ -1309,7 +1143,7 @@ std::string proxyToClash(std::vector<Proxy> &nodes,
       if (!merge_external_rules({}))
         return "";
     }
-    return dump_with_extracted_fields();
+    return writer.compose(yamlnode);
   }
 
   if (!ext.managed_config_prefix.empty() || ext.clash_script) {
@@ -1336,7 +1170,7 @@ std::string proxyToClash(std::vector<Proxy> &nodes,
       if (!merge_external_rules(generated_rules))
         return "";
     }
-    return dump_with_extracted_fields();
+    return writer.compose(yamlnode);
   }
 
   if (has_external_rules) {
@@ -1350,114 +1184,35 @@ std::string proxyToClash(std::vector<Proxy> &nodes,
     yamlnode.remove(rules_field_name);
     if (!merge_external_rules(generated_rules))
       return "";
-    return dump_with_extracted_fields();
+    return writer.compose(yamlnode);
   }
 
-  std::string output_content =
+  const std::string rules =
       rulesetToClashStr(yamlnode, ruleset_content_array,
                         ext.overwrite_original_rules, ext.clash_new_field_name,
                         ext.rule_stats);
-
-  // 提取 proxy-providers，手动控制输出顺序
-  // 使用之前在 998-1002 行已提取的 proxy_providers_yaml
-  std::string proxy_providers_str;
-  if (!proxy_providers_yaml.empty()) {
-    writeLog(0, "正在使用先前提取的 proxy-providers", LOG_LEVEL_INFO);
-
-    // proxy_providers_yaml 已经是 YAML::Dump 的结果
-    // 需要移除可能的文档分隔符 "---"
-    std::string content = proxy_providers_yaml;
-    size_t start_pos = 0;
-    if (content.find("---") == 0) {
-      size_t newline_pos = content.find('\n');
-      if (newline_pos != std::string::npos) {
-        start_pos = newline_pos + 1;
-      }
-    }
-
-    if (start_pos < content.length()) {
-      content = content.substr(start_pos);
-
-      // 为每一行添加 2 个空格的缩进（YAML 格式要求）
-      std::string indented_content;
-      std::istringstream stream(content);
-      std::string line;
-      while (std::getline(stream, line)) {
-        if (!line.empty()) {
-          indented_content += "  " + line + "\n"; // 添加 2 个空格缩进
-        } else {
-          indented_content += "\n";
-        }
-      }
-
-      proxy_providers_str = "proxy-providers:\n" + indented_content;
-
-      // 确保末尾有换行符，避免与 proxy-groups 连在一起
-      if (!proxy_providers_str.empty() && proxy_providers_str.back() != '\n') {
-        proxy_providers_str += "\n";
-      }
-
-      writeLog(0,
-               "已准备待插入的 proxy-providers，长度：" +
-                   std::to_string(proxy_providers_str.length()),
-               LOG_LEVEL_INFO);
-    }
-  } else {
-    writeLog(0, "没有需要插入的 proxy-providers", LOG_LEVEL_INFO);
-  }
-
-  std::string yamlnode_str = YAML::Dump(yamlnode);
-
-  // 在 proxy-groups 之前插入 proxy-providers
-  if (!proxy_providers_str.empty()) {
-    writeLog(
-        0,
-        "正在尝试将 proxy-providers 插入到 proxy-groups 前，大小：" +
-            std::to_string(proxy_providers_str.length()),
-        LOG_LEVEL_INFO);
-
-    std::string proxy_groups_key =
-        ext.clash_new_field_name ? "proxy-groups:" : "Proxy Group:";
-    size_t groups_pos = yamlnode_str.find(proxy_groups_key);
-
-    if (groups_pos != std::string::npos) {
-      writeLog(0,
-               "已在位置 " + std::to_string(groups_pos) + " 找到 proxy-groups",
-               LOG_LEVEL_INFO);
-      // 在 proxy-groups: 这一行之前插入
-      yamlnode_str.insert(groups_pos, proxy_providers_str);
-      writeLog(0, "已将 proxy-providers 插入到 proxy-groups 前",
-               LOG_LEVEL_INFO);
-    } else {
-      writeLog(0, "未找到 proxy-groups，将追加到末尾",
-               LOG_LEVEL_WARNING);
-      // 如果找不到 proxy-groups，尝试在文件末尾插入
-      yamlnode_str += proxy_providers_str;
-    }
-  } else {
-    writeLog(0, "proxy-providers 内容为空，没有内容需要插入",
-             LOG_LEVEL_WARNING);
-  }
-
-  // 插入 proxies 字段（在 proxy-groups 之前）
-  if (!proxies_yaml.empty()) {
-    insertProxiesBeforeTarget(yamlnode_str, proxies_yaml,
-                              ext.clash_new_field_name);
-  }
-
-  output_content.insert(0, yamlnode_str);
+  std::string output_content = writer.compose(yamlnode, rules);
   replaceAll(output_content, "!<str> ", "");
   formatterShortId(output_content);
   return output_content;
 }
 
+/// copies into a new buffer once, replacing in place moved the rest of the
+/// document for every match
 void replaceAll(std::string &input, const std::string &search,
                 const std::string &replace) {
-  size_t pos = 0;
-  while ((pos = input.find(search, pos)) != std::string::npos) {
-    input.replace(pos, search.length(), replace);
-    pos += replace.length();
-  }
+  size_t pos = input.find(search);
+  if (search.empty() || pos == std::string::npos)
+    return;
+  std::string result;
+  result.reserve(input.size());
+  size_t last = 0;
+  for (; pos != std::string::npos; pos = input.find(search, last)) {
+    result.append(input, last, pos - last).append(replace);
+    last = pos + search.size();
+  }
+  result.append(input, last, std::string::npos);
+  input.swap(result);
 }
 
 // peer = (public-key = bmXOC+F1FxEMF9dyiK2H5/1SUtzH0JuVo51h2wPfgyo=,
@@ -1746,6 +1501,7 @@ std::string proxyToSurge(std::vector<Proxy> &nodes,
 
   ini.set_current_section("Proxy Group");
   ini.erase_section();
+  NodeIndex node_index(nodelist);
   for (const ProxyGroupConfig &x : extra_proxy_group) {
     string_array filtered_nodelist;
     std::string group;
@@ -1770,7 +1526,7 @@ std::string proxyToSurge(std::vector<Proxy> &nodes,
     }
 
     for (const auto &y : x.Proxies)
-      groupGenerate(y, nodelist, filtered_nodelist, true, ext);
+      groupGenerate(y, node_index, filtered_nodelist, true, ext);
 
     if (filtered_nodelist.empty())
       filtered_nodelist.emplace_back("DIRECT");
@@ -2244,6 +2000,7 @@ void proxyToQuan(std::vector<Proxy> &nodes, INIReader &ini,
   ini.set_current_section("POLICY");
   ini.erase_section();
 
+  NodeIndex node_index(nodelist);
   for (const ProxyGroupConfig &x : extra_proxy_group) {
     string_array filtered_nodelist;
     std::string type;
@@ -2285,7 +2042,7 @@ void proxyToQuan(std::vector<Proxy> &nodes, INIReader &ini,
     }
 
     for (const auto &y : x.Proxies)
-      groupGenerate(y, nodelist, filtered_nodelist, true, ext);
+      groupGenerate(y, node_index, filtered_nodelist, true, ext);
 
     if (filtered_nodelist.empty())
       filtered_nodelist.emplace_back("direct");
@@ -2524,6 +2281,7 @@ void proxyToQuanX(std::vector<Proxy> &nodes, INIReader &ini,
   ini.get_items(original_groups);
   ini.erase_section();
 
+  NodeIndex node_index(nodelist);
   for (const ProxyGroupConfig &x : extra_proxy_group) {
     std::string type;
     string_array filtered_nodelist;
@@ -2552,7 +2310,7 @@ void proxyToQuanX(std::vector<Proxy> &nodes, INIReader &ini,
 
     if (x.Type != ProxyGroupType::SSID) {
       for (const auto &y : x.Proxies)
-        groupGenerate(y, nodelist, filtered_nodelist, true, ext);
+        groupGenerate(y, node_index, filtered_nodelist, true, ext);
 
       if (filtered_nodelist.empty())
         filtered_nodelist.emplace_back("direct");
@@ -2809,6 +2567,7 @@ void proxyToMellow(std::vector<Proxy> &nodes, INIReader &ini,
 
   ini.set_current_section("EndpointGroup");
 
+  NodeIndex node_index(nodelist);
   for (const ProxyGroupConfig &x : extra_proxy_group) {
     string_array filtered_nodelist;
     url.clear();
@@ -2825,7 +2584,7 @@ void proxyToMellow(std::vector<Proxy> &nodes, INIReader &ini,
     }
 
     for (const auto &y : x.Proxies)
-      groupGenerate(y, nodelist, filtered_nodelist, false, ext);
+      groupGenerate(y, node_index, filtered_nodelist, false, ext);
 
     if (filtered_nodelist.empty()) {
       if (remarks_list.empty())
@@ -3094,6 +2853,7 @@ std::string proxyToLoon(std::vector<Proxy> &nodes, const std::string &base_conf,
   ini.get_items(original_groups);
   ini.erase_section();
 
+  NodeIndex node_index(nodelist);
   for (const ProxyGroupConfig &x : extra_proxy_group) {
     string_array filtered_nodelist;
     std::string group, group_extra;
@@ -3116,7 +2876,7 @@ std::string proxyToLoon(std::vector<Proxy> &nodes, const std::string &base_conf,
     }
 
     for (const auto &y : x.Proxies)
-      groupGenerate(y, nodelist, filtered_nodelist, true, ext);
+      groupGenerate(y, node_index, filtered_nodelist, true, ext);
 
     if (filtered_nodelist.empty())
       filtered_nodelist.emplace_back("DIRECT");
@@ -3726,6 +3486,7 @@ void proxyToSingBox(std::vector<Proxy> &nodes, rapidjson::Document &json,
     return;
   }
 
+  NodeIndex node_index(nodelist);
   for (const ProxyGroupConfig &x : extra_proxy_group) {
     string_array filtered_nodelist;
     std::string type;
@@ -3744,7 +3505,7 @@ void proxyToSingBox(std::vector<Proxy> &nodes, rapidjson::Document &json,
       continue;
     }
     for (const auto &y : x.Proxies)
-      groupGenerate(y, nodelist, filtered_nodelist, true, ext);
+      groupGenerate(y, node_index, filtered_nodelist, true, ext);
 
     if (filtered_nodelist.empty())
       filtered_nodelist.emplace_back("DIRECT");
@@ -3797,11 +3558,14 @@ std::string proxyToSingBox(std::vector<Proxy> &nodes,
                            const std::string &base_conf,
                            std::vector<RulesetContent> &ruleset_content_array,
                            const ProxyGroupConfigs &extra_proxy_group,
-                           extra_settings &ext) {
+                           extra_settings &ext,
+                           const rapidjson::Document *parsed_base) {
   using namespace rapidjson_ext;
   rapidjson::Document json;
 
-  if (!ext.nodelist) {
+  if (!ext.nodelist && parsed_base) {
+    json.CopyFrom(*parsed_base, json.GetAllocator());
+  } else if (!ext.nodelist) {
     json.Parse(base_conf.data());
     if (json.HasParseError()) {
       writeLog(
@@ -12,6 +12,7 @@
 #include "config/proxy_provider_interval.h"
 #include "config/proxy_provider_direct.h"
 #include "config/regmatch.h"
+#include "generator/config/regmatch_program.h"
 #include "parser/config/proxy.h"
 #include "ruleconvert.h"
 #include "utils/ini_reader/ini_reader.h"
@@ -42,9 +43,9 @@ struct extra_settings {
   string_array rule_prepend;
   string_array rule_append;
   std::string external_rule_error;
-  RegexMatchConfigs rename_array;
+  RegexMatchProgramPtr rename_program;
   bool rename_for_providers = false;
-  RegexMatchConfigs emoji_array;
+  RegexMatchProgramPtr emoji_program;
   bool add_emoji = false;
   bool remove_emoji = false;
   bool append_proxy_type = false;
@@ -86,11 +87,14 @@ struct extra_settings {
 #endif // NO_JS_RUNTIME
 };
 
+/// parsed_base, when given, is base_conf already parsed and is cloned instead
+/// of parsing base_conf again
 std::string proxyToClash(std::vector<Proxy> &nodes,
                          const std::string &base_conf,
                          std::vector<RulesetContent> &ruleset_content_array,
                          const ProxyGroupConfigs &extra_proxy_group,
-                         bool clashR, extra_settings &ext);
+                         bool clashR, extra_settings &ext,
+                         const YAML::Node *parsed_base = nullptr);
 void proxyToClash(std::vector<Proxy> &nodes, YAML::Node &yamlnode,
                   const ProxyGroupConfigs &extra_proxy_group, bool clashR,
                   extra_settings &ext);
@@ -139,7 +143,8 @@ std::string proxyToSingBox(std::vector<Proxy> &nodes,
                            const std::string &base_conf,
                            std::vector<RulesetContent> &ruleset_content_array,
                            const ProxyGroupConfigs &extra_proxy_group,
-                           extra_settings &ext);
+                           extra_settings &ext,
+                           const rapidjson::Document *parsed_base = nullptr);
 void replaceAll(std::string &input, const std::string &search,
                 const std::string &replace);
 #endif // SUBEXPORT_H_INCLUDED
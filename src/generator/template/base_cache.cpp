@@ -0,0 +1,129 @@
+#include <string>
+#include <string_view>
+
+#include "generator/template/base_cache.h"
+#include "handler/settings.h"
+#include "utils/xxhash.h"
+
+namespace
+{
+
+constexpr size_t kBaseCacheEntries = 64;
+constexpr size_t kBaseCacheBytes = 16 * 1024 * 1024;
+/// a parsed tree takes a few times the room of its text
+constexpr size_t kParsedSizeFactor = 4;
+
+ShardedLruCache<std::string, RenderedBase> base_cache(kBaseCacheEntries, kBaseCacheBytes);
+
+bool seesRequest(std::string_view tag)
+{
+    for(const char *name : {"request", "fetch", "include"})
+        if(tag.find(name) != std::string_view::npos)
+            return true;
+    return false;
+}
+
+std::string buildBaseCacheKey(const std::string &content, const template_args &vars, BaseFormat format,
+                              const std::string &include_scope, FetchContext context)
+{
+    std::string variables;
+    for(const string_map *map : {&vars.global_vars, &vars.local_vars})
+    {
+        for(const auto &[name, value] : *map)
+            variables.append(name).append(1, '\0').append(value).append(1, '\0');
+        variables += '\1';
+    }
+    /// the lengths go along with the hashes, as in ruleconvert's keys
+    return xxHash64Hex(content) + "-" + std::to_string(content.size()) + ":" + xxHash64Hex(variables) + "-" +
+           std::to_string(variables.size()) + ":" + std::to_string(static_cast<int>(format)) + ":" +
+           std::to_string(static_cast<int>(context)) + ":" + std::to_string(global.configGeneration) + ":" +
+           include_scope;
+}
+
+RenderedBase renderAndParse(const std::string &content, const template_args &vars, BaseFormat format,
+                            const std::string &include_scope, FetchContext context)
+{
+    RenderedBase base;
+    base.status = render_template(content, vars, base.content, include_scope, context);
+    if(base.status != 0)
+        return base;
+    /// a base that does not parse is reported by the generator, which parses the text again
+    switch(format)
+    {
+    case BaseFormat::Clash:
+        try
+        {
+            base.clash = YAML::Load(base.content);
+            base.parsed = true;
+        }
+        catch(std::exception &)
+        {
+        }
+        break;
+    case BaseFormat::SingBox:
+        base.singbox.Parse(base.content.data());
+        base.parsed = !base.singbox.HasParseError();
+        break;
+    case BaseFormat::Text:
+        break;
+    }
+    return base;
+}
+
+} // namespace
+
+bool base_template_is_static(const std::string &content)
+{
+    for(const char *open : {"{{", "{%"})
+    {
+        const std::string close = open[1] == '{' ? "}}" : "%}";
+        for(size_t pos = content.find(open); pos != std::string::npos; pos = content.find(open, pos))
+        {
+            size_t end = content.find(close, pos + 2);
+            if(end == std::string::npos || seesRequest(std::string_view(content).substr(pos, end - pos)))
+                return false;
+            pos = end + 2;
+        }
+    }
+    /// line statements, `#~#` at the start of a line
+    for(size_t line = 0; line < content.size();)
+    {
+        size_t end = content.find('\n', line);
+        if(end == std::string::npos)
+            end = content.size();
+        size_t first = content.find_first_not_of(" \t", line);
+        if(first < end && content.compare(first, 3, "#~#") == 0 &&
+           seesRequest(std::string_view(content).substr(first, end - first)))
+            return false;
+        line = end + 1;
+    }
+    return true;
+}
+
+RenderedBasePtr render_base(const std::string &content, const template_args &vars, BaseFormat format,
+                            const std::string &include_scope, FetchContext context)
+{
+    const bool cache_enabled = base_template_is_static(content);
+    const std::string key = cache_enabled ? buildBaseCacheKey(content, vars, format, include_scope, context) : "";
+    return base_cache.getOrCompute(
+        key, cache_enabled, [&]() { return renderAndParse(content, vars, format, include_scope, context); },
+        [&](const RenderedBase &base) -> ShardedLruCache<std::string, RenderedBase>::CacheSize
+        {
+            if(base.status != 0)
+                return std::nullopt;
+            return base.content.size() * (format == BaseFormat::Text ? 1 : kParsedSizeFactor);
+        });
+}
+
+int render_base_template(const std::string &content, const template_args &vars, std::string &output,
+                         const std::string &include_scope, FetchContext context)
+{
+    RenderedBasePtr base = render_base(content, vars, BaseFormat::Text, include_scope, context);
+    output = base->content;
+    return base->status;
+}
+
+LruCacheStats base_template_cache_stats()
+{
+    return base_cache.stats();
+}
@@ -0,0 +1,50 @@
+#ifndef BASE_CACHE_H_INCLUDED
+#define BASE_CACHE_H_INCLUDED
+
+#include <memory>
+#include <string>
+
+#include <yaml-cpp/yaml.h>
+
+#include "generator/template/templates.h"
+#include "handler/fetch_context.h"
+#include "utils/concurrent_lru_cache.h"
+#include "utils/rapidjson_extra.h"
+
+enum class BaseFormat
+{
+    Text,
+    Clash,
+    SingBox
+};
+
+/// a base config after render_template and, for Clash and sing-box, parsing. Shared between
+/// requests, so the trees are never handed out themselves: a request clones them.
+struct RenderedBase
+{
+    int status = 0; /// render_template's result, content holds its error when non-zero
+    std::string content;
+    bool parsed = false; /// clash or singbox holds content parsed
+    YAML::Node clash;
+    rapidjson::Document singbox;
+};
+
+using RenderedBasePtr = std::shared_ptr<const RenderedBase>;
+
+/// whether the template can see the request: the request variables, fetch() and includes are
+/// looked for inside its tags only, so a plain `include-all:` key does not count
+bool base_template_is_static(const std::string &content);
+
+/// render_template with the result kept per config generation and template variables when the
+/// template is static, which a base config usually is. Other templates render every time.
+RenderedBasePtr render_base(const std::string &content, const template_args &vars, BaseFormat format,
+                            const std::string &include_scope = "templates",
+                            FetchContext context = FetchContext::TrustedConfig);
+/// render_template's interface on top of render_base
+int render_base_template(const std::string &content, const template_args &vars, std::string &output,
+                         const std::string &include_scope = "templates",
+                         FetchContext context = FetchContext::TrustedConfig);
+
+LruCacheStats base_template_cache_stats();
+
+#endif // BASE_CACHE_H_INCLUDED
@@ -26,9 +26,22 @@ void CurlHandleLease::reset() {
   handle_ = nullptr;
 }
 
+void CurlHandleLease::recordTransfer() const {
+  if (pool_ && handle_)
+    pool_->recordTransfer(handle_);
+}
+
 CurlHandlePool::CurlHandlePool(size_t capacity)
     : capacity_(std::max<size_t>(1, capacity)) {
   idle_.reserve(capacity_);
+  share_ = curl_share_init();
+  if (!share_)
+    return;
+  curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lockShare);
+  curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlockShare);
+  curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
 }
 
 CurlHandlePool::~CurlHandlePool() {
@@ -41,6 +54,18 @@ CurlHandlePool::~CurlHandlePool() {
   cv_.notify_all();
   for (CURL *handle : handles)
     curl_easy_cleanup(handle);
+  /// fails while a lease still holds a handle, which then keeps it alive
+  if (share_ && curl_share_cleanup(share_) == CURLSHE_OK)
+    share_ = nullptr;
+}
+
+void CurlHandlePool::lockShare(CURL *, curl_lock_data data, curl_lock_access,
+                               void *pool) {
+  static_cast<CurlHandlePool *>(pool)->share_mutexes_[data].lock();
+}
+
+void CurlHandlePool::unlockShare(CURL *, curl_lock_data data, void *pool) {
+  static_cast<CurlHandlePool *>(pool)->share_mutexes_[data].unlock();
 }
 
 CurlHandleLease CurlHandlePool::acquire() {
@@ -66,6 +91,31 @@ CurlHandleLease CurlHandlePool::acquire() {
     cv_.notify_one();
     return {};
   }
+  if (share_)
+    curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+  return CurlHandleLease(this, handle);
+}
+
+CurlHandleLease CurlHandlePool::acquireNow() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (stopping_)
+    return {};
+  if (!idle_.empty()) {
+    CURL *handle = idle_.back();
+    idle_.pop_back();
+    return CurlHandleLease(this, handle);
+  }
+
+  ++created_;
+  lock.unlock();
+  CURL *handle = curl_easy_init();
+  if (!handle) {
+    lock.lock();
+    --created_;
+    return {};
+  }
+  if (share_)
+    curl_easy_setopt(handle, CURLOPT_SHARE, share_);
   return CurlHandleLease(this, handle);
 }
 
@@ -75,11 +125,14 @@ void CurlHandlePool::release(CURL *handle) {
 
   curl_easy_setopt(handle, CURLOPT_COOKIELIST, "ALL");
   curl_easy_reset(handle);
+  /// reset drops every option, the share included
+  if (share_)
+    curl_easy_setopt(handle, CURLOPT_SHARE, share_);
 
   bool cleanup = false;
   {
     std::lock_guard<std::mutex> lock(mutex_);
-    if (stopping_) {
+    if (stopping_ || created_ > capacity_) {
       --created_;
       cleanup = true;
     } else {
@@ -92,11 +145,41 @@ void CurlHandlePool::release(CURL *handle) {
     cv_.notify_one();
 }
 
+void CurlHandlePool::recordTransfer(CURL *handle) {
+  long connects = 0;
+  if (curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects) !=
+      CURLE_OK)
+    return;
+  if (connects > 0) {
+    new_connections_ += static_cast<uint64_t>(connects);
+    return;
+  }
+  /// no new connection and a peer address: a cached connection carried it.
+  /// A transfer that failed before connecting has no address.
+  char *ip = nullptr;
+  if (curl_easy_getinfo(handle, CURLINFO_PRIMARY_IP, &ip) == CURLE_OK && ip &&
+      *ip)
+    ++reused_connections_;
+}
+
+CurlHandlePool::Stats CurlHandlePool::stats() const {
+  Stats stats;
+  stats.new_connections = new_connections_.load();
+  stats.reused_connections = reused_connections_.load();
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats.handles = created_;
+  return stats;
+}
+
 CurlHandlePool &globalCurlHandlePool(size_t configured_capacity) {
   static CurlHandlePool pool(configured_capacity);
   return pool;
 }
 
+CurlHandlePool::Stats curlHandlePoolStats(size_t configured_capacity) {
+  return globalCurlHandlePool(configured_capacity).stats();
+}
+
 size_t curlHandlePoolCapacity(size_t configured_capacity) {
   return globalCurlHandlePool(configured_capacity).capacity();
 }
@@ -1,8 +1,10 @@
 #ifndef CURL_HANDLE_POOL_H_INCLUDED
 #define CURL_HANDLE_POOL_H_INCLUDED
 
+#include <atomic>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <mutex>
 #include <vector>
 
@@ -21,6 +23,8 @@ public:
 
   CURL *get() const { return handle_; }
   explicit operator bool() const { return handle_ != nullptr; }
+  /// CurlHandlePool::recordTransfer for this handle
+  void recordTransfer() const;
 
 private:
   friend class CurlHandlePool;
@@ -32,22 +36,46 @@ private:
   CURL *handle_ = nullptr;
 };
 
+/// Every handle of a pool is attached to one share object holding the DNS
+/// cache and TLS sessions, so a ruleset host resolved or handshaken with by
+/// one request is reused by the next whichever handle serves it. Connections
+/// are left to the multi engine's cache, cookies are not shared.
 class CurlHandlePool {
 public:
+  struct Stats {
+    uint64_t new_connections = 0;
+    uint64_t reused_connections = 0;
+    uint64_t handles = 0;
+  };
+
   explicit CurlHandlePool(size_t capacity);
   CurlHandlePool(const CurlHandlePool &) = delete;
   CurlHandlePool &operator=(const CurlHandlePool &) = delete;
   ~CurlHandlePool();
 
   CurlHandleLease acquire();
+  /// acquire for a caller that must not wait, such as an async fetch or the
+  /// thread driving transfers: past the capacity a handle is made anyway and
+  /// closed on release, the multi engine's connection limit still applies
+  CurlHandleLease acquireNow();
   size_t capacity() const { return capacity_; }
+  /// counts the connection the last curl_easy_perform on handle made or reused
+  void recordTransfer(CURL *handle);
+  Stats stats() const;
 
 private:
   friend class CurlHandleLease;
   void release(CURL *handle);
+  static void lockShare(CURL *, curl_lock_data data, curl_lock_access,
+                        void *pool);
+  static void unlockShare(CURL *, curl_lock_data data, void *pool);
 
   const size_t capacity_;
-  std::mutex mutex_;
+  CURLSH *share_ = nullptr;
+  std::mutex share_mutexes_[CURL_LOCK_DATA_LAST];
+  std::atomic<uint64_t> new_connections_{0};
+  std::atomic<uint64_t> reused_connections_{0};
+  mutable std::mutex mutex_;
   std::condition_variable cv_;
   std::vector<CURL *> idle_;
   size_t created_ = 0;
@@ -55,6 +83,7 @@ private:
 };
 
 CurlHandlePool &globalCurlHandlePool(size_t configured_capacity);
+CurlHandlePool::Stats curlHandlePoolStats(size_t configured_capacity);
 size_t curlHandlePoolCapacity(size_t configured_capacity);
 
 #endif // CURL_HANDLE_POOL_H_INCLUDED
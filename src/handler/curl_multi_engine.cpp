@@ -0,0 +1,219 @@
+#include "handler/curl_multi_engine.h"
+#include "utils/bounded_executor.h"
+
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <memory>
+#include <utility>
+
+namespace {
+
+/// connections opened to one host at most, further transfers to it wait for
+/// one of them or share it as an HTTP/2 stream. webget counts a transfer's
+/// time limit from when it leaves that wait, not from its submission.
+constexpr size_t kMaxHostConnections = 6;
+/// the longest the engine sleeps with nothing to wake it
+constexpr int kIdlePollMs = 1000;
+/// completions store fetch cache entries and copy bodies; past the queue a
+/// completion runs on the engine thread, holding transfers back until it ends
+constexpr size_t kCompletionWorkers = 4;
+constexpr size_t kCompletionQueue = 1024;
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+constexpr bool kMultiEngineSupported = true;
+#else
+/// curl_multi_poll and curl_multi_wakeup came with 7.66 and 7.68, before them
+/// every transfer runs on its caller's thread as it always did
+constexpr bool kMultiEngineSupported = false;
+#endif
+
+void complete(const CurlMultiEngine::Completion &done, CURLcode code) {
+  try {
+    done(code);
+  } catch (...) {
+    /// a completion has nowhere to report to, keep the engine running
+  }
+}
+
+} // namespace
+
+CurlMultiEngine::CurlMultiEngine(size_t max_host_connections,
+                                 size_t max_total_connections) {
+  if (!kMultiEngineSupported)
+    return;
+  multi_ = curl_multi_init();
+  if (!multi_)
+    return;
+  curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    static_cast<long>(std::max<size_t>(1, max_host_connections)));
+  curl_multi_setopt(
+      multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+      static_cast<long>(std::max(max_host_connections, max_total_connections)));
+  completions_ =
+      std::make_unique<BoundedExecutor>(kCompletionWorkers, kCompletionQueue);
+  thread_ = std::thread([this] { run(); });
+}
+
+CurlMultiEngine::~CurlMultiEngine() {
+  if (!multi_)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+#if LIBCURL_VERSION_NUM >= 0x074400
+  curl_multi_wakeup(multi_);
+#endif
+  if (thread_.joinable())
+    thread_.join();
+  /// runs what the engine thread handed over before it stopped
+  completions_.reset();
+  curl_multi_cleanup(multi_);
+}
+
+void CurlMultiEngine::submit(CURL *handle, Completion done,
+                             std::chrono::milliseconds delay) {
+  bool inline_transfer = !multi_;
+  if (!inline_transfer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      inline_transfer = true;
+    } else {
+      pending_.push_back(Pending{handle, std::move(done),
+                                 std::chrono::steady_clock::now() + delay});
+    }
+  }
+  if (inline_transfer) {
+    if (delay.count() > 0)
+      std::this_thread::sleep_for(delay);
+    started_++;
+    const CURLcode code = curl_easy_perform(handle);
+    completed_++;
+    complete(done, code);
+    return;
+  }
+#if LIBCURL_VERSION_NUM >= 0x074400
+  curl_multi_wakeup(multi_);
+#endif
+}
+
+CURLcode CurlMultiEngine::perform(CURL *handle) {
+  if (!multi_ || onEngineThread()) {
+    started_++;
+    const CURLcode code = curl_easy_perform(handle);
+    completed_++;
+    return code;
+  }
+  auto result = std::make_shared<std::promise<CURLcode>>();
+  std::future<CURLcode> future = result->get_future();
+  submit(handle, [result](CURLcode code) { result->set_value(code); });
+  return future.get();
+}
+
+CurlMultiEngine::Stats CurlMultiEngine::stats() const {
+  Stats stats;
+  stats.started = started_.load();
+  stats.completed = completed_.load();
+  stats.running = stats.started - std::min(stats.started, stats.completed);
+  return stats;
+}
+
+bool CurlMultiEngine::onEngineThread() const {
+  return multi_ && std::this_thread::get_id() == thread_.get_id();
+}
+
+void CurlMultiEngine::finish(CURL *handle, CURLcode code) {
+  curl_multi_remove_handle(multi_, handle);
+  auto iter = running_.find(handle);
+  if (iter == running_.end())
+    return;
+  Completion done = std::move(iter->second);
+  running_.erase(iter);
+  completed_++;
+  dispatch(std::move(done), code);
+}
+
+void CurlMultiEngine::dispatch(Completion done, CURLcode code) {
+  if (!completions_) {
+    complete(done, code);
+    return;
+  }
+  completions_->submit(
+      [done = std::move(done), code] { complete(done, code); });
+}
+
+void CurlMultiEngine::run() {
+#if LIBCURL_VERSION_NUM >= 0x074400
+  std::vector<Pending> due;
+  for (;;) {
+    int timeout_ms = kIdlePollMs;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_)
+        break;
+      const auto now = std::chrono::steady_clock::now();
+      for (auto iter = pending_.begin(); iter != pending_.end();) {
+        if (iter->start <= now) {
+          due.push_back(std::move(*iter));
+          iter = pending_.erase(iter);
+          continue;
+        }
+        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              iter->start - now)
+                              .count() +
+                          1;
+        timeout_ms = static_cast<int>(std::min<long long>(timeout_ms, wait));
+        ++iter;
+      }
+    }
+    for (Pending &item : due) {
+      if (curl_multi_add_handle(multi_, item.handle) != CURLM_OK) {
+        started_++;
+        completed_++;
+        dispatch(std::move(item.done), CURLE_FAILED_INIT);
+        continue;
+      }
+      started_++;
+      running_.emplace(item.handle, std::move(item.done));
+    }
+    due.clear();
+
+    int still_running = 0;
+    curl_multi_perform(multi_, &still_running);
+    int queued = 0;
+    while (CURLMsg *message = curl_multi_info_read(multi_, &queued)) {
+      if (message->msg != CURLMSG_DONE)
+        continue;
+      /// the message is gone once its handle leaves the multi handle
+      CURL *handle = message->easy_handle;
+      const CURLcode code = message->data.result;
+      finish(handle, code);
+    }
+    curl_multi_poll(multi_, nullptr, 0, timeout_ms, nullptr);
+  }
+
+  std::vector<Pending> abandoned;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    abandoned.swap(pending_);
+  }
+  for (Pending &item : abandoned)
+    dispatch(std::move(item.done), CURLE_ABORTED_BY_CALLBACK);
+  std::vector<CURL *> handles;
+  for (const auto &entry : running_)
+    handles.push_back(entry.first);
+  for (CURL *handle : handles)
+    finish(handle, CURLE_ABORTED_BY_CALLBACK);
+#endif
+}
+
+CurlMultiEngine &globalCurlMultiEngine(size_t max_total_connections) {
+  static CurlMultiEngine engine(kMaxHostConnections, max_total_connections);
+  return engine;
+}
+
+CurlMultiEngine::Stats curlMultiEngineStats(size_t max_total_connections) {
+  return globalCurlMultiEngine(max_total_connections).stats();
+}
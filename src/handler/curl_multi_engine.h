@@ -0,0 +1,78 @@
+#ifndef CURL_MULTI_ENGINE_H_INCLUDED
+#define CURL_MULTI_ENGINE_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <curl/curl.h>
+
+class BoundedExecutor;
+
+/// One thread driving every outbound transfer through a curl multi handle.
+/// Transfers to one host share its connections, multiplexed over HTTP/2 when
+/// the server offers it, and wait inside libcurl once the per-host connection
+/// limit is reached, so a transfer waiting on the network holds no thread.
+/// The engine thread only does the curl_multi bookkeeping, what follows a
+/// transfer runs on a few completion workers of its own.
+class CurlMultiEngine {
+public:
+  using Completion = std::function<void(CURLcode)>;
+
+  struct Stats {
+    uint64_t started = 0;
+    uint64_t completed = 0;
+    uint64_t running = 0;
+  };
+
+  CurlMultiEngine(size_t max_host_connections, size_t max_total_connections);
+  CurlMultiEngine(const CurlMultiEngine &) = delete;
+  CurlMultiEngine &operator=(const CurlMultiEngine &) = delete;
+  ~CurlMultiEngine();
+
+  /// runs handle after delay and calls done with its result on a completion
+  /// worker. handle is the engine's until then. done may submit further
+  /// transfers; while it blocks it holds up later completions, not transfers.
+  void submit(CURL *handle, Completion done,
+              std::chrono::milliseconds delay = std::chrono::milliseconds(0));
+  /// submit for a caller that waits on the result
+  CURLcode perform(CURL *handle);
+  Stats stats() const;
+  /// whether the caller is the engine thread, which must never wait
+  bool onEngineThread() const;
+
+private:
+  struct Pending {
+    CURL *handle;
+    Completion done;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  void run();
+  void finish(CURL *handle, CURLcode code);
+  /// hands done to a completion worker, or runs it right away without one
+  void dispatch(Completion done, CURLcode code);
+
+  CURLM *multi_ = nullptr;
+  mutable std::mutex mutex_;
+  std::vector<Pending> pending_;
+  bool stopping_ = false;
+  /// touched by the engine thread only
+  std::unordered_map<CURL *, Completion> running_;
+  std::atomic<uint64_t> started_{0};
+  std::atomic<uint64_t> completed_{0};
+  std::unique_ptr<BoundedExecutor> completions_;
+  std::thread thread_;
+};
+
+CurlMultiEngine &globalCurlMultiEngine(size_t max_total_connections);
+CurlMultiEngine::Stats curlMultiEngineStats(size_t max_total_connections);
+
+#endif // CURL_MULTI_ENGINE_H_INCLUDED
@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <utime.h>
+#endif // _WIN32
+
+#include "handler/fetch_cache.h"
+#include "utils/file.h"
+#include "utils/string.h"
+
+namespace
+{
+
+constexpr const char *kHeaderSuffix = "_header";
+/// the index is swept once it holds this many slots, or twice what the last sweep kept
+constexpr size_t kIndexSweepFloor = 1024;
+
+uint64_t memorySize(const std::string &key, const FetchCacheEntry &entry)
+{
+    return key.size() + entry.content.size() + entry.headers.size();
+}
+
+bool readWhole(const std::string &path, std::string &content)
+{
+    std::FILE *fp = std::fopen(path.data(), "rb");
+    if(!fp)
+        return false;
+    content.clear();
+    char buffer[65536];
+    size_t length;
+    while((length = std::fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        content.append(buffer, length);
+    bool ok = !std::ferror(fp);
+    std::fclose(fp);
+    return ok;
+}
+
+bool writeAtomic(const std::string &path, const std::string &temp, const std::string &content)
+{
+    std::FILE *fp = std::fopen(temp.data(), "wb");
+    if(!fp)
+        return false;
+    bool written = std::fwrite(content.data(), 1, content.size(), fp) == content.size();
+    written = std::fclose(fp) == 0 && written;
+#ifdef _WIN32
+    if(written)
+        remove(path.data());
+#endif // _WIN32
+    if(!written || rename(temp.data(), path.data()) != 0)
+    {
+        remove(temp.data());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+FetchValidators fetchValidators(const std::string &headers)
+{
+    FetchValidators validators;
+    string_size pos = 0;
+    while(pos < headers.size())
+    {
+        string_size end = headers.find('\n', pos);
+        if(end == std::string::npos)
+            end = headers.size();
+        std::string line = trimWhitespace(headers.substr(pos, end - pos), true, true);
+        pos = end + 1;
+        /// a status line starts the next response of a redirect chain, only the last one counts
+        if(startsWith(line, "HTTP/"))
+        {
+            validators = FetchValidators();
+            continue;
+        }
+        string_size colon = line.find(':');
+        if(colon == std::string::npos)
+            continue;
+        std::string name = toLower(trimWhitespace(line.substr(0, colon), true, true));
+        if(name == "etag")
+            validators.etag = trimWhitespace(line.substr(colon + 1), true, true);
+        else if(name == "last-modified")
+            validators.last_modified = trimWhitespace(line.substr(colon + 1), true, true);
+    }
+    return validators;
+}
+
+FetchCache::FetchCache(std::string directory, uint64_t memory_limit) : directory_(std::move(directory)), index_sweep_at_(kIndexSweepFloor), memory_limit_(memory_limit)
+{
+    md(directory_.data());
+}
+
+void FetchCache::setMemoryLimit(uint64_t memory_limit)
+{
+    std::vector<std::string> evicted;
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        if(memory_limit_ == memory_limit)
+            return;
+        memory_limit_ = memory_limit;
+        memoryTrim(evicted);
+    }
+    forget(evicted);
+}
+
+std::shared_ptr<FetchCache::Slot> FetchCache::slot(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    std::shared_ptr<Slot> &slot = index_[key];
+    if(slot)
+        return slot;
+    slot = std::make_shared<Slot>();
+    std::shared_ptr<Slot> created = slot;
+    if(index_.size() >= index_sweep_at_)
+        sweepIndex();
+    return created;
+}
+
+/// drops the slots of keys evicted from the memory tier, unless someone is using them right now;
+/// the next lookup of such a key costs one stat again
+void FetchCache::forget(const std::vector<std::string> &keys)
+{
+    if(keys.empty())
+        return;
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for(const std::string &key : keys)
+    {
+        auto iter = index_.find(key);
+        /// a holder of the slot may be holding its lock as well
+        if(iter != index_.end() && iter->second.use_count() == 1)
+            index_.erase(iter);
+    }
+}
+
+/// called with index_mutex_ held. Keys that were only looked up and missed, or whose memory
+/// entry went away while their slot was busy, are not covered by forget()
+void FetchCache::sweepIndex()
+{
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        for(auto iter = index_.begin(); iter != index_.end();)
+        {
+            /// memory-resident entries keep their slot, a body whose disk write failed lives there only
+            if(iter->second.use_count() == 1 && !memory_.count(iter->first))
+                iter = index_.erase(iter);
+            else
+                ++iter;
+        }
+    }
+    index_sweep_at_ = std::max(kIndexSweepFloor, index_.size() * 2);
+}
+
+FetchCache::EntryPtr FetchCache::getFresh(const std::string &key, unsigned int ttl, EntryPtr *stale)
+{
+    std::shared_ptr<Slot> entry_slot = slot(key);
+    std::lock_guard<std::mutex> lock(entry_slot->mutex);
+    return load(key, *entry_slot, true, ttl, stale);
+}
+
+FetchCache::EntryPtr FetchCache::getAny(const std::string &key)
+{
+    std::shared_ptr<Slot> entry_slot = slot(key);
+    std::lock_guard<std::mutex> lock(entry_slot->mutex);
+    return load(key, *entry_slot, false, 0, nullptr);
+}
+
+FetchCache::EntryPtr FetchCache::load(const std::string &key, Slot &slot, bool check_ttl, unsigned int ttl, EntryPtr *stale)
+{
+    if(!slot.probed)
+    {
+        struct stat result {};
+        slot.exists = stat((directory_ + "/" + key).data(), &result) == 0;
+        slot.stored_at = slot.exists ? result.st_mtime : 0;
+        slot.probed = true;
+    }
+    if(!slot.exists)
+    {
+        misses_++;
+        return nullptr;
+    }
+    if(check_ttl && difftime(time(nullptr), slot.stored_at) > ttl)
+    {
+        expired_++;
+        if(stale)
+            *stale = read(key, slot);
+        return nullptr;
+    }
+
+    EntryPtr entry = read(key, slot);
+    if(entry)
+        hits_++;
+    else
+        misses_++;
+    return entry;
+}
+
+FetchCache::EntryPtr FetchCache::read(const std::string &key, Slot &slot)
+{
+    if(EntryPtr entry = memoryGet(key))
+    {
+        memory_hits_++;
+        return entry;
+    }
+
+    const std::string path = directory_ + "/" + key;
+    auto loaded = std::make_shared<FetchCacheEntry>();
+    if(!readWhole(path, loaded->content))
+    {
+        /// removed behind our back, e.g. by an operator clearing the directory
+        slot.exists = false;
+        return nullptr;
+    }
+    readWhole(path + kHeaderSuffix, loaded->headers);
+    EntryPtr entry = std::move(loaded);
+    memoryPut(key, entry);
+    return entry;
+}
+
+bool FetchCache::put(const std::string &key, const std::string &content, const std::string &headers)
+{
+    const std::string path = directory_ + "/" + key, path_header = path + kHeaderSuffix;
+    const std::string temp_suffix = "." + std::to_string(temp_serial_++) + ".tmp";
+    auto entry = std::make_shared<FetchCacheEntry>();
+    entry->content = content;
+    entry->headers = headers;
+
+    std::shared_ptr<Slot> entry_slot = slot(key);
+    std::lock_guard<std::mutex> lock(entry_slot->mutex);
+    if(entry_slot->probed && entry_slot->exists)
+    {
+        refetches_++;
+        refetched_bytes_ += content.size();
+    }
+    md(directory_.data());
+    bool written;
+    if(headers.empty())
+    {
+        remove(path_header.data());
+        written = true;
+    }
+    else
+        written = writeAtomic(path_header, path_header + temp_suffix, headers);
+    /// the body goes last, its mtime is what marks the entry fresh after a restart
+    written = written && writeAtomic(path, path + temp_suffix, content);
+    if(!written)
+        remove(path.data());
+
+    entry_slot->probed = true;
+    entry_slot->exists = true;
+    entry_slot->stored_at = time(nullptr);
+    memoryPut(key, std::move(entry));
+    writes_++;
+    return written;
+}
+
+bool FetchCache::refresh(const std::string &key, uint64_t body_bytes)
+{
+    std::shared_ptr<Slot> entry_slot = slot(key);
+    std::lock_guard<std::mutex> lock(entry_slot->mutex);
+    if(!entry_slot->probed || !entry_slot->exists)
+        return false;
+    entry_slot->stored_at = time(nullptr);
+#ifndef _WIN32
+    /// keeps the TTL restart across process restarts, where the mtime is all we have
+    utime((directory_ + "/" + key).data(), nullptr);
+#endif // _WIN32
+    revalidations_++;
+    revalidated_bytes_ += body_bytes;
+    return true;
+}
+
+void FetchCache::flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        index_.clear();
+        index_sweep_at_ = kIndexSweepFloor;
+    }
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        memory_.clear();
+        memory_lru_.clear();
+        memory_bytes_ = 0;
+    }
+    operateFiles(directory_, [this](const std::string &file){ remove((directory_ + "/" + file).data()); return 0; });
+}
+
+FetchCache::Stats FetchCache::stats() const
+{
+    Stats stats;
+    stats.hits = hits_.load();
+    stats.memory_hits = memory_hits_.load();
+    stats.misses = misses_.load();
+    stats.expired = expired_.load();
+    stats.writes = writes_.load();
+    stats.revalidations = revalidations_.load();
+    stats.revalidated_bytes = revalidated_bytes_.load();
+    stats.refetches = refetches_.load();
+    stats.refetched_bytes = refetched_bytes_.load();
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        stats.index_entries = index_.size();
+    }
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    stats.memory_entries = memory_.size();
+    stats.memory_bytes = memory_bytes_;
+    return stats;
+}
+
+FetchCache::EntryPtr FetchCache::memoryGet(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    auto iter = memory_.find(key);
+    if(iter == memory_.end())
+        return nullptr;
+    memory_lru_.splice(memory_lru_.begin(), memory_lru_, iter->second.lru);
+    return iter->second.entry;
+}
+
+void FetchCache::memoryPut(const std::string &key, EntryPtr entry)
+{
+    const uint64_t size = memorySize(key, *entry);
+    std::vector<std::string> evicted;
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        auto iter = memory_.find(key);
+        if(iter != memory_.end())
+        {
+            memory_bytes_ -= memorySize(key, *iter->second.entry);
+            memory_lru_.erase(iter->second.lru);
+            memory_.erase(iter);
+        }
+        if(size > memory_limit_)
+            return;
+        memory_lru_.push_front(key);
+        memory_.emplace(key, MemoryEntry {std::move(entry), memory_lru_.begin()});
+        memory_bytes_ += size;
+        memoryTrim(evicted);
+    }
+    /// the caller holds the slot of key, which is never among the evicted: it went in last and fits
+    forget(evicted);
+}
+
+void FetchCache::memoryTrim(std::vector<std::string> &evicted)
+{
+    while(memory_bytes_ > memory_limit_ && !memory_lru_.empty())
+    {
+        auto iter = memory_.find(memory_lru_.back());
+        memory_bytes_ -= memorySize(iter->first, *iter->second.entry);
+        evicted.push_back(std::move(memory_lru_.back()));
+        memory_.erase(iter);
+        memory_lru_.pop_back();
+    }
+}
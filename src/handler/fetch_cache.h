@@ -0,0 +1,114 @@
+#ifndef FETCH_CACHE_H_INCLUDED
+#define FETCH_CACHE_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct FetchCacheEntry
+{
+    std::string content;
+    std::string headers;
+};
+
+/// validators of the final response in a raw header blob, used for conditional requests
+struct FetchValidators
+{
+    std::string etag;
+    std::string last_modified;
+
+    bool empty() const { return etag.empty() && last_modified.empty(); }
+};
+
+FetchValidators fetchValidators(const std::string &headers);
+
+/// the webGet cache: "<directory>/<key>" holds the body and "<key>_header" the response headers,
+/// the same layout older versions wrote, so an existing cache directory stays warm on upgrade.
+/// An in-memory index remembers which keys exist and when they were stored, so a lookup costs
+/// one stat the first time a key is seen and none afterwards. Recently used entries are kept
+/// in RAM up to memory_limit bytes, 0 disables that tier. Index slots of keys outside that tier
+/// are dropped when nobody holds them, so the index does not grow with every URL ever asked
+/// for. Every key has its own lock, and files are written to a temporary name and renamed into
+/// place, so readers never see a partial body.
+class FetchCache
+{
+public:
+    using EntryPtr = std::shared_ptr<const FetchCacheEntry>;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t memory_hits = 0;
+        uint64_t misses = 0;
+        uint64_t expired = 0;
+        uint64_t writes = 0;
+        uint64_t revalidations = 0;
+        uint64_t revalidated_bytes = 0;
+        uint64_t refetches = 0;
+        uint64_t refetched_bytes = 0;
+        uint64_t memory_entries = 0;
+        uint64_t memory_bytes = 0;
+        uint64_t index_entries = 0;
+    };
+
+    FetchCache(std::string directory, uint64_t memory_limit);
+
+    const std::string &directory() const { return directory_; }
+    void setMemoryLimit(uint64_t memory_limit);
+    /// entry stored no more than ttl seconds ago, nullptr otherwise. An older entry is
+    /// handed out through stale when given, so its validators can be sent upstream.
+    EntryPtr getFresh(const std::string &key, unsigned int ttl, EntryPtr *stale = nullptr);
+    /// entry of any age, for serving a stale copy when the upstream fails
+    EntryPtr getAny(const std::string &key);
+    /// the entry is kept in memory even when the disk write fails, which is reported by returning false
+    bool put(const std::string &key, const std::string &content, const std::string &headers);
+    /// upstream answered 304 for the stored copy, restart its TTL; false when the entry is gone
+    bool refresh(const std::string &key, uint64_t body_bytes);
+    void flush();
+    Stats stats() const;
+
+private:
+    struct Slot
+    {
+        std::mutex mutex;
+        bool probed = false;
+        bool exists = false;
+        time_t stored_at = 0;
+    };
+    struct MemoryEntry
+    {
+        EntryPtr entry;
+        std::list<std::string>::iterator lru;
+    };
+
+    std::shared_ptr<Slot> slot(const std::string &key);
+    EntryPtr load(const std::string &key, Slot &slot, bool check_ttl, unsigned int ttl, EntryPtr *stale);
+    EntryPtr read(const std::string &key, Slot &slot);
+    EntryPtr memoryGet(const std::string &key);
+    void memoryPut(const std::string &key, EntryPtr entry);
+    void memoryTrim(std::vector<std::string> &evicted);
+    void forget(const std::vector<std::string> &keys);
+    void sweepIndex();
+
+    std::string directory_;
+    mutable std::mutex index_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Slot>> index_;
+    /// index size that triggers the next sweep of unused slots
+    size_t index_sweep_at_;
+
+    mutable std::mutex memory_mutex_;
+    std::list<std::string> memory_lru_;
+    std::unordered_map<std::string, MemoryEntry> memory_;
+    uint64_t memory_bytes_ = 0, memory_limit_;
+
+    std::atomic<uint64_t> hits_ {0}, memory_hits_ {0}, misses_ {0}, expired_ {0}, writes_ {0}, temp_serial_ {0};
+    std::atomic<uint64_t> revalidations_ {0}, revalidated_bytes_ {0}, refetches_ {0}, refetched_bytes_ {0};
+};
+
+#endif // FETCH_CACHE_H_INCLUDED
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cctype>
 #include <condition_variable>
@@ -12,6 +13,8 @@
 #include <numeric>
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <unordered_set>
 
 #include <inja.hpp>
@@ -22,19 +25,24 @@
 #include "config/binding.h"
 #include "generator/config/external_rules.h"
 #include "generator/config/nodemanip.h"
+#include "generator/config/rule_types.h"
 #include "generator/config/ruleconvert.h"
 #include "generator/config/subexport.h"
+#include "generator/template/base_cache.h"
 #include "generator/template/templates.h"
 #include "interfaces.h"
+#include "response_encoding.h"
 #include "multithread.h"
 #include "parser/mihomo_scheme_utils.h"
 #include "parser/mihomo_bridge.h"
 #include "script/cron.h"
+#include "script/script_cache.h"
 #include "script/script_quickjs.h"
 #include "server/webserver.h"
 #include "settings.h"
 #include "statistics.h"
 #include "sub_request_key.h"
+#include "sub_response_cache.h"
 #include "upload.h"
 #include "webget.h"
 #include "utils/time_compat.h"
@@ -238,6 +246,29 @@ static void appendVaryHeader(Response &response, const std::string &field) {
   iter->second += ", " + field;
 }
 
+static ContentEncoding responseEncoding(const Request &request,
+                                        Response &response, size_t body_size) {
+  appendVaryHeader(response, "Accept-Encoding");
+  if (request.method == "HEAD" || body_size < kMinCompressedBodySize ||
+      response.headers.count("Content-Encoding"))
+    return ContentEncoding::Identity;
+  return negotiateContentEncoding(request.accept_encoding);
+}
+
+/// body in the encoding the client prefers, with Content-Encoding to match
+static std::string encodeResponseBody(const Request &request,
+                                      Response &response, std::string body) {
+  ContentEncoding encoding = responseEncoding(request, response, body.size());
+  if (encoding == ContentEncoding::Identity)
+    return body;
+  std::string compressed;
+  if (!compressBody(body, encoding, compressed) ||
+      compressed.size() >= body.size())
+    return body;
+  response.headers["Content-Encoding"] = contentEncodingName(encoding);
+  return compressed;
+}
+
 static std::string buildProviderRemarkFilter(const string_array &rules) {
   string_array valid_rules;
   for (const std::string &rule : rules) {
@@ -253,7 +284,7 @@ static std::string buildProviderRemarkFilter(const string_array &rules) {
   return "(" + join(valid_rules, ")|(") + ")";
 }
 
-extern string_array ClashRuleTypes, SurgeRuleTypes, QuanXRuleTypes;
+extern string_array ClashRuleTypes;
 
 struct UAProfile {
   std::string head;
@@ -372,10 +403,8 @@ std::string getRuleset(RESPONSE_CALLBACK_ARGS) {
   std::vector<RulesetContent> rca;
   RulesetConfigs confs = INIBinding::from<RulesetConfig>::from_ini(vArray);
   refreshRulesets(confs, rca, FetchContext::PublicRequest);
-  for (RulesetContent &x : rca) {
-    std::string content = x.rule_content.get();
-    output_content += convertRuleset(content, x.rule_type);
-  }
+  for (RulesetContent &x : rca)
+    output_content += convertRuleset(*x.rule_content.get(), x.rule_type);
 
   if (output_content.empty()) {
     *status_code = 400;
@@ -424,17 +453,11 @@ std::string getRuleset(RESPONSE_CALLBACK_ARGS) {
     }
     switch (type_int) {
     case 2:
-      if (!std::any_of(QuanXRuleTypes.begin(), QuanXRuleTypes.end(),
-                       [&strLine](const std::string &type) {
-                         return startsWith(strLine, type);
-                       }))
+      if (!ruleTypeAllowed(strLine, RULE_TARGET_QUANX))
         continue;
       break;
     case 1:
-      if (!std::any_of(SurgeRuleTypes.begin(), SurgeRuleTypes.end(),
-                       [&strLine](const std::string &type) {
-                         return startsWith(strLine, type);
-                       }))
+      if (!ruleTypeAllowed(strLine, RULE_TARGET_SURGE))
         continue;
       break;
     case 3:
@@ -470,10 +493,7 @@ std::string getRuleset(RESPONSE_CALLBACK_ARGS) {
       output_content += '\n';
       continue;
     case 6:
-      if (!std::any_of(ClashRuleTypes.begin(), ClashRuleTypes.end(),
-                       [&strLine](const std::string &type) {
-                         return startsWith(strLine, type);
-                       }))
+      if (!ruleTypeAllowed(strLine, RULE_TARGET_CLASH))
         continue;
       output_content += "  - ";
     default:
@@ -515,7 +535,7 @@ std::string getRuleset(RESPONSE_CALLBACK_ARGS) {
       break;
     }
   }
-  return output_content;
+  return encodeResponseBody(request, response, std::move(output_content));
 }
 
 bool checkExternalBase(const std::string &path, std::string &dest,
@@ -1036,6 +1056,8 @@ struct CoalescedResponse {
   string_icase_map headers;
   std::string body;
   uint64_t rule_conversions = 0;
+  /// compressed copies of body, made once for every waiter and cache hit
+  EncodedBodies encoded;
 };
 
 using SharedCoalescedResponse = std::shared_ptr<const CoalescedResponse>;
@@ -1048,16 +1070,10 @@ struct InflightSubRequest {
   std::exception_ptr exception;
 };
 
-struct CachedSubResponse {
-  SharedCoalescedResponse result;
-  std::chrono::steady_clock::time_point expires_at;
-};
-
 static std::mutex g_sub_inflight_mutex;
 static std::map<std::string, std::shared_ptr<InflightSubRequest>>
     g_sub_inflight;
-static std::mutex g_sub_response_cache_mutex;
-static std::map<std::string, CachedSubResponse> g_sub_response_cache;
+static std::atomic<int> g_sub_refreshes_running{0};
 
 struct SubExplainProvider {
   std::string name;
@@ -1446,6 +1462,21 @@ static void copyCoalescedToResponse(const CoalescedResponse &result,
   response.headers = result.headers;
 }
 
+/// encodeResponseBody for a shared result, reusing its compressed copies
+static std::string encodeCoalescedBody(const Request &request,
+                                       Response &response,
+                                       const CoalescedResponse &result) {
+  ContentEncoding encoding =
+      responseEncoding(request, response, result.body.size());
+  if (encoding == ContentEncoding::Identity)
+    return result.body;
+  EncodedBodies::BodyPtr body = result.encoded.get(result.body, encoding);
+  if (!body)
+    return result.body;
+  response.headers["Content-Encoding"] = contentEncodingName(encoding);
+  return *body;
+}
+
 static SharedCoalescedResponse makeCoalescedResult(
     std::string &&body, Response &&response, uint64_t rule_conversions) {
   auto result = std::make_shared<CoalescedResponse>();
@@ -1457,55 +1488,36 @@ static SharedCoalescedResponse makeCoalescedResult(
   return result;
 }
 
-static void pruneExpiredSubResponseCache(
-    std::chrono::steady_clock::time_point now) {
-  for (auto iter = g_sub_response_cache.begin();
-       iter != g_sub_response_cache.end();) {
-    if (iter->second.expires_at <= now)
-      iter = g_sub_response_cache.erase(iter);
-    else
-      ++iter;
-  }
+static SubResponseCache<CoalescedResponse> &subResponseCache() {
+  static SubResponseCache<CoalescedResponse> cache(2048, 64 * 1024 * 1024);
+  cache.setLimits(static_cast<size_t>(global.responseCacheMaxEntries),
+                  static_cast<size_t>(global.responseCacheMaxMB) * 1024 *
+                      1024);
+  return cache;
 }
 
-static bool getCachedSubResponse(const std::string &key,
-                                 SharedCoalescedResponse &result) {
+static SubResponseCache<CoalescedResponse>::Lookup
+getCachedSubResponse(const std::string &key) {
   if (global.responseCacheTtl <= 0)
-    return false;
-
-  auto now = std::chrono::steady_clock::now();
-  std::lock_guard<std::mutex> lock(g_sub_response_cache_mutex);
-  auto iter = g_sub_response_cache.find(key);
-  if (iter == g_sub_response_cache.end())
-    return false;
-  if (iter->second.expires_at <= now) {
-    g_sub_response_cache.erase(iter);
-    return false;
-  }
-  result = iter->second.result;
-  return true;
+    return {};
+  return subResponseCache().get(key, std::chrono::steady_clock::now());
 }
 
-static void storeCachedSubResponse(const std::string &key,
+static bool storeCachedSubResponse(const std::string &key,
                                    const SharedCoalescedResponse &result) {
   if (global.responseCacheTtl <= 0 || !result || result->status_code != 200)
-    return;
-
-  int ttl = std::min(global.responseCacheTtl, 5);
-  if (ttl <= 0)
-    return;
+    return false;
 
-  auto now = std::chrono::steady_clock::now();
-  std::lock_guard<std::mutex> lock(g_sub_response_cache_mutex);
-  pruneExpiredSubResponseCache(now);
-  if (g_sub_response_cache.size() > 2048) {
-    writeLog(0,
-             "响应微缓存条目数量过多，已清空以避免占用过多内存。",
-             LOG_LEVEL_WARNING);
-    g_sub_response_cache.clear();
-  }
-  g_sub_response_cache[key] = {
-      result, now + std::chrono::seconds(ttl)};
+  /// half the body again leaves room for the compressed copies made later
+  size_t size = result->body.size() + result->body.size() / 2 +
+                result->content_type.size();
+  for (const auto &header : result->headers)
+    size += header.first.size() + header.second.size();
+  subResponseCache().put(key, result, size,
+                         std::chrono::seconds(global.responseCacheTtl),
+                         std::chrono::seconds(global.responseCacheStaleTtl),
+                         std::chrono::steady_clock::now());
+  return true;
 }
 
 static std::string runSubconverterImplWithRetry(const Request &original,
@@ -1554,6 +1566,44 @@ static void recordTrackedSubRequest(bool track, const Request &request,
   statistics::recordSubscriptionConversion(request, rule_conversions);
 }
 
+/// Regenerates a stale cached response off the request path. Refreshes share
+/// the max_concurrent_threads budget; past it the stale body keeps being served
+/// and a later stale hit retries.
+static void refreshCachedSubResponse(const Request &request,
+                                     const std::string &key) {
+  if (g_sub_refreshes_running.fetch_add(1) >=
+      std::max(1, global.maxConcurThreads)) {
+    g_sub_refreshes_running.fetch_sub(1);
+    subResponseCache().refreshFailed(key);
+    return;
+  }
+  try {
+    std::thread([request, key]() {
+      try {
+        Response refresh_response;
+        RuleConversionStats stats;
+        std::string body =
+            runSubconverterImplWithRetry(request, refresh_response, &stats);
+        body = finalizeSubResponse(request, refresh_response, std::move(body),
+                                   AgeResponseContext());
+        if (!storeCachedSubResponse(
+                key, makeCoalescedResult(std::move(body),
+                                         std::move(refresh_response),
+                                         stats.rules)))
+          subResponseCache().refreshFailed(key);
+      } catch (...) {
+        writeLog(0, "/sub 响应缓存后台刷新失败，继续提供旧响应。",
+                 LOG_LEVEL_WARNING);
+        subResponseCache().refreshFailed(key);
+      }
+      g_sub_refreshes_running.fetch_sub(1);
+    }).detach();
+  } catch (const std::system_error &) {
+    g_sub_refreshes_running.fetch_sub(1);
+    subResponseCache().refreshFailed(key);
+  }
+}
+
 static std::string subconverterEntry(Request &request, Response &response,
                                      bool track) {
   AgeResponseContext age = consumeAgeResponseContext(request);
@@ -1580,7 +1630,7 @@ static std::string subconverterEntry(Request &request, Response &response,
         subconverter_impl(request, response, track ? &stats : nullptr);
     body = finalizeSubResponse(request, response, std::move(body), age);
     recordTrackedSubRequest(track, request, response, stats.rules);
-    return body;
+    return encodeResponseBody(request, response, std::move(body));
   }
 
   std::string key =
@@ -1592,16 +1642,23 @@ static std::string subconverterEntry(Request &request, Response &response,
         subconverter_impl(request, response, track ? &stats : nullptr);
     body = finalizeSubResponse(request, response, std::move(body), age);
     recordTrackedSubRequest(track, request, response, stats.rules);
-    return body;
+    return encodeResponseBody(request, response, std::move(body));
   }
 
-  SharedCoalescedResponse cached_result;
-  if (getCachedSubResponse(key, cached_result)) {
-    writeLog(0, "/sub 响应微缓存命中。", LOG_LEVEL_DEBUG);
+  SubResponseCache<CoalescedResponse>::Lookup cached =
+      getCachedSubResponse(key);
+  if (cached.value) {
+    const SharedCoalescedResponse &cached_result = cached.value;
+    if (cached.state == SubResponseCache<CoalescedResponse>::State::Stale)
+      writeLog(0, "/sub 响应缓存已过期，返回旧响应。", LOG_LEVEL_DEBUG);
+    else
+      writeLog(0, "/sub 响应缓存命中。", LOG_LEVEL_DEBUG);
+    if (cached.refresh)
+      refreshCachedSubResponse(request, key);
     copyCoalescedToResponse(*cached_result, response);
     recordTrackedSubRequest(track, request, response,
                             cached_result->rule_conversions);
-    return cached_result->body;
+    return encodeCoalescedBody(request, response, *cached_result);
   }
 
   std::shared_ptr<InflightSubRequest> call;
@@ -1628,7 +1685,7 @@ static std::string subconverterEntry(Request &request, Response &response,
     copyCoalescedToResponse(*call->result, response);
     recordTrackedSubRequest(track, request, response,
                             call->result->rule_conversions);
-    return call->result->body;
+    return encodeCoalescedBody(request, response, *call->result);
   }
 
   try {
@@ -1655,7 +1712,7 @@ static std::string subconverterEntry(Request &request, Response &response,
     call->cv.notify_all();
     recordTrackedSubRequest(track, request, response,
                             result->rule_conversions);
-    return result->body;
+    return encodeCoalescedBody(request, response, *result);
   } catch (...) {
     {
       std::lock_guard<std::mutex> lock(call->mutex);
@@ -1673,6 +1730,10 @@ static std::string subconverterEntry(Request &request, Response &response,
 
 } // namespace
 
+SubResponseCacheStats subResponseCacheStats() {
+  return subResponseCache().stats();
+}
+
 std::string subconverter(RESPONSE_CALLBACK_ARGS) {
   return subconverterEntry(request, response, false);
 }
@@ -2027,11 +2088,13 @@ static std::string subconverter_impl(Request &request, Response &response,
       }
     }
     if (!extconf.rename.empty()) {
-      ext.rename_array = extconf.rename;
+      ext.rename_program =
+          compileRegexMatchProgram(extconf.rename, 0, authorized);
       ext.rename_for_providers = true;
     }
     if (!extconf.emoji.empty())
-      ext.emoji_array = extconf.emoji;
+      ext.emoji_program =
+          compileRegexMatchProgram(extconf.emoji, 0, authorized);
     if (!extconf.include.empty())
       lIncludeRemarks = extconf.include;
     if (!extconf.exclude.empty())
@@ -2160,14 +2223,16 @@ static std::string subconverter_impl(Request &request, Response &response,
   }
   ext.add_emoji = argAddEmoji.get(global.addEmoji);
   ext.remove_emoji = argRemoveEmoji.get(global.removeEmoji);
-  if (ext.add_emoji && ext.emoji_array.empty())
-    ext.emoji_array = safe_get_emojis();
+  if (ext.add_emoji && !ext.emoji_program)
+    ext.emoji_program = safe_get_emoji_program();
   if (!argRenames.empty()) {
-    ext.rename_array = INIBinding::from<RegexMatchConfig>::from_ini(
-        split(argRenames, "`"), "@");
+    ext.rename_program = compileRegexMatchProgram(
+        INIBinding::from<RegexMatchConfig>::from_ini(split(argRenames, "`"),
+                                                     "@"),
+        0, authorized);
     ext.rename_for_providers = true;
-  } else if (ext.rename_array.empty())
-    ext.rename_array = safe_get_renames();
+  } else if (!ext.rename_program)
+    ext.rename_program = safe_get_rename_program();
 
   /// check custom include/exclude settings
   if (!argIncludeRemark.empty() && regValid(argIncludeRemark))
@@ -2217,10 +2282,20 @@ static std::string subconverter_impl(Request &request, Response &response,
     urls = split(global.insertUrls, "|");
     explain.insert_url_count = urls.size();
     importItems(urls, true);
+    std::vector<NodeSource> sources;
     for (std::string &x : urls) {
       x = regTrim(x);
       writeLog(0, "正在从 URL 获取节点数据：'" + x + "'。", LOG_LEVEL_INFO);
-      if (addNodes(x, insert_nodes, groupID, parse_set) == -1) {
+      sources.push_back({x, groupID--});
+    }
+    addNodesConcurrently(sources, parse_set,
+                         global.subscriptionFetchConcurrency,
+                         !global.skipFailedLinks);
+    for (NodeSource &source : sources) {
+      const std::string &x = source.link;
+      std::move(source.nodes.begin(), source.nodes.end(),
+                std::back_inserter(insert_nodes));
+      if (source.result == -1) {
         if (global.skipFailedLinks)
           writeLog(
               0, "以下链接不包含任何有效节点信息：" + x,
@@ -2237,7 +2312,6 @@ static std::string subconverter_impl(Request &request, Response &response,
                  x;
         }
       }
-      groupID--;
     }
   }
   urls = split(argUrl, "|");
@@ -2443,32 +2517,48 @@ static std::string subconverter_impl(Request &request, Response &response,
                LOG_LEVEL_INFO);
       importItems(node_urls, true, FetchContext::PublicRequest);
       // 关键：实际添加节点到 nodes 列表
+      std::vector<NodeSource> sources;
       for (std::string &x : node_urls) {
         writeLog(0, "正在从 URL 获取节点数据：'" + x + "'。", LOG_LEVEL_INFO);
-        if (addNodes(x, nodes, groupID, parse_set) == -1) {
+        sources.push_back({x, groupID++});
+      }
+      addNodesConcurrently(sources, parse_set,
+                           global.subscriptionFetchConcurrency);
+      for (NodeSource &source : sources) {
+        std::move(source.nodes.begin(), source.nodes.end(),
+                  std::back_inserter(nodes));
+        if (source.result == -1) {
           // 跳过无法解析的节点链接，记录警告后继续处理其他节点
           writeLog(0,
-                   "已跳过无效节点链接：'" + x + "'，继续处理其他节点。",
+                   "已跳过无效节点链接：'" + source.link +
+                       "'，继续处理其他节点。",
                    LOG_LEVEL_WARNING);
         }
-        groupID++;
       }
     }
   } else {
     // 其他格式保持原有逻辑，完全展开节点
     importItems(urls, true,
                 FetchContext::PublicRequest); // 只为非 proxy-provider 模式处理 import 语法
+    std::vector<NodeSource> sources;
     for (std::string &x : urls) {
       x = regTrim(x);
       // std::cerr<<"Fetching node data from url '"<<x<<"'."<<std::endl;
       writeLog(0, "正在从 URL 获取节点数据：'" + x + "'。", LOG_LEVEL_INFO);
-      if (addNodes(x, nodes, groupID, parse_set) == -1) {
+      sources.push_back({x, groupID++});
+    }
+    addNodesConcurrently(sources, parse_set,
+                         global.subscriptionFetchConcurrency);
+    for (NodeSource &source : sources) {
+      std::move(source.nodes.begin(), source.nodes.end(),
+                std::back_inserter(nodes));
+      if (source.result == -1) {
         // 跳过无法解析的节点链接，记录警告后继续处理其他节点
         writeLog(0,
-                 "已跳过无效节点链接：'" + x + "'，继续处理其他节点。",
+                 "已跳过无效节点链接：'" + source.link +
+                     "'，继续处理其他节点。",
                  LOG_LEVEL_WARNING);
       }
-      groupID++;
     }
   }
   // exit if found nothing
@@ -2522,7 +2612,7 @@ static std::string subconverter_impl(Request &request, Response &response,
     filterScript = argFilterScript;
   if (!filterScript.empty()) {
     if (startsWith(filterScript, "path:"))
-      filterScript = fileGet(filterScript.substr(5), false);
+      filterScript = script_file_source(filterScript.substr(5));
     /*
     duk_context *ctx = duktape_init();
     if(ctx)
@@ -2551,9 +2641,23 @@ static std::string subconverter_impl(Request &request, Response &response,
         ext.js_runtime, ext.js_context,
         [&](qjs::Context &ctx) {
           try {
-            ctx.eval(filterScript);
-            auto filter =
-                (std::function<bool(const Proxy &)>)ctx.eval("filter");
+            /// filterAll(nodes) answers for every node in one call, with
+            /// the same meaning per entry as filter(node)
+            qjs::Value filter_all =
+                script_function(ctx, filterScript, "filterAll", true);
+            if (JS_IsFunction(ctx.ctx, filter_all.v)) {
+              std::vector<char> flags =
+                  script_batch_flags(ctx, filter_all, nodes);
+              const Proxy *first = nodes.data();
+              nodes.erase(std::remove_if(nodes.begin(), nodes.end(),
+                                         [&](const Proxy &node) {
+                                           return flags[&node - first] != 0;
+                                         }),
+                          nodes.end());
+              return;
+            }
+            auto filter = (std::function<bool(const Proxy &)>)
+                script_function(ctx, filterScript, "filter");
             nodes.erase(std::remove_if(nodes.begin(), nodes.end(), filter),
                         nodes.end());
           } catch (qjs::exception) {
@@ -2610,16 +2714,18 @@ static std::string subconverter_impl(Request &request, Response &response,
       proxyToClash(nodes, yamlnode, dummy_group, argTarget == "clashr", ext);
       output_content = YAML::Dump(yamlnode);
     } else {
-      if (render_template(fetchFile(lClashBase, proxy, global.cacheConfig,
-                                    true, baseFetchContext),
-                          tpl_args, base_content, global.templatePath,
-                          baseFetchContext) != 0) {
+      RenderedBasePtr base =
+          render_base(fetchFile(lClashBase, proxy, global.cacheConfig, true,
+                                baseFetchContext),
+                      tpl_args, BaseFormat::Clash, global.templatePath,
+                      baseFetchContext);
+      if (base->status != 0) {
         *status_code = 400;
-        return base_content;
+        return base->content;
       }
-      output_content =
-          proxyToClash(nodes, base_content, lRulesetContent, lCustomProxyGroups,
-                       argTarget == "clashr", ext);
+      output_content = proxyToClash(
+          nodes, base->content, lRulesetContent, lCustomProxyGroups,
+          argTarget == "clashr", ext, base->parsed ? &base->clash : nullptr);
       if (!ext.external_rule_error.empty()) {
         *status_code = 400;
         return ext.external_rule_error;
@@ -2642,10 +2748,11 @@ static std::string subconverter_impl(Request &request, Response &response,
         uploadGist("surge" + argSurgeVer + "list", argUploadPath,
                    output_content, true);
     } else {
-      if (render_template(fetchFile(lSurgeBase, proxy, global.cacheConfig,
-                                    true, baseFetchContext),
-                          tpl_args, base_content, global.templatePath,
-                          baseFetchContext) != 0) {
+      if (render_base_template(
+              fetchFile(lSurgeBase, proxy, global.cacheConfig, true,
+                        baseFetchContext),
+              tpl_args, base_content, global.templatePath,
+              baseFetchContext) != 0) {
         *status_code = 400;
         return base_content;
       }
@@ -2666,10 +2773,11 @@ static std::string subconverter_impl(Request &request, Response &response,
   case "surfboard"_hash:
     writeLog(0, "生成目标：Surfboard", LOG_LEVEL_INFO);
 
-    if (render_template(fetchFile(lSurfboardBase, proxy, global.cacheConfig,
-                                  true, baseFetchContext),
-                        tpl_args, base_content, global.templatePath,
-                        baseFetchContext) != 0) {
+    if (render_base_template(
+            fetchFile(lSurfboardBase, proxy, global.cacheConfig, true,
+                      baseFetchContext),
+            tpl_args, base_content, global.templatePath,
+            baseFetchContext) != 0) {
       *status_code = 400;
       return base_content;
     }
@@ -2688,10 +2796,11 @@ static std::string subconverter_impl(Request &request, Response &response,
   case "mellow"_hash:
     writeLog(0, "生成目标：Mellow", LOG_LEVEL_INFO);
 
-    if (render_template(fetchFile(lMellowBase, proxy, global.cacheConfig, true,
-                                  baseFetchContext),
-                        tpl_args, base_content, global.templatePath,
-                        baseFetchContext) != 0) {
+    if (render_base_template(
+            fetchFile(lMellowBase, proxy, global.cacheConfig, true,
+                      baseFetchContext),
+            tpl_args, base_content, global.templatePath,
+            baseFetchContext) != 0) {
       *status_code = 400;
       return base_content;
     }
@@ -2704,10 +2813,11 @@ static std::string subconverter_impl(Request &request, Response &response,
   case "sssub"_hash:
     writeLog(0, "生成目标：SS Subscription", LOG_LEVEL_INFO);
 
-    if (render_template(fetchFile(lSSSubBase, proxy, global.cacheConfig, true,
-                                  baseFetchContext),
-                        tpl_args, base_content, global.templatePath,
-                        baseFetchContext) != 0) {
+    if (render_base_template(
+            fetchFile(lSSSubBase, proxy, global.cacheConfig, true,
+                      baseFetchContext),
+            tpl_args, base_content, global.templatePath,
+            baseFetchContext) != 0) {
       *status_code = 400;
       return base_content;
     }
@@ -2760,10 +2870,11 @@ static std::string subconverter_impl(Request &request, Response &response,
   case "quan"_hash:
     writeLog(0, "生成目标：Quantumult", LOG_LEVEL_INFO);
     if (!ext.nodelist) {
-      if (render_template(fetchFile(lQuanBase, proxy, global.cacheConfig, true,
-                                    baseFetchContext),
-                          tpl_args, base_content, global.templatePath,
-                          baseFetchContext) != 0) {
+      if (render_base_template(
+              fetchFile(lQuanBase, proxy, global.cacheConfig, true,
+                        baseFetchContext),
+              tpl_args, base_content, global.templatePath,
+              baseFetchContext) != 0) {
         *status_code = 400;
         return base_content;
       }
@@ -2778,10 +2889,11 @@ static std::string subconverter_impl(Request &request, Response &response,
   case "quanx"_hash:
     writeLog(0, "生成目标：Quantumult X", LOG_LEVEL_INFO);
     if (!ext.nodelist) {
-      if (render_template(fetchFile(lQuanXBase, proxy, global.cacheConfig,
-                                    true, baseFetchContext),
-                          tpl_args, base_content, global.templatePath,
-                          baseFetchContext) != 0) {
+      if (render_base_template(
+              fetchFile(lQuanXBase, proxy, global.cacheConfig, true,
+                        baseFetchContext),
+              tpl_args, base_content, global.templatePath,
+              baseFetchContext) != 0) {
         *status_code = 400;
         return base_content;
       }
@@ -2796,10 +2908,11 @@ static std::string subconverter_impl(Request &request, Response &response,
   case "loon"_hash:
     writeLog(0, "生成目标：Loon", LOG_LEVEL_INFO);
     if (!ext.nodelist) {
-      if (render_template(fetchFile(lLoonBase, proxy, global.cacheConfig, true,
-                                    baseFetchContext),
-                          tpl_args, base_content, global.templatePath,
-                          baseFetchContext) != 0) {
+      if (render_base_template(
+              fetchFile(lLoonBase, proxy, global.cacheConfig, true,
+                        baseFetchContext),
+              tpl_args, base_content, global.templatePath,
+              baseFetchContext) != 0) {
         *status_code = 400;
         return base_content;
       }
@@ -2820,18 +2933,24 @@ static std::string subconverter_impl(Request &request, Response &response,
   case "singbox"_hash:
     writeLog(0, "生成目标：sing-box", LOG_LEVEL_INFO);
     if (!ext.nodelist) {
-      if (render_template(fetchFile(lSingBoxBase, proxy, global.cacheConfig,
-                                    true, baseFetchContext),
-                          tpl_args, base_content, global.templatePath,
-                          baseFetchContext) != 0) {
+      RenderedBasePtr base =
+          render_base(fetchFile(lSingBoxBase, proxy, global.cacheConfig, true,
+                                baseFetchContext),
+                      tpl_args, BaseFormat::SingBox, global.templatePath,
+                      baseFetchContext);
+      if (base->status != 0) {
         *status_code = 400;
-        return base_content;
+        return base->content;
       }
+      output_content =
+          proxyToSingBox(nodes, base->content, lRulesetContent,
+                         lCustomProxyGroups, ext,
+                         base->parsed ? &base->singbox : nullptr);
+    } else {
+      output_content = proxyToSingBox(nodes, base_content, lRulesetContent,
+                                      lCustomProxyGroups, ext);
     }
 
-    output_content = proxyToSingBox(nodes, base_content, lRulesetContent,
-                                    lCustomProxyGroups, ext);
-
     if (argUpload)
       uploadGist("singbox", argUploadPath, output_content, false);
     break;
@@ -2974,7 +3093,9 @@ static std::string subconverter_impl(Request &request, Response &response,
                  "Effective update interval in seconds.");
     addParameter("strict", boolString(strict), "applied",
                  "Managed config strict flag.");
-    addParameter("rename", std::to_string(ext.rename_array.size()) +
+    addParameter("rename", std::to_string(ext.rename_program
+                                              ? ext.rename_program->size()
+                                              : 0) +
                                " rename rule(s)",
                  argRenames.empty() ? "ignored" : "applied",
                  "Request rename rules override configured rename rules.");
@@ -3092,14 +3213,14 @@ static std::string subconverter_impl(Request &request, Response &response,
       addConfigSection("custom_groups", "effective", "loaded",
                        std::to_string(explain.custom_group_count) +
                            " custom group(s).");
-    if (!ext.rename_array.empty())
+    if (ext.rename_program && !ext.rename_program->empty())
       addConfigSection("rename", argRenames.empty() ? "configured" : "request",
                        "loaded",
-                       std::to_string(ext.rename_array.size()) +
+                       std::to_string(ext.rename_program->size()) +
                            " rename rule(s).");
-    if (!ext.emoji_array.empty())
+    if (ext.emoji_program && !ext.emoji_program->empty())
       addConfigSection("emoji", "configured", "loaded",
-                       std::to_string(ext.emoji_array.size()) +
+                       std::to_string(ext.emoji_program->size()) +
                            " emoji rule(s).");
     if (!lIncludeRemarks.empty() || !lExcludeRemarks.empty())
       addConfigSection("filters", "effective", "loaded",
@@ -3207,12 +3328,14 @@ std::string surgeConfToClash(RESPONSE_CALLBACK_ARGS) {
   tpl_args.request_params["target"] = "clash";
   tpl_args.request_params["url"] = url;
 
-  if (render_template(fetchFile(global.clashBase, proxy, global.cacheConfig),
-                      tpl_args, base_content, global.templatePath) != 0) {
+  RenderedBasePtr base =
+      render_base(fetchFile(global.clashBase, proxy, global.cacheConfig),
+                  tpl_args, BaseFormat::Clash, global.templatePath);
+  if (base->status != 0) {
     *status_code = 400;
-    return base_content;
+    return base->content;
   }
-  clash = YAML::Load(base_content);
+  clash = base->parsed ? YAML::Clone(base->clash) : YAML::Load(base->content);
 
   base_content = fetchFile(url, proxy, global.cacheConfig);
 
@@ -3392,20 +3515,15 @@ std::string surgeConfToClash(RESPONSE_CALLBACK_ARGS) {
             (lineSize >= 2 && strLine[0] == '/' &&
              strLine[1] == '/')) // empty lines and comments are ignored
           continue;
-        else if (!std::any_of(ClashRuleTypes.begin(), ClashRuleTypes.end(),
-                              [&strLine](const std::string &type) {
-                                return startsWith(strLine, type);
-                              })) // remove unsupported types
+        else if (!ruleTypeAllowed(strLine,
+                                  RULE_TARGET_CLASH)) // remove unsupported types
           continue;
         strLine = appendClashRuleTarget(strLine, trim(strArray[2]));
         rule.push_back(strLine);
       }
       ss.clear();
       continue;
-    } else if (!std::any_of(ClashRuleTypes.begin(), ClashRuleTypes.end(),
-                            [&strLine](const std::string &type) {
-                              return startsWith(strLine, type);
-                            }))
+    } else if (!ruleTypeAllowed(strLine, RULE_TARGET_CLASH))
       continue;
     rule.push_back(x);
   }
@@ -8,6 +8,7 @@
 #include "config/ruleset.h"
 #include "generator/config/subexport.h"
 #include "handler/fetch_context.h"
+#include "handler/sub_response_cache.h"
 #include "server/webserver.h"
 
 void refreshRulesets(RulesetConfigs &ruleset_list,
@@ -22,6 +23,7 @@ std::string getRuleset(RESPONSE_CALLBACK_ARGS);
 
 std::string subconverter(RESPONSE_CALLBACK_ARGS);
 std::string subconverterTracked(RESPONSE_CALLBACK_ARGS);
+SubResponseCacheStats subResponseCacheStats();
 std::string simpleToClashR(RESPONSE_CALLBACK_ARGS);
 std::string surgeConfToClash(RESPONSE_CALLBACK_ARGS);
 
@@ -1,6 +1,9 @@
 #include <algorithm>
+#include <chrono>
 #include <future>
+#include <memory>
 #include <thread>
+#include <unordered_map>
 #include <utility>
 
 #include "handler/settings.h"
@@ -12,6 +15,8 @@
 
 //safety lock for multi-thread
 std::mutex on_emoji, on_rename, on_stream, on_time;
+//compiled emoji/rename rules, guarded by the locks above
+static RegexMatchProgramPtr emoji_program, rename_program;
 
 static size_t configuredWorkerCount()
 {
@@ -38,6 +43,13 @@ std::shared_future<std::string> makeReadyStringFuture(std::string value)
     return promise.get_future().share();
 }
 
+std::shared_future<RulesetBody> makeReadyRulesetFuture(std::string value)
+{
+    std::promise<RulesetBody> promise;
+    promise.set_value(std::make_shared<const std::string>(std::move(value)));
+    return promise.get_future().share();
+}
+
 size_t rulesetExecutorWorkerCount()
 {
     return rulesetExecutor().workerCount();
@@ -72,16 +84,37 @@ RegexMatchConfigs safe_get_times()
     return global.timeNodeRules;
 }
 
+static RegexMatchProgramPtr currentProgram(RegexMatchProgramPtr &program, const RegexMatchConfigs &configs)
+{
+    if(!program || program->generation != global.configGeneration)
+        program = compileRegexMatchProgram(configs, global.configGeneration);
+    return program;
+}
+
+RegexMatchProgramPtr safe_get_emoji_program()
+{
+    guarded_mutex guard(on_emoji);
+    return currentProgram(emoji_program, global.emojis);
+}
+
+RegexMatchProgramPtr safe_get_rename_program()
+{
+    guarded_mutex guard(on_rename);
+    return currentProgram(rename_program, global.renames);
+}
+
 void safe_set_emojis(RegexMatchConfigs data)
 {
     guarded_mutex guard(on_emoji);
     global.emojis.swap(data);
+    emoji_program.reset();
 }
 
 void safe_set_renames(RegexMatchConfigs data)
 {
     guarded_mutex guard(on_rename);
     global.renames.swap(data);
+    rename_program.reset();
 }
 
 void safe_set_streams(RegexMatchConfigs data)
@@ -100,6 +133,8 @@ void safe_replace_settings(Settings &&settings)
 {
     std::scoped_lock guard(on_emoji, on_rename, on_stream, on_time);
     global = std::move(settings);
+    emoji_program.reset();
+    rename_program.reset();
 }
 
 static bool canReadLocalFetchPath(const std::string &path,
@@ -131,11 +166,13 @@ std::shared_future<std::string> fetchFileAsync(const std::string &path, const Pr
         retVal = rulesetExecutor().submit(
             [path](){ return fileGet(path, true); });
     else if(isLink(path))
-        retVal = rulesetExecutor().submit(
-            [path, proxy, cache_ttl, context](){
-                return webGet(path, proxy, cache_ttl, nullptr, nullptr,
-                              context);
-            });
+    {
+        /// downloads wait on the fetch engine, not on an executor worker
+        auto promise = std::make_shared<std::promise<std::string>>();
+        retVal = promise->get_future();
+        webGetAsync(path, proxy, cache_ttl, context,
+                    [promise](std::string content){ promise->set_value(std::move(content)); });
+    }
     else
         return makeReadyStringFuture(std::string());
     return retVal.share();
@@ -145,3 +182,117 @@ std::string fetchFile(const std::string &path, const ProxyPolicy &proxy, int cac
 {
     return fetchFileAsync(path, proxy, cache_ttl, find_local, false, context).get();
 }
+
+namespace
+{
+
+struct SharedRuleset
+{
+    std::shared_future<RulesetBody> body;
+    /// set under on_shared_rulesets when the body is, so the TTL counts from the end of the fetch
+    std::shared_ptr<std::chrono::steady_clock::time_point> fetched_at;
+};
+
+/// rulesets asked for by requests with their own list are few, the limit only stops a flood of
+/// distinct URLs from growing the map
+constexpr size_t kSharedRulesetLimit = 256;
+
+std::mutex on_shared_rulesets;
+std::unordered_map<std::string, SharedRuleset> shared_rulesets;
+
+/// still being fetched, or fetched no more than cache_ttl ago with something in it
+bool reusable(const SharedRuleset &shared, int cache_ttl, std::chrono::steady_clock::time_point now)
+{
+    if(shared.body.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return true;
+    if(now - *shared.fetched_at >= std::chrono::seconds(cache_ttl))
+        return false;
+    try
+    {
+        return !shared.body.get()->empty();
+    }
+    catch(...)
+    {
+        return false;
+    }
+}
+
+RulesetBody fetchRulesetBody(const std::string &path, const ProxyPolicy &proxy, int cache_ttl, FetchContext context)
+{
+    std::string content;
+    if(fileExist(path, true) && canReadLocalFetchPath(path, context))
+        content = fileGet(path, true);
+    else if(isLink(path))
+        content = webGet(path, proxy, cache_ttl, nullptr, nullptr, context);
+    return std::make_shared<const std::string>(std::move(content));
+}
+
+} // namespace
+
+std::shared_future<RulesetBody> fetchRulesetAsync(const std::string &path, const ProxyPolicy &proxy, int cache_ttl, bool async, FetchContext context)
+{
+    if(!fileExist(path, true) && !isLink(path))
+        return makeReadyRulesetFuture(std::string());
+
+    /// local rulesets are read again for every request, so edits to them show up right away
+    if(fileExist(path, true))
+    {
+        if(!async)
+            return makeReadyRulesetFuture(*fetchRulesetBody(path, proxy, cache_ttl, context));
+        return rulesetExecutor()
+            .submit([path, proxy, cache_ttl, context]()
+                    { return fetchRulesetBody(path, proxy, cache_ttl, context); })
+            .share();
+    }
+
+    const std::string key = std::to_string(global.configGeneration) + "\n" +
+                            std::to_string(static_cast<int>(context)) + "\n" +
+                            proxy.cacheIdentity() + "\n" + path;
+    const auto now = std::chrono::steady_clock::now();
+    std::shared_ptr<std::promise<RulesetBody>> promise;
+    std::shared_future<RulesetBody> body;
+    auto fetched_at = std::make_shared<std::chrono::steady_clock::time_point>(now);
+    {
+        guarded_mutex guard(on_shared_rulesets);
+        auto iter = shared_rulesets.find(key);
+        if(iter != shared_rulesets.end())
+        {
+            if(reusable(iter->second, cache_ttl, now))
+                return iter->second.body;
+            shared_rulesets.erase(iter);
+        }
+        if(shared_rulesets.size() >= kSharedRulesetLimit)
+        {
+            for(auto stale = shared_rulesets.begin(); stale != shared_rulesets.end();)
+                stale = reusable(stale->second, cache_ttl, now) ? std::next(stale) : shared_rulesets.erase(stale);
+        }
+        promise = std::make_shared<std::promise<RulesetBody>>();
+        body = promise->get_future().share();
+        if(shared_rulesets.size() < kSharedRulesetLimit)
+            shared_rulesets.emplace(key, SharedRuleset{body, fetched_at});
+    }
+
+    auto fulfil = [promise, fetched_at](RulesetBody content)
+    {
+        guarded_mutex guard(on_shared_rulesets);
+        *fetched_at = std::chrono::steady_clock::now();
+        promise->set_value(std::move(content));
+    };
+    if(async)
+        webGetAsync(path, proxy, cache_ttl, context, [fulfil](std::string content)
+        {
+            fulfil(std::make_shared<const std::string>(std::move(content)));
+        });
+    else
+    {
+        try
+        {
+            fulfil(fetchRulesetBody(path, proxy, cache_ttl, context));
+        }
+        catch(...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+    }
+    return body;
+}
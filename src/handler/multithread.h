@@ -8,6 +8,8 @@
 #include <yaml-cpp/yaml.h>
 
 #include "config/regmatch.h"
+#include "config/ruleset.h"
+#include "generator/config/regmatch_program.h"
 #include "handler/fetch_context.h"
 #include "handler/proxy_policy.h"
 #include "utils/ini_reader/ini_reader.h"
@@ -21,6 +23,8 @@ RegexMatchConfigs safe_get_emojis();
 RegexMatchConfigs safe_get_renames();
 RegexMatchConfigs safe_get_streams();
 RegexMatchConfigs safe_get_times();
+RegexMatchProgramPtr safe_get_emoji_program();
+RegexMatchProgramPtr safe_get_rename_program();
 YAML::Node safe_get_clash_base();
 INIReader safe_get_mellow_base();
 void safe_set_emojis(RegexMatchConfigs data);
@@ -29,6 +33,7 @@ void safe_set_streams(RegexMatchConfigs data);
 void safe_set_times(RegexMatchConfigs data);
 void safe_replace_settings(Settings &&settings);
 std::shared_future<std::string> makeReadyStringFuture(std::string value);
+std::shared_future<RulesetBody> makeReadyRulesetFuture(std::string value);
 size_t rulesetExecutorWorkerCount();
 size_t rulesetExecutorQueueCapacity();
 std::shared_future<std::string> fetchFileAsync(
@@ -38,5 +43,11 @@ std::shared_future<std::string> fetchFileAsync(
 std::string fetchFile(const std::string &path, const ProxyPolicy &proxy,
                       int cache_ttl, bool find_local = true,
                       FetchContext context = FetchContext::TrustedConfig);
+/// fetchFileAsync for a ruleset. A remote body is fetched once per cache_ttl,
+/// counted from when the fetch ends, and config generation and then handed to
+/// every request asking for it; a local file is read for every request.
+std::shared_future<RulesetBody> fetchRulesetAsync(
+    const std::string &path, const ProxyPolicy &proxy, int cache_ttl,
+    bool async, FetchContext context = FetchContext::TrustedConfig);
 
 #endif // MULTITHREAD_H_INCLUDED
@@ -0,0 +1,223 @@
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif // USE_BROTLI
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif // USE_ZSTD
+
+#include "handler/response_encoding.h"
+
+namespace {
+
+constexpr int kGzipLevel = 6;
+/// a cached body is compressed once and sent many times, so the levels lean
+/// towards size while staying well under a second for a multi-MB config
+constexpr int kBrotliQuality = 6;
+constexpr int kZstdLevel = 9;
+
+/// negotiation order when q-values tie
+constexpr ContentEncoding kPreference[] = {
+    ContentEncoding::Zstd, ContentEncoding::Brotli, ContentEncoding::Gzip};
+
+std::string_view trim(std::string_view text) {
+  const size_t begin = text.find_first_not_of(" \t");
+  if (begin == std::string_view::npos)
+    return {};
+  return text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+}
+
+bool equalsIgnoreCase(std::string_view left, std::string_view right) {
+  if (left.size() != right.size())
+    return false;
+  for (size_t i = 0; i < left.size(); i++) {
+    char a = left[i], b = right[i];
+    if (a >= 'A' && a <= 'Z')
+      a = static_cast<char>(a - 'A' + 'a');
+    if (b >= 'A' && b <= 'Z')
+      b = static_cast<char>(b - 'A' + 'a');
+    if (a != b)
+      return false;
+  }
+  return true;
+}
+
+/// qvalue in thousandths, as RFC 9110 bounds its precision; 1000 when absent
+int parseQuality(std::string_view parameters) {
+  while (!parameters.empty()) {
+    const size_t semicolon = parameters.find(';');
+    std::string_view parameter = trim(parameters.substr(0, semicolon));
+    parameters = semicolon == std::string_view::npos
+                     ? std::string_view()
+                     : parameters.substr(semicolon + 1);
+    if (parameter.size() < 2 || (parameter[0] != 'q' && parameter[0] != 'Q'))
+      continue;
+    std::string_view value = trim(parameter.substr(1));
+    if (value.empty() || value[0] != '=')
+      continue;
+    value = trim(value.substr(1));
+    if (value.empty() || (value[0] != '0' && value[0] != '1'))
+      return 0;
+    int quality = (value[0] - '0') * 1000;
+    if (value.size() > 1 && value[1] == '.') {
+      int scale = 100;
+      for (size_t i = 2; i < value.size() && i < 5 && scale; i++, scale /= 10) {
+        if (value[i] < '0' || value[i] > '9')
+          break;
+        quality += (value[i] - '0') * scale;
+      }
+    }
+    return quality > 1000 ? 1000 : quality;
+  }
+  return 1000;
+}
+
+bool gzipBody(std::string_view body, std::string &out) {
+  z_stream stream{};
+  if (deflateInit2(&stream, kGzipLevel, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  out.resize(deflateBound(&stream, static_cast<uLong>(body.size())));
+  stream.next_in =
+      reinterpret_cast<Bytef *>(const_cast<char *>(body.data()));
+  stream.avail_in = static_cast<uInt>(body.size());
+  stream.next_out = reinterpret_cast<Bytef *>(out.data());
+  stream.avail_out = static_cast<uInt>(out.size());
+  const int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return result == Z_STREAM_END;
+}
+
+} // namespace
+
+const char *contentEncodingName(ContentEncoding encoding) {
+  switch (encoding) {
+  case ContentEncoding::Gzip:
+    return "gzip";
+  case ContentEncoding::Brotli:
+    return "br";
+  case ContentEncoding::Zstd:
+    return "zstd";
+  default:
+    return "identity";
+  }
+}
+
+bool contentEncodingAvailable(ContentEncoding encoding) {
+  switch (encoding) {
+  case ContentEncoding::Identity:
+  case ContentEncoding::Gzip:
+    return true;
+#ifdef USE_BROTLI
+  case ContentEncoding::Brotli:
+    return true;
+#endif // USE_BROTLI
+#ifdef USE_ZSTD
+  case ContentEncoding::Zstd:
+    return true;
+#endif // USE_ZSTD
+  default:
+    return false;
+  }
+}
+
+ContentEncoding negotiateContentEncoding(std::string_view accept_encoding) {
+  /// -1 for codings the header does not mention
+  int quality[kContentEncodingCount] = {-1, -1, -1, -1};
+  int wildcard = -1;
+  while (!accept_encoding.empty()) {
+    const size_t comma = accept_encoding.find(',');
+    std::string_view item = accept_encoding.substr(0, comma);
+    accept_encoding = comma == std::string_view::npos
+                          ? std::string_view()
+                          : accept_encoding.substr(comma + 1);
+    const size_t semicolon = item.find(';');
+    const std::string_view coding = trim(item.substr(0, semicolon));
+    const int q = semicolon == std::string_view::npos
+                      ? 1000
+                      : parseQuality(item.substr(semicolon + 1));
+    if (coding == "*")
+      wildcard = q;
+    else if (equalsIgnoreCase(coding, "gzip") ||
+             equalsIgnoreCase(coding, "x-gzip"))
+      quality[static_cast<size_t>(ContentEncoding::Gzip)] = q;
+    else if (equalsIgnoreCase(coding, "br"))
+      quality[static_cast<size_t>(ContentEncoding::Brotli)] = q;
+    else if (equalsIgnoreCase(coding, "zstd"))
+      quality[static_cast<size_t>(ContentEncoding::Zstd)] = q;
+  }
+
+  ContentEncoding best = ContentEncoding::Identity;
+  int best_quality = 0;
+  for (ContentEncoding encoding : kPreference) {
+    if (!contentEncodingAvailable(encoding))
+      continue;
+    int q = quality[static_cast<size_t>(encoding)];
+    if (q < 0)
+      q = wildcard < 0 ? 0 : wildcard;
+    if (q > best_quality) {
+      best = encoding;
+      best_quality = q;
+    }
+  }
+  return best;
+}
+
+bool compressBody(std::string_view body, ContentEncoding encoding,
+                  std::string &out) {
+  switch (encoding) {
+  case ContentEncoding::Gzip:
+    return gzipBody(body, out);
+#ifdef USE_BROTLI
+  case ContentEncoding::Brotli: {
+    size_t size = BrotliEncoderMaxCompressedSize(body.size());
+    if (!size)
+      return false;
+    out.resize(size);
+    if (!BrotliEncoderCompress(
+            kBrotliQuality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+            body.size(), reinterpret_cast<const uint8_t *>(body.data()),
+            &size, reinterpret_cast<uint8_t *>(out.data())))
+      return false;
+    out.resize(size);
+    return true;
+  }
+#endif // USE_BROTLI
+#ifdef USE_ZSTD
+  case ContentEncoding::Zstd: {
+    out.resize(ZSTD_compressBound(body.size()));
+    const size_t size = ZSTD_compress(out.data(), out.size(), body.data(),
+                                      body.size(), kZstdLevel);
+    if (ZSTD_isError(size))
+      return false;
+    out.resize(size);
+    return true;
+  }
+#endif // USE_ZSTD
+  default:
+    return false;
+  }
+}
+
+EncodedBodies::BodyPtr EncodedBodies::get(std::string_view body,
+                                          ContentEncoding encoding) const {
+  const size_t index = static_cast<size_t>(encoding);
+  if (encoding == ContentEncoding::Identity || index >= kContentEncodingCount)
+    return nullptr;
+  /// held while compressing, so clients arriving together wait for the one
+  /// compression instead of each running their own
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!made_[index]) {
+    made_[index] = true;
+    std::string compressed;
+    if (compressBody(body, encoding, compressed) &&
+        compressed.size() < body.size())
+      bodies_[index] = std::make_shared<const std::string>(
+          std::move(compressed));
+  }
+  return bodies_[index];
+}
@@ -0,0 +1,47 @@
+#ifndef RESPONSE_ENCODING_H_INCLUDED
+#define RESPONSE_ENCODING_H_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+enum class ContentEncoding : uint8_t { Identity, Gzip, Brotli, Zstd };
+
+constexpr size_t kContentEncodingCount = 4;
+/// bodies below this go out as they are, compressing them saves next to
+/// nothing
+constexpr size_t kMinCompressedBodySize = 1024;
+
+/// the token for Content-Encoding, "identity" for Identity
+const char *contentEncodingName(ContentEncoding encoding);
+/// gzip always, brotli and zstd when the build found the libraries
+bool contentEncodingAvailable(ContentEncoding encoding);
+/// the available encoding with the highest q-value in an Accept-Encoding
+/// header, zstd over brotli over gzip when they tie. Identity when the header
+/// is empty or refuses every compressed encoding.
+ContentEncoding negotiateContentEncoding(std::string_view accept_encoding);
+/// false when the encoding is unavailable or the library fails
+bool compressBody(std::string_view body, ContentEncoding encoding,
+                  std::string &out);
+
+/// the compressed variants of one body that never changes, each compressed
+/// the first time a client asks for it and then kept. A variant that fails or
+/// does not come out smaller is remembered as nullptr, the body is sent
+/// as it is.
+class EncodedBodies {
+public:
+  using BodyPtr = std::shared_ptr<const std::string>;
+
+  BodyPtr get(std::string_view body, ContentEncoding encoding) const;
+
+private:
+  mutable std::mutex mutex_;
+  mutable std::array<BodyPtr, kContentEncodingCount> bodies_;
+  mutable std::array<bool, kContentEncodingCount> made_{};
+};
+
+#endif // RESPONSE_ENCODING_H_INCLUDED
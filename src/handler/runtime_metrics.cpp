@@ -0,0 +1,219 @@
+#include "handler/runtime_metrics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "generator/config/ruleconvert.h"
+#include "generator/template/base_cache.h"
+#include "handler/curl_handle_pool.h"
+#include "handler/curl_multi_engine.h"
+#include "handler/interfaces.h"
+#include "handler/settings.h"
+#include "handler/webget.h"
+#include "script/script_cache.h"
+#include "script/script_quickjs.h"
+#include "utils/regexp.h"
+
+namespace {
+
+void appendMetric(std::string &output, const std::string &name,
+                  const char *type, const char *help, uint64_t value) {
+  output += "# HELP " + name + " " + help + "\n";
+  output += "# TYPE " + name + " " + type + "\n";
+  output += name + " " + std::to_string(value) + "\n";
+}
+
+void appendCacheMetrics(std::string &output, const std::string &prefix,
+                        const std::string &subject,
+                        const LruCacheStats &stats) {
+  appendMetric(output, prefix + "_hits_total", "counter",
+               ("Lookups served by the " + subject + " cache.").data(),
+               stats.hits);
+  appendMetric(output, prefix + "_misses_total", "counter",
+               ("Lookups not found in the " + subject + " cache.").data(),
+               stats.misses);
+  appendMetric(output, prefix + "_evictions_total", "counter",
+               ("Entries evicted from the " + subject + " cache.").data(),
+               stats.evictions);
+  appendMetric(output, prefix + "_entries", "gauge",
+               ("Entries in the " + subject + " cache.").data(),
+               stats.entries);
+  appendMetric(output, prefix + "_bytes", "gauge",
+               ("Approximate size of the " + subject + " cache in bytes.")
+                   .data(),
+               stats.bytes);
+}
+
+} // namespace
+
+namespace runtime_metrics {
+
+std::string page(RESPONSE_CALLBACK_ARGS) {
+  (void)request;
+  response.headers["Cache-Control"] = "no-store";
+
+  std::string output;
+  RegexCacheStats regex = regexCacheStats();
+  appendMetric(output, "subconverter_regex_cache_hits_total", "counter",
+               "Compiled regex cache hits.", regex.hits);
+  appendMetric(output, "subconverter_regex_cache_misses_total", "counter",
+               "Compiled regex cache misses, including invalid patterns.",
+               regex.misses);
+  appendMetric(output, "subconverter_regex_cache_entries", "gauge",
+               "Compiled regex cache entries.", regex.entries);
+  appendMetric(output, "subconverter_regex_cache_bytes", "gauge",
+               "Approximate compiled regex cache size in bytes.",
+               regex.bytes);
+  appendMetric(output, "subconverter_regex_jit_compiled_total", "counter",
+               "Regex patterns compiled with PCRE2 JIT.", regex.jit_compiled);
+  appendMetric(output, "subconverter_regex_jit_fallbacks_total", "counter",
+               "JIT matches retried on the interpreter after a JIT stack "
+               "overflow.",
+               regex.jit_fallbacks);
+
+  appendCacheMetrics(output, "subconverter_ruleset_cache",
+                     "ruleset conversion", rulesetConversionCacheStats());
+  appendCacheMetrics(output, "subconverter_rule_block_cache",
+                     "rendered rule block", ruleBlockCacheStats());
+  appendCacheMetrics(output, "subconverter_external_config_cache",
+                     "parsed external config", externalConfigCacheStats());
+  appendCacheMetrics(output, "subconverter_base_template_cache",
+                     "rendered base config", base_template_cache_stats());
+
+  SubResponseCacheStats sub_response = subResponseCacheStats();
+  appendMetric(output, "subconverter_sub_response_cache_hits_total", "counter",
+               "/sub responses served fresh from the response cache.",
+               sub_response.hits);
+  appendMetric(output, "subconverter_sub_response_cache_stale_hits_total",
+               "counter",
+               "/sub responses served stale while a refresh was pending.",
+               sub_response.stale_hits);
+  appendMetric(output, "subconverter_sub_response_cache_misses_total",
+               "counter", "/sub lookups not found in the response cache.",
+               sub_response.misses);
+  appendMetric(output, "subconverter_sub_response_cache_refreshes_total",
+               "counter", "Background refreshes started for stale responses.",
+               sub_response.refreshes);
+  appendMetric(output, "subconverter_sub_response_cache_evictions_total",
+               "counter", "Responses evicted from the response cache.",
+               sub_response.evictions);
+  appendMetric(output, "subconverter_sub_response_cache_entries", "gauge",
+               "Responses in the /sub response cache.", sub_response.entries);
+  appendMetric(output, "subconverter_sub_response_cache_bytes", "gauge",
+               "Approximate size of the /sub response cache in bytes.",
+               sub_response.bytes);
+
+  ContentStore::Stats ruleset_disk = rulesetDiskCacheStats();
+  appendMetric(output, "subconverter_ruleset_disk_cache_hits_total", "counter",
+               "Converted rulesets read back from ruleset_cache_dir.",
+               ruleset_disk.hits);
+  appendMetric(output, "subconverter_ruleset_disk_cache_misses_total",
+               "counter", "Converted rulesets not found in ruleset_cache_dir.",
+               ruleset_disk.misses);
+  appendMetric(output, "subconverter_ruleset_disk_cache_writes_total",
+               "counter", "Converted rulesets written to ruleset_cache_dir.",
+               ruleset_disk.writes);
+  appendMetric(output, "subconverter_ruleset_disk_cache_bytes", "gauge",
+               "Approximate size of ruleset_cache_dir in bytes.",
+               ruleset_disk.bytes);
+
+  CurlHandlePool::Stats curl_pool = curlHandlePoolStats(
+      static_cast<size_t>(std::max(1, global.maxConcurThreads)));
+  appendMetric(output, "subconverter_curl_connections_new_total", "counter",
+               "Upstream transfers that opened a new connection.",
+               curl_pool.new_connections);
+  appendMetric(output, "subconverter_curl_connections_reused_total",
+               "counter",
+               "Upstream transfers carried by a cached connection.",
+               curl_pool.reused_connections);
+  appendMetric(output, "subconverter_curl_handles", "gauge",
+               "curl handles created by the handle pool.", curl_pool.handles);
+
+  CurlMultiEngine::Stats engine = curlMultiEngineStats(
+      static_cast<size_t>(std::max(1, global.maxConcurThreads)));
+  appendMetric(output, "subconverter_fetch_engine_transfers_total", "counter",
+               "Upstream transfers started by the fetch engine.",
+               engine.started);
+  appendMetric(output, "subconverter_fetch_engine_running", "gauge",
+               "Upstream transfers in flight in the fetch engine.",
+               engine.running);
+
+  FetchTransferStats transfer = fetchTransferStats();
+  appendMetric(output, "subconverter_fetch_transfers_total", "counter",
+               "Upstream fetches that downloaded a body.", transfer.fetches);
+  appendMetric(output, "subconverter_fetch_transfers_encoded_total",
+               "counter", "Upstream fetches answered with a compressed body.",
+               transfer.encoded_fetches);
+  appendMetric(output, "subconverter_fetch_wire_bytes_total", "counter",
+               "Upstream body bytes as transferred, before decoding.",
+               transfer.wire_bytes);
+  appendMetric(output, "subconverter_fetch_decoded_bytes_total", "counter",
+               "Upstream body bytes after content decoding.",
+               transfer.decoded_bytes);
+
+  FetchCache::Stats fetch = fetchCacheStats();
+  appendMetric(output, "subconverter_fetch_cache_hits_total", "counter",
+               "Fetches served from the cache within their TTL.", fetch.hits);
+  appendMetric(output, "subconverter_fetch_cache_memory_hits_total",
+               "counter", "Fetch cache hits served without reading the disk.",
+               fetch.memory_hits);
+  appendMetric(output, "subconverter_fetch_cache_misses_total", "counter",
+               "Fetch cache lookups with no stored copy.", fetch.misses);
+  appendMetric(output, "subconverter_fetch_cache_expired_total", "counter",
+               "Fetch cache lookups that found a copy older than its TTL.",
+               fetch.expired);
+  appendMetric(output, "subconverter_fetch_cache_writes_total", "counter",
+               "Fetched responses stored in the cache.", fetch.writes);
+  appendMetric(output, "subconverter_fetch_cache_revalidated_total", "counter",
+               "Expired cache entries confirmed unchanged by a 304 response.",
+               fetch.revalidations);
+  appendMetric(output, "subconverter_fetch_cache_revalidated_bytes_total",
+               "counter",
+               "Body bytes not downloaded again thanks to a 304 response.",
+               fetch.revalidated_bytes);
+  appendMetric(output, "subconverter_fetch_cache_refetched_total", "counter",
+               "Expired cache entries replaced by a full download.",
+               fetch.refetches);
+  appendMetric(output, "subconverter_fetch_cache_refetched_bytes_total",
+               "counter", "Body bytes downloaded to replace expired entries.",
+               fetch.refetched_bytes);
+  appendMetric(output, "subconverter_fetch_cache_memory_entries", "gauge",
+               "Fetched responses held in memory.", fetch.memory_entries);
+  appendMetric(output, "subconverter_fetch_cache_memory_bytes", "gauge",
+               "Approximate size of the in-memory fetch cache in bytes.",
+               fetch.memory_bytes);
+  appendMetric(output, "subconverter_fetch_cache_index_entries", "gauge",
+               "Fetch cache keys whose presence on disk is remembered.",
+               fetch.index_entries);
+
+  ScriptCacheStats script = script_cache_stats();
+  appendCacheMetrics(output, "subconverter_script_bytecode_cache",
+                     "compiled script bytecode", script.bytecode);
+  appendMetric(output, "subconverter_script_function_reuses_total", "counter",
+               "Script calls that reused a function already resolved in the "
+               "same context.",
+               script.function_reuses);
+  appendMetric(output, "subconverter_script_file_reads_total", "counter",
+               "Script files read from disk because they were new or changed.",
+               script.file_reads);
+
+#ifndef NO_JS_RUNTIME
+  ScriptRuntimePool::Stats runtimes = script_runtime_pool().stats();
+  appendMetric(output, "subconverter_script_runtimes_created_total", "counter",
+               "QuickJS runtimes created for clean script calls.",
+               runtimes.created);
+  appendMetric(output, "subconverter_script_runtimes_reused_total", "counter",
+               "Clean script calls served by a pooled QuickJS runtime.",
+               runtimes.reused);
+  appendMetric(output, "subconverter_script_runtimes_discarded_total",
+               "counter",
+               "QuickJS runtimes freed instead of returned to the pool.",
+               runtimes.discarded);
+  appendMetric(output, "subconverter_script_runtimes_idle", "gauge",
+               "QuickJS runtimes waiting in the pool.", runtimes.idle);
+#endif // NO_JS_RUNTIME
+  return output;
+}
+
+} // namespace runtime_metrics
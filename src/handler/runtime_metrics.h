@@ -0,0 +1,14 @@
+#ifndef RUNTIME_METRICS_H_INCLUDED
+#define RUNTIME_METRICS_H_INCLUDED
+
+#include <string>
+
+#include "server/webserver.h"
+
+namespace runtime_metrics {
+
+std::string page(RESPONSE_CALLBACK_ARGS);
+
+} // namespace runtime_metrics
+
+#endif // RUNTIME_METRICS_H_INCLUDED
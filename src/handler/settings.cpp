@@ -16,6 +16,7 @@
 #include "utils/concurrent_lru_cache.h"
 #include "utils/md5/md5_interface.h"
 #include "utils/network.h"
+#include "utils/regexp.h"
 #include "utils/system.h"
 
 // multi-thread lock
@@ -128,18 +129,76 @@ static void finalizePerformanceSettings() {
   if (!response_cache_ttl.empty())
     global.responseCacheTtl = to_int(response_cache_ttl, global.responseCacheTtl);
 
+  std::string response_cache_stale_ttl =
+      getEnv("SUBCONVERTER_RESPONSE_CACHE_STALE_TTL");
+  if (!response_cache_stale_ttl.empty())
+    global.responseCacheStaleTtl =
+        to_int(response_cache_stale_ttl, global.responseCacheStaleTtl);
+
+  std::string enable_metrics = getEnv("SUBCONVERTER_ENABLE_METRICS");
+  if (!enable_metrics.empty())
+    global.enableMetrics = parseBoolSetting(enable_metrics);
+
+  std::string regex_jit = getEnv("SUBCONVERTER_REGEX_JIT");
+  if (!regex_jit.empty())
+    global.enableRegexJit = parseBoolSetting(regex_jit);
+
+  std::string ruleset_cache_dir = getEnv("SUBCONVERTER_RULESET_CACHE_DIR");
+  if (!ruleset_cache_dir.empty())
+    global.rulesetCacheDir = ruleset_cache_dir;
+
+  std::string subscription_fetch_concurrency =
+      getEnv("SUBCONVERTER_SUBSCRIPTION_FETCH_CONCURRENCY");
+  if (!subscription_fetch_concurrency.empty())
+    global.subscriptionFetchConcurrency = to_int(
+        subscription_fetch_concurrency, global.subscriptionFetchConcurrency);
+
+  std::string script_runtime_pool_size =
+      getEnv("SUBCONVERTER_SCRIPT_RUNTIME_POOL_SIZE");
+  if (!script_runtime_pool_size.empty())
+    global.scriptRuntimePoolSize =
+        to_int(script_runtime_pool_size, global.scriptRuntimePoolSize);
+
+  std::string script_memory_limit = getEnv("SUBCONVERTER_SCRIPT_MEMORY_LIMIT_MB");
+  if (!script_memory_limit.empty())
+    global.scriptMemoryLimitMB =
+        to_int(script_memory_limit, global.scriptMemoryLimitMB);
+
+  std::string script_timeout = getEnv("SUBCONVERTER_SCRIPT_TIMEOUT_MS");
+  if (!script_timeout.empty())
+    global.scriptTimeout = to_int(script_timeout, global.scriptTimeout);
+
+  std::string fetch_cache_memory = getEnv("SUBCONVERTER_FETCH_CACHE_MEMORY_MB");
+  if (!fetch_cache_memory.empty())
+    global.fetchCacheMemoryMB =
+        to_int(fetch_cache_memory, global.fetchCacheMemoryMB);
+
   if (global.responseCacheTtl < 0)
     global.responseCacheTtl = 0;
+  if (global.responseCacheStaleTtl < 0)
+    global.responseCacheStaleTtl = 0;
+  if (global.responseCacheMaxEntries < 0)
+    global.responseCacheMaxEntries = 0;
+  if (global.responseCacheMaxMB < 0)
+    global.responseCacheMaxMB = 0;
+  if (global.subscriptionFetchConcurrency < 1)
+    global.subscriptionFetchConcurrency = 1;
+  if (global.fetchCacheMemoryMB < 0)
+    global.fetchCacheMemoryMB = 0;
+  if (global.scriptRuntimePoolSize < 0)
+    global.scriptRuntimePoolSize = 0;
+  if (global.scriptMemoryLimitMB < 0)
+    global.scriptMemoryLimitMB = 0;
+  if (global.scriptTimeout < 0)
+    global.scriptTimeout = 0;
   if (global.maxConcurThreads < 1)
     global.maxConcurThreads = 1;
   if (global.maxServerThreads < global.maxConcurThreads)
     global.maxServerThreads = global.maxConcurThreads;
-  if (global.responseCacheTtl > 5) {
-    writeLog(0,
-             "response_cache_ttl 最大允许 5 秒，已自动收敛到 5。",
+  if (global.enableRegexJit && !regexJitAvailable())
+    writeLog(0, "当前 PCRE2 未启用 JIT 支持，正则匹配将使用解释器。",
              LOG_LEVEL_WARNING);
-    global.responseCacheTtl = 5;
-  }
+  regexSetJitEnabled(global.enableRegexJit);
 }
 
 static void finalizeDashboardAuthSettings() {
@@ -444,7 +503,7 @@ void refreshRulesets(RulesetConfigs &ruleset_list,
             "",
             "",
             RULESET_SURGE,
-            makeReadyStringFuture(rule_url.substr(pos)),
+            makeReadyRulesetFuture(rule_url.substr(pos)),
             0,
             x.Options};
     } else {
@@ -471,8 +530,8 @@ void refreshRulesets(RulesetConfigs &ruleset_list,
             rule_url,
             rule_url_typed,
             type,
-            fetchFileAsync(rule_url, proxy, global.cacheRuleset, true,
-                           global.asyncFetchRuleset, context),
+            fetchRulesetAsync(rule_url, proxy, global.cacheRuleset,
+                              global.asyncFetchRuleset, context),
             x.Interval,
             x.Options};
     }
@@ -782,6 +841,21 @@ void readYAMLConf(YAML::Node &node) {
     node["advanced"]["coalesce_retry_on_5xx"] >> global.coalesceRetryOn5xx;
     node["advanced"]["allow_insecure_tls"] >> global.allowInsecureTls;
     node["advanced"]["response_cache_ttl"] >> global.responseCacheTtl;
+    node["advanced"]["response_cache_stale_ttl"] >>
+        global.responseCacheStaleTtl;
+    node["advanced"]["response_cache_max_entries"] >>
+        global.responseCacheMaxEntries;
+    node["advanced"]["response_cache_max_mb"] >> global.responseCacheMaxMB;
+    node["advanced"]["enable_metrics"] >> global.enableMetrics;
+    node["advanced"]["enable_regex_jit"] >> global.enableRegexJit;
+    node["advanced"]["ruleset_cache_dir"] >> global.rulesetCacheDir;
+    node["advanced"]["fetch_cache_memory_mb"] >> global.fetchCacheMemoryMB;
+    node["advanced"]["subscription_fetch_concurrency"] >>
+        global.subscriptionFetchConcurrency;
+    node["advanced"]["script_runtime_pool_size"] >>
+        global.scriptRuntimePoolSize;
+    node["advanced"]["script_memory_limit_mb"] >> global.scriptMemoryLimitMB;
+    node["advanced"]["script_timeout_ms"] >> global.scriptTimeout;
   }
   if (node["statistics"].IsDefined()) {
     YAML::Node stats = node["statistics"];
@@ -1024,7 +1098,16 @@ void readTOMLConf(toml::value &root) {
       "enable_request_coalescing", global.enableRequestCoalescing,
       "coalesce_retry_on_5xx", global.coalesceRetryOn5xx,
       "allow_insecure_tls", global.allowInsecureTls,
-      "response_cache_ttl", global.responseCacheTtl);
+      "response_cache_ttl", global.responseCacheTtl,
+      "response_cache_stale_ttl", global.responseCacheStaleTtl,
+      "response_cache_max_entries", global.responseCacheMaxEntries,
+      "response_cache_max_mb", global.responseCacheMaxMB, "enable_metrics",
+      global.enableMetrics, "enable_regex_jit", global.enableRegexJit,
+      "ruleset_cache_dir", global.rulesetCacheDir, "fetch_cache_memory_mb",
+      global.fetchCacheMemoryMB, "subscription_fetch_concurrency",
+      global.subscriptionFetchConcurrency, "script_runtime_pool_size",
+      global.scriptRuntimePoolSize, "script_memory_limit_mb",
+      global.scriptMemoryLimitMB, "script_timeout_ms", global.scriptTimeout);
 
   if (global.printDbgInfo)
     global.logLevel = LOG_LEVEL_VERBOSE;
@@ -1497,6 +1580,21 @@ bool readConf() {
   ini.get_bool_if_exist("coalesce_retry_on_5xx", global.coalesceRetryOn5xx);
   ini.get_bool_if_exist("allow_insecure_tls", global.allowInsecureTls);
   ini.get_int_if_exist("response_cache_ttl", global.responseCacheTtl);
+  ini.get_int_if_exist("response_cache_stale_ttl",
+                       global.responseCacheStaleTtl);
+  ini.get_int_if_exist("response_cache_max_entries",
+                       global.responseCacheMaxEntries);
+  ini.get_int_if_exist("response_cache_max_mb", global.responseCacheMaxMB);
+  ini.get_bool_if_exist("enable_metrics", global.enableMetrics);
+  ini.get_bool_if_exist("enable_regex_jit", global.enableRegexJit);
+  ini.get_if_exist("ruleset_cache_dir", global.rulesetCacheDir);
+  ini.get_int_if_exist("fetch_cache_memory_mb", global.fetchCacheMemoryMB);
+  ini.get_int_if_exist("subscription_fetch_concurrency",
+                       global.subscriptionFetchConcurrency);
+  ini.get_int_if_exist("script_runtime_pool_size",
+                       global.scriptRuntimePoolSize);
+  ini.get_int_if_exist("script_memory_limit_mb", global.scriptMemoryLimitMB);
+  ini.get_int_if_exist("script_timeout_ms", global.scriptTimeout);
 
   if (ini.section_exist("statistics")) {
     ini.enter_section("statistics");
@@ -1818,7 +1916,7 @@ struct CachedExternalConfig {
   size_t cache_bytes = 0;
 };
 
-ConcurrentLruCache<std::string, CachedExternalConfig> external_config_cache(
+ShardedLruCache<std::string, CachedExternalConfig> external_config_cache(
     kExternalConfigCacheEntries, kExternalConfigCacheBytes);
 
 static std::string buildExternalConfigCacheKey(
@@ -1857,6 +1955,10 @@ size_t externalConfigCacheMaxEntries() {
 
 size_t externalConfigCacheMaxBytes() { return kExternalConfigCacheBytes; }
 
+LruCacheStats externalConfigCacheStats() {
+  return external_config_cache.stats();
+}
+
 ExternalConfigLoadResult loadExternalConfig(const std::string &path,
                                             ExternalConfig &ext,
                                             FetchContext context) {
@@ -1882,39 +1984,39 @@ ExternalConfigLoadResult loadExternalConfig(const std::string &path,
   const std::string key = buildExternalConfigCacheKey(
       base_content, context, global.configGeneration);
 
-  CachedExternalConfig cached = external_config_cache.getOrCompute(
-      key, cache_enabled,
-      [&] {
-        CachedExternalConfig value;
-        template_args parsed_tpl_args = *request_tpl_args;
-        parsed_tpl_args.local_vars.clear();
-        ExternalConfig parsed;
-        parsed.tpl_args = &parsed_tpl_args;
-        value.status =
-            parseExternalConfigContent(path, base_content, parsed, context);
-        value.local_vars = std::move(parsed_tpl_args.local_vars);
-        parsed.tpl_args = nullptr;
-        value.config = std::move(parsed);
-        value.cache_bytes =
-            base_content.size() + localVarsSize(value.local_vars);
-        return value;
-      },
-      [](const CachedExternalConfig &value)
-          -> ConcurrentLruCache<std::string,
-                                CachedExternalConfig>::CacheSize {
-        if (value.status != ExternalConfigLoadStatus::Success)
-          return std::nullopt;
-        return value.cache_bytes;
-      });
-
-  if (cached.status != ExternalConfigLoadStatus::Success)
-    return {cached.status};
+  std::shared_ptr<const CachedExternalConfig> cached =
+      external_config_cache.getOrCompute(
+          key, cache_enabled,
+          [&] {
+            CachedExternalConfig value;
+            template_args parsed_tpl_args = *request_tpl_args;
+            parsed_tpl_args.local_vars.clear();
+            ExternalConfig parsed;
+            parsed.tpl_args = &parsed_tpl_args;
+            value.status =
+                parseExternalConfigContent(path, base_content, parsed, context);
+            value.local_vars = std::move(parsed_tpl_args.local_vars);
+            parsed.tpl_args = nullptr;
+            value.config = std::move(parsed);
+            value.cache_bytes =
+                base_content.size() + localVarsSize(value.local_vars);
+            return value;
+          },
+          [](const CachedExternalConfig &value)
+              -> ShardedLruCache<std::string, CachedExternalConfig>::CacheSize {
+            if (value.status != ExternalConfigLoadStatus::Success)
+              return std::nullopt;
+            return value.cache_bytes;
+          });
+
+  if (cached->status != ExternalConfigLoadStatus::Success)
+    return {cached->status};
 
   template_args *destination_tpl_args = ext.tpl_args;
-  ext = std::move(cached.config);
+  ext = cached->config;
   ext.tpl_args = destination_tpl_args;
   if (destination_tpl_args) {
-    for (const auto &[name, value] : cached.local_vars)
+    for (const auto &[name, value] : cached->local_vars)
       destination_tpl_args->local_vars[name] = value;
   }
   return {ExternalConfigLoadStatus::Success};
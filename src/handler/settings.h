@@ -83,15 +83,32 @@ struct Settings {
   // cache system
   bool serveCacheOnFetchFail = false;
   int cacheSubscription = 60, cacheConfig = 300, cacheRuleset = 21600;
+  // converted rulesets kept on disk across restarts, disabled when empty
+  std::string rulesetCacheDir;
+  // recently fetched bodies kept in RAM in front of the cache directory
+  int fetchCacheMemoryMB = 32;
+  // links of one /sub request fetched and parsed at the same time
+  int subscriptionFetchConcurrency = 4;
+  // idle QuickJS runtimes kept for script_clean_context calls
+  int scriptRuntimePoolSize = 4;
+  // heap limit per script runtime and wall clock limit per script call
+  int scriptMemoryLimitMB = 128, scriptTimeout = 60000;
 
   // request coalescing and short-lived response cache
   bool enableRequestCoalescing = true, coalesceRetryOn5xx = true;
   // Secure TLS is the default. This is an explicit compatibility escape hatch
   // for outbound libcurl requests only.
   bool allowInsecureTls = false;
-  int responseCacheTtl = 0;
+  // fresh seconds, then seconds a stale copy is served while one refresh runs
+  int responseCacheTtl = 0, responseCacheStaleTtl = 0;
+  int responseCacheMaxEntries = 2048, responseCacheMaxMB = 64;
   unsigned long long configGeneration = 0;
 
+  // opt-in Prometheus-style runtime counters at /metrics
+  bool enableMetrics = false;
+  // PCRE2 JIT for cached regex patterns, interpreter otherwise
+  bool enableRegexJit = true;
+
   // opt-in privacy-preserving statistics and dashboard
   bool statisticsEnabled = false;
   std::string statisticsDataDir = "stats";
@@ -170,6 +187,7 @@ loadExternalConfig(const std::string &path, ExternalConfig &ext,
 bool isExternalConfigCacheableContent(const std::string &content);
 size_t externalConfigCacheMaxEntries();
 size_t externalConfigCacheMaxBytes();
+LruCacheStats externalConfigCacheStats();
 // template <class T, class... U>
 // void find_if_exist(const toml::value &v, const toml::key &k, T& target,
 // U&&... args)
@@ -94,6 +94,18 @@ std::string sanitizedSettingsSnapshot(const Settings &settings) {
            {"coalesce_retry_on_5xx", settings.coalesceRetryOn5xx},
            {"allow_insecure_tls", settings.allowInsecureTls},
            {"response_cache_ttl", settings.responseCacheTtl},
+           {"response_cache_stale_ttl", settings.responseCacheStaleTtl},
+           {"response_cache_max_entries", settings.responseCacheMaxEntries},
+           {"response_cache_max_mb", settings.responseCacheMaxMB},
+           {"enable_metrics", settings.enableMetrics},
+           {"enable_regex_jit", settings.enableRegexJit},
+           {"ruleset_cache_dir", settings.rulesetCacheDir},
+           {"fetch_cache_memory_mb", settings.fetchCacheMemoryMB},
+           {"subscription_fetch_concurrency",
+            settings.subscriptionFetchConcurrency},
+           {"script_runtime_pool_size", settings.scriptRuntimePoolSize},
+           {"script_memory_limit_mb", settings.scriptMemoryLimitMB},
+           {"script_timeout_ms", settings.scriptTimeout},
        }},
       {"security",
        {
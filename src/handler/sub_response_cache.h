@@ -0,0 +1,160 @@
+#ifndef SUB_RESPONSE_CACHE_H_INCLUDED
+#define SUB_RESPONSE_CACHE_H_INCLUDED
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct SubResponseCacheStats {
+  uint64_t hits = 0, stale_hits = 0, misses = 0, refreshes = 0,
+           evictions = 0;
+  uint64_t entries = 0, bytes = 0;
+};
+
+/// Finished /sub responses bounded by entry count and bytes, least recently
+/// used first out. An entry is fresh for its TTL, then stale for a further
+/// window in which it is still served while exactly one caller, the one told
+/// to by Lookup::refresh, regenerates it in the background.
+template <typename Value> class SubResponseCache {
+public:
+  using Clock = std::chrono::steady_clock;
+  using ValuePtr = std::shared_ptr<const Value>;
+
+  enum class State { Miss, Fresh, Stale };
+
+  struct Lookup {
+    State state = State::Miss;
+    ValuePtr value;
+    bool refresh = false;
+  };
+
+  SubResponseCache(size_t max_entries, size_t max_bytes)
+      : max_entries_(max_entries), max_bytes_(max_bytes) {}
+
+  void setLimits(size_t max_entries, size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_entries_ = max_entries;
+    max_bytes_ = max_bytes;
+    trim();
+  }
+
+  Lookup get(const std::string &key, Clock::time_point now) {
+    Lookup lookup;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = entries_.find(key);
+    if (iter == entries_.end()) {
+      ++misses_;
+      return lookup;
+    }
+    Entry &entry = iter->second;
+    if (now >= entry.stale_until) {
+      erase(iter);
+      ++misses_;
+      return lookup;
+    }
+    lru_.splice(lru_.begin(), lru_, entry.lru);
+    lookup.value = entry.value;
+    if (now < entry.fresh_until) {
+      ++hits_;
+      lookup.state = State::Fresh;
+      return lookup;
+    }
+    ++stale_hits_;
+    lookup.state = State::Stale;
+    if (!entry.refreshing) {
+      entry.refreshing = true;
+      lookup.refresh = true;
+      ++refreshes_;
+    }
+    return lookup;
+  }
+
+  void put(const std::string &key, ValuePtr value, size_t size,
+           Clock::duration ttl, Clock::duration stale_window,
+           Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = entries_.find(key);
+    if (iter != entries_.end())
+      erase(iter);
+    size += key.size();
+    if (size > max_bytes_ || max_entries_ == 0)
+      return;
+    lru_.push_front(key);
+    Entry &entry = entries_[key];
+    entry.value = std::move(value);
+    entry.size = size;
+    entry.fresh_until = now + ttl;
+    entry.stale_until = entry.fresh_until + stale_window;
+    entry.lru = lru_.begin();
+    bytes_ += size;
+    trim();
+  }
+
+  /// the background refresh did not produce a cacheable response, let the
+  /// next stale hit try again
+  void refreshFailed(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = entries_.find(key);
+    if (iter != entries_.end())
+      iter->second.refreshing = false;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+    bytes_ = 0;
+  }
+
+  SubResponseCacheStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SubResponseCacheStats stats;
+    stats.hits = hits_;
+    stats.stale_hits = stale_hits_;
+    stats.misses = misses_;
+    stats.refreshes = refreshes_;
+    stats.evictions = evictions_;
+    stats.entries = entries_.size();
+    stats.bytes = bytes_;
+    return stats;
+  }
+
+private:
+  struct Entry {
+    ValuePtr value;
+    size_t size = 0;
+    Clock::time_point fresh_until, stale_until;
+    bool refreshing = false;
+    std::list<std::string>::iterator lru;
+  };
+
+  using EntryIterator = typename std::unordered_map<std::string, Entry>::iterator;
+
+  void erase(EntryIterator iter) {
+    bytes_ -= iter->second.size;
+    lru_.erase(iter->second.lru);
+    entries_.erase(iter);
+  }
+
+  void trim() {
+    while (!lru_.empty() &&
+           (entries_.size() > max_entries_ || bytes_ > max_bytes_)) {
+      erase(entries_.find(lru_.back()));
+      ++evictions_;
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+  std::list<std::string> lru_;
+  size_t max_entries_, max_bytes_, bytes_ = 0;
+  uint64_t hits_ = 0, stale_hits_ = 0, misses_ = 0, refreshes_ = 0,
+           evictions_ = 0;
+};
+
+#endif // SUB_RESPONSE_CACHE_H_INCLUDED
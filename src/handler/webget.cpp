@@ -1,12 +1,16 @@
 #include <algorithm>
+#include <chrono>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <mutex>
 #include <thread>
 #include <utility>
+#include <vector>
 #include <atomic>
 #include <cctype>
 #include <cstdint>
@@ -15,11 +19,12 @@
 
 #include "handler/cocr_source_url.h"
 #include "handler/curl_handle_pool.h"
+#include "handler/curl_multi_engine.h"
+#include "handler/fetch_cache.h"
 #include "handler/settings.h"
 #include "utils/base64/base64.h"
 #include "utils/defer.h"
 #include "utils/file_extra.h"
-#include "utils/lock.h"
 #include "utils/logger.h"
 #include "utils/network.h"
 #include "utils/system.h"
@@ -33,26 +38,37 @@
 #endif // _stat
 #endif // _WIN32
 
-/*
-using guarded_mutex = std::lock_guard<std::mutex>;
-std::mutex cache_rw_lock;
-*/
-
-RWLock cache_rw_lock;
-
 //std::string user_agent_str = "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/74.0.3729.169 Safari/537.36";
 static auto user_agent_str = "clash.meta";
 
+/// how long a transfer may take once it has started
+static constexpr std::chrono::seconds kTransferTimeout {15};
+
 struct curl_progress_data
 {
     long size_limit = 0L;
+    /// body bytes after content decoding, which the limit applies to
+    std::string *content = nullptr;
+    curl_off_t decoded = 0;
+    /// first progress call, which libcurl makes once the transfer leaves the multi engine's queue
+    std::chrono::steady_clock::time_point started {};
+    bool timed_out = false;
+    /// body_writer stopped the transfer at size_limit
+    bool too_large = false;
 };
 
+static std::atomic<uint64_t> transfer_fetches {0};
+static std::atomic<uint64_t> transfer_encoded_fetches {0};
+static std::atomic<uint64_t> transfer_wire_bytes {0};
+static std::atomic<uint64_t> transfer_decoded_bytes {0};
+
 struct CacheFetchResult
 {
     int status_code = 0;
     std::string content;
     std::string response_headers;
+    /// upstream answered 304 and content is the stored copy
+    bool revalidated = false;
 };
 
 struct GitHubFileRef
@@ -64,7 +80,30 @@ struct GitHubFileRef
 };
 
 static std::mutex cache_fetch_mutex;
-static std::map<std::string, std::shared_future<CacheFetchResult>> cache_fetches;
+
+struct CacheFetch
+{
+    std::shared_future<CacheFetchResult> result;
+    /// webGetAsync callers waiting on the result, run by whoever ends the fetch
+    std::vector<std::function<void()>> waiters;
+};
+
+static std::map<std::string, CacheFetch> cache_fetches;
+
+static void end_cache_fetch(const std::string &key)
+{
+    std::vector<std::function<void()>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(cache_fetch_mutex);
+        auto iter = cache_fetches.find(key);
+        if(iter == cache_fetches.end())
+            return;
+        waiters.swap(iter->second.waiters);
+        cache_fetches.erase(iter);
+    }
+    for(auto &waiter : waiters)
+        waiter();
+}
 
 class CacheFetchOwnerCleanup
 {
@@ -73,10 +112,8 @@ public:
         : owner_(owner), key_(std::move(key)) {}
     ~CacheFetchOwnerCleanup()
     {
-        if(!owner_)
-            return;
-        std::lock_guard<std::mutex> lock(cache_fetch_mutex);
-        cache_fetches.erase(key_);
+        if(owner_)
+            end_cache_fetch(key_);
     }
 
 private:
@@ -84,6 +121,13 @@ private:
     std::string key_;
 };
 
+static FetchCache &fetch_cache()
+{
+    static FetchCache cache("cache", 0);
+    cache.setMemoryLimit(static_cast<uint64_t>(std::max(global.fetchCacheMemoryMB, 0)) * 1024 * 1024);
+    return cache;
+}
+
 static CURLcode curl_init()
 {
     static std::once_flag init_flag;
@@ -458,6 +502,22 @@ static int writer(char *data, size_t size, size_t nmemb, std::string *writerData
     return static_cast<int>(size * nmemb);
 }
 
+/// libcurl hands the body over already decoded, a chunk at a time, so a small compressed
+/// response cannot inflate past the size limit before it is stopped here
+static size_t body_writer(char *data, size_t size, size_t nmemb, void *userp)
+{
+    auto *progress = static_cast<curl_progress_data*>(userp);
+    const size_t bytes = size * nmemb;
+    progress->decoded += static_cast<curl_off_t>(bytes);
+    if(progress->size_limit && progress->decoded > progress->size_limit)
+    {
+        progress->too_large = true;
+        return 0;
+    }
+    progress->content->append(data, bytes);
+    return bytes;
+}
+
 static int dummy_writer(char *, size_t size, size_t nmemb, void *)
 {
     /// dummy writer, do not save anything
@@ -475,6 +535,16 @@ static int size_checker(void *clientp, curl_off_t, curl_off_t dlnow, curl_off_t,
             if(dlnow > data->size_limit)
                 return 1;
         }
+        /// CURLOPT_TIMEOUT counts the time a transfer waits for a connection to its host too, this
+        /// counts from the start; libcurl calls in at least once a second while it runs
+        const auto now = std::chrono::steady_clock::now();
+        if(data->started == std::chrono::steady_clock::time_point {})
+            data->started = now;
+        else if(now - data->started > kTransferTimeout)
+        {
+            data->timed_out = true;
+            return 1;
+        }
     }
     return 0;
 }
@@ -560,8 +630,15 @@ static inline void curl_set_common_options(CURL *curl_handle, const char *url, c
                      global.allowInsecureTls ? 0L : 1L);
     curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST,
                      global.allowInsecureTls ? 0L : 2L);
-    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 15L);
+    /// with progress data size_checker keeps the time limit
+    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, data ? 0L : static_cast<long>(kTransferTimeout.count()));
     curl_easy_setopt(curl_handle, CURLOPT_COOKIEFILE, "");
+    /// "" offers every encoding this libcurl was built with and decodes the body transparently
+    curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+    /// HTTP/2 where TLS offers it; a transfer to a host already being talked to waits to become
+    /// another stream on that connection rather than opening its own
+    curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl_handle, CURLOPT_PIPEWAIT, 1L);
     if(data)
     {
         if(data->size_limit)
@@ -665,69 +742,80 @@ static bool is_recoverable_curl_error(CURLcode code)
     }
 }
 
-//static std::string curlGet(const std::string &url, const std::string &proxy, std::string &response_headers, CURLcode &return_code, const string_map &request_headers)
-static int curlGet(const FetchArgument &argument, FetchResult &result, CURLcode *return_code = nullptr)
+/// what a transfer needs kept alive from setting it up until it is finished
+struct CurlTransfer
 {
-    CURL *curl_handle;
-    std::string *data = result.content, new_url = argument.url;
+    CurlHandleLease lease;
     curl_slist *header_list = nullptr;
-    defer(curl_slist_free_all(header_list);)
+    curl_progress_data limit;
+    FetchContext prereq_context = FetchContext::TrustedConfig;
+
+    CurlTransfer() = default;
+    CurlTransfer(const CurlTransfer &) = delete;
+    CurlTransfer &operator=(const CurlTransfer &) = delete;
+    ~CurlTransfer()
+    {
+        curl_slist_free_all(header_list);
+    }
+};
+
+static size_t curl_max_connections()
+{
+    return static_cast<size_t>(std::max(1, global.maxConcurThreads));
+}
+
+/// sets the transfer up for argument, writing into result; anything but CURLE_OK means it
+/// cannot be performed. Only a caller about to wait for the transfer anyway waits for a handle,
+/// an async one takes a handle past the pool capacity and the engine's connection limit queues it.
+static CURLcode curl_prepare(const FetchArgument &argument, FetchResult &result, CurlTransfer &transfer,
+                             bool wait_for_handle)
+{
+    CURL *curl_handle;
+    std::string new_url = argument.url;
+    curl_slist *&header_list = transfer.header_list;
+    curl_progress_data &limit = transfer.limit;
     CURLcode retVal;
 
     retVal = curl_init();
     if(retVal != CURLE_OK)
     {
-        *result.status_code = 0;
-        if(return_code)
-            *return_code = retVal;
         writeLog(0, "curl_global_init 失败：" + std::string(curl_easy_strerror(retVal)), LOG_LEVEL_ERROR);
-        return 0;
+        return retVal;
     }
 
-    CurlHandleLease curl_lease =
-        globalCurlHandlePool(
-            static_cast<size_t>(std::max(1, global.maxConcurThreads)))
-            .acquire();
-    curl_handle = curl_lease.get();
+    CurlHandlePool &pool = globalCurlHandlePool(curl_max_connections());
+    /// the engine thread must never wait, even for a synchronous fetch
+    transfer.lease = wait_for_handle && !globalCurlMultiEngine(curl_max_connections()).onEngineThread()
+                         ? pool.acquire()
+                         : pool.acquireNow();
+    curl_handle = transfer.lease.get();
     if(curl_handle == nullptr)
     {
-        retVal = CURLE_FAILED_INIT;
-        *result.status_code = 0;
-        if(return_code)
-            *return_code = retVal;
         writeLog(0, "curl_easy_init 失败。", LOG_LEVEL_ERROR);
-        return 0;
+        return CURLE_FAILED_INIT;
     }
     ProxyPolicy effective_proxy;
     retVal = apply_curl_proxy_policy(curl_handle, argument.proxy, new_url,
                                      effective_proxy);
     if(retVal != CURLE_OK)
-    {
-        *result.status_code = 0;
-        if(return_code)
-            *return_code = retVal;
-        return 0;
-    }
+        return retVal;
     if(effective_proxy.mode == ProxyMode::Cors)
         header_list = curl_slist_append(header_list,
                                         "X-Requested-With: SubConverter-Extended " VERSION);
-    curl_progress_data limit;
     limit.size_limit = global.maxAllowedDownloadSize;
     curl_set_common_options(curl_handle, new_url.data(), &limit);
     retVal = curl_set_platform_tls_trust(curl_handle);
     if(retVal != CURLE_OK)
     {
-        *result.status_code = 0;
-        if(return_code)
-            *return_code = retVal;
         writeLog(0,
                  "Windows 原生 TLS 信任库配置失败：" +
                      std::string(curl_easy_strerror(retVal)),
                  LOG_LEVEL_ERROR);
-        return 0;
+        return retVal;
     }
 #if LIBCURL_VERSION_NUM >= 0x075000
-    FetchContext prereq_context = argument.context;
+    /// the SSRF check runs on whichever thread drives the transfer, with the context kept here
+    transfer.prereq_context = argument.context;
     if(isPublicFetchRestricted(argument.context) &&
        (effective_proxy.mode == ProxyMode::Direct ||
         (effective_proxy.mode == ProxyMode::System &&
@@ -735,7 +823,7 @@ static int curlGet(const FetchArgument &argument, FetchResult &result, CURLcode
     {
         curl_easy_setopt(curl_handle, CURLOPT_PREREQFUNCTION,
                          public_fetch_prereq_callback);
-        curl_easy_setopt(curl_handle, CURLOPT_PREREQDATA, &prereq_context);
+        curl_easy_setopt(curl_handle, CURLOPT_PREREQDATA, &transfer.prereq_context);
     }
 #endif
     header_list = curl_slist_append(header_list, "Content-Type: application/json;charset=utf-8");
@@ -756,8 +844,9 @@ static int curlGet(const FetchArgument &argument, FetchResult &result, CURLcode
 
     if(result.content)
     {
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, writer);
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, result.content);
+        limit.content = result.content;
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, body_writer);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &limit);
     }
     else
         curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, dummy_writer);
@@ -800,21 +889,50 @@ static int curlGet(const FetchArgument &argument, FetchResult &result, CURLcode
     case HTTP_GET:
         break;
     }
+    return CURLE_OK;
+}
 
-    retVal = curl_easy_perform(curl_handle);
-    if(retVal != CURLE_OK &&
-       (argument.method == HTTP_GET || argument.method == HTTP_HEAD) &&
-       is_recoverable_curl_error(retVal))
-    {
-        writeLog(0, "出站请求遇到可恢复网络错误，200ms 后重试一次。",
-                 LOG_LEVEL_WARNING);
-        if(result.content)
-            result.content->clear();
-        if(result.response_headers)
-            result.response_headers->clear();
-        sleepMs(200);
-        retVal = curl_easy_perform(curl_handle);
-    }
+static bool should_retry_transfer(const FetchArgument &argument, CURLcode retVal)
+{
+    return retVal != CURLE_OK &&
+           (argument.method == HTTP_GET || argument.method == HTTP_HEAD) &&
+           is_recoverable_curl_error(retVal);
+}
+
+/// clears what the failed attempt left behind before the one retry
+static void reset_for_retry(FetchResult &result, CurlTransfer &transfer)
+{
+    writeLog(0, "出站请求遇到可恢复网络错误，200ms 后重试一次。",
+             LOG_LEVEL_WARNING);
+    if(result.content)
+        result.content->clear();
+    if(result.response_headers)
+        result.response_headers->clear();
+    transfer.limit.decoded = 0;
+    transfer.limit.started = {};
+    transfer.limit.timed_out = false;
+    transfer.limit.too_large = false;
+}
+
+/// what a performed transfer ended with, a transfer stopped by size_checker for its time limit
+/// reported as the timeout it is, one stopped by body_writer for its size as the oversized
+/// body it is rather than a write error, which would send it to the jsDelivr fallback
+static CURLcode transfer_result(const CurlTransfer &transfer, CURLcode code)
+{
+    if(code == CURLE_ABORTED_BY_CALLBACK && transfer.limit.timed_out)
+        return CURLE_OPERATION_TIMEDOUT;
+    if(code == CURLE_WRITE_ERROR && transfer.limit.too_large)
+        return CURLE_FILESIZE_EXCEEDED;
+    return code;
+}
+
+/// reads the outcome of a performed transfer into result
+static int curl_finish(const FetchArgument &argument, FetchResult &result, CurlTransfer &transfer,
+                       CURLcode retVal, CURLcode *return_code)
+{
+    CURL *curl_handle = transfer.lease.get();
+    std::string *data = result.content;
+    const curl_progress_data &limit = transfer.limit;
 
     long code = 0;
     curl_easy_getinfo(curl_handle, CURLINFO_HTTP_CODE, &code);
@@ -822,6 +940,31 @@ static int curlGet(const FetchArgument &argument, FetchResult &result, CURLcode
     if(return_code)
         *return_code = retVal;
 
+    if(result.content)
+    {
+        /// SIZE_DOWNLOAD counts the body as it came over the wire, before decoding
+        curl_off_t wire = 0;
+#if LIBCURL_VERSION_NUM >= 0x073700
+        curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+#else
+        double wire_size = 0;
+        curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD, &wire_size);
+        wire = static_cast<curl_off_t>(wire_size);
+#endif
+        transfer_fetches++;
+        transfer_wire_bytes += static_cast<uint64_t>(wire);
+        transfer_decoded_bytes += static_cast<uint64_t>(limit.decoded);
+        if(wire != limit.decoded)
+            transfer_encoded_fetches++;
+        if(shouldLog(LOG_LEVEL_VERBOSE))
+            writeLog(0, "出站请求传输 " + std::to_string(wire) + " 字节，解码后 " +
+                            std::to_string(limit.decoded) + " 字节。",
+                     LOG_LEVEL_VERBOSE);
+    }
+    if(retVal == CURLE_FILESIZE_EXCEEDED && limit.too_large)
+        writeLog(0, "出站请求解码后的内容超过 " + std::to_string(limit.size_limit) + " 字节上限，已中止。",
+                 LOG_LEVEL_WARNING);
+
 #if LIBCURL_VERSION_NUM >= 0x080700
     long used_proxy = 0;
     if(curl_easy_getinfo(curl_handle, CURLINFO_USED_PROXY, &used_proxy) == CURLE_OK &&
@@ -877,56 +1020,199 @@ static int curlGet(const FetchArgument &argument, FetchResult &result, CURLcode
     return *result.status_code;
 }
 
-static int curlGetWithGitHubFallback(const FetchArgument &argument, FetchResult &result)
+static int curl_fail(FetchResult &result, CURLcode retVal, CURLcode *return_code)
 {
-    CURLcode original_code = CURLE_OK;
-    int original_status = curlGet(argument, result, &original_code);
+    *result.status_code = 0;
+    if(return_code)
+        *return_code = retVal;
+    return 0;
+}
+
+//static std::string curlGet(const std::string &url, const std::string &proxy, std::string &response_headers, CURLcode &return_code, const string_map &request_headers)
+static int curlGet(const FetchArgument &argument, FetchResult &result, CURLcode *return_code = nullptr)
+{
+    CurlTransfer transfer;
+    CURLcode retVal = curl_prepare(argument, result, transfer, true);
+    if(retVal != CURLE_OK)
+        return curl_fail(result, retVal, return_code);
+
+    CurlMultiEngine &engine = globalCurlMultiEngine(curl_max_connections());
+    retVal = transfer_result(transfer, engine.perform(transfer.lease.get()));
+    transfer.lease.recordTransfer();
+    if(should_retry_transfer(argument, retVal))
+    {
+        reset_for_retry(result, transfer);
+        sleepMs(200);
+        retVal = transfer_result(transfer, engine.perform(transfer.lease.get()));
+        transfer.lease.recordTransfer();
+    }
+    return curl_finish(argument, result, transfer, retVal, return_code);
+}
+
+/// a curlGet running on the multi engine
+struct CurlAttempt
+{
+    FetchArgument argument;
+    FetchResult result;
+    std::unique_ptr<CurlTransfer> transfer;
+    std::function<void(int, CURLcode)> done;
+    bool retried = false;
+};
+
+static void submit_attempt(const std::shared_ptr<CurlAttempt> &attempt, std::chrono::milliseconds delay);
+
+static void complete_attempt(const std::shared_ptr<CurlAttempt> &attempt, CURLcode code)
+{
+    code = transfer_result(*attempt->transfer, code);
+    attempt->transfer->lease.recordTransfer();
+    if(!attempt->retried && should_retry_transfer(attempt->argument, code))
+    {
+        attempt->retried = true;
+        reset_for_retry(attempt->result, *attempt->transfer);
+        submit_attempt(attempt, std::chrono::milliseconds(200));
+        return;
+    }
+    CURLcode return_code = code;
+    int status = 0;
+    try
+    {
+        status = curl_finish(attempt->argument, attempt->result, *attempt->transfer, code, &return_code);
+    }
+    catch(...)
+    {
+        /// done runs whatever happens, someone is waiting on it
+        return_code = CURLE_OUT_OF_MEMORY;
+    }
+    /// the handle goes back to the pool before anyone waiting on the result runs
+    attempt->transfer.reset();
+    attempt->done(status, return_code);
+}
 
-    std::string fallback_url;
+static void submit_attempt(const std::shared_ptr<CurlAttempt> &attempt, std::chrono::milliseconds delay)
+{
+    globalCurlMultiEngine(curl_max_connections())
+        .submit(attempt->transfer->lease.get(),
+                [attempt](CURLcode code) { complete_attempt(attempt, code); }, delay);
+}
+
+/// curlGet without a thread waiting on it: done gets the status code and curl result on an
+/// engine completion worker once the transfer, and its one retry, are over. Whatever argument and result
+/// point to must outlive it.
+static void curlGetAsync(const FetchArgument &argument, FetchResult result,
+                         std::function<void(int, CURLcode)> done)
+{
+    auto attempt = std::make_shared<CurlAttempt>(
+        CurlAttempt{argument, result, std::make_unique<CurlTransfer>(), std::move(done)});
+    CURLcode retVal = curl_prepare(attempt->argument, attempt->result, *attempt->transfer, false);
+    if(retVal != CURLE_OK)
+    {
+        attempt->transfer.reset();
+        attempt->done(curl_fail(attempt->result, retVal, nullptr), retVal);
+        return;
+    }
+    submit_attempt(attempt, std::chrono::milliseconds(0));
+}
+
+/// a failed GitHub Raw fetch being retried from jsDelivr, with what to put back if that fails too
+struct GitHubFallback
+{
+    std::string url;
+    int original_status = 0;
+    std::string original_headers, original_cookies;
+};
+
+/// true with fallback filled in and the output cleared when the failed fetch should be retried
+static bool begin_github_fallback(const FetchArgument &argument, FetchResult &result,
+                                  int original_status, CURLcode original_code,
+                                  GitHubFallback &fallback)
+{
     if(argument.method != HTTP_GET || argument.keep_resp_on_fail ||
        original_status == 200 ||
        !should_try_jsdelivr_fallback(original_code, original_status) ||
-       !build_jsdelivr_github_url(argument.url, fallback_url))
-        return original_status;
+       !build_jsdelivr_github_url(argument.url, fallback.url))
+        return false;
 
-    std::string original_headers, original_cookies;
+    fallback.original_status = original_status;
     if(result.response_headers)
-        original_headers = *result.response_headers;
+        fallback.original_headers = *result.response_headers;
     if(result.cookies)
-        original_cookies = *result.cookies;
+        fallback.original_cookies = *result.cookies;
 
     writeLog(0,
              "GitHub Raw 获取失败，正在尝试 jsDelivr 回退源：" +
-                 fallback_url,
+                 fallback.url,
              LOG_LEVEL_WARNING);
     clear_fetch_output(result);
+    return true;
+}
 
-    FetchArgument fallback_argument {HTTP_GET, fallback_url, argument.proxy,
-                                     nullptr, argument.request_headers,
-                                     argument.cookies, argument.cache_ttl,
-                                     argument.keep_resp_on_fail,
-                                     argument.context};
-    CURLcode fallback_code = CURLE_OK;
-    int fallback_status = curlGet(fallback_argument, result, &fallback_code);
+static FetchArgument github_fallback_argument(const FetchArgument &argument,
+                                              const GitHubFallback &fallback)
+{
+    return FetchArgument {HTTP_GET, fallback.url, argument.proxy,
+                          nullptr, argument.request_headers,
+                          argument.cookies, argument.cache_ttl,
+                          argument.keep_resp_on_fail,
+                          argument.context};
+}
+
+static int end_github_fallback(FetchResult &result, const GitHubFallback &fallback,
+                               int fallback_status, CURLcode fallback_code)
+{
     if(fallback_code == CURLE_OK && fallback_status == 200)
     {
         writeLog(0,
                  "GitHub Raw 已通过 jsDelivr 回退源获取成功：" +
-                     fallback_url,
+                     fallback.url,
                  LOG_LEVEL_INFO);
         return fallback_status;
     }
 
     writeLog(0,
-             "GitHub Raw 通过 jsDelivr 回退源获取失败：" + fallback_url,
+             "GitHub Raw 通过 jsDelivr 回退源获取失败：" + fallback.url,
              LOG_LEVEL_WARNING);
     clear_fetch_output(result);
     if(result.response_headers)
-        *result.response_headers = original_headers;
+        *result.response_headers = fallback.original_headers;
     if(result.cookies)
-        *result.cookies = original_cookies;
-    *result.status_code = original_status;
-    return original_status;
+        *result.cookies = fallback.original_cookies;
+    *result.status_code = fallback.original_status;
+    return fallback.original_status;
+}
+
+static int curlGetWithGitHubFallback(const FetchArgument &argument, FetchResult &result)
+{
+    CURLcode original_code = CURLE_OK;
+    int original_status = curlGet(argument, result, &original_code);
+
+    GitHubFallback fallback;
+    if(!begin_github_fallback(argument, result, original_status, original_code, fallback))
+        return original_status;
+
+    CURLcode fallback_code = CURLE_OK;
+    int fallback_status = curlGet(github_fallback_argument(argument, fallback), result, &fallback_code);
+    return end_github_fallback(result, fallback, fallback_status, fallback_code);
+}
+
+/// curlGetWithGitHubFallback on the multi engine, done gets the status code on a completion worker
+static void curlGetWithGitHubFallbackAsync(const FetchArgument &argument, FetchResult result,
+                                           std::function<void(int)> done)
+{
+    curlGetAsync(argument, result,
+                 [argument, result, done](int original_status, CURLcode original_code) mutable
+    {
+        auto fallback = std::make_shared<GitHubFallback>();
+        if(!begin_github_fallback(argument, result, original_status, original_code, *fallback))
+        {
+            done(original_status);
+            return;
+        }
+        curlGetAsync(github_fallback_argument(argument, *fallback), result,
+                     [result, fallback, done](int fallback_status, CURLcode fallback_code) mutable
+        {
+            done(end_github_fallback(result, *fallback, fallback_status, fallback_code));
+        });
+    });
 }
 
 // data:[<mediatype>][;base64],<data>
@@ -968,6 +1254,93 @@ std::string buildSocks5ProxyString(const std::string &addr, int port, const std:
     return proxystr;
 }
 
+/// the request for a cache miss made conditional on the expired copy, when it has validators;
+/// false leaves the request as it was
+static bool conditional_fetch_headers(const FetchCache::EntryPtr &stale,
+                                      const string_icase_map *request_headers,
+                                      string_icase_map &conditional_headers)
+{
+    FetchValidators validators;
+    if(stale)
+        validators = fetchValidators(stale->headers);
+    if(validators.empty())
+        return false;
+    /// ask upstream whether the expired copy still matches, headers set by the caller win
+    if(request_headers)
+        conditional_headers = *request_headers;
+    if(!validators.etag.empty())
+        conditional_headers.emplace("If-None-Match", validators.etag);
+    if(!validators.last_modified.empty())
+        conditional_headers.emplace("If-Modified-Since", validators.last_modified);
+    return true;
+}
+
+/// a 304 to a conditional request stands for the expired copy it confirmed
+static void apply_revalidation(CacheFetchResult &result, const FetchCache::EntryPtr &stale)
+{
+    if(stale && result.status_code == 304)
+    {
+        result.status_code = 200;
+        result.content = stale->content;
+        result.response_headers = stale->headers;
+        result.revalidated = true;
+    }
+}
+
+/// the content a cache-backed webGet returns: the owner of the fetch stores a success, a
+/// failure falls back to the stored copy when serve_cache_on_fetch_fail allows it
+static std::string finish_cached_fetch(const std::string &url_md5, const std::string &effective_url,
+                                       bool owner, CacheFetchResult fetched,
+                                       std::string *response_headers)
+{
+    FetchCache &cache = fetch_cache();
+    std::string content = std::move(fetched.content);
+    if(response_headers)
+        *response_headers = fetched.response_headers;
+    if(fetched.status_code == 200) // success, save new cache
+    {
+        if(owner && fetched.revalidated)
+        {
+            if(shouldLog(LOG_LEVEL_VERBOSE))
+                writeLog(0, "缓存已由上游确认未变更：'" + effective_url + "'，继续使用本地缓存。");
+            /// flushed while the request was in flight, store the copy again
+            if(!cache.refresh(url_md5, content.size()))
+                cache.put(url_md5, content, fetched.response_headers);
+        }
+        else if(owner && !cache.put(url_md5, content, fetched.response_headers))
+            writeLog(0, "写入缓存失败：'" + cache.directory() + "'。", LOG_LEVEL_WARNING);
+    }
+    else
+    {
+        FetchCache::EntryPtr cached;
+        if(global.serveCacheOnFetchFail && (cached = cache.getAny(url_md5))) // failed, check if cache exist
+        {
+            if(shouldLog(LOG_LEVEL_VERBOSE))
+                writeLog(0, "获取失败，返回缓存内容。"); // cache exist, serving cache
+            content = cached->content;
+            if(response_headers)
+                *response_headers = cached->headers;
+        }
+        else
+        {
+            if(shouldLog(LOG_LEVEL_VERBOSE))
+                writeLog(0, "获取失败，且没有可用的本地缓存。"); // cache not exist or not allow to serve cache, serving nothing
+        }
+    }
+    return content;
+}
+
+static CocrSourceResolution resolve_fetch_source(const std::string &url)
+{
+    CocrSourceResolution source =
+        resolveCocrSourceUrl(url, global.customOpenClashRulesSourceSwitch);
+    if(source.rewritten && shouldLog(LOG_LEVEL_VERBOSE))
+        writeLog(0, "COCR 服务端取源切换：'" + url + "' -> '" +
+                        source.effective_url + "'。",
+                 LOG_LEVEL_VERBOSE);
+    return source;
+}
+
 std::string webGet(const std::string &url, const ProxyPolicy &proxy, unsigned int cache_ttl, std::string *response_headers, string_icase_map *request_headers, FetchContext context)
 {
     int return_code = 0;
@@ -976,13 +1349,8 @@ std::string webGet(const std::string &url, const ProxyPolicy &proxy, unsigned in
     if (!isFetchUrlAllowed(url, context))
         return "";
 
-    CocrSourceResolution source =
-        resolveCocrSourceUrl(url, global.customOpenClashRulesSourceSwitch);
+    CocrSourceResolution source = resolve_fetch_source(url);
     const std::string &effective_url = source.effective_url;
-    if(source.rewritten && shouldLog(LOG_LEVEL_VERBOSE))
-        writeLog(0, "COCR 服务端取源切换：'" + url + "' -> '" +
-                        effective_url + "'。",
-                 LOG_LEVEL_VERBOSE);
 
     FetchArgument argument {HTTP_GET, effective_url, proxy, nullptr,
                             request_headers, nullptr, cache_ttl, false,
@@ -994,33 +1362,20 @@ std::string webGet(const std::string &url, const ProxyPolicy &proxy, unsigned in
     // cache system
     if(cache_ttl > 0)
     {
-        md("cache");
+        FetchCache &cache = fetch_cache();
         const std::string url_md5 =
             build_cache_key(effective_url, proxy, request_headers);
-        const std::string path = "cache/" + url_md5, path_header = path + "_header";
-        struct stat result {};
-        if(stat(path.data(), &result) == 0) // cache exist
-        {
-            time_t mtime = result.st_mtime, now = time(nullptr); // get cache modified time and current time
-            if(difftime(now, mtime) <= cache_ttl) // within TTL
-            {
-                if(shouldLog(LOG_LEVEL_VERBOSE))
-                    writeLog(0, "缓存命中：'" + effective_url + "'，使用本地缓存。");
-                //guarded_mutex guard(cache_rw_lock);
-                cache_rw_lock.readLock();
-                defer(cache_rw_lock.readUnlock();)
-                if(response_headers)
-                    *response_headers = fileGet(path_header, true);
-                return fileGet(path, true);
-            }
-            if(shouldLog(LOG_LEVEL_VERBOSE))
-                writeLog(0, "缓存过期：'" + effective_url + "'，正在创建新缓存。"); // out of TTL
-        }
-        else
+        FetchCache::EntryPtr stale;
+        if(FetchCache::EntryPtr cached = cache.getFresh(url_md5, cache_ttl, &stale))
         {
             if(shouldLog(LOG_LEVEL_VERBOSE))
-                writeLog(0, "缓存不存在：'" + effective_url + "'，正在创建新缓存。");
+                writeLog(0, "缓存命中：'" + effective_url + "'，使用本地缓存。");
+            if(response_headers)
+                *response_headers = cached->headers;
+            return cached->content;
         }
+        if(shouldLog(LOG_LEVEL_VERBOSE))
+            writeLog(0, "缓存不存在或已过期：'" + effective_url + "'，正在创建新缓存。");
         std::shared_future<CacheFetchResult> fetch_future;
         std::shared_ptr<std::promise<CacheFetchResult>> fetch_promise;
         bool owner = false;
@@ -1032,11 +1387,11 @@ std::string webGet(const std::string &url, const ProxyPolicy &proxy, unsigned in
                 fetch_promise =
                     std::make_shared<std::promise<CacheFetchResult>>();
                 fetch_future = fetch_promise->get_future().share();
-                cache_fetches.emplace(url_md5, fetch_future);
+                cache_fetches.emplace(url_md5, CacheFetch{fetch_future, {}});
                 owner = true;
             }
             else
-                fetch_future = iter->second;
+                fetch_future = iter->second.result;
         }
         CacheFetchOwnerCleanup owner_cleanup(owner, url_md5);
 
@@ -1048,7 +1403,17 @@ std::string webGet(const std::string &url, const ProxyPolicy &proxy, unsigned in
                 FetchResult fetch_result {
                     &result.status_code, &result.content,
                     &result.response_headers, nullptr};
-                curlGetWithGitHubFallback(argument, fetch_result);
+                string_icase_map conditional_headers;
+                if(!conditional_fetch_headers(stale, request_headers, conditional_headers))
+                    curlGetWithGitHubFallback(argument, fetch_result);
+                else
+                {
+                    FetchArgument conditional {HTTP_GET, effective_url, proxy, nullptr,
+                                               &conditional_headers, nullptr, cache_ttl, false,
+                                               context};
+                    curlGetWithGitHubFallback(conditional, fetch_result);
+                    apply_revalidation(result, stale);
+                }
                 fetch_promise->set_value(std::move(result));
             }
             catch(...)
@@ -1057,55 +1422,133 @@ std::string webGet(const std::string &url, const ProxyPolicy &proxy, unsigned in
             }
         }
 
-        CacheFetchResult fetched = fetch_future.get();
-        return_code = fetched.status_code;
-        content = std::move(fetched.content);
-        if(response_headers)
-            *response_headers = fetched.response_headers;
-        if(return_code == 200) // success, save new cache
+        return finish_cached_fetch(url_md5, effective_url, owner, fetch_future.get(), response_headers);
+    }
+    //return curlGet(url, proxy, response_headers, return_code);
+    curlGetWithGitHubFallback(argument, fetch_res);
+    return content;
+}
+
+void webGetAsync(const std::string &url, const ProxyPolicy &proxy, unsigned int cache_ttl,
+                 FetchContext context, std::function<void(std::string)> done)
+{
+    if (!isFetchUrlAllowed(url, context))
+    {
+        done("");
+        return;
+    }
+
+    CocrSourceResolution source = resolve_fetch_source(url);
+    const std::string &effective_url = source.effective_url;
+    if (startsWith(effective_url, "data:"))
+    {
+        done(dataGet(effective_url));
+        return;
+    }
+
+    /// what the transfer writes into and reads from until it completes
+    struct AsyncFetch
+    {
+        std::string effective_url;
+        std::string url_md5;
+        FetchCache::EntryPtr stale;
+        string_icase_map conditional_headers;
+        CacheFetchResult result;
+        std::shared_ptr<std::promise<CacheFetchResult>> promise;
+    };
+    auto fetch = std::make_shared<AsyncFetch>();
+    fetch->effective_url = effective_url;
+    FetchResult fetch_result {&fetch->result.status_code, &fetch->result.content,
+                              &fetch->result.response_headers, nullptr};
+
+    if(cache_ttl == 0)
+    {
+        FetchArgument argument {HTTP_GET, effective_url, proxy, nullptr,
+                                nullptr, nullptr, cache_ttl, false, context};
+        curlGetWithGitHubFallbackAsync(argument, fetch_result,
+                                       [fetch, done](int) { done(std::move(fetch->result.content)); });
+        return;
+    }
+
+    fetch->url_md5 = build_cache_key(effective_url, proxy, nullptr);
+    if(FetchCache::EntryPtr cached = fetch_cache().getFresh(fetch->url_md5, cache_ttl, &fetch->stale))
+    {
+        if(shouldLog(LOG_LEVEL_VERBOSE))
+            writeLog(0, "缓存命中：'" + effective_url + "'，使用本地缓存。");
+        done(cached->content);
+        return;
+    }
+    if(shouldLog(LOG_LEVEL_VERBOSE))
+        writeLog(0, "缓存不存在或已过期：'" + effective_url + "'，正在创建新缓存。");
+    {
+        std::lock_guard<std::mutex> lock(cache_fetch_mutex);
+        auto iter = cache_fetches.find(fetch->url_md5);
+        if(iter != cache_fetches.end())
         {
-            if(owner)
+            /// someone else is fetching it, take their result when they are done
+            std::shared_future<CacheFetchResult> result = iter->second.result;
+            iter->second.waiters.emplace_back([result, fetch, done]()
             {
-                //guarded_mutex guard(cache_rw_lock);
-                cache_rw_lock.writeLock();
-                defer(cache_rw_lock.writeUnlock();)
-                fileWrite(path, content, true);
-                if(!fetched.response_headers.empty())
-                    fileWrite(path_header, fetched.response_headers, true);
-            }
+                CacheFetchResult fetched;
+                try
+                {
+                    fetched = result.get();
+                }
+                catch(...)
+                {
+                }
+                done(finish_cached_fetch(fetch->url_md5, fetch->effective_url, false,
+                                         std::move(fetched), nullptr));
+            });
+            return;
         }
-        else
+        fetch->promise = std::make_shared<std::promise<CacheFetchResult>>();
+        cache_fetches.emplace(fetch->url_md5, CacheFetch{fetch->promise->get_future().share(), {}});
+    }
+
+    const bool conditional = conditional_fetch_headers(fetch->stale, nullptr, fetch->conditional_headers);
+    FetchArgument argument {HTTP_GET, effective_url, proxy, nullptr,
+                            conditional ? &fetch->conditional_headers : nullptr,
+                            nullptr, cache_ttl, false, context};
+    curlGetWithGitHubFallbackAsync(argument, fetch_result, [fetch, done](int)
+    {
+        std::string content;
+        try
         {
-            if(fileExist(path) && global.serveCacheOnFetchFail) // failed, check if cache exist
+            apply_revalidation(fetch->result, fetch->stale);
+            fetch->promise->set_value(fetch->result);
+            content = finish_cached_fetch(fetch->url_md5, fetch->effective_url, true,
+                                          std::move(fetch->result), nullptr);
+        }
+        catch(...)
+        {
+            try
             {
-                if(shouldLog(LOG_LEVEL_VERBOSE))
-                    writeLog(0, "获取失败，返回缓存内容。"); // cache exist, serving cache
-                //guarded_mutex guard(cache_rw_lock);
-                cache_rw_lock.readLock();
-                defer(cache_rw_lock.readUnlock();)
-                content = fileGet(path, true);
-                if(response_headers)
-                    *response_headers = fileGet(path_header, true);
+                fetch->promise->set_exception(std::current_exception());
             }
-            else
+            catch(...)
             {
-                if(shouldLog(LOG_LEVEL_VERBOSE))
-                    writeLog(0, "获取失败，且没有可用的本地缓存。"); // cache not exist or not allow to serve cache, serving nothing
             }
         }
-        return content;
-    }
-    //return curlGet(url, proxy, response_headers, return_code);
-    curlGetWithGitHubFallback(argument, fetch_res);
-    return content;
+        end_cache_fetch(fetch->url_md5);
+        done(std::move(content));
+    });
 }
 
 void flushCache()
 {
-    //guarded_mutex guard(cache_rw_lock);
-    cache_rw_lock.writeLock();
-    defer(cache_rw_lock.writeUnlock();)
-    operateFiles("cache", [](const std::string &file){ remove(("cache/" + file).data()); return 0; });
+    fetch_cache().flush();
+}
+
+FetchCache::Stats fetchCacheStats()
+{
+    return fetch_cache().stats();
+}
+
+FetchTransferStats fetchTransferStats()
+{
+    return {transfer_fetches.load(), transfer_encoded_fetches.load(),
+            transfer_wire_bytes.load(), transfer_decoded_bytes.load()};
 }
 
 int webPost(const std::string &url, const std::string &data, const ProxyPolicy &proxy, const string_icase_map &request_headers, std::string *retData)
@@ -1,10 +1,13 @@
 #ifndef WEBGET_H_INCLUDED
 #define WEBGET_H_INCLUDED
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <map>
 
 #include "handler/fetch_context.h"
+#include "handler/fetch_cache.h"
 #include "handler/proxy_policy.h"
 #include "utils/map_extra.h"
 #include "utils/string.h"
@@ -38,14 +41,30 @@ struct FetchResult
     std::string *cookies = nullptr;
 };
 
+/// upstream body bytes as transferred and after content decoding, over all fetches so far
+struct FetchTransferStats
+{
+    uint64_t fetches = 0;
+    uint64_t encoded_fetches = 0; /// fetches that came back content-encoded
+    uint64_t wire_bytes = 0;
+    uint64_t decoded_bytes = 0;
+};
+
 int webGet(const FetchArgument& argument, FetchResult &result);
 std::string webGet(const std::string &url, const ProxyPolicy &proxy,
                    unsigned int cache_ttl = 0,
                    std::string *response_headers = nullptr,
                    string_icase_map *request_headers = nullptr,
                    FetchContext context = FetchContext::TrustedConfig);
+/// webGet with no thread waiting on the transfer: done gets the content, on one of the fetch
+/// engine's completion workers or on the caller's thread when there is nothing to fetch. done
+/// should not block, other completions queue behind it.
+void webGetAsync(const std::string &url, const ProxyPolicy &proxy, unsigned int cache_ttl,
+                 FetchContext context, std::function<void(std::string)> done);
 bool isFetchUrlAllowed(const std::string &url, FetchContext context);
 void flushCache();
+FetchCache::Stats fetchCacheStats();
+FetchTransferStats fetchTransferStats();
 int webPost(const std::string &url, const std::string &data,
             const ProxyPolicy &proxy, const string_icase_map &request_headers,
             std::string *retData);
@@ -13,6 +13,7 @@
 #include "handler/inspect_page.h"
 #include "handler/interfaces.h"
 #include "handler/multithread.h"
+#include "handler/runtime_metrics.h"
 #include "handler/settings.h"
 #include "handler/statistics.h"
 #include "handler/version_page.h"
@@ -25,6 +26,7 @@
 #include "utils/logger.h"
 #include "utils/network.h"
 #include "utils/rapidjson_extra.h"
+#include "utils/regexp.h"
 #include "utils/system.h"
 #include "utils/urlencode.h"
 #include "version.h"
@@ -175,7 +177,16 @@ int main(int argc, char *argv[]) {
           std::to_string(externalConfigCacheMaxBytes()) + " bytes" +
           ", ruleset conversion cache=" +
           std::to_string(rulesetConversionCacheMaxEntries()) + " entries/" +
-          std::to_string(rulesetConversionCacheMaxBytes()) + " bytes。",
+          std::to_string(rulesetConversionCacheMaxBytes()) + " bytes" +
+          ", ruleset disk cache=" +
+          (global.rulesetCacheDir.empty() ? std::string("off")
+                                          : global.rulesetCacheDir) +
+          ", regex cache=" + std::to_string(regexCacheMaxEntries()) +
+          " entries/" + std::to_string(regexCacheMaxBytes()) + " bytes" +
+          ", regex JIT=" +
+          (regexJitActive() ? "on"
+                            : (regexJitAvailable() ? "off" : "unavailable")) +
+          "。",
       LOG_LEVEL_INFO);
   statistics::initialize();
   // vfs::vfs_read("vfs.ini");
@@ -241,6 +252,11 @@ int main(int argc, char *argv[]) {
                                     : statistics::dashboardData);
   }
 
+  if (global.enableMetrics)
+    webServer.append_response("GET", "/metrics",
+                              "text/plain; version=0.0.4; charset=utf-8",
+                              runtime_metrics::page);
+
   webServer.append_response(
       "GET", "/robots.txt", "text/plain; charset=utf-8",
       [](RESPONSE_CALLBACK_ARGS) -> std::string {
@@ -248,6 +264,7 @@ int main(int argc, char *argv[]) {
                "Disallow: /version\n"
                "Disallow: /inspect\n"
                "Disallow: /dashboard\n"
+               "Disallow: /metrics\n"
                "Disallow: /v\n";
       });
 
@@ -1,15 +1,21 @@
 #include "mihomo_bridge.h"
+#include "mihomo_result.h"
 #include <nlohmann/json.hpp>
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
 #include <utility>
 
 // Go library functions (generated from libconvert.h)
 extern "C" {
 char *ConvertSubscription(char *data);
+size_t ConvertSubscriptionBinary(char *data, size_t length, void *out,
+                                 size_t capacity);
 char *ResolveAgeRecipient(char *key);
 char *EncryptAgeArmored(char *data, char *recipient);
 void ReleaseUnusedMemory();
@@ -20,6 +26,22 @@ namespace {
 
 constexpr size_t kLargeSubscriptionThreshold = 256 * 1024;
 constexpr auto kGoMemoryReleaseInterval = std::chrono::seconds(30);
+constexpr size_t kInitialResultBuffer = 64 * 1024;
+/// results up to this size reuse one buffer per thread, larger ones get
+/// their own allocation and give it back afterwards
+constexpr size_t kRetainedResultBuffer = 1024 * 1024;
+
+struct ResultBuffer {
+  std::unique_ptr<char[]> data;
+  size_t capacity = 0;
+
+  void reserve(size_t size) {
+    if (size <= capacity)
+      return;
+    data.reset(new char[size]);
+    capacity = size;
+  }
+};
 
 void releaseGoMemoryAfterLargeParse(size_t subscription_size) noexcept {
   if (subscription_size < kLargeSubscriptionThreshold)
@@ -79,9 +101,9 @@ std::string ProxyNode::toYAML() const {
 }
 
 std::vector<ProxyNode> parseSubscription(const std::string &subscription) {
-  std::vector<ProxyNode> nodes;
   LargeParseMemoryGuard memory_guard(subscription.size());
 
+#ifdef MIHOMO_JSON_ABI
   // Call Go function
   char *raw_result =
       ConvertSubscription(const_cast<char *>(subscription.c_str()));
@@ -89,72 +111,28 @@ std::vector<ProxyNode> parseSubscription(const std::string &subscription) {
     throw std::runtime_error("调用 Go ConvertSubscription 函数失败");
   }
   std::unique_ptr<char, decltype(&FreeString)> result(raw_result, &FreeString);
-
-  // Parse JSON result
-  try {
-    auto json_result = nlohmann::json::parse(result.get());
-
-    // Check for error
-    if (json_result.contains("error")) {
-      std::string error = json_result["error"];
-      throw std::runtime_error("Mihomo 解析器错误：" + error);
-    }
-
-    // Parse proxy array
-    nodes.reserve(json_result.size());
-    for (const auto &item : json_result) {
-      ProxyNode node;
-      node.name = item.value("name", "");
-      node.type = item.value("type", "");
-      node.server = item.value("server", "");
-
-      // Port: handle both number and string
-      if (item.contains("port")) {
-        if (item["port"].is_number()) {
-          node.port = item["port"].get<int>();
-        } else if (item["port"].is_string()) {
-          try {
-            node.port = std::stoi(item["port"].get<std::string>());
-          } catch (...) {
-            node.port = 0;
-          }
-        } else {
-          node.port = 0;
-        }
-      } else {
-        node.port = 0;
-      }
-
-      // Store all other fields in params
-      for (auto it = item.begin(); it != item.end(); ++it) {
-        const std::string &key = it.key();
-        if (key != "name" && key != "type" && key != "server" &&
-            key != "port") {
-          std::string value;
-          if (it->is_string()) {
-            value = it->get<std::string>();
-          } else if (it->is_number_integer()) {
-            value = std::to_string(it->get<int>());
-          } else if (it->is_number_float()) {
-            value = std::to_string(it->get<double>());
-          } else if (it->is_boolean()) {
-            value = it->get<bool>() ? "true" : "false";
-          } else {
-            value = it->dump(); // For complex types, serialize to JSON
-          }
-          node.params[key] = value;
-          node.param_json[key] = it->dump();
-        }
-      }
-
-      nodes.emplace_back(std::move(node));
-    }
-
-  } catch (const nlohmann::json::exception &e) {
-    throw std::runtime_error(std::string("JSON 解析错误：") + e.what());
+  return decodeJsonResult(result.get());
+#else
+  // Go writes the result straight into this buffer. A result that does not
+  // fit only reports its size, and the subscription is parsed again into a
+  // buffer that does; the estimate keeps that rare.
+  thread_local ResultBuffer retained;
+  ResultBuffer oversized;
+  size_t wanted = std::max(kInitialResultBuffer, subscription.size() * 2);
+  ResultBuffer *buffer = &retained;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (wanted > kRetainedResultBuffer)
+      buffer = &oversized;
+    buffer->reserve(wanted);
+    const size_t size = ConvertSubscriptionBinary(
+        const_cast<char *>(subscription.data()), subscription.size(),
+        buffer->data.get(), buffer->capacity);
+    if (size <= buffer->capacity)
+      return decodeBinaryResult(std::string_view(buffer->data.get(), size));
+    wanted = size;
   }
-
-  return nodes;
+  throw std::runtime_error("调用 Go ConvertSubscriptionBinary 函数失败");
+#endif // MIHOMO_JSON_ABI
 }
 
 bool isMihomoParserAvailable() {
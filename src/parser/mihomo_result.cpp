@@ -0,0 +1,302 @@
+#include "mihomo_result.h"
+#include <nlohmann/json.hpp>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+
+constexpr std::string_view kResultMagic = "MHR1";
+
+enum ResultStatus : uint8_t { StatusOk = 0, StatusError = 1 };
+
+/// field kinds, see bridge/result_binary.go
+enum FieldKind : uint8_t {
+  FieldString = 0,
+  FieldInteger = 1,
+  FieldFloat = 2,
+  FieldBool = 3,
+  FieldNull = 4,
+  FieldJson = 5,
+};
+
+[[noreturn]] void throwMalformed() {
+  throw std::runtime_error("Mihomo 解析结果格式错误");
+}
+
+class ResultReader {
+public:
+  explicit ResultReader(std::string_view data) : data_(data) {}
+
+  size_t remaining() const { return data_.size(); }
+
+  uint8_t u8() {
+    if (data_.empty())
+      throwMalformed();
+    const uint8_t value = static_cast<uint8_t>(data_[0]);
+    data_.remove_prefix(1);
+    return value;
+  }
+
+  uint32_t u32() {
+    if (data_.size() < 4)
+      throwMalformed();
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--)
+      value = (value << 8) | static_cast<uint8_t>(data_[i]);
+    data_.remove_prefix(4);
+    return value;
+  }
+
+  std::string_view bytes(size_t size) {
+    if (data_.size() < size)
+      throwMalformed();
+    std::string_view value = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return value;
+  }
+
+  std::string_view text() { return bytes(u32()); }
+
+private:
+  std::string_view data_;
+};
+
+/// nlohmann::json::dump of a string: short escapes where JSON has them,
+/// \u00xx for other control bytes, everything else raw
+std::string quoteJson(std::string_view text) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string quoted;
+  quoted.reserve(text.size() + 2);
+  quoted += '"';
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      quoted += "\\\"";
+      break;
+    case '\\':
+      quoted += "\\\\";
+      break;
+    case '\b':
+      quoted += "\\b";
+      break;
+    case '\f':
+      quoted += "\\f";
+      break;
+    case '\n':
+      quoted += "\\n";
+      break;
+    case '\r':
+      quoted += "\\r";
+      break;
+    case '\t':
+      quoted += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        quoted += "\\u00";
+        quoted += kHex[(c >> 4) & 0xF];
+        quoted += kHex[c & 0xF];
+      } else {
+        quoted += c;
+      }
+    }
+  }
+  quoted += '"';
+  return quoted;
+}
+
+/// the integer as json::get<int> hands it out
+int integerValue(std::string_view text) {
+  const char *first = text.data(), *last = text.data() + text.size();
+  if (!text.empty() && text[0] == '-') {
+    int64_t value = 0;
+    if (std::from_chars(first, last, value).ec != std::errc())
+      throwMalformed();
+    return static_cast<int>(value);
+  }
+  uint64_t value = 0;
+  if (std::from_chars(first, last, value).ec != std::errc())
+    throwMalformed();
+  return static_cast<int>(value);
+}
+
+double floatValue(std::string_view text) {
+  const std::string terminated(text);
+  char *end = nullptr;
+  const double value = std::strtod(terminated.c_str(), &end);
+  if (end == terminated.c_str())
+    throwMalformed();
+  return value;
+}
+
+int portValue(uint8_t kind, std::string_view value) {
+  switch (kind) {
+  case FieldInteger:
+    return integerValue(value);
+  case FieldFloat:
+    return static_cast<int>(floatValue(value));
+  case FieldString:
+    try {
+      return std::stoi(std::string(value));
+    } catch (...) {
+      return 0;
+    }
+  default:
+    return 0;
+  }
+}
+
+} // namespace
+
+namespace mihomo {
+
+std::vector<ProxyNode> decodeBinaryResult(std::string_view result) {
+  ResultReader reader(result);
+  if (reader.bytes(kResultMagic.size()) != kResultMagic)
+    throwMalformed();
+  const uint8_t status = reader.u8();
+  if (status == StatusError)
+    throw std::runtime_error("Mihomo 解析器错误：" +
+                             std::string(reader.text()));
+  if (status != StatusOk)
+    throwMalformed();
+
+  const uint32_t count = reader.u32();
+  /// every node takes at least its field count, a corrupt count must not
+  /// reserve gigabytes
+  if (count > reader.remaining() / 4)
+    throwMalformed();
+  std::vector<ProxyNode> nodes;
+  nodes.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    ProxyNode node;
+    node.port = 0;
+    for (uint32_t fields = reader.u32(); fields > 0; fields--) {
+      const uint8_t kind = reader.u8();
+      const std::string_view key = reader.text();
+      const std::string_view value = reader.text();
+
+      if (key == "name" || key == "type" || key == "server") {
+        if (kind != FieldString)
+          throw std::runtime_error("Mihomo 解析结果格式错误：" +
+                                   std::string(key) + " 不是字符串");
+        std::string &target = key == "name"   ? node.name
+                              : key == "type" ? node.type
+                                              : node.server;
+        target.assign(value);
+        continue;
+      }
+      if (key == "port") {
+        node.port = portValue(kind, value);
+        continue;
+      }
+
+      std::string param, param_json;
+      switch (kind) {
+      case FieldString:
+        param.assign(value);
+        param_json = quoteJson(value);
+        break;
+      case FieldInteger:
+        param = std::to_string(integerValue(value));
+        param_json.assign(value);
+        break;
+      case FieldFloat:
+        param = std::to_string(floatValue(value));
+        param_json.assign(value);
+        break;
+      case FieldBool:
+      case FieldJson:
+        param.assign(value);
+        param_json.assign(value);
+        break;
+      case FieldNull:
+        param = param_json = "null";
+        break;
+      default:
+        throwMalformed();
+      }
+      std::string name(key);
+      node.params.insert_or_assign(name, std::move(param));
+      node.param_json.insert_or_assign(std::move(name), std::move(param_json));
+    }
+    nodes.emplace_back(std::move(node));
+  }
+  if (reader.remaining())
+    throwMalformed();
+  return nodes;
+}
+
+std::vector<ProxyNode> decodeJsonResult(const char *result) {
+  std::vector<ProxyNode> nodes;
+  try {
+    auto json_result = nlohmann::json::parse(result);
+
+    // Check for error
+    if (json_result.contains("error")) {
+      std::string error = json_result["error"];
+      throw std::runtime_error("Mihomo 解析器错误：" + error);
+    }
+
+    // Parse proxy array
+    nodes.reserve(json_result.size());
+    for (const auto &item : json_result) {
+      ProxyNode node;
+      node.name = item.value("name", "");
+      node.type = item.value("type", "");
+      node.server = item.value("server", "");
+
+      // Port: handle both number and string
+      if (item.contains("port")) {
+        if (item["port"].is_number()) {
+          node.port = item["port"].get<int>();
+        } else if (item["port"].is_string()) {
+          try {
+            node.port = std::stoi(item["port"].get<std::string>());
+          } catch (...) {
+            node.port = 0;
+          }
+        } else {
+          node.port = 0;
+        }
+      } else {
+        node.port = 0;
+      }
+
+      // Store all other fields in params
+      for (auto it = item.begin(); it != item.end(); ++it) {
+        const std::string &key = it.key();
+        if (key != "name" && key != "type" && key != "server" &&
+            key != "port") {
+          std::string value;
+          if (it->is_string()) {
+            value = it->get<std::string>();
+          } else if (it->is_number_integer()) {
+            value = std::to_string(it->get<int>());
+          } else if (it->is_number_float()) {
+            value = std::to_string(it->get<double>());
+          } else if (it->is_boolean()) {
+            value = it->get<bool>() ? "true" : "false";
+          } else {
+            value = it->dump(); // For complex types, serialize to JSON
+          }
+          node.params[key] = value;
+          node.param_json[key] = it->dump();
+        }
+      }
+
+      nodes.emplace_back(std::move(node));
+    }
+
+  } catch (const nlohmann::json::exception &e) {
+    throw std::runtime_error(std::string("JSON 解析错误：") + e.what());
+  }
+
+  return nodes;
+}
+
+} // namespace mihomo
@@ -0,0 +1,35 @@
+#ifndef MIHOMO_RESULT_H
+#define MIHOMO_RESULT_H
+
+#include <string_view>
+#include <vector>
+
+#include "mihomo_bridge.h"
+
+namespace mihomo {
+
+/**
+ * @brief Decode a ConvertSubscriptionBinary result into proxy nodes
+ *
+ * Reads the field table laid out in bridge/result_binary.go in one pass,
+ * without an intermediate document. Nodes come out identical to what
+ * decodeJsonResult makes of the same subscription.
+ *
+ * @param result The bytes the Go side wrote
+ * @return Vector of parsed proxy nodes
+ * @throws std::runtime_error on a parser error or a malformed result
+ */
+std::vector<ProxyNode> decodeBinaryResult(std::string_view result);
+
+/**
+ * @brief Decode a ConvertSubscription JSON result into proxy nodes
+ *
+ * The JSON ABI, used by MIHOMO_JSON_ABI builds and parity tests.
+ *
+ * @throws std::runtime_error on a parser error or malformed JSON
+ */
+std::vector<ProxyNode> decodeJsonResult(const char *result);
+
+} // namespace mihomo
+
+#endif // MIHOMO_RESULT_H
@@ -0,0 +1,195 @@
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+
+#include "script/script_cache.h"
+#include "utils/file.h"
+
+namespace
+{
+
+struct SourceEntry
+{
+    time_t mtime = 0;
+    long long size = 0;
+    std::string content;
+};
+
+/// script paths come from the configuration and authorized requests, a handful in practice
+constexpr size_t kMaxSourceEntries = 256;
+
+std::mutex source_mutex;
+std::unordered_map<std::string, SourceEntry> source_cache;
+std::atomic<uint64_t> source_reads {0}, function_reuses {0};
+
+#ifndef NO_JS_RUNTIME
+
+struct CompiledScript
+{
+    /// names the script in the per-context registry, unique for the life of the process
+    uint64_t id = 0;
+    std::vector<uint8_t> bytecode;
+};
+
+constexpr size_t kBytecodeCacheEntries = 256;
+constexpr size_t kBytecodeCacheBytes = 16 * 1024 * 1024;
+/// non-enumerable global holding, per script run in a context, the functions resolved from it
+constexpr const char *kRegistryName = "__subconverter_scripts";
+
+std::atomic<uint64_t> script_serial {0};
+
+ShardedLruCache<std::string, CompiledScript> &bytecode_cache()
+{
+    static ShardedLruCache<std::string, CompiledScript> cache(kBytecodeCacheEntries, kBytecodeCacheBytes);
+    return cache;
+}
+
+CompiledScript compile_script(JSContext *ctx, const std::string &script)
+{
+    CompiledScript compiled;
+    compiled.id = ++script_serial;
+    JSValue function = JS_Eval(ctx, script.data(), script.size(), "<eval>", JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+    if(JS_IsException(function))
+    {
+        /// the plain eval fallback reports the syntax error again in the caller's context
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return compiled;
+    }
+    size_t size = 0;
+    uint8_t *data = JS_WriteObject(ctx, &size, function, JS_WRITE_OBJ_BYTECODE);
+    JS_FreeValue(ctx, function);
+    if(!data)
+    {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return compiled;
+    }
+    compiled.bytecode.assign(data, data + size);
+    js_free(ctx, data);
+    return compiled;
+}
+
+/// top-level let and const bindings are not properties of the global object, so the name is
+/// resolved by evaluating it
+qjs::Value resolve_function(qjs::Context &context, const char *name, bool optional)
+{
+    if(!optional)
+        return context.eval(name);
+    const std::string expression = std::string("typeof ") + name + " === 'function' ? " + name + " : undefined";
+    return context.eval(expression);
+}
+
+/// hooks callers look up, probed by name as let and const bindings cannot be enumerated
+constexpr const char *kHookNames[] = {"parse", "filter", "filterAll", "rename", "renameAll", "getEmoji", "getEmojiAll", "compare"};
+
+/// evaluates to an object with every function the global scope holds right after a script ran:
+/// enumerable globals, which covers function declarations and var, plus the hooks by name
+const std::string &snapshot_expression()
+{
+    static const std::string expression = []()
+    {
+        std::string text = "(() => { const s = {};"
+                           " for (const k of Object.keys(globalThis)) if (typeof globalThis[k] === 'function') s[k] = globalThis[k];";
+        for(const char *name : kHookNames)
+            text += std::string(" if (typeof ") + name + " === 'function') s." + name + " = " + name + ";";
+        text += " return s; })()";
+        return text;
+    }();
+    return expression;
+}
+
+#endif // NO_JS_RUNTIME
+
+} // namespace
+
+std::string script_file_source(const std::string &path, bool scope_limit)
+{
+    if(scope_limit && !isInScope(path))
+        return "";
+    struct stat result {};
+    if(stat(path.data(), &result) != 0)
+        return "";
+    {
+        std::lock_guard<std::mutex> lock(source_mutex);
+        auto iter = source_cache.find(path);
+        if(iter != source_cache.end() && iter->second.mtime == result.st_mtime && iter->second.size == result.st_size)
+            return iter->second.content;
+    }
+
+    std::string content = fileGet(path);
+    source_reads++;
+    std::lock_guard<std::mutex> lock(source_mutex);
+    if(source_cache.size() >= kMaxSourceEntries && source_cache.find(path) == source_cache.end())
+        source_cache.clear();
+    source_cache[path] = SourceEntry {result.st_mtime, static_cast<long long>(result.st_size), content};
+    return content;
+}
+
+ScriptCacheStats script_cache_stats()
+{
+    ScriptCacheStats stats;
+#ifndef NO_JS_RUNTIME
+    stats.bytecode = bytecode_cache().stats();
+#endif // NO_JS_RUNTIME
+    stats.function_reuses = function_reuses.load();
+    stats.file_reads = source_reads.load();
+    return stats;
+}
+
+#ifndef NO_JS_RUNTIME
+
+qjs::Value script_function(qjs::Context &context, const std::string &script, const char *name, bool optional)
+{
+    JSContext *ctx = context.ctx;
+    auto compiled = bytecode_cache().getOrCompute(
+        script, true, [&]() { return compile_script(ctx, script); },
+        [&](const CompiledScript &value) -> std::optional<size_t>
+        {
+            if(value.bytecode.empty())
+                return std::nullopt;
+            return script.size() + value.bytecode.size();
+        });
+    if(compiled->bytecode.empty())
+    {
+        context.eval(script);
+        return resolve_function(context, name, optional);
+    }
+
+    qjs::Value global = context.global();
+    qjs::Value registry = context.newValue(JS_GetPropertyStr(ctx, global.v, kRegistryName));
+    if(!JS_IsObject(registry.v))
+    {
+        registry = context.newObject();
+        JS_DefinePropertyValueStr(ctx, global.v, kRegistryName, JS_DupValue(ctx, registry.v), JS_PROP_CONFIGURABLE);
+    }
+    /// a script runs once per context and the functions it leaves behind are captured right away,
+    /// so a later script redefining a name cannot change what this script's lookups return
+    const std::string key = std::to_string(compiled->id);
+    qjs::Value functions = context.newValue(JS_GetPropertyStr(ctx, registry.v, key.data()));
+    const bool evaluated = !JS_IsObject(functions.v);
+    if(evaluated)
+    {
+        JSValue object = JS_ReadObject(ctx, compiled->bytecode.data(), compiled->bytecode.size(), JS_READ_OBJ_BYTECODE);
+        if(JS_IsException(object))
+            throw qjs::exception {ctx};
+        context.newValue(JS_EvalFunction(ctx, object));
+        functions = context.eval(snapshot_expression());
+        JS_SetPropertyStr(ctx, registry.v, key.data(), JS_DupValue(ctx, functions.v));
+    }
+    qjs::Value function = context.newValue(JS_GetPropertyStr(ctx, functions.v, name));
+    if(JS_IsFunction(ctx, function.v))
+    {
+        if(!evaluated)
+            function_reuses++;
+        return function;
+    }
+    if(optional)
+        return function;
+    JS_ThrowReferenceError(ctx, "%s is not defined", name);
+    throw qjs::exception {ctx};
+}
+
+#endif // NO_JS_RUNTIME
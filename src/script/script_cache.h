@@ -0,0 +1,35 @@
+#ifndef SCRIPT_CACHE_H_INCLUDED
+#define SCRIPT_CACHE_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+
+#include "utils/concurrent_lru_cache.h"
+
+struct ScriptCacheStats
+{
+    LruCacheStats bytecode;
+    uint64_t function_reuses = 0;
+    uint64_t file_reads = 0;
+};
+
+/// content of a script file, read again only when its size or mtime changes
+std::string script_file_source(const std::string &path, bool scope_limit = false);
+ScriptCacheStats script_cache_stats();
+
+#ifndef NO_JS_RUNTIME
+
+#include <quickjspp.hpp>
+
+/// the global function name defined by script. The script is compiled to QuickJS bytecode once
+/// per process and that bytecode is shared by every runtime, it then runs once per context and
+/// the functions it defines are captured right after it runs, so later calls for the same script
+/// in the same context return its own function even if another script redefined the name since.
+/// Names are the global functions the script leaves behind plus the hooks callers use by name.
+/// A script that does not compile falls back to a plain eval so the error surfaces as before.
+/// An optional function that the script does not define comes back undefined instead of throwing.
+qjs::Value script_function(qjs::Context &context, const std::string &script, const char *name, bool optional = false);
+
+#endif // NO_JS_RUNTIME
+
+#endif // SCRIPT_CACHE_H_INCLUDED
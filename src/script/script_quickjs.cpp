@@ -1,3 +1,4 @@
+#include <chrono>
 #include <string>
 #include <cstring>
 #include <map>
@@ -420,9 +421,230 @@ std::string getGeoIP(const std::string &address, const std::string &proxy)
     return fetchFile("https://api.ip.sb/geoip/" + address, policy, global.cacheConfig);
 }
 
+namespace
+{
+
+/// steady clock milliseconds at which scripts on this thread are interrupted, 0 when unarmed
+thread_local int64_t script_deadline_ms = 0;
+
+int64_t steady_milliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int script_interrupt_handler(JSRuntime *, void *)
+{
+    return script_deadline_ms && steady_milliseconds() >= script_deadline_ms;
+}
+
+void script_runtime_destroy(std::unique_ptr<qjs::Runtime> runtime)
+{
+    js_std_free_handlers(runtime->rt);
+    runtime.reset();
+}
+
+} // namespace
+
 void script_runtime_init(qjs::Runtime &runtime)
 {
     js_std_init_handlers(runtime.rt);
+    if(global.scriptMemoryLimitMB > 0)
+        JS_SetMemoryLimit(runtime.rt, static_cast<size_t>(global.scriptMemoryLimitMB) * 1024 * 1024);
+    JS_SetInterruptHandler(runtime.rt, script_interrupt_handler, nullptr);
+}
+
+ScriptDeadline::ScriptDeadline() : previous_(script_deadline_ms)
+{
+    if(global.scriptTimeout > 0)
+        script_deadline_ms = steady_milliseconds() + global.scriptTimeout;
+}
+
+ScriptDeadline::~ScriptDeadline()
+{
+    script_deadline_ms = previous_;
+}
+
+ScriptRuntimePool::Lease::Lease(ScriptRuntimePool *pool, std::unique_ptr<qjs::Runtime> runtime) : pool_(pool), runtime_(std::move(runtime))
+{
+    context_ = std::make_unique<qjs::Context>(*runtime_);
+    script_context_init(*context_);
+}
+
+ScriptRuntimePool::Lease::~Lease()
+{
+    if(!runtime_)
+        return;
+    /// timers and handlers the script registered must not fire in the next lease's context
+    js_std_free_handlers(runtime_->rt);
+    context_.reset();
+    js_std_init_handlers(runtime_->rt);
+    pool_->release(std::move(runtime_));
+}
+
+ScriptRuntimePool::~ScriptRuntimePool()
+{
+    for(std::unique_ptr<qjs::Runtime> &runtime : idle_)
+        script_runtime_destroy(std::move(runtime));
+}
+
+ScriptRuntimePool::Lease ScriptRuntimePool::acquire()
+{
+    std::unique_ptr<qjs::Runtime> runtime;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!idle_.empty())
+        {
+            runtime = std::move(idle_.back());
+            idle_.pop_back();
+            reused_++;
+        }
+        else
+            created_++;
+    }
+    if(runtime)
+    {
+        /// the runtime may have been created on another thread, stack overflow checks must use this one
+        JS_UpdateStackTop(runtime->rt);
+        JS_SetMemoryLimit(runtime->rt, global.scriptMemoryLimitMB > 0 ? static_cast<size_t>(global.scriptMemoryLimitMB) * 1024 * 1024 : static_cast<size_t>(-1));
+    }
+    else
+    {
+        runtime = std::make_unique<qjs::Runtime>();
+        script_runtime_init(*runtime);
+    }
+    return Lease(this, std::move(runtime));
+}
+
+void ScriptRuntimePool::release(std::unique_ptr<qjs::Runtime> runtime)
+{
+    /// jobs left behind still reference the freed context, and a heap that stayed large after it
+    /// was freed is holding on to something, neither is worth handing to the next caller
+    bool reusable = !JS_IsJobPending(runtime->rt);
+    if(reusable && global.scriptMemoryLimitMB > 0)
+    {
+        JSMemoryUsage usage {};
+        JS_ComputeMemoryUsage(runtime->rt, &usage);
+        reusable = usage.malloc_size < static_cast<int64_t>(global.scriptMemoryLimitMB) * 1024 * 1024 / 2;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(reusable && idle_.size() < static_cast<size_t>(global.scriptRuntimePoolSize))
+        {
+            idle_.push_back(std::move(runtime));
+            return;
+        }
+        discarded_++;
+    }
+    script_runtime_destroy(std::move(runtime));
+}
+
+ScriptRuntimePool::Stats ScriptRuntimePool::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.created = created_;
+    stats.reused = reused_;
+    stats.discarded = discarded_;
+    stats.idle = idle_.size();
+    return stats;
+}
+
+ScriptRuntimePool &script_runtime_pool()
+{
+    static ScriptRuntimePool pool;
+    return pool;
+}
+
+/// the Proxy objects a batch hook gets, wrapping the caller's nodes without owning them, so a
+/// field is only converted to JavaScript when a script reads it. When the batch is over every
+/// one of them is pointed at a blank node, as the caller's may be gone by the time a script
+/// that kept one reads it again.
+class ScriptNodeBatch
+{
+public:
+    ScriptNodeBatch(qjs::Context &context, const std::vector<Proxy> &nodes) : context_(context)
+    {
+        handles_.reserve(nodes.size());
+        for(const Proxy &node : nodes)
+        {
+            JSValue handle = qjs::js_traits<std::shared_ptr<Proxy>>::wrap(context.ctx, std::shared_ptr<Proxy>(const_cast<Proxy *>(&node), [](Proxy *) {}));
+            if(JS_IsException(handle))
+                break;
+            handles_.push_back(handle);
+        }
+    }
+    ScriptNodeBatch(const ScriptNodeBatch &) = delete;
+    ScriptNodeBatch &operator=(const ScriptNodeBatch &) = delete;
+
+    ~ScriptNodeBatch()
+    {
+        auto blank = std::make_shared<Proxy>();
+        for(JSValue handle : handles_)
+        {
+            auto *node = static_cast<std::shared_ptr<Proxy> *>(JS_GetOpaque(handle, qjs::js_traits<std::shared_ptr<Proxy>>::QJSClassId));
+            if(node)
+                *node = blank;
+            JS_FreeValue(context_.ctx, handle);
+        }
+    }
+
+    /// a new array holding every node, throws when one of them could not be wrapped
+    qjs::Value array(size_t count) const
+    {
+        if(handles_.size() != count)
+            throw qjs::exception {context_.ctx};
+        qjs::Value array = context_.newValue(JS_NewArray(context_.ctx));
+        for(uint32_t i = 0; i < handles_.size(); i++)
+            if(JS_SetPropertyUint32(context_.ctx, array.v, i, JS_DupValue(context_.ctx, handles_[i])) < 0)
+                throw qjs::exception {context_.ctx};
+        return array;
+    }
+
+private:
+    qjs::Context &context_;
+    std::vector<JSValue> handles_;
+};
+
+/// batch has to outlive the result, which may hold nodes itself
+static qjs::Value script_call_batch(qjs::Context &context, const qjs::Value &function, const ScriptNodeBatch &batch, const std::vector<Proxy> &nodes)
+{
+    qjs::Value array = batch.array(nodes.size());
+    qjs::Value result = context.newValue(JS_Call(context.ctx, function.v, JS_UNDEFINED, 1, &array.v));
+    if(JS_IsArray(context.ctx, result.v) <= 0 || static_cast<uint32_t>(result["length"]) != nodes.size())
+    {
+        JS_ThrowTypeError(context.ctx, "batch hook must return an array with one entry per node");
+        throw qjs::exception {context.ctx};
+    }
+    return result;
+}
+
+StringArray script_batch_strings(qjs::Context &context, const qjs::Value &function, const std::vector<Proxy> &nodes)
+{
+    ScriptNodeBatch batch(context, nodes);
+    qjs::Value result = script_call_batch(context, function, batch, nodes);
+    StringArray strings(nodes.size());
+    for(uint32_t i = 0; i < nodes.size(); i++)
+    {
+        JSValue entry = JS_GetPropertyUint32(context.ctx, result.v, i);
+        if(JS_IsString(entry))
+            strings[i] = qjs::js_traits<std::string>::unwrap(context.ctx, entry);
+        JS_FreeValue(context.ctx, entry);
+    }
+    return strings;
+}
+
+std::vector<char> script_batch_flags(qjs::Context &context, const qjs::Value &function, const std::vector<Proxy> &nodes)
+{
+    ScriptNodeBatch batch(context, nodes);
+    qjs::Value result = script_call_batch(context, function, batch, nodes);
+    std::vector<char> flags(nodes.size());
+    for(uint32_t i = 0; i < nodes.size(); i++)
+    {
+        JSValue entry = JS_GetPropertyUint32(context.ctx, result.v, i);
+        flags[i] = JS_ToBool(context.ctx, entry) > 0;
+        JS_FreeValue(context.ctx, entry);
+    }
+    return flags;
 }
 
 int ShowMsgbox(const std::string &title, const std::string &content, uint16_t type = 0)
@@ -6,6 +6,10 @@
 
 #ifndef NO_JS_RUNTIME
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <quickjspp.hpp>
 
 void script_runtime_init(qjs::Runtime &runtime);
@@ -205,21 +209,86 @@ namespace qjs
     };
 }
 
+/// initialized runtimes for clean script calls. Creating a runtime is most of the cost of a clean
+/// call, so released runtimes are kept up to script_runtime_pool_size and handed out again;
+/// isolation comes from every lease getting a new context, which is freed when the lease ends.
+class ScriptRuntimePool
+{
+public:
+    struct Stats
+    {
+        uint64_t created = 0;
+        uint64_t reused = 0;
+        uint64_t discarded = 0;
+        uint64_t idle = 0;
+    };
+
+    class Lease
+    {
+    public:
+        Lease(ScriptRuntimePool *pool, std::unique_ptr<qjs::Runtime> runtime);
+        Lease(Lease &&other) noexcept = default;
+        ~Lease();
+
+        qjs::Context &context() { return *context_; }
+
+    private:
+        ScriptRuntimePool *pool_;
+        std::unique_ptr<qjs::Runtime> runtime_;
+        std::unique_ptr<qjs::Context> context_;
+    };
+
+    ~ScriptRuntimePool();
+
+    Lease acquire();
+    Stats stats() const;
+
+private:
+    void release(std::unique_ptr<qjs::Runtime> runtime);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<qjs::Runtime>> idle_;
+    uint64_t created_ = 0, reused_ = 0, discarded_ = 0;
+};
+
+ScriptRuntimePool &script_runtime_pool();
+
+/// arms the script_timeout_ms deadline that the interrupt handler installed by
+/// script_runtime_init checks for scripts running on this thread
+class ScriptDeadline
+{
+public:
+    ScriptDeadline();
+    ~ScriptDeadline();
+
+private:
+    int64_t previous_;
+};
+
+/// batch hooks such as renameAll(nodes) take every node in one call and return an array with
+/// one entry per node. Entries that are not strings come back empty. The nodes are instances of
+/// the Proxy class registered by script_context_init over the caller's vector itself, not a copy:
+/// a field a script sets changes the caller's node, and a node kept past the call reads as an
+/// empty one from then on.
+StringArray script_batch_strings(qjs::Context &context, const qjs::Value &function, const std::vector<Proxy> &nodes);
+/// the truthiness of each entry, for hooks like filterAll(nodes) that return keep flags
+std::vector<char> script_batch_flags(qjs::Context &context, const qjs::Value &function, const std::vector<Proxy> &nodes);
+
 template <typename Fn>
 void script_safe_runner(qjs::Runtime *runtime, qjs::Context *context, Fn runnable, bool clean_context = false)
 {
-    qjs::Runtime *internal_runtime = runtime;
-    qjs::Context *internal_context = context;
-    defer(if(clean_context) {delete internal_context; delete internal_runtime;} )
     if(clean_context)
     {
-        internal_runtime = new qjs::Runtime();
-        script_runtime_init(*internal_runtime);
-        internal_context = new qjs::Context(*internal_runtime);
-        script_context_init(*internal_context);
+        ScriptRuntimePool::Lease lease = script_runtime_pool().acquire();
+        ScriptDeadline deadline;
+        runnable(lease.context());
+        return;
+    }
+    if(runtime && context)
+    {
+        ScriptDeadline deadline;
+        runnable(*context);
     }
-    if(internal_runtime && internal_context)
-        runnable(*internal_context);
 }
 
 #else
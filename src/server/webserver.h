@@ -19,6 +19,8 @@ struct Request
     string_multimap argument;
     string_icase_map headers;
     std::string postdata;
+    /// kept apart from headers, which are passed on to upstream fetches
+    std::string accept_encoding;
 };
 
 struct Response
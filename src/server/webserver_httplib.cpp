@@ -50,6 +50,7 @@ static httplib::Server::Handler makeHandler(const responseRoute &rr) {
       }
       req.headers.emplace(h.first.data(), h.second.data());
     }
+    req.accept_encoding = request.get_header_value("Accept-Encoding");
     for (const auto &param : request.params) {
       req.argument.emplace(param.first, param.second);
     }
@@ -272,6 +272,8 @@ static void on_request(evhttp_request *req, void *args)
         kv = kv->next.tqe_next;
     }
     request.headers.emplace("X-Client-IP", client_ip);
+    if (const char *accept_encoding = evhttp_find_header(req->input_headers, "Accept-Encoding"))
+        request.accept_encoding = accept_encoding;
 
     std::string return_data;
     int retVal = process_request(server, request, response, return_data);
@@ -1,9 +1,12 @@
 #ifndef BOUNDED_EXECUTOR_H_INCLUDED
 #define BOUNDED_EXECUTOR_H_INCLUDED
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <cstddef>
 #include <deque>
+#include <exception>
 #include <functional>
 #include <future>
 #include <memory>
@@ -101,4 +104,59 @@ private:
   bool stopping_ = false;
 };
 
+/// Runs job(0) .. job(count - 1) with at most max_parallel of them at once,
+/// the calling thread included, and returns when all have finished. If jobs
+/// throw, the exception of the lowest index is rethrown, the same one a plain
+/// loop would have surfaced. Helpers still queued behind other work when the
+/// jobs are done are not waited for, they find nothing left and return.
+template <class Job>
+void parallelFor(BoundedExecutor &executor, size_t count, size_t max_parallel,
+                 Job &&job) {
+  if (count == 0)
+    return;
+  max_parallel = std::clamp<size_t>(max_parallel, 1, count);
+
+  /// outlives the call for helpers that start late; job is only touched
+  /// after claiming an index, and every claimed index is waited for
+  struct State {
+    explicit State(size_t count) : errors(count) {}
+    std::atomic<size_t> next{0};
+    std::vector<std::exception_ptr> errors;
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t finished = 0;
+  };
+  auto state = std::make_shared<State>(count);
+  auto *run = &job;
+  auto drain = [state, count, run] {
+    for (size_t index = state->next++; index < count;
+         index = state->next++) {
+      try {
+        (*run)(index);
+      } catch (...) {
+        state->errors[index] = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (++state->finished == count)
+        state->cv.notify_all();
+    }
+  };
+
+  for (size_t i = 1; i < max_parallel; ++i)
+    executor.submit(drain);
+  drain();
+  std::vector<std::exception_ptr> errors;
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&] { return state->finished == count; });
+    /// a late helper may drop the last reference to state, the exceptions
+    /// must not go with it while the caller still handles one
+    errors = std::move(state->errors);
+  }
+  for (std::exception_ptr &error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
 #endif // BOUNDED_EXECUTOR_H_INCLUDED
@@ -1,7 +1,10 @@
 #ifndef CONCURRENT_LRU_CACHE_H_INCLUDED
 #define CONCURRENT_LRU_CACHE_H_INCLUDED
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <future>
 #include <list>
@@ -10,6 +13,7 @@
 #include <optional>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 template <class Key, class Value, class Hash = std::hash<Key>>
 class ConcurrentLruCache {
@@ -139,4 +143,218 @@ private:
   size_t bytes_ = 0;
 };
 
+struct LruCacheStats {
+  size_t entries = 0;
+  size_t bytes = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+
+  LruCacheStats &operator+=(const LruCacheStats &other) {
+    entries += other.entries;
+    bytes += other.bytes;
+    hits += other.hits;
+    misses += other.misses;
+    evictions += other.evictions;
+    return *this;
+  }
+};
+
+// ConcurrentLruCache split into independently locked shards, for caches whose
+// lookups contend or whose values are large. Values are shared as
+// shared_ptr<const Value>, so a hit hands out a pointer instead of copying the
+// value under the lock. The entry and byte budgets stay global: an insert
+// evicts from its own shard first and then from the others, so a single value
+// may still use the whole byte budget.
+template <class Key, class Value, class Hash = std::hash<Key>>
+class ShardedLruCache {
+public:
+  using CacheSize = std::optional<size_t>;
+  using ValuePtr = std::shared_ptr<const Value>;
+
+  static constexpr size_t kDefaultShards = 8;
+
+  ShardedLruCache(size_t max_entries, size_t max_bytes,
+                  size_t shard_count = kDefaultShards)
+      : max_entries_(max_entries), max_bytes_(max_bytes),
+        shard_count_(std::max<size_t>(shard_count, 1)),
+        shards_(new Shard[shard_count_]) {}
+
+  ShardedLruCache(const ShardedLruCache &) = delete;
+  ShardedLruCache &operator=(const ShardedLruCache &) = delete;
+
+  template <class Compute, class SizeOf>
+  ValuePtr getOrCompute(const Key &key, bool cache_enabled, Compute &&compute,
+                        SizeOf &&size_of, bool *cache_hit = nullptr) {
+    if (cache_hit)
+      *cache_hit = false;
+    if (!cache_enabled)
+      return std::make_shared<const Value>(compute());
+
+    const size_t index = Hash{}(key) % shard_count_;
+    Shard &shard = shards_[index];
+    std::shared_future<ValuePtr> future;
+    std::shared_ptr<std::promise<ValuePtr>> promise;
+    bool owner = false;
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto cached = shard.entries.find(key);
+      if (cached != shard.entries.end()) {
+        shard.touch(cached);
+        ++shard.hits;
+        if (cache_hit)
+          *cache_hit = true;
+        return cached->second.value;
+      }
+      ++shard.misses;
+
+      auto inflight = shard.inflight.find(key);
+      if (inflight != shard.inflight.end()) {
+        future = inflight->second;
+      } else {
+        promise = std::make_shared<std::promise<ValuePtr>>();
+        future = promise->get_future().share();
+        shard.inflight.emplace(key, future);
+        owner = true;
+      }
+    }
+
+    if (!owner)
+      return future.get();
+
+    try {
+      ValuePtr value = std::make_shared<const Value>(compute());
+      CacheSize bytes = size_of(*value);
+      if (bytes && *bytes <= max_bytes_ && max_entries_ != 0)
+        insert(index, key, value, *bytes);
+      promise->set_value(std::move(value));
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.inflight.erase(key);
+    }
+    return future.get();
+  }
+
+  size_t size() const { return entries_.load(); }
+
+  size_t bytes() const { return bytes_.load(); }
+
+  size_t shardCount() const { return shard_count_; }
+
+  std::vector<LruCacheStats> shardStats() const {
+    std::vector<LruCacheStats> stats(shard_count_);
+    for (size_t i = 0; i < shard_count_; ++i) {
+      const Shard &shard = shards_[i];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      stats[i].entries = shard.entries.size();
+      stats[i].bytes = shard.bytes;
+      stats[i].hits = shard.hits;
+      stats[i].misses = shard.misses;
+      stats[i].evictions = shard.evictions;
+    }
+    return stats;
+  }
+
+  LruCacheStats stats() const {
+    LruCacheStats total;
+    for (const LruCacheStats &shard : shardStats())
+      total += shard;
+    return total;
+  }
+
+  void clear() {
+    for (size_t i = 0; i < shard_count_; ++i) {
+      Shard &shard = shards_[i];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      entries_ -= shard.entries.size();
+      bytes_ -= shard.bytes;
+      shard.entries.clear();
+      shard.lru.clear();
+      shard.bytes = 0;
+    }
+  }
+
+private:
+  struct Entry {
+    ValuePtr value;
+    size_t bytes = 0;
+    typename std::list<Key>::iterator lru;
+  };
+
+  using EntryMap = std::unordered_map<Key, Entry, Hash>;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    std::list<Key> lru;
+    EntryMap entries;
+    std::unordered_map<Key, std::shared_future<ValuePtr>, Hash> inflight;
+    size_t bytes = 0;
+    uint64_t hits = 0, misses = 0, evictions = 0;
+
+    void touch(typename EntryMap::iterator entry) {
+      lru.splice(lru.begin(), lru, entry->second.lru);
+      entry->second.lru = lru.begin();
+    }
+  };
+
+  bool overBudget() const {
+    return entries_.load() > max_entries_ || bytes_.load() > max_bytes_;
+  }
+
+  void evictOldest(Shard &shard) {
+    auto evicted = shard.entries.find(shard.lru.back());
+    if (evicted != shard.entries.end()) {
+      shard.bytes -= evicted->second.bytes;
+      bytes_ -= evicted->second.bytes;
+      --entries_;
+      ++shard.evictions;
+      shard.entries.erase(evicted);
+    }
+    shard.lru.pop_back();
+  }
+
+  void insert(size_t index, const Key &key, const ValuePtr &value,
+              size_t bytes) {
+    {
+      Shard &shard = shards_[index];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto existing = shard.entries.find(key);
+      if (existing != shard.entries.end()) {
+        shard.bytes -= existing->second.bytes;
+        bytes_ -= existing->second.bytes;
+        --entries_;
+        shard.lru.erase(existing->second.lru);
+        shard.entries.erase(existing);
+      }
+
+      shard.lru.push_front(key);
+      shard.entries.emplace(key, Entry{value, bytes, shard.lru.begin()});
+      shard.bytes += bytes;
+      bytes_ += bytes;
+      ++entries_;
+      // the new entry sits at the front, so it is never the one evicted here
+      while (overBudget() && shard.entries.size() > 1)
+        evictOldest(shard);
+    }
+    // one shard lock at a time, so concurrent inserts cannot deadlock
+    for (size_t step = 1; step < shard_count_ && overBudget(); ++step) {
+      Shard &shard = shards_[(index + step) % shard_count_];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      while (overBudget() && !shard.entries.empty())
+        evictOldest(shard);
+    }
+  }
+
+  const size_t max_entries_;
+  const size_t max_bytes_;
+  const size_t shard_count_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<size_t> entries_{0};
+  std::atomic<size_t> bytes_{0};
+};
+
 #endif // CONCURRENT_LRU_CACHE_H_INCLUDED
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <utime.h>
+#endif // _WIN32
+
+#include "content_store.h"
+#include "file.h"
+#include "string.h"
+
+namespace
+{
+
+/// every entry is "SCCS0001", the payload length as 8 little-endian bytes, then the payload
+constexpr std::string_view kEntryMagic = "SCCS0001";
+constexpr size_t kHeaderSize = 16;
+/// entries are "<key>.sccs" and temporaries "<key>.sccs.<serial>.tmp", anything else in the
+/// directory belongs to someone else and is neither counted nor pruned
+constexpr std::string_view kEntrySuffix = ".sccs";
+constexpr std::string_view kTempSuffix = ".tmp";
+/// temporary files this old were left behind by a crashed writer
+constexpr time_t kStaleTempSeconds = 3600;
+
+std::string encodeHeader(uint64_t length)
+{
+    std::string header(kEntryMagic);
+    for(int i = 0; i < 8; i++)
+        header += static_cast<char>((length >> (i * 8)) & 0xff);
+    return header;
+}
+
+/// reads the payload straight into value, so it is never held twice
+bool readEntry(const std::string &path, std::string &value)
+{
+    std::FILE *fp = std::fopen(path.data(), "rb");
+    if(!fp)
+        return false;
+    bool valid = false;
+    struct stat result {};
+    char header[kHeaderSize];
+    if(fstat(fileno(fp), &result) == 0 && static_cast<uint64_t>(result.st_size) >= kHeaderSize &&
+       std::fread(header, 1, kHeaderSize, fp) == kHeaderSize &&
+       std::string_view(header, kEntryMagic.size()) == kEntryMagic)
+    {
+        uint64_t length = 0;
+        for(int i = 0; i < 8; i++)
+            length |= static_cast<uint64_t>(static_cast<unsigned char>(header[kEntryMagic.size() + i])) << (i * 8);
+        if(length == static_cast<uint64_t>(result.st_size) - kHeaderSize)
+        {
+            value.resize(length);
+            valid = std::fread(value.data(), 1, length, fp) == length;
+        }
+    }
+    std::fclose(fp);
+    return valid;
+}
+
+void makeDirectories(const std::string &path)
+{
+    size_t pos = path.find_first_of("/\\", 1);
+    while(true)
+    {
+        md(path.substr(0, pos).data());
+        if(pos == std::string::npos)
+            break;
+        pos = path.find_first_of("/\\", pos + 1);
+    }
+}
+
+struct EntryFile
+{
+    std::string name;
+    uint64_t size;
+    time_t mtime;
+};
+
+std::vector<EntryFile> listEntries(const std::string &directory)
+{
+    std::vector<EntryFile> entries;
+    const time_t now = time(nullptr);
+    operateFiles(directory, [&](const std::string &name)
+    {
+        const std::string path = directory + "/" + name;
+        struct stat result {};
+        if(stat(path.data(), &result) != 0 || !S_ISREG(result.st_mode))
+            return 0;
+        if(endsWith(name, std::string(kTempSuffix)) && name.find(std::string(kEntrySuffix) + ".") != std::string::npos)
+        {
+            if(difftime(now, result.st_mtime) > kStaleTempSeconds)
+                remove(path.data());
+            return 0;
+        }
+        if(endsWith(name, std::string(kEntrySuffix)))
+            entries.push_back({name, static_cast<uint64_t>(result.st_size), result.st_mtime});
+        return 0;
+    });
+    return entries;
+}
+
+} // namespace
+
+ContentStore::ContentStore(std::string directory, uint64_t max_bytes) : directory_(std::move(directory)), max_bytes_(max_bytes)
+{
+    makeDirectories(directory_);
+    uint64_t total = 0;
+    for(const EntryFile &entry : listEntries(directory_))
+        total += entry.size;
+    bytes_ = total;
+}
+
+bool ContentStore::get(const std::string &key, std::string &value)
+{
+    const std::string path = directory_ + "/" + key + std::string(kEntrySuffix);
+    const bool found = readEntry(path, value);
+#ifndef _WIN32
+    /// refreshing the mtime makes pruning drop the least recently used entries first
+    if(found)
+        utime(path.data(), nullptr);
+#endif // _WIN32
+    if(found)
+        hits_++;
+    else
+        misses_++;
+    return found;
+}
+
+bool ContentStore::put(const std::string &key, const std::string &value)
+{
+    const std::string path = directory_ + "/" + key + std::string(kEntrySuffix);
+    const std::string temp = path + "." + std::to_string(temp_serial_++) + randomStr(8) + std::string(kTempSuffix);
+    const std::string header = encodeHeader(value.size());
+
+    std::FILE *fp = std::fopen(temp.data(), "wb");
+    if(!fp)
+        return false;
+    bool written = std::fwrite(header.data(), 1, header.size(), fp) == header.size() &&
+                   std::fwrite(value.data(), 1, value.size(), fp) == value.size();
+    written = std::fclose(fp) == 0 && written;
+    /// an overwritten entry's bytes leave the directory along with it
+    struct stat previous {};
+    const uint64_t replaced = stat(path.data(), &previous) == 0 ? static_cast<uint64_t>(previous.st_size) : 0;
+#ifdef _WIN32
+    if(written)
+        remove(path.data());
+#endif // _WIN32
+    if(!written || rename(temp.data(), path.data()) != 0)
+    {
+        remove(temp.data());
+        return false;
+    }
+
+    writes_++;
+    const uint64_t size = header.size() + value.size();
+    if((size >= replaced ? bytes_ += size - replaced : bytes_ -= replaced - size) > max_bytes_)
+        prune(key + std::string(kEntrySuffix));
+    return true;
+}
+
+void ContentStore::prune(const std::string &keep)
+{
+    std::lock_guard<std::mutex> lock(prune_mutex_);
+    std::vector<EntryFile> entries = listEntries(directory_);
+    std::sort(entries.begin(), entries.end(), [](const EntryFile &a, const EntryFile &b) { return a.mtime < b.mtime; });
+    uint64_t total = 0;
+    for(const EntryFile &entry : entries)
+        total += entry.size;
+    const uint64_t target = max_bytes_ / 4 * 3;
+    for(const EntryFile &entry : entries)
+    {
+        if(total <= target)
+            break;
+        if(entry.name != keep && remove((directory_ + "/" + entry.name).data()) == 0)
+            total -= entry.size;
+    }
+    bytes_ = total;
+}
+
+ContentStore::Stats ContentStore::stats() const
+{
+    Stats stats;
+    stats.hits = hits_.load();
+    stats.misses = misses_.load();
+    stats.writes = writes_.load();
+    stats.bytes = bytes_.load();
+    return stats;
+}
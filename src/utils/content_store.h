@@ -0,0 +1,44 @@
+#ifndef CONTENT_STORE_H_INCLUDED
+#define CONTENT_STORE_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/// a directory of immutable blobs named by a content-derived key, kept across restarts.
+/// Entries carry their own suffix, so other files in the directory are left alone. Reads go
+/// straight into the caller's string, writes go to a temporary file that is renamed into place
+/// so a reader never sees a partial entry. Once the entries grow past max_bytes the oldest
+/// ones are removed until they are back under three quarters of the limit.
+class ContentStore
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t writes = 0;
+        uint64_t bytes = 0;
+    };
+
+    ContentStore(std::string directory, uint64_t max_bytes);
+
+    const std::string &directory() const { return directory_; }
+    /// key must be a plain file name, e.g. a hex digest
+    bool get(const std::string &key, std::string &value);
+    bool put(const std::string &key, const std::string &value);
+    Stats stats() const;
+
+private:
+    /// keep is the entry just written, which must survive even when mtimes tie
+    void prune(const std::string &keep);
+
+    std::string directory_;
+    uint64_t max_bytes_;
+    std::atomic<uint64_t> bytes_ {0};
+    std::atomic<uint64_t> hits_ {0}, misses_ {0}, writes_ {0}, temp_serial_ {0};
+    std::mutex prune_mutex_;
+};
+
+#endif // CONTENT_STORE_H_INCLUDED
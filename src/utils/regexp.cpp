@@ -1,15 +1,19 @@
-#include <string>
+#include <algorithm>
+#include <atomic>
 #include <cstdarg>
+#include <memory>
+#include <string>
 
 /*
 #ifdef USE_STD_REGEX
 #include <regex>
 #else
 */
-#include <jpcre2.hpp>
-using jp = jpcre2::select<char>;
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
 //#endif // USE_STD_REGEX
 
+#include "concurrent_lru_cache.h"
 #include "regexp.h"
 
 /*
@@ -131,38 +135,304 @@ int regGetMatch(const std::string &src, const std::string &match, size_t group_c
 
 #else
 */
-bool regMatch(const std::string &src, const std::string &match)
+struct CompiledRegex
+{
+    pcre2_code *code = nullptr;
+    uint32_t capture_count = 0;
+    bool jit = false;
+
+    CompiledRegex() = default;
+    CompiledRegex(const CompiledRegex &) = delete;
+    CompiledRegex &operator=(const CompiledRegex &) = delete;
+    ~CompiledRegex()
+    {
+        if(code)
+            pcre2_code_free(code);
+    }
+};
+
+namespace
+{
+
+/// option sets used by the public helpers, kept identical to the former jpcre2 modifiers
+constexpr uint32_t kMatchOptions = PCRE2_MULTILINE | PCRE2_ANCHORED | PCRE2_ENDANCHORED | PCRE2_UTF;
+constexpr uint32_t kFindOptions = PCRE2_MULTILINE | PCRE2_UTF | PCRE2_ALT_BSUX;
+constexpr uint32_t kReplaceOptions = PCRE2_UTF | PCRE2_MULTILINE | PCRE2_ALT_BSUX;
+constexpr uint32_t kValidOptions = PCRE2_UTF | PCRE2_ALT_BSUX;
+
+constexpr size_t kRegexCacheEntries = 4096;
+constexpr size_t kRegexCacheBytes = 16 * 1024 * 1024;
+
+using CompiledRegexPtr = std::shared_ptr<const CompiledRegex>;
+
+struct RegexCacheKey
+{
+    std::string pattern;
+    uint32_t options = 0;
+    bool jit = false;
+
+    bool operator==(const RegexCacheKey &other) const
+    {
+        return options == other.options && jit == other.jit && pattern == other.pattern;
+    }
+};
+
+struct RegexCacheKeyHash
+{
+    size_t operator()(const RegexCacheKey &key) const
+    {
+        size_t flags = (static_cast<size_t>(key.options) << 1) | static_cast<size_t>(key.jit);
+        return std::hash<std::string>()(key.pattern) ^ (flags * 0x9e3779b97f4a7c15ULL);
+    }
+};
+
+ConcurrentLruCache<RegexCacheKey, CompiledRegexPtr, RegexCacheKeyHash> regex_cache(kRegexCacheEntries, kRegexCacheBytes);
+std::atomic<uint64_t> regex_cache_hits{0}, regex_cache_misses{0};
+std::atomic<uint64_t> regex_jit_compiled{0}, regex_jit_fallbacks{0};
+std::atomic<bool> regex_jit_enabled{true};
+
+bool jitSupported()
+{
+    static const bool supported = []
+    {
+        uint32_t jit = 0;
+        return pcre2_config(PCRE2_CONFIG_JIT, &jit) >= 0 && jit == 1;
+    }();
+    return supported;
+}
+
+CompiledRegexPtr compileUncached(const std::string &pattern, uint32_t options, bool jit)
+{
+    auto compiled = std::make_shared<CompiledRegex>();
+    int error_number = 0;
+    PCRE2_SIZE error_offset = 0;
+    compiled->code = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.c_str()), PCRE2_ZERO_TERMINATED, options, &error_number, &error_offset, nullptr);
+    if(!compiled->code)
+        return compiled;
+    pcre2_pattern_info(compiled->code, PCRE2_INFO_CAPTURECOUNT, &compiled->capture_count);
+    /// a pattern the JIT compiler rejects simply stays on the interpreter
+    if(jit && pcre2_jit_compile(compiled->code, PCRE2_JIT_COMPLETE) == 0)
+    {
+        compiled->jit = true;
+        regex_jit_compiled.fetch_add(1, std::memory_order_relaxed);
+    }
+    return compiled;
+}
+
+/// invalid patterns are cached too, so a bad rule is not recompiled for every node
+CompiledRegexPtr getCompiled(const std::string &pattern, uint32_t options, bool want_jit = true)
+{
+    bool hit = false;
+    const bool jit = want_jit && regexJitActive();
+    CompiledRegexPtr compiled = regex_cache.getOrCompute(
+        RegexCacheKey{pattern, options, jit}, true,
+        [&] { return compileUncached(pattern, options, jit); },
+        [&](const CompiledRegexPtr &value) -> ConcurrentLruCache<RegexCacheKey, CompiledRegexPtr, RegexCacheKeyHash>::CacheSize
+        {
+            size_t code_size = 0, jit_size = 0;
+            if(value->code)
+                pcre2_pattern_info(value->code, PCRE2_INFO_SIZE, &code_size);
+            if(value->jit)
+                pcre2_pattern_info(value->code, PCRE2_INFO_JITSIZE, &jit_size);
+            return pattern.size() + code_size + jit_size + sizeof(CompiledRegex);
+        },
+        &hit);
+    if(hit)
+        regex_cache_hits.fetch_add(1, std::memory_order_relaxed);
+    else
+        regex_cache_misses.fetch_add(1, std::memory_order_relaxed);
+    return compiled;
+}
+
+/// match data is per thread and only grows, so matching never allocates once warmed up
+pcre2_match_data *threadMatchData(const CompiledRegex &compiled)
 {
-    jp::Regex reg;
-    reg.setPattern(match).addModifier("m").addPcre2Option(PCRE2_ANCHORED|PCRE2_ENDANCHORED|PCRE2_UTF).compile();
-    if(!reg)
+    struct Holder
+    {
+        pcre2_match_data *data = nullptr;
+        uint32_t pairs = 0;
+        ~Holder()
+        {
+            if(data)
+                pcre2_match_data_free(data);
+        }
+    };
+    thread_local Holder holder;
+    uint32_t pairs = std::max<uint32_t>(compiled.capture_count + 1, 16);
+    if(holder.pairs < pairs)
+    {
+        if(holder.data)
+            pcre2_match_data_free(holder.data);
+        holder.data = pcre2_match_data_create(pairs, nullptr);
+        holder.pairs = holder.data ? pairs : 0;
+    }
+    return holder.data;
+}
+
+/// JIT code runs on its own stack; give each thread one larger than the 32K default
+pcre2_match_context *threadMatchContext()
+{
+    struct Holder
+    {
+        pcre2_match_context *context = nullptr;
+        pcre2_jit_stack *stack = nullptr;
+        Holder()
+        {
+            context = pcre2_match_context_create(nullptr);
+            stack = pcre2_jit_stack_create(32 * 1024, 1024 * 1024, nullptr);
+            if(context && stack)
+                pcre2_jit_stack_assign(context, nullptr, stack);
+        }
+        ~Holder()
+        {
+            if(context)
+                pcre2_match_context_free(context);
+            if(stack)
+                pcre2_jit_stack_free(stack);
+        }
+    };
+    thread_local Holder holder;
+    return holder.context;
+}
+
+/// pcre2_match dispatches to the JIT code itself after validating the UTF-8 subject,
+/// the interpreter is only used again when the JIT stack runs out
+template <class Run>
+int runWithFallback(const CompiledRegex &compiled, Run &&run)
+{
+    if(!compiled.jit)
+        return run(0u, static_cast<pcre2_match_context*>(nullptr));
+    int rc = run(0u, threadMatchContext());
+    if(rc == PCRE2_ERROR_JIT_STACKLIMIT)
+    {
+        regex_jit_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        rc = run(static_cast<uint32_t>(PCRE2_NO_JIT), static_cast<pcre2_match_context*>(nullptr));
+    }
+    return rc;
+}
+
+int matchAt(const CompiledRegex &compiled, const std::string &src, PCRE2_SIZE start_offset, uint32_t options, pcre2_match_data *match_data)
+{
+    return runWithFallback(compiled, [&](uint32_t extra_options, pcre2_match_context *context)
+    {
+        return pcre2_match(compiled.code, reinterpret_cast<PCRE2_SPTR>(src.data()), src.size(), start_offset, options | extra_options, match_data, context);
+    });
+}
+
+bool findCompiled(const CompiledRegex &compiled, const std::string &src)
+{
+    if(!compiled.code)
         return false;
-    return reg.match(src, "g");
+    pcre2_match_data *match_data = threadMatchData(compiled);
+    if(!match_data)
+        return false;
+    return matchAt(compiled, src, 0, 0, match_data) >= 0;
+}
+
+std::string replaceCompiled(const CompiledRegex &compiled, const std::string &src, const std::string &rep, bool global)
+{
+    if(!compiled.code)
+        return src;
+    pcre2_match_data *match_data = threadMatchData(compiled);
+    if(!match_data)
+        return src;
+
+    uint32_t replace_options = PCRE2_SUBSTITUTE_OVERFLOW_LENGTH | PCRE2_SUBSTITUTE_UNKNOWN_UNSET | PCRE2_SUBSTITUTE_UNSET_EMPTY | PCRE2_SUBSTITUTE_EXTENDED;
+    if(global)
+        replace_options |= PCRE2_SUBSTITUTE_GLOBAL;
+    std::string result;
+    PCRE2_SIZE length = 0;
+    int rc = runWithFallback(compiled, [&](uint32_t extra_options, pcre2_match_context *context)
+    {
+        result.resize(src.size() + rep.size() + 1);
+        length = result.size();
+        int substituted = pcre2_substitute(compiled.code, reinterpret_cast<PCRE2_SPTR>(src.data()), src.size(), 0, replace_options | extra_options, match_data, context,
+                                           reinterpret_cast<PCRE2_SPTR>(rep.data()), rep.size(), reinterpret_cast<PCRE2_UCHAR *>(result.data()), &length);
+        if(substituted == PCRE2_ERROR_NOMEMORY)
+        {
+            /// length now holds the required size including the terminating zero
+            result.resize(length);
+            substituted = pcre2_substitute(compiled.code, reinterpret_cast<PCRE2_SPTR>(src.data()), src.size(), 0, replace_options | extra_options, match_data, context,
+                                           reinterpret_cast<PCRE2_SPTR>(rep.data()), rep.size(), reinterpret_cast<PCRE2_UCHAR *>(result.data()), &length);
+        }
+        return substituted;
+    });
+    if(rc < 0)
+        return src;
+    result.resize(length);
+    return result;
+}
+
+} // namespace
+
+bool regMatch(const std::string &src, const std::string &match)
+{
+    return findCompiled(*getCompiled(match, kMatchOptions), src);
 }
 
 bool regFind(const std::string &src, const std::string &match)
 {
-    jp::Regex reg;
-    reg.setPattern(match).addModifier("m").addPcre2Option(PCRE2_UTF|PCRE2_ALT_BSUX).compile();
-    if(!reg)
-        return false;
-    return reg.match(src, "g");
+    return findCompiled(*getCompiled(match, kFindOptions), src);
 }
 
 std::string regReplace(const std::string &src, const std::string &match, const std::string &rep, bool global, bool multiline)
 {
-    jp::Regex reg;
-    reg.setPattern(match).addModifier(multiline ? "m" : "").addPcre2Option(PCRE2_UTF|PCRE2_MULTILINE|PCRE2_ALT_BSUX).compile();
-    if(!reg)
-        return src;
-    return reg.replace(src, rep, global ? "gEx" : "Ex");
+    /// PCRE2_MULTILINE is always part of the replace options, so multiline does not change the compiled pattern
+    (void)multiline;
+    return replaceCompiled(*getCompiled(match, kReplaceOptions), src, rep, global);
 }
 
 bool regValid(const std::string &reg)
 {
-    jp::Regex r;
-    r.setPattern(reg).addPcre2Option(PCRE2_UTF|PCRE2_ALT_BSUX).compile();
-    return !!r;
+    return getCompiled(reg, kValidOptions, false)->code != nullptr;
+}
+
+bool regValidUTF8(std::string_view src)
+{
+    size_t i = 0;
+    while(i < src.size())
+    {
+        unsigned char c = static_cast<unsigned char>(src[i]);
+        size_t length = 0;
+        uint32_t code_point = 0;
+        if(c < 0x80)
+        {
+            i++;
+            continue;
+        }
+        else if((c & 0xe0) == 0xc0)
+        {
+            length = 2;
+            code_point = c & 0x1f;
+        }
+        else if((c & 0xf0) == 0xe0)
+        {
+            length = 3;
+            code_point = c & 0x0f;
+        }
+        else if((c & 0xf8) == 0xf0)
+        {
+            length = 4;
+            code_point = c & 0x07;
+        }
+        else
+            return false;
+        if(i + length > src.size())
+            return false;
+        for(size_t j = 1; j < length; j++)
+        {
+            unsigned char next = static_cast<unsigned char>(src[i + j]);
+            if((next & 0xc0) != 0x80)
+                return false;
+            code_point = (code_point << 6) | (next & 0x3f);
+        }
+        if((length == 2 && code_point < 0x80) || (length == 3 && code_point < 0x800) ||
+           (length == 4 && (code_point < 0x10000 || code_point > 0x10ffff)) ||
+           (code_point >= 0xd800 && code_point <= 0xdfff))
+            return false;
+        i += length;
+    }
+    return true;
 }
 
 int regGetMatch(const std::string &src, const std::string &match, size_t group_count, ...)
@@ -189,34 +459,135 @@ int regGetMatch(const std::string &src, const std::string &match, size_t group_c
 
 std::vector<std::string> regGetAllMatch(const std::string &src, const std::string &match, bool group_only)
 {
-    jp::Regex reg;
-    reg.setPattern(match).addModifier("m").addPcre2Option(PCRE2_UTF|PCRE2_ALT_BSUX).compile();
-    jp::VecNum vec_num;
-    jp::RegexMatch rm;
-    size_t count = rm.setRegexObject(&reg).setSubject(src).setNumberedSubstringVector(&vec_num).setModifier("gm").match();
     std::vector<std::string> result;
-    if(!count)
+    CompiledRegexPtr compiled = getCompiled(match, kFindOptions);
+    if(!compiled->code)
+        return result;
+    pcre2_match_data *match_data = threadMatchData(*compiled);
+    if(!match_data)
+        return result;
+
+    const PCRE2_SIZE subject_length = src.size();
+    const uint32_t pairs = compiled->capture_count + 1;
+    const uint32_t begin = group_only ? 1 : 0;
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+    auto collect = [&]()
+    {
+        for(uint32_t i = begin; i < pairs; i++)
+        {
+            if(ovector[2 * i] == PCRE2_UNSET)
+                result.emplace_back();
+            else
+                result.emplace_back(src, ovector[2 * i], ovector[2 * i + 1] - ovector[2 * i]);
+        }
+    };
+
+    int rc = matchAt(*compiled, src, 0, 0, match_data);
+    if(rc < 0)
         return result;
-    size_t begin = 0;
-    if(group_only)
-        begin = 1;
-    size_t index = begin, match_index = 0;
+    collect();
+
+    /// global matching, advancing past empty matches the same way pcre2demo does
+    uint32_t newline = 0;
+    pcre2_pattern_info(compiled->code, PCRE2_INFO_NEWLINE, &newline);
+    const bool crlf_is_newline = newline == PCRE2_NEWLINE_ANY || newline == PCRE2_NEWLINE_CRLF || newline == PCRE2_NEWLINE_ANYCRLF;
+    PCRE2_SIZE last_start = ovector[0], last_end = ovector[1];
     while(true)
     {
-        if(vec_num.size() <= match_index)
+        uint32_t options = 0;
+        PCRE2_SIZE start_offset = last_end;
+        if(last_start == last_end)
+        {
+            if(last_start == subject_length)
+                break;
+            options = PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+        }
+        else if(last_start > last_end) /// \K moved the start past the end
             break;
-        if(vec_num[match_index].size() <= index)
+
+        rc = matchAt(*compiled, src, start_offset, options, match_data);
+        if(rc == PCRE2_ERROR_NOMATCH)
         {
-            match_index++;
-            index = begin;
+            if(options == 0)
+                break;
+            last_end = start_offset + 1;
+            if(crlf_is_newline && start_offset + 1 < subject_length && src[start_offset] == '\r' && src[start_offset + 1] == '\n')
+                last_end++;
+            else
+            {
+                while(last_end < subject_length && (static_cast<unsigned char>(src[last_end]) & 0xc0) == 0x80)
+                    last_end++;
+            }
             continue;
         }
-        result.push_back(std::move(vec_num[match_index][index]));
-        index++;
+        if(rc < 0)
+            break;
+        collect();
+        last_start = ovector[0];
+        last_end = ovector[1];
     }
     return result;
 }
 
+RegexCacheStats regexCacheStats()
+{
+    RegexCacheStats stats;
+    stats.hits = regex_cache_hits.load(std::memory_order_relaxed);
+    stats.misses = regex_cache_misses.load(std::memory_order_relaxed);
+    stats.entries = regex_cache.size();
+    stats.bytes = regex_cache.bytes();
+    stats.jit_compiled = regex_jit_compiled.load(std::memory_order_relaxed);
+    stats.jit_fallbacks = regex_jit_fallbacks.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool regexJitAvailable()
+{
+    return jitSupported();
+}
+
+void regexSetJitEnabled(bool enabled)
+{
+    regex_jit_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool regexJitActive()
+{
+    return regex_jit_enabled.load(std::memory_order_relaxed) && jitSupported();
+}
+
+size_t regexCacheMaxEntries()
+{
+    return kRegexCacheEntries;
+}
+
+size_t regexCacheMaxBytes()
+{
+    return kRegexCacheBytes;
+}
+
+RegexPattern::RegexPattern(const std::string &pattern) : pattern_(pattern), compiled_(getCompiled(pattern, kFindOptions))
+{
+}
+
+bool RegexPattern::valid() const
+{
+    return compiled_ && compiled_->code;
+}
+
+bool RegexPattern::find(const std::string &src) const
+{
+    return compiled_ && findCompiled(*compiled_, src);
+}
+
+std::string RegexPattern::replace(const std::string &src, const std::string &rep, bool global) const
+{
+    if(!compiled_)
+        return src;
+    static_assert(kFindOptions == kReplaceOptions, "find and replace share one compiled pattern");
+    return replaceCompiled(*compiled_, src, rep, global);
+}
+
 //#endif // USE_STD_REGEX
 
 std::string regTrim(const std::string &src)
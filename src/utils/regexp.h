@@ -1,7 +1,12 @@
 #ifndef REGEXP_H_INCLUDED
 #define REGEXP_H_INCLUDED
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 bool regValid(const std::string &reg);
 bool regFind(const std::string &src, const std::string &match);
@@ -10,5 +15,46 @@ bool regMatch(const std::string &src, const std::string &match);
 int regGetMatch(const std::string &src, const std::string &match, size_t group_count, ...);
 std::vector<std::string> regGetAllMatch(const std::string &src, const std::string &match, bool group_only = false);
 std::string regTrim(const std::string &src);
+/// PCRE2 runs in UTF mode, so every function above leaves subjects failing this check untouched
+bool regValidUTF8(std::string_view src);
+
+struct CompiledRegex;
+
+/// a pattern resolved once, so hot loops skip the shared cache lookup; same semantics as regFind/regReplace
+class RegexPattern
+{
+public:
+    RegexPattern() = default;
+    explicit RegexPattern(const std::string &pattern);
+
+    const std::string &pattern() const { return pattern_; }
+    bool valid() const;
+    bool find(const std::string &src) const;
+    std::string replace(const std::string &src, const std::string &rep, bool global = true) const;
+
+private:
+    std::string pattern_;
+    std::shared_ptr<const CompiledRegex> compiled_;
+};
+
+/// compiled pattern cache shared by every function above
+struct RegexCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    uint64_t jit_compiled = 0;
+    uint64_t jit_fallbacks = 0;
+};
+
+RegexCacheStats regexCacheStats();
+size_t regexCacheMaxEntries();
+size_t regexCacheMaxBytes();
+
+/// PCRE2 JIT for cached patterns, falls back to the interpreter when unavailable
+bool regexJitAvailable();
+void regexSetJitEnabled(bool enabled);
+bool regexJitActive();
 
 #endif // REGEXP_H_INCLUDED
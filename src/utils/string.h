@@ -81,10 +81,10 @@ inline bool endsWith(const std::string &hay, const std::string &needle)
 
 #endif
 
-inline bool count_least(const std::string &hay, const char needle, size_t cnt)
+inline bool count_least(std::string_view hay, const char needle, size_t cnt)
 {
     string_size pos = hay.find(needle);
-    while(pos != std::string::npos)
+    while(pos != std::string_view::npos)
     {
         cnt--;
         if(!cnt)
@@ -94,7 +94,7 @@ inline bool count_least(const std::string &hay, const char needle, size_t cnt)
     return false;
 }
 
-inline char getLineBreak(const std::string &str)
+inline char getLineBreak(std::string_view str)
 {
     return count_least(str, '\n', 1) ? '\n' : '\r';
 }
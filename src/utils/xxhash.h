@@ -0,0 +1,124 @@
+#ifndef XXHASH_H_INCLUDED
+#define XXHASH_H_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/// XXH64, a fast non-cryptographic hash for content-addressed keys where MD5 is needlessly slow
+
+namespace xxhash_detail
+{
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t read64(const unsigned char *data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+inline uint32_t read32(const unsigned char *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+inline uint64_t mixRound(uint64_t acc, uint64_t input)
+{
+    acc += input * kPrime2;
+    return rotl(acc, 31) * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= mixRound(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace xxhash_detail
+
+inline uint64_t xxHash64(std::string_view input, uint64_t seed = 0)
+{
+    using namespace xxhash_detail;
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data());
+    const unsigned char *end = data + input.size();
+    uint64_t hash;
+
+    if(input.size() >= 32)
+    {
+        uint64_t v1 = seed + kPrime1 + kPrime2, v2 = seed + kPrime2, v3 = seed, v4 = seed - kPrime1;
+        const unsigned char *limit = end - 32;
+        do
+        {
+            v1 = mixRound(v1, read64(data));
+            v2 = mixRound(v2, read64(data + 8));
+            v3 = mixRound(v3, read64(data + 16));
+            v4 = mixRound(v4, read64(data + 24));
+            data += 32;
+        } while(data <= limit);
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    }
+    else
+        hash = seed + kPrime5;
+
+    hash += input.size();
+    for(; data + 8 <= end; data += 8)
+    {
+        hash ^= mixRound(0, read64(data));
+        hash = rotl(hash, 27) * kPrime1 + kPrime4;
+    }
+    if(data + 4 <= end)
+    {
+        hash ^= static_cast<uint64_t>(read32(data)) * kPrime1;
+        hash = rotl(hash, 23) * kPrime2 + kPrime3;
+        data += 4;
+    }
+    for(; data < end; data++)
+    {
+        hash ^= *data * kPrime5;
+        hash = rotl(hash, 11) * kPrime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/// 16 lower-case hex digits, usable in file names
+inline std::string xxHash64Hex(std::string_view input, uint64_t seed = 0)
+{
+    static const char digits[] = "0123456789abcdef";
+    uint64_t hash = xxHash64(input, seed);
+    std::string hex(16, '0');
+    for(int i = 15; i >= 0; i--, hash >>= 4)
+        hex[i] = digits[hash & 0xf];
+    return hex;
+}
+
+#endif // XXHASH_H_INCLUDED
@@ -0,0 +1,164 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "generator/config/clash_writer.h"
+
+namespace {
+
+const std::vector<std::string> kPieces = {
+    "a",        "HK",       "01",           " ",          "\t",
+    "\n",       "\r",       ":",            "#",          "-",
+    "?",        ",",        "[",            "]",          "{",
+    "}",        "&",        "*",            "!",          "|",
+    ">",        "'",        "\"",           "%",          "@",
+    "`",        "\\",       "\x01",         "\x04",       "\x7f",
+    "\xc2\x85", "\xc2\x80", "\xc2\xa0",     "\xef\xbb\xbf", "日本",
+    "\xff",     "\xe6\x97", "\xf4\x90\x80\x80", "\xed\xa0\x80",
+    "\xef\xbf\xbe", "\xef\xb7\x90", "~", "null", "true", "0x1F", "8388",
+    "example.com", "🇭🇰", "/path?a=b&c"};
+
+std::string randomScalar(std::mt19937 &random) {
+  std::string value;
+  const size_t pieces = random() % 5;
+  for (size_t i = 0; i < pieces; i++)
+    value += kPieces[random() % kPieces.size()];
+  return value;
+}
+
+YAML::EmitterStyle::value randomStyle(std::mt19937 &random) {
+  switch (random() % 3) {
+  case 0:
+    return YAML::EmitterStyle::Block;
+  case 1:
+    return YAML::EmitterStyle::Flow;
+  default:
+    return YAML::EmitterStyle::Default;
+  }
+}
+
+YAML::Node randomNode(std::mt19937 &random, int depth) {
+  const unsigned kind = depth > 3 ? random() % 2 : random() % 5;
+  if (kind == 0) {
+    YAML::Node scalar(randomScalar(random));
+    if (random() % 8 == 0)
+      scalar.SetTag("str");
+    return scalar;
+  }
+  if (kind == 1 && random() % 4 == 0)
+    return YAML::Node();
+  YAML::Node node(kind % 2 ? YAML::NodeType::Map : YAML::NodeType::Sequence);
+  const size_t children = random() % 4;
+  for (size_t i = 0; i < children; i++) {
+    if (node.IsMap())
+      node[randomScalar(random)] = randomNode(random, depth + 1);
+    else
+      node.push_back(randomNode(random, depth + 1));
+  }
+  node.SetStyle(randomStyle(random));
+  return node;
+}
+
+/// what proxyToClash did with a dumped section before ClashYamlWriter
+std::string indented(const std::string &key, const YAML::Node &node) {
+  std::string result = key + ":\n", line;
+  std::istringstream stream(YAML::Dump(node));
+  while (std::getline(stream, line))
+    result += line.empty() ? "\n" : "  " + line + "\n";
+  return result;
+}
+
+std::string legacyCompose(YAML::Node base, const YAML::Node &providers,
+                          const YAML::Node &proxies, const YAML::Node &groups,
+                          const std::string &rules) {
+  base["proxy-groups"] = groups;
+  std::string head = YAML::Dump(base);
+  const size_t pos = head.find("proxy-groups:");
+  head.insert(pos, indented("proxies", proxies));
+  head.insert(pos, indented("proxy-providers", providers));
+  return head + rules;
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 random(20240611);
+  YAML::Node base = YAML::Load("port: 7890\n"
+                               "dns: {enable: true, nameserver: [1.1.1.1]}\n"
+                               "proxy-groups: ~\n"
+                               "rules: ~\n");
+  for (int round = 0; round < 400; round++) {
+    const bool compact = round % 2;
+    ClashYamlWriter writer(true, compact, compact);
+    YAML::Node proxies(YAML::NodeType::Sequence),
+        groups(YAML::NodeType::Sequence), providers;
+    for (int i = 0; i < 50; i++) {
+      YAML::Node proxy;
+      proxy["name"] = randomScalar(random) + std::to_string(i);
+      proxy["server"] = "example.com";
+      proxy["port"] = 443 + i;
+      proxy["password"] = "123456";
+      proxy["password"].SetTag("str");
+      proxy["ws-opts"]["headers"]["Host"] = randomScalar(random);
+      proxy["alpn"].push_back("h2");
+      proxy["extra"] = randomNode(random, 1);
+      proxy.SetStyle(i % 3 ? YAML::EmitterStyle::Flow
+                           : YAML::EmitterStyle::Block);
+      writer.addProxy(proxy);
+      proxies.push_back(proxy);
+    }
+    for (const char *name : {"Proxy", "Auto", "Proxy"}) {
+      YAML::Node group;
+      group["name"] = name;
+      group["type"] = "select";
+      group["proxies"].push_back(randomScalar(random));
+      group.SetStyle(compact ? YAML::EmitterStyle::Flow
+                             : YAML::EmitterStyle::Block);
+      writer.addGroup(name, group);
+      /// reset() on the iterated node never reached the list, the first
+      /// group of a name stayed
+      bool replaced = false;
+      for (auto &&existing : groups) {
+        if (existing["name"].as<std::string>() == name) {
+          existing.reset(group);
+          replaced = true;
+          break;
+        }
+      }
+      if (!replaced)
+        groups.push_back(group);
+    }
+    providers["Provider_A"]["type"] = "http";
+    providers["Provider_A"]["header"]["User-Agent"].push_back("clash");
+    providers["Provider_A"]["override"]["proxy-name"].push_back(
+        YAML::Load("{pattern: a, target: b}"));
+    writer.setProviders(providers);
+    if (compact) {
+      proxies.SetStyle(YAML::EmitterStyle::Flow);
+      groups.SetStyle(YAML::EmitterStyle::Flow);
+    }
+
+    YAML::Node head = YAML::Clone(base), legacy_head = YAML::Clone(base);
+    head[writer.groupsKey()] = YAML::Node();
+    writer.takeSections(head);
+    const std::string rules = "\nrules:\n  - MATCH,DIRECT\n";
+    assert(writer.compose(head, rules) ==
+           legacyCompose(legacy_head, providers, proxies, groups, rules));
+  }
+
+  /// proxies and providers the base carries are moved, not dropped
+  YAML::Node carried = YAML::Load("proxy-groups: ~\n"
+                                  "proxies: [{name: a, type: ss}]\n"
+                                  "proxy-providers: {p: {type: file}}\n");
+  ClashYamlWriter writer(true, false, false);
+  writer.takeSections(carried);
+  assert(writer.compose(carried) == "proxy-providers:\n  {p: {type: file}}\n"
+                                    "proxies:\n  [{name: a, type: ss}]\n"
+                                    "proxy-groups: ~");
+  return 0;
+}
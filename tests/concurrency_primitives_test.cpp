@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdio>
 #include <future>
 #include <map>
 #include <stdexcept>
@@ -65,6 +67,70 @@ static void testBoundedExecutor() {
   executor.shutdown();
 }
 
+static void testParallelFor() {
+  BoundedExecutor executor(4, 16);
+  std::vector<int> results(12, 0);
+  std::atomic<int> running{0}, peak{0};
+  parallelFor(executor, results.size(), 3, [&](size_t index) {
+    int now = running.fetch_add(1) + 1;
+    int seen = peak.load();
+    while (now > seen && !peak.compare_exchange_weak(seen, now))
+      ;
+    std::this_thread::sleep_for(5ms);
+    results[index] = static_cast<int>(index) * 2;
+    running.fetch_sub(1);
+  });
+  for (size_t i = 0; i < results.size(); ++i)
+    assert(results[i] == static_cast<int>(i) * 2);
+  /// the cap holds, and the work did overlap
+  assert(peak.load() <= 3 && peak.load() >= 2);
+
+  /// every job still runs, and the lowest failing index wins
+  std::atomic<int> ran{0};
+  std::string error;
+  try {
+    parallelFor(executor, 8, 4, [&](size_t index) {
+      ran.fetch_add(1);
+      if (index == 5 || index == 2)
+        throw std::runtime_error("job " + std::to_string(index));
+    });
+  } catch (const std::runtime_error &e) {
+    error = e.what();
+  }
+  assert(error == "job 2");
+  assert(ran.load() == 8);
+
+  /// a cap of one is a plain loop on the calling thread
+  std::vector<size_t> order;
+  std::thread::id caller = std::this_thread::get_id();
+  parallelFor(executor, 4, 1, [&](size_t index) {
+    assert(std::this_thread::get_id() == caller);
+    order.push_back(index);
+  });
+  assert((order == std::vector<size_t>{0, 1, 2, 3}));
+  parallelFor(executor, 0, 4, [](size_t) { assert(false); });
+
+  /// helpers stuck behind unrelated work are not waited for
+  BoundedExecutor busy(1, 16);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<bool> blocking{false};
+  auto blocker = busy.submit([&] {
+    blocking = true;
+    released.wait();
+  });
+  while (!blocking.load())
+    std::this_thread::yield();
+  std::vector<int> done(6, 0);
+  const auto start = std::chrono::steady_clock::now();
+  parallelFor(busy, done.size(), 4, [&](size_t index) { done[index] = 1; });
+  assert(std::chrono::steady_clock::now() - start < 1s);
+  assert(std::count(done.begin(), done.end(), 1) == 6);
+  release.set_value();
+  blocker.get();
+  busy.shutdown();
+}
+
 static void testConcurrentLruCache() {
   ConcurrentLruCache<std::string, std::string> cache(2, 64);
   std::atomic<int> computations{0};
@@ -176,8 +242,7 @@ struct MockExternalConfig {
 };
 
 static void testExternalConfigCacheSemantics() {
-  ConcurrentLruCache<std::string, MockExternalConfig> cache(64,
-                                                            8 * 1024 * 1024);
+  ShardedLruCache<std::string, MockExternalConfig> cache(64, 8 * 1024 * 1024);
   int parses = 0;
   auto parse = [&](const std::string &content_hash, int context,
                    int generation, bool enabled) {
@@ -193,23 +258,22 @@ static void testExternalConfigCacheSemantics() {
               {{"request_local", "copied-" + content_hash}}};
         },
         [](const MockExternalConfig &value)
-            -> ConcurrentLruCache<std::string,
-                                  MockExternalConfig>::CacheSize {
+            -> ShardedLruCache<std::string, MockExternalConfig>::CacheSize {
           return value.parsed.size() +
                  value.local_vars.begin()->first.size() +
                  value.local_vars.begin()->second.size();
         });
   };
 
-  MockExternalConfig first = parse("content-a", 1, 7, true);
+  MockExternalConfig first = *parse("content-a", 1, 7, true);
   first.local_vars["request_local"] = "request-mutation";
-  MockExternalConfig hit = parse("content-a", 1, 7, true);
+  auto hit = parse("content-a", 1, 7, true);
   assert(parses == 1);
-  assert(hit.local_vars.at("request_local") == "copied-content-a");
+  assert(hit->local_vars.at("request_local") == "copied-content-a");
 
-  assert(parse("content-b", 1, 7, true).parsed == "content-b");
-  assert(parse("content-a", 1, 8, true).parsed == "content-a");
-  assert(parse("content-a", 2, 7, true).parsed == "content-a");
+  assert(parse("content-b", 1, 7, true)->parsed == "content-b");
+  assert(parse("content-a", 1, 8, true)->parsed == "content-a");
+  assert(parse("content-a", 2, 7, true)->parsed == "content-a");
   assert(parses == 4);
 
   (void)parse("dynamic-content", 1, 7, false);
@@ -217,9 +281,173 @@ static void testExternalConfigCacheSemantics() {
   assert(parses == 6);
 }
 
+static void testShardedLruCache() {
+  using Cache = ShardedLruCache<std::string, std::string>;
+  auto size_of = [](const std::string &value) -> Cache::CacheSize {
+    return value.size();
+  };
+
+  Cache cache(4, 1024, 4);
+  assert(cache.shardCount() == 4);
+  std::atomic<int> computations{0};
+  std::promise<void> start;
+  std::shared_future<void> started = start.get_future().share();
+  std::vector<std::future<Cache::ValuePtr>> futures;
+  for (int i = 0; i < 12; ++i) {
+    futures.emplace_back(std::async(std::launch::async, [&] {
+      started.wait();
+      return cache.getOrCompute(
+          "coalesced", true,
+          [&] {
+            computations.fetch_add(1);
+            std::this_thread::sleep_for(20ms);
+            return std::string("byte-exact\nvalue");
+          },
+          size_of);
+    }));
+  }
+  start.set_value();
+  Cache::ValuePtr shared = futures.front().get();
+  for (size_t i = 1; i < futures.size(); ++i)
+    assert(futures[i].get() == shared);
+  assert(*shared == "byte-exact\nvalue");
+  assert(computations.load() == 1);
+
+  bool hit = false;
+  Cache::ValuePtr again = cache.getOrCompute(
+      "coalesced", true, [] { return std::string("wrong"); }, size_of, &hit);
+  assert(hit && again == shared);
+
+  /// the entry budget is global even though the keys land in different shards
+  for (int i = 0; i < 8; ++i)
+    (void)cache.getOrCompute(
+        "key-" + std::to_string(i), true,
+        [&] { return std::string(16, 'x'); }, size_of);
+  assert(cache.size() == 4);
+  LruCacheStats stats = cache.stats();
+  assert(stats.entries == 4 && stats.evictions == 5);
+  assert(stats.hits == 1 && stats.misses == 20);
+  size_t shard_entries = 0;
+  for (const LruCacheStats &shard : cache.shardStats())
+    shard_entries += shard.entries;
+  assert(shard_entries == 4);
+
+  /// one value may still use the whole byte budget
+  Cache large(8, 1000, 8);
+  for (int i = 0; i < 4; ++i)
+    (void)large.getOrCompute(
+        "small-" + std::to_string(i), true,
+        [] { return std::string(100, 's'); }, size_of);
+  (void)large.getOrCompute(
+      "large", true, [] { return std::string(900, 'l'); }, size_of);
+  assert(large.bytes() <= 1000);
+  hit = false;
+  (void)large.getOrCompute(
+      "large", true, [] { return std::string(); }, size_of, &hit);
+  assert(hit);
+
+  int oversized_computations = 0;
+  for (int i = 0; i < 2; ++i)
+    assert(*large.getOrCompute(
+               "oversized", true,
+               [&] {
+                 ++oversized_computations;
+                 return std::string(1001, 'o');
+               },
+               size_of) == std::string(1001, 'o'));
+  assert(oversized_computations == 2);
+
+  bool threw = false;
+  try {
+    (void)cache.getOrCompute(
+        "exception", true,
+        []() -> std::string { throw std::runtime_error("failed"); }, size_of);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  assert(*cache.getOrCompute(
+             "exception", true, [] { return std::string("recovered"); },
+             size_of) == "recovered");
+
+  cache.clear();
+  assert(cache.size() == 0 && cache.bytes() == 0);
+}
+
+/// hot lookups of multi-megabyte values from many threads, the ruleset cache
+/// workload: one lock plus a copy per hit against sharded pointer hand-out
+static bool benchmarkCacheThroughput() {
+  const unsigned threads =
+      std::max(4u, std::min(16u, std::thread::hardware_concurrency()));
+  constexpr int kKeys = 32;
+  constexpr int kLookups = 2000;
+  const std::string value(256 * 1024, 'r');
+
+  auto run = [&](auto &&lookup) {
+    std::promise<void> start;
+    std::shared_future<void> started = start.get_future().share();
+    std::vector<std::thread> workers;
+    std::atomic<size_t> checksum{0};
+    for (unsigned t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t] {
+        started.wait();
+        size_t local = 0;
+        for (int i = 0; i < kLookups; ++i)
+          local += lookup("key-" + std::to_string((i * 7 + t) % kKeys));
+        checksum.fetch_add(local);
+      });
+    }
+    auto begin = std::chrono::steady_clock::now();
+    start.set_value();
+    for (std::thread &worker : workers)
+      worker.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    assert(checksum.load() == threads * kLookups * value.size());
+    return threads * kLookups / elapsed.count();
+  };
+
+  ConcurrentLruCache<std::string, std::string> single(kKeys,
+                                                      64 * 1024 * 1024);
+  double single_rate = run([&](const std::string &key) {
+    return single
+        .getOrCompute(
+            key, true, [&] { return value; },
+            [](const std::string &result)
+                -> ConcurrentLruCache<std::string, std::string>::CacheSize {
+              return result.size();
+            })
+        .size();
+  });
+
+  ShardedLruCache<std::string, std::string> sharded(kKeys, 64 * 1024 * 1024);
+  double sharded_rate = run([&](const std::string &key) {
+    return sharded
+        .getOrCompute(
+            key, true, [&] { return value; },
+            [](const std::string &result)
+                -> ShardedLruCache<std::string, std::string>::CacheSize {
+              return result.size();
+            })
+        ->size();
+  });
+
+  std::printf("cache throughput with %u threads: single lock %.0f lookups/s, "
+              "sharded %.0f lookups/s\n",
+              threads, single_rate, sharded_rate);
+  if (sharded_rate < single_rate) {
+    std::printf("structural performance regression: sharded cache is slower "
+                "than the single-lock cache\n");
+    return false;
+  }
+  return true;
+}
+
 int main() {
   testBoundedExecutor();
+  testParallelFor();
   testConcurrentLruCache();
   testExternalConfigCacheSemantics();
-  return 0;
+  testShardedLruCache();
+  return benchmarkCacheThroughput() ? 0 : 1;
 }
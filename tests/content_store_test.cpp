@@ -0,0 +1,79 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+#include "utils/content_store.h"
+#include "utils/file.h"
+#include "utils/xxhash.h"
+
+static void removeTree(const std::string &directory) {
+  operateFiles(directory, [&](const std::string &name) {
+    remove((directory + "/" + name).data());
+    return 0;
+  });
+  rmdir(directory.data());
+  rmdir(directory.substr(0, directory.rfind('/')).data());
+}
+
+int main() {
+  /// reference vectors of XXH64 with seed 0
+  assert(xxHash64("") == 0xEF46DB3751D8E999ull);
+  assert(xxHash64("a") == 0xD24EC4F1A98C6E5Bull);
+  assert(xxHash64("abc") == 0x44BC2CF5AD770999ull);
+  assert(xxHash64Hex("abc") == "44bc2cf5ad770999");
+  const std::string long_input(1000, 'x');
+  assert(xxHash64(long_input) != xxHash64(long_input.substr(1)));
+  assert(xxHash64(long_input, 1) != xxHash64(long_input));
+
+  char pattern[] = "/tmp/content_store_test_XXXXXX";
+  const char *root = mkdtemp(pattern);
+  assert(root);
+  const std::string directory = std::string(root) + "/nested";
+
+  std::string value;
+  {
+    ContentStore store(directory, 1024 * 1024);
+    assert(!store.get("missing", value));
+    assert(store.put("entry", "DOMAIN,example.com\n"));
+    assert(store.get("entry", value) && value == "DOMAIN,example.com\n");
+    assert(store.put("empty", ""));
+    assert(store.get("empty", value) && value.empty());
+    ContentStore::Stats stats = store.stats();
+    assert(stats.hits == 2 && stats.misses == 1 && stats.writes == 2);
+    /// overwriting a key replaces its bytes rather than adding to them
+    assert(store.put("entry", "DOMAIN,example.org\n"));
+    assert(store.stats().bytes == stats.bytes);
+    assert(store.get("entry", value) && value == "DOMAIN,example.org\n");
+  }
+
+  /// a new instance over the same directory is warm, as after a restart
+  ContentStore reopened(directory, 1024 * 1024);
+  assert(reopened.stats().bytes > 0);
+  assert(reopened.get("entry", value) && value == "DOMAIN,example.org\n");
+
+  /// truncated or foreign entries are treated as misses
+  fileWrite(directory + "/truncated.sccs", "SCCS0001\x10", true);
+  assert(!reopened.get("truncated", value));
+  fileWrite(directory + "/foreign.sccs", std::string(32, 'z'), true);
+  assert(!reopened.get("foreign", value));
+
+  /// pruning keeps the entries around three quarters of the limit and
+  /// leaves files that are not entries alone
+  md((directory + "_small").data());
+  fileWrite(directory + "_small/unrelated", std::string(8192, 'u'), true);
+  ContentStore small(directory + "_small", 4096);
+  assert(small.stats().bytes == 0);
+  for (int i = 0; i < 16; i++)
+    assert(small.put("blob" + std::to_string(i), std::string(1000, 'b')));
+  assert(small.stats().bytes <= 4096);
+  assert(small.get("blob15", value) && value.size() == 1000);
+  assert(fileExist(directory + "_small/unrelated"));
+
+  removeTree(directory);
+  removeTree(directory + "_small");
+  rmdir(root);
+  return 0;
+}
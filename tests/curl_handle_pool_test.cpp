@@ -1,8 +1,10 @@
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <future>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <curl/curl.h>
 
@@ -43,6 +45,16 @@ int main() {
     CURL *reused = waiting.get();
     assert(reused == original);
 
+    {
+      /// a thread that cannot wait gets a handle past the capacity, closed
+      /// again when it comes back
+      CurlHandleLease held = pool.acquire();
+      CurlHandleLease extra = pool.acquireNow();
+      assert(extra && extra.get() != held.get());
+      assert(pool.stats().handles == 2);
+    }
+    assert(pool.stats().handles == 1);
+
     CurlHandleLease isolated = pool.acquire();
     assert(isolated.get() == original);
     cookies = nullptr;
@@ -148,6 +160,66 @@ int main() {
       assert(curl_easy_perform(request.get()) == CURLE_OK);
     }
     assert(after_patch_response == "GET||");
+
+    for (int i = 0; i < 2; i++) {
+      std::string response;
+      CurlHandleLease request = pool.acquire();
+      curl_easy_setopt(request.get(), CURLOPT_URL, url.c_str());
+      curl_easy_setopt(request.get(), CURLOPT_WRITEFUNCTION, collect);
+      curl_easy_setopt(request.get(), CURLOPT_WRITEDATA, &response);
+      assert(curl_easy_perform(request.get()) == CURLE_OK);
+      request.recordTransfer();
+    }
+    CurlHandlePool::Stats stats = pool.stats();
+    assert(stats.handles == 1);
+    assert(stats.new_connections + stats.reused_connections == 2);
+    assert(stats.reused_connections >= 1);
+
+    {
+      CurlHandlePool shared_pool(2);
+      CurlHandleLease first_lease = shared_pool.acquire();
+      CurlHandleLease second_lease = shared_pool.acquire();
+      assert(first_lease.get() != second_lease.get());
+      for (CurlHandleLease *request : {&first_lease, &second_lease}) {
+        std::string response;
+        curl_easy_setopt(request->get(), CURLOPT_URL, url.c_str());
+        curl_easy_setopt(request->get(), CURLOPT_WRITEFUNCTION, collect);
+        curl_easy_setopt(request->get(), CURLOPT_WRITEDATA, &response);
+        assert(curl_easy_perform(request->get()) == CURLE_OK);
+        request->recordTransfer();
+        assert(response == "GET||");
+      }
+      stats = shared_pool.stats();
+      assert(stats.handles == 2);
+      /// connections stay with the handle that opened them
+      assert(stats.new_connections == 2);
+    }
+
+    {
+      CurlHandlePool shared_pool(4);
+      std::vector<std::thread> workers;
+      std::atomic<int> succeeded{0};
+      for (int worker = 0; worker < 4; worker++)
+        workers.emplace_back([&] {
+          for (int i = 0; i < 5; i++) {
+            std::string response;
+            CurlHandleLease request = shared_pool.acquire();
+            curl_easy_setopt(request.get(), CURLOPT_URL, url.c_str());
+            curl_easy_setopt(request.get(), CURLOPT_WRITEFUNCTION, collect);
+            curl_easy_setopt(request.get(), CURLOPT_WRITEDATA, &response);
+            if (curl_easy_perform(request.get()) == CURLE_OK &&
+                response == "GET||")
+              succeeded++;
+            request.recordTransfer();
+          }
+        });
+      for (std::thread &worker : workers)
+        worker.join();
+      assert(succeeded == 20);
+      stats = shared_pool.stats();
+      assert(stats.new_connections + stats.reused_connections == 20);
+      assert(stats.reused_connections > 0);
+    }
     server.stop();
     server_thread.join();
   }
@@ -0,0 +1,193 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "handler/curl_handle_pool.h"
+#include "handler/curl_multi_engine.h"
+#include "httplib.h"
+
+using namespace std::chrono_literals;
+
+static size_t collect(char *data, size_t size, size_t count, void *output) {
+  static_cast<std::string *>(output)->append(data, size * count);
+  return size * count;
+}
+
+int main() {
+  assert(curl_global_init(CURL_GLOBAL_ALL) == CURLE_OK);
+  {
+    httplib::Server server;
+    std::atomic<int> concurrent{0}, peak{0};
+    server.Get("/slow", [&](const httplib::Request &request,
+                            httplib::Response &response) {
+      int now = ++concurrent;
+      int seen = peak.load();
+      while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+      }
+      std::this_thread::sleep_for(100ms);
+      --concurrent;
+      response.set_content(request.get_param_value("id"), "text/plain");
+    });
+    int port = server.bind_to_any_port("127.0.0.1");
+    assert(port > 0);
+    std::thread server_thread([&] { server.listen_after_bind(); });
+    const std::string base =
+        "http://127.0.0.1:" + std::to_string(port) + "/slow?id=";
+
+    {
+      CurlMultiEngine engine(2, 16);
+
+      /// a waiting caller gets its own transfer's result
+      CURL *single = curl_easy_init();
+      std::string single_body;
+      std::string single_url = base + "single";
+      curl_easy_setopt(single, CURLOPT_URL, single_url.c_str());
+      curl_easy_setopt(single, CURLOPT_WRITEFUNCTION, collect);
+      curl_easy_setopt(single, CURLOPT_WRITEDATA, &single_body);
+      assert(engine.perform(single) == CURLE_OK);
+      assert(single_body == "single");
+      curl_easy_cleanup(single);
+
+      /// eight transfers from one thread run together, two at a time for the
+      /// one host
+      constexpr int kTransfers = 8;
+      std::vector<CURL *> handles(kTransfers);
+      std::vector<std::string> bodies(kTransfers), urls(kTransfers);
+      std::mutex mutex;
+      std::condition_variable cv;
+      int done = 0;
+      bool all_ok = true;
+      const auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < kTransfers; i++) {
+        handles[i] = curl_easy_init();
+        urls[i] = base + std::to_string(i);
+        curl_easy_setopt(handles[i], CURLOPT_URL, urls[i].c_str());
+        curl_easy_setopt(handles[i], CURLOPT_WRITEFUNCTION, collect);
+        curl_easy_setopt(handles[i], CURLOPT_WRITEDATA, &bodies[i]);
+        engine.submit(handles[i], [&, i](CURLcode code) {
+          assert(!engine.onEngineThread());
+          std::lock_guard<std::mutex> lock(mutex);
+          all_ok = all_ok && code == CURLE_OK &&
+                   bodies[i] == std::to_string(i);
+          ++done;
+          cv.notify_all();
+        });
+      }
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        assert(cv.wait_for(lock, 10s, [&] { return done == kTransfers; }));
+      }
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      assert(all_ok);
+      /// two at a time: together, and never past the per-host limit
+      assert(peak.load() == 2);
+      assert(elapsed >= 350ms);
+      for (CURL *handle : handles)
+        curl_easy_cleanup(handle);
+
+      /// a delayed submission waits before it starts
+      CURL *delayed = curl_easy_init();
+      std::string delayed_body;
+      std::string delayed_url = base + "delayed";
+      curl_easy_setopt(delayed, CURLOPT_URL, delayed_url.c_str());
+      curl_easy_setopt(delayed, CURLOPT_WRITEFUNCTION, collect);
+      curl_easy_setopt(delayed, CURLOPT_WRITEDATA, &delayed_body);
+      std::promise<CURLcode> delayed_result;
+      const auto delayed_start = std::chrono::steady_clock::now();
+      engine.submit(
+          delayed,
+          [&](CURLcode code) { delayed_result.set_value(code); }, 200ms);
+      assert(delayed_result.get_future().get() == CURLE_OK);
+      assert(std::chrono::steady_clock::now() - delayed_start >= 300ms);
+      assert(delayed_body == "delayed");
+      curl_easy_cleanup(delayed);
+
+      /// a completion still busy does not hold up the next transfer, it runs
+      /// apart from the engine thread
+      CURL *blocking = curl_easy_init(), *next = curl_easy_init();
+      std::string blocking_body, next_body;
+      std::string blocking_url = base + "blocking", next_url = base + "next";
+      curl_easy_setopt(blocking, CURLOPT_URL, blocking_url.c_str());
+      curl_easy_setopt(blocking, CURLOPT_WRITEFUNCTION, collect);
+      curl_easy_setopt(blocking, CURLOPT_WRITEDATA, &blocking_body);
+      curl_easy_setopt(next, CURLOPT_URL, next_url.c_str());
+      curl_easy_setopt(next, CURLOPT_WRITEFUNCTION, collect);
+      curl_easy_setopt(next, CURLOPT_WRITEDATA, &next_body);
+      std::promise<CURLcode> next_result;
+      std::future<CURLcode> next_done = next_result.get_future();
+      std::promise<bool> blocking_result;
+      engine.submit(blocking, [&](CURLcode) {
+        engine.submit(next,
+                      [&](CURLcode code) { next_result.set_value(code); });
+        blocking_result.set_value(next_done.wait_for(5s) ==
+                                  std::future_status::ready);
+      });
+      assert(blocking_result.get_future().get());
+      assert(next_done.get() == CURLE_OK && next_body == "next");
+      curl_easy_cleanup(blocking);
+      curl_easy_cleanup(next);
+
+      CurlMultiEngine::Stats stats = engine.stats();
+      assert(stats.started == kTransfers + 4);
+      assert(stats.completed == kTransfers + 4);
+      assert(stats.running == 0);
+    }
+
+    {
+      /// async callers past the handle pool's capacity do not wait for a
+      /// handle, the engine's connection limit queues their transfers instead
+      CurlHandlePool pool(2);
+      CurlHandleLease busy = pool.acquire(), also_busy = pool.acquire();
+      CurlMultiEngine engine(2, 2);
+      constexpr int kQueued = 6;
+      std::vector<CurlHandleLease> leases;
+      std::vector<std::string> bodies(kQueued), urls(kQueued);
+      std::mutex mutex;
+      std::condition_variable cv;
+      int done = 0;
+      bool all_ok = true;
+      peak = 0;
+      const auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < kQueued; i++) {
+        leases.push_back(pool.acquireNow());
+        assert(leases.back());
+        urls[i] = base + "queued" + std::to_string(i);
+        CURL *handle = leases.back().get();
+        curl_easy_setopt(handle, CURLOPT_URL, urls[i].c_str());
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, collect);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &bodies[i]);
+        engine.submit(handle, [&, i](CURLcode code) {
+          std::lock_guard<std::mutex> lock(mutex);
+          all_ok = all_ok && code == CURLE_OK &&
+                   bodies[i] == "queued" + std::to_string(i);
+          ++done;
+          cv.notify_all();
+        });
+      }
+      /// every request takes 100ms, the caller is back well before the first
+      assert(std::chrono::steady_clock::now() - start < 50ms);
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        assert(cv.wait_for(lock, 10s, [&] { return done == kQueued; }));
+      }
+      assert(all_ok);
+      assert(peak.load() <= 2);
+      assert(pool.stats().handles == 2 + kQueued);
+      leases.clear();
+      assert(pool.stats().handles == 2);
+    }
+
+    server.stop();
+    server_thread.join();
+  }
+  curl_global_cleanup();
+  return 0;
+}
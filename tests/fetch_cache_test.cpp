@@ -0,0 +1,184 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <utime.h>
+
+#include "handler/fetch_cache.h"
+
+static std::string readFile(const std::string &path) {
+  std::string content;
+  std::FILE *fp = std::fopen(path.data(), "rb");
+  assert(fp);
+  char buffer[256];
+  size_t length;
+  while ((length = std::fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    content.append(buffer, length);
+  std::fclose(fp);
+  return content;
+}
+
+static void writeFile(const std::string &path, const std::string &content) {
+  std::FILE *fp = std::fopen(path.data(), "wb");
+  assert(fp);
+  std::fwrite(content.data(), 1, content.size(), fp);
+  std::fclose(fp);
+}
+
+static void testValidators() {
+  FetchValidators validators = fetchValidators(
+      "HTTP/1.1 301 Moved Permanently\r\n"
+      "Location: https://example.com/rules.list\r\n"
+      "ETag: \"redirect\"\r\n\r\n"
+      "HTTP/2 200\r\n"
+      "etag: W/\"abc\"\r\n"
+      "Last-Modified:  Tue, 15 Nov 1994 12:45:26 GMT \r\n\r\n");
+  assert(validators.etag == "W/\"abc\"");
+  assert(validators.last_modified == "Tue, 15 Nov 1994 12:45:26 GMT");
+
+  /// validators of a redirect do not describe the final body
+  validators = fetchValidators("HTTP/1.1 302 Found\r\nETag: \"a\"\r\n\r\n"
+                               "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n");
+  assert(validators.empty());
+  assert(fetchValidators("").empty());
+}
+
+int main() {
+  testValidators();
+
+  char pattern[] = "/tmp/fetch_cache_test_XXXXXX";
+  const char *root = mkdtemp(pattern);
+  assert(root);
+  const std::string directory = std::string(root) + "/cache";
+
+  {
+    FetchCache cache(directory, 1024 * 1024);
+    assert(!cache.getFresh("missing", 60));
+    assert(!cache.getAny("missing"));
+    assert(cache.put("entry", "proxies: []\n", "ETag: \"a\"\r\n"));
+
+    /// the layout older versions wrote, so existing cache directories stay warm
+    assert(readFile(directory + "/entry") == "proxies: []\n");
+    assert(readFile(directory + "/entry_header") == "ETag: \"a\"\r\n");
+
+    FetchCache::EntryPtr hit = cache.getFresh("entry", 60);
+    assert(hit && hit->content == "proxies: []\n");
+    assert(hit->headers == "ETag: \"a\"\r\n");
+    FetchCache::Stats stats = cache.stats();
+    assert(stats.hits == 1 && stats.memory_hits == 1);
+    assert(stats.misses == 2 && stats.writes == 1);
+
+    /// an empty header set removes the stale header file
+    assert(cache.put("entry", "proxies: [a]\n", ""));
+    assert(access((directory + "/entry_header").data(), F_OK) != 0);
+    assert(cache.getFresh("entry", 60)->headers.empty());
+
+    cache.flush();
+    assert(!cache.getAny("entry"));
+    assert(cache.stats().memory_entries == 0);
+  }
+
+  /// entries written by an earlier process are found through their mtime
+  writeFile(directory + "/legacy", "legacy body");
+  writeFile(directory + "/legacy_header", "Content-Type: text/plain\r\n");
+  struct utimbuf old_times {};
+  old_times.actime = old_times.modtime = time(nullptr) - 3600;
+  utime((directory + "/legacy").data(), &old_times);
+  {
+    FetchCache cache(directory, 0);
+    FetchCache::EntryPtr expired;
+    assert(!cache.getFresh("legacy", 60, &expired));
+    assert(expired && expired->headers == "Content-Type: text/plain\r\n");
+    assert(cache.stats().expired == 1 && cache.stats().hits == 0);
+    FetchCache::EntryPtr stale = cache.getAny("legacy");
+    assert(stale && stale->content == "legacy body");
+    assert(stale->headers == "Content-Type: text/plain\r\n");
+    /// with the memory tier disabled every hit is read back from disk
+    assert(cache.stats().memory_hits == 0 && cache.stats().memory_bytes == 0);
+
+    /// a 304 restarts the TTL without touching the body
+    assert(cache.refresh("legacy", expired->content.size()));
+    assert(cache.getFresh("legacy", 60)->content == "legacy body");
+    assert(cache.stats().revalidations == 1);
+    assert(cache.stats().revalidated_bytes == expired->content.size());
+    assert(!cache.refresh("never-stored", 1));
+
+    /// a full download over an existing entry is a refetch
+    assert(cache.put("legacy", "new body", ""));
+    assert(cache.stats().refetches == 1 && cache.stats().refetched_bytes == 8);
+    assert(cache.put("first", "body", ""));
+    assert(cache.stats().refetches == 1);
+
+    /// a file removed behind the cache's back turns into a miss
+    remove((directory + "/legacy").data());
+    assert(!cache.getAny("legacy"));
+    remove((directory + "/first").data());
+  }
+
+  /// the memory tier stays within its budget, the disk keeps everything
+  {
+    FetchCache cache(directory, 4096);
+    for (int i = 0; i < 8; i++)
+      assert(cache.put("blob" + std::to_string(i), std::string(1000, 'b'),
+                       ""));
+    assert(cache.stats().memory_bytes <= 4096);
+    for (int i = 0; i < 8; i++)
+      assert(cache.getFresh("blob" + std::to_string(i), 60)->content.size() ==
+             1000);
+    cache.setMemoryLimit(0);
+    assert(cache.stats().memory_entries == 0);
+  }
+
+  /// the index keeps slots for what the memory tier holds, not for every key ever seen
+  {
+    FetchCache cache(directory, 4096);
+    for (int i = 0; i < 100; i++)
+      assert(cache.put("many" + std::to_string(i), std::string(1000, 'm'),
+                       ""));
+    FetchCache::Stats stats = cache.stats();
+    assert(stats.memory_entries > 0);
+    assert(stats.index_entries == stats.memory_entries);
+    /// a dropped slot still finds its entry on disk
+    assert(cache.getFresh("many0", 60)->content.size() == 1000);
+
+    for (int i = 0; i < 5000; i++)
+      assert(!cache.getFresh("unknown" + std::to_string(i), 60));
+    assert(cache.stats().index_entries <= 2048);
+    for (int i = 0; i < 100; i++)
+      assert(cache.getAny("many" + std::to_string(i)));
+    cache.flush();
+    assert(cache.stats().index_entries == 0);
+  }
+
+  /// concurrent writers and readers of one key never observe a partial body
+  {
+    FetchCache cache(directory, 0);
+    const std::string first(200000, 'x'), second(300000, 'y');
+    assert(cache.put("shared", first, ""));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([&, t] {
+        for (int i = 0; i < 50; i++) {
+          if (t % 2)
+            cache.put("shared", i % 2 ? first : second, "");
+          else {
+            FetchCache::EntryPtr entry = cache.getAny("shared");
+            assert(entry && (entry->content == first ||
+                             entry->content == second));
+          }
+        }
+      });
+    }
+    for (std::thread &thread : threads)
+      thread.join();
+    cache.flush();
+  }
+
+  rmdir(directory.data());
+  rmdir(root);
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "generator/config/regmatch_program.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// what groupGenerate did for every rule before NodeIndex
+void legacyGroup(const std::string &rule, const std::vector<Proxy> &nodes,
+                 string_array &list) {
+  std::unordered_set<std::string> seen(list.begin(), list.end());
+  std::string real_rule;
+  for (const Proxy &node : nodes) {
+    if (parseNodeMatcher(rule, real_rule).matches(node) &&
+        (real_rule.empty() || regFind(node.Remark, real_rule)) &&
+        seen.insert(node.Remark).second)
+      list.emplace_back(node.Remark);
+  }
+}
+
+double milliseconds(Clock::time_point begin, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t node_count = 3000;
+  constexpr size_t group_count = 60;
+  const std::vector<std::string> regions = {"香港", "日本", "美国", "新加坡",
+                                            "台湾", "HK",   "JP",   "US"};
+
+  std::vector<Proxy> nodes(node_count);
+  for (size_t i = 0; i < node_count; ++i) {
+    nodes[i].Remark = regions[i % regions.size()] + " " +
+                      std::to_string(i) + (i % 7 ? " IPLC" : " 0.5x");
+    nodes[i].Group = i % 3 ? "Airport A" : "Airport B";
+    nodes[i].GroupId = static_cast<uint32_t>(i % 4);
+    nodes[i].Port = static_cast<uint16_t>(443 + i % 5);
+    nodes[i].Type = i % 2 ? ProxyType::Shadowsocks : ProxyType::Trojan;
+  }
+
+  /// a typical ACL-style template: region groups, a few selector groups, and
+  /// an everything-group that most service groups repeat
+  const string_array shared = {"(香港|HK)", "(日本|JP)", "(美国|US)",
+                               "(新加坡|SG)", "(台湾|TW)", ".*"};
+  std::vector<string_array> groups;
+  for (size_t i = 0; groups.size() < group_count; ++i) {
+    switch (i % 6) {
+    case 0:
+      groups.push_back({"[]DIRECT", shared[i / 6 % 5]});
+      break;
+    case 1:
+      groups.push_back({"!!GROUP=Airport B!!IPLC", "!!PORT=443+!!0\\.5x$"});
+      break;
+    case 2:
+      groups.push_back({"!!TYPE=SS!!" + shared[i % 5], "(?i)iplc"});
+      break;
+    default:
+      groups.push_back({"[]Proxy", ".*"});
+    }
+  }
+
+  size_t legacy_entries = 0, indexed_entries = 0;
+  std::vector<string_array> legacy(groups.size()), indexed(groups.size());
+  const auto legacy_begin = Clock::now();
+  for (size_t i = 0; i < groups.size(); ++i) {
+    for (const std::string &rule : groups[i])
+      if (rule.compare(0, 2, "[]") != 0)
+        legacyGroup(rule, nodes, legacy[i]);
+    legacy_entries += legacy[i].size();
+  }
+  const auto legacy_end = Clock::now();
+
+  const auto indexed_begin = Clock::now();
+  NodeIndex index(nodes);
+  for (size_t i = 0; i < groups.size(); ++i) {
+    for (const std::string &rule : groups[i])
+      if (rule.compare(0, 2, "[]") != 0)
+        index.appendRemarks(rule, indexed[i]);
+    indexed_entries += indexed[i].size();
+  }
+  const auto indexed_end = Clock::now();
+
+  if (legacy != indexed) {
+    std::cerr << "group mismatch\n";
+    return 1;
+  }
+
+  const double legacy_ms = milliseconds(legacy_begin, legacy_end);
+  const double indexed_ms = milliseconds(indexed_begin, indexed_end);
+  std::cout << std::fixed << std::setprecision(3) << "nodes=" << node_count
+            << " groups=" << groups.size() << " entries=" << indexed_entries
+            << '\n'
+            << "group_ms legacy=" << legacy_ms << " indexed=" << indexed_ms
+            << '\n'
+            << "rules evaluated=" << index.evaluated()
+            << " reused=" << index.reused() << '\n';
+
+  if (legacy_entries != indexed_entries || indexed_ms >= legacy_ms) {
+    std::cerr << "structural performance regression\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,159 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parser/mihomo_result.h"
+
+namespace {
+
+/// builds results in the layout of bridge/result_binary.go
+class ResultWriter {
+public:
+  ResultWriter &ok(uint32_t nodes) {
+    data += "MHR1";
+    data += '\0';
+    return u32(nodes);
+  }
+
+  ResultWriter &error(const std::string &message) {
+    data += "MHR1";
+    data += '\1';
+    return text(message);
+  }
+
+  ResultWriter &node(uint32_t fields) { return u32(fields); }
+
+  ResultWriter &field(uint8_t kind, const std::string &key,
+                      const std::string &value = "") {
+    data += static_cast<char>(kind);
+    text(key);
+    return text(value);
+  }
+
+  std::string data;
+
+private:
+  ResultWriter &u32(uint32_t value) {
+    for (int i = 0; i < 4; i++)
+      data += static_cast<char>((value >> (8 * i)) & 0xFF);
+    return *this;
+  }
+
+  ResultWriter &text(const std::string &value) {
+    u32(static_cast<uint32_t>(value.size()));
+    data += value;
+    return *this;
+  }
+};
+
+enum : uint8_t { String, Integer, Float, Bool, Null, Json };
+
+bool sameNode(const mihomo::ProxyNode &left, const mihomo::ProxyNode &right) {
+  return left.name == right.name && left.type == right.type &&
+         left.server == right.server && left.port == right.port &&
+         left.params == right.params && left.param_json == right.param_json;
+}
+
+bool throws(const std::string &data) {
+  try {
+    mihomo::decodeBinaryResult(data);
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+/// the binary result matches what the JSON ABI made of the same proxies
+void testParity() {
+  ResultWriter writer;
+  writer.ok(2)
+      .node(14)
+      .field(String, "name", "节点 \"A\"")
+      .field(String, "type", "vmess")
+      .field(String, "server", "example.com")
+      .field(Integer, "port", "443")
+      .field(Integer, "alterId", "18446744073709551615")
+      .field(Integer, "weight", "2")
+      .field(Float, "ratio", "0.5")
+      .field(Float, "huge", "1e+20")
+      .field(Bool, "udp", "true")
+      .field(Null, "dialer")
+      .field(String, "broken", "a\xef\xbf\xbd" "b\t\x01")
+      .field(Json, "alpn", R"(["h2","http/1.1"])")
+      .field(Json, "ws-opts",
+             R"({"early":2048,"headers":{"Host":"x"},"path":"/<ws>\n"})")
+      .field(Json, "reserved", R"([1,2.5,false,null])")
+      .node(4)
+      .field(String, "name", "B")
+      .field(String, "type", "ss")
+      .field(String, "server", "10.0.0.1")
+      .field(String, "port", "8388");
+
+  /// encoding/json output for the same proxies
+  const char *json =
+      R"([{"alpn":["h2","http/1.1"],"alterId":18446744073709551615,)"
+      R"("broken":"a�b\t\u0001","dialer":null,)"
+      R"("huge":100000000000000000000,"name":"节点 \"A\"","port":443,)"
+      R"("ratio":0.5,"reserved":[1,2.5,false,null],)"
+      R"("server":"example.com","type":"vmess","udp":true,"weight":2,)"
+      R"("ws-opts":{"early":2048,"headers":{"Host":"x"},)"
+      R"("path":"/<ws>\n"}},)"
+      R"({"name":"B","port":"8388","server":"10.0.0.1","type":"ss"}])";
+
+  const auto binary = mihomo::decodeBinaryResult(writer.data);
+  const auto legacy = mihomo::decodeJsonResult(json);
+  assert(binary.size() == 2 && legacy.size() == 2);
+  for (size_t i = 0; i < binary.size(); i++)
+    assert(sameNode(binary[i], legacy[i]));
+
+  assert(binary[0].port == 443);
+  assert(binary[0].params.at("broken") == "a\xef\xbf\xbd" "b\t\x01");
+  assert(binary[0].param_json.at("broken") == R"("a�b\t\u0001")");
+  assert(binary[0].params.at("dialer") == "null");
+  assert(binary[1].port == 8388);
+  assert(binary[1].params.empty());
+}
+
+void testErrors() {
+  ResultWriter error;
+  error.error("file doesn't have any proxy");
+  try {
+    mihomo::decodeBinaryResult(error.data);
+    assert(false);
+  } catch (const std::runtime_error &e) {
+    assert(std::string(e.what()) ==
+           "Mihomo 解析器错误：file doesn't have any proxy");
+  }
+
+  ResultWriter valid;
+  valid.ok(1).node(1).field(String, "name", "A");
+  assert(!throws(valid.data));
+  /// truncated anywhere, trailing bytes, bad magic or an unknown kind
+  for (size_t size = 0; size < valid.data.size(); size++)
+    assert(throws(valid.data.substr(0, size)));
+  assert(throws(valid.data + '\0'));
+  assert(throws("MHR2" + valid.data.substr(4)));
+  ResultWriter unknown;
+  unknown.ok(1).node(1).field(9, "x", "y");
+  assert(throws(unknown.data));
+  ResultWriter numeric_name;
+  numeric_name.ok(1).node(1).field(Integer, "name", "1");
+  assert(throws(numeric_name.data));
+  /// a node count the remaining bytes cannot hold
+  ResultWriter huge;
+  huge.ok(0xFFFFFFFF);
+  assert(throws(huge.data));
+}
+
+} // namespace
+
+int main() {
+  testParity();
+  testErrors();
+  return 0;
+}
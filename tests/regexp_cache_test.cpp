@@ -0,0 +1,151 @@
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jpcre2.hpp>
+
+#include "utils/regexp.h"
+
+using jp = jpcre2::select<char>;
+
+/// reference behaviour of the helpers before compiled patterns were cached
+static std::string referenceReplace(const std::string &src,
+                                    const std::string &match,
+                                    const std::string &rep, bool global) {
+  jp::Regex reg;
+  reg.setPattern(match)
+      .addModifier("m")
+      .addPcre2Option(PCRE2_UTF | PCRE2_MULTILINE | PCRE2_ALT_BSUX)
+      .compile();
+  if (!reg)
+    return src;
+  return reg.replace(src, rep, global ? "gEx" : "Ex");
+}
+
+static bool referenceFind(const std::string &src, const std::string &match) {
+  jp::Regex reg;
+  reg.setPattern(match)
+      .addModifier("m")
+      .addPcre2Option(PCRE2_UTF | PCRE2_ALT_BSUX)
+      .compile();
+  if (!reg)
+    return false;
+  return reg.match(src, "g");
+}
+
+static bool referenceMatch(const std::string &src, const std::string &match) {
+  jp::Regex reg;
+  reg.setPattern(match)
+      .addModifier("m")
+      .addPcre2Option(PCRE2_ANCHORED | PCRE2_ENDANCHORED | PCRE2_UTF)
+      .compile();
+  if (!reg)
+    return false;
+  return reg.match(src, "g");
+}
+
+static std::vector<std::string> referenceGetAllMatch(const std::string &src,
+                                                     const std::string &match,
+                                                     bool group_only) {
+  jp::Regex reg;
+  reg.setPattern(match)
+      .addModifier("m")
+      .addPcre2Option(PCRE2_UTF | PCRE2_ALT_BSUX)
+      .compile();
+  jp::VecNum vec_num;
+  jp::RegexMatch rm;
+  rm.setRegexObject(&reg)
+      .setSubject(src)
+      .setNumberedSubstringVector(&vec_num)
+      .setModifier("gm")
+      .match();
+  std::vector<std::string> result;
+  for (auto &groups : vec_num)
+    for (size_t i = group_only ? 1 : 0; i < groups.size(); i++)
+      result.push_back(groups[i]);
+  return result;
+}
+
+int main() {
+  const std::vector<std::string> subjects = {
+      "",
+      "HK 01 | IPLC",
+      "🇭🇰 香港 02 [x1.5]",
+      "line1\r\nline2\nUS-LA",
+      "aaa",
+      "  padded  ",
+      "\xe6\x97\xa5\xe6\x9c\xac Tokyo",
+  };
+  const std::vector<std::string> patterns = {
+      "(?i)hk|香港",  "^(.*?) (\\d+)", "(\\d+)?",      "",
+      "x*",           "^",             "$",            "(a)|(b)",
+      "\\u65e5",      "(?<=\\s)\\w+",  "[",            "(?i)us-(\\w+)",
+      "\\s*",         "(?m)^line\\d$", "\\[x([\\d.]+)\\]"};
+  const std::vector<std::string> replacements = {"", "$1", "<$0>", "${2}-$1",
+                                                 "\\u$1"};
+
+  /// rounds 0/1 run with JIT (when available), 2/3 on the interpreter
+  for (int round = 0; round < 4; round++) {
+    regexSetJitEnabled(round < 2);
+    assert(regexJitActive() == (round < 2 && regexJitAvailable()));
+    for (const auto &pattern : patterns) {
+      for (const auto &subject : subjects) {
+        assert(regFind(subject, pattern) == referenceFind(subject, pattern));
+        assert(regMatch(subject, pattern) == referenceMatch(subject, pattern));
+        assert(regGetAllMatch(subject, pattern, false) ==
+               referenceGetAllMatch(subject, pattern, false));
+        assert(regGetAllMatch(subject, pattern, true) ==
+               referenceGetAllMatch(subject, pattern, true));
+        RegexPattern compiled(pattern);
+        assert(compiled.valid() == regValid(pattern));
+        assert(compiled.find(subject) == regFind(subject, pattern));
+        for (const auto &rep : replacements) {
+          assert(regReplace(subject, pattern, rep, true, true) ==
+                 referenceReplace(subject, pattern, rep, true));
+          assert(compiled.replace(subject, rep) ==
+                 regReplace(subject, pattern, rep));
+          assert(regReplace(subject, pattern, rep, false, false) ==
+                 referenceReplace(subject, pattern, rep, false));
+        }
+      }
+    }
+  }
+  regexSetJitEnabled(true);
+  if (regexJitAvailable())
+    assert(regexCacheStats().jit_compiled > 0);
+
+  /// deep backtracking must still produce the interpreter result
+  std::string nested(20000, 'a');
+  assert(regFind(nested, "^(a|b)*$") == referenceFind(nested, "^(a|b)*$"));
+
+  assert(!regValid("["));
+  assert(regValid("(?i)hk"));
+  assert(regTrim("  padded  ") == "padded  ");
+
+  std::string long_rep(4096, 'z');
+  assert(regReplace("abc", "b", long_rep) == "a" + long_rep + "c");
+
+  RegexCacheStats before = regexCacheStats();
+  assert(before.entries > 0 && before.entries <= regexCacheMaxEntries());
+  assert(before.bytes <= regexCacheMaxBytes());
+  assert(before.hits > before.misses);
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < 8; i++) {
+    workers.emplace_back([i] {
+      for (int j = 0; j < 500; j++) {
+        std::string pattern = "node" + std::to_string((i + j) % 32) + "$";
+        assert(regFind("node" + std::to_string((i + j) % 32), pattern));
+        assert(regReplace("node" + std::to_string(j), "\\d+", "#") == "node#");
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+
+  RegexCacheStats after = regexCacheStats();
+  assert(after.hits > before.hits);
+  assert(after.misses >= before.misses + 32);
+  return 0;
+}
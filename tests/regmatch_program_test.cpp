@@ -0,0 +1,272 @@
+#include <cassert>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "generator/config/regmatch_program.h"
+
+/// the per-pattern loop RemarkFilter replaces
+static bool referenceAny(const string_array &patterns, const Proxy &node) {
+  for (const std::string &pattern : patterns) {
+    std::string real_rule;
+    if (!parseNodeMatcher(pattern, real_rule).matches(node))
+      continue;
+    if (real_rule.empty() || regFind(node.Remark, real_rule))
+      return true;
+  }
+  return false;
+}
+
+/// what groupGenerate did for every rule before NodeIndex
+static void referenceGroup(const std::string &rule,
+                           const std::vector<Proxy> &nodes,
+                           string_array &list) {
+  std::unordered_set<std::string> seen(list.begin(), list.end());
+  std::string real_rule;
+  for (const Proxy &node : nodes) {
+    if (parseNodeMatcher(rule, real_rule).matches(node) &&
+        (real_rule.empty() || regFind(node.Remark, real_rule)) &&
+        seen.insert(node.Remark).second)
+      list.emplace_back(node.Remark);
+  }
+}
+
+/// stands in for a script's per node rename()/getEmoji()
+static std::string referenceScript(const RegexMatchRule &rule,
+                                   const Proxy &node) {
+  const std::string &script = rule.config.Script;
+  if (script == "tag-hk")
+    return regFind(node.Remark, "HK") ? "[HK] " + node.Remark : "";
+  if (script == "flag-jp")
+    return regFind(node.Remark, "日本") ? "🇯🇵" : "";
+  if (script == "flag-group")
+    return node.GroupId == 1 ? "🏳" : "";
+  return "";
+}
+
+/// the node-major nodeRename applyRenameProgram replaces
+static void referenceRename(Proxy &node, const RegexMatchProgram &program,
+                            bool authorized) {
+  const std::string original_remark = node.Remark;
+  for (const RegexMatchRule &x : program.rules) {
+    if (!x.config.Script.empty() && authorized) {
+      std::string returned_remark = referenceScript(x, node);
+      if (!returned_remark.empty())
+        node.Remark = returned_remark;
+      continue;
+    }
+    if (!x.pattern.pattern().empty() && x.matcher.matches(node))
+      node.Remark = x.pattern.replace(node.Remark, x.config.Replace);
+  }
+  if (node.Remark.empty())
+    node.Remark = original_remark;
+}
+
+/// the node-major addEmoji applyEmojiProgram replaces
+static std::string referenceEmoji(const Proxy &node,
+                                  const RegexMatchProgram &program,
+                                  bool authorized) {
+  for (const RegexMatchRule &x : program.rules) {
+    if (!x.config.Script.empty() && authorized) {
+      std::string emoji = referenceScript(x, node);
+      if (!emoji.empty())
+        return emoji + " " + node.Remark;
+      continue;
+    }
+    if (x.config.Replace.empty() || x.pattern.pattern().empty())
+      continue;
+    if (x.matcher.matches(node) && x.pattern.find(node.Remark))
+      return x.config.Replace + " " + node.Remark;
+  }
+  return node.Remark;
+}
+
+/// a script hook over the nodes being processed, counting its calls
+static ScriptRuleHook referenceHook(const std::vector<Proxy> &nodes,
+                                    size_t &calls) {
+  return [&nodes, &calls](const RegexMatchRule &rule,
+                          const std::vector<char> *skip) {
+    ++calls;
+    string_array results(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+      if (!skip || !(*skip)[i])
+        results[i] = referenceScript(rule, nodes[i]);
+    return results;
+  };
+}
+
+/// the rule-major passes leave every node as the node-major loop did
+static void testRuleMajorOrder(const std::vector<Proxy> &nodes) {
+  const RegexMatchConfigs renames = {
+      {"!!GROUP=Airport B!!^剩余.*", "", ""},
+      {"(?i)iplc", "专线", ""},
+      {"HK", "香港", "tag-hk"},
+      {"^香港 (\\d+)", "HK-$1", ""},
+      {"!!TYPE=SS!!^$", "empty", ""},
+      {"!!GROUPID=0!!.*", "", ""},
+      {"", "ignored", ""},
+      {"\\s+", " ", ""},
+  };
+  const RegexMatchConfigs emojis = {
+      {"!!GROUPID=2!!HK", "🇭🇰", ""},
+      {"日本", "🗾", "flag-jp"},
+      {"", "🌐", ""},
+      {"US", "", ""},
+      {".*", "🏳", "flag-group"},
+      {"(?i)hk|日本|东京", "🇨🇳", ""},
+      {"!!PORT=8443!!.*", "🔒", ""},
+      {"过期", "⌛", ""},
+  };
+  const auto rename_program = compileRegexMatchProgram(renames, 0, false);
+  const auto emoji_program = compileRegexMatchProgram(emojis, 0, false);
+
+  for (bool authorized : {false, true}) {
+    std::vector<Proxy> reference = nodes, applied = nodes;
+    for (Proxy &node : reference) {
+      referenceRename(node, *rename_program, authorized);
+      node.Remark = referenceEmoji(node, *emoji_program, authorized);
+    }
+
+    size_t calls = 0;
+    ScriptRuleHook hook;
+    if (authorized)
+      hook = referenceHook(applied, calls);
+    applyRenameProgram(*rename_program, applied, hook);
+    /// one call per script rule, not one per node
+    assert(calls == (authorized ? 1 : 0));
+    applyEmojiProgram(*emoji_program, applied, hook);
+    assert(calls == (authorized ? 3 : 0));
+
+    size_t restored = 0, first_wins = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      assert(applied[i].Remark == reference[i].Remark);
+      restored += !nodes[i].Remark.empty() && nodes[i].GroupId == 0 &&
+                  applied[i].Remark.find(nodes[i].Remark) != std::string::npos;
+      first_wins += applied[i].Remark.rfind("🇭🇰 ", 0) == 0 ||
+                    applied[i].Remark.rfind("🇯🇵 ", 0) == 0;
+    }
+    /// GROUPID=0 nodes are renamed to nothing and get their remark back, and
+    /// later matching emoji rules never stack on the first one
+    assert(restored > 0 && first_wins > 0);
+    for (const Proxy &node : applied)
+      assert(node.Remark.find("🇨🇳 🇭🇰") == std::string::npos &&
+             node.Remark.find("🇨🇳 🇯🇵") == std::string::npos);
+  }
+}
+
+int main() {
+  Proxy node;
+  node.Remark = "HK 01 IPLC";
+  node.Group = "Airport A";
+  node.GroupId = 2;
+  node.Port = 443;
+  node.Hostname = "hk01.example.com";
+  node.Type = ProxyType::Trojan;
+
+  std::string real_rule;
+  NodeMatcher matcher = parseNodeMatcher("!!GROUPID=1-3!!HK", real_rule);
+  assert(matcher.kind == NodeMatcher::Kind::GroupId);
+  assert(matcher.target == "1-3" && real_rule == "HK");
+  assert(matcher.matches(node));
+
+  matcher = parseNodeMatcher("!!INSERT=!2!!HK", real_rule);
+  assert(matcher.kind == NodeMatcher::Kind::Insert);
+  assert(matcher.matches(node));
+
+  matcher = parseNodeMatcher("!!TYPE=SS|VMESS!!.*", real_rule);
+  assert(!matcher.matches(node) && real_rule == ".*");
+  matcher = parseNodeMatcher("!!PORT=400+", real_rule);
+  assert(matcher.matches(node) && real_rule.empty());
+  matcher = parseNodeMatcher("!!SERVER=^hk\\d+!!(.*)", real_rule);
+  assert(matcher.matches(node) && real_rule == "(.*)");
+  matcher = parseNodeMatcher("!!GROUP=Airport B!!HK", real_rule);
+  assert(!matcher.matches(node));
+  matcher = parseNodeMatcher("(?i)iplc", real_rule);
+  assert(matcher.kind == NodeMatcher::Kind::Any && real_rule == "(?i)iplc");
+  assert(matcher.matches(node));
+
+  RegexMatchConfigs configs(3);
+  configs[0].Match = "!!GROUPID=2!!IPLC";
+  configs[0].Replace = "专线";
+  configs[1].Match = "!!PORT=80";
+  configs[1].Replace = "ignored";
+  configs[2].Match = "HK";
+  configs[2].Script = "path:/nonexistent/rename.js";
+
+  RegexMatchProgramPtr program = compileRegexMatchProgram(configs, 7);
+  assert(program->generation == 7 && program->size() == 3);
+  assert(program->rules[0].matcher.matches(node));
+  assert(program->rules[0].pattern.replace(node.Remark, "专线") ==
+         "HK 01 专线");
+  assert(program->rules[1].pattern.pattern().empty());
+  /// read when applied, so edits to the file show up without a reload
+  assert(program->rules[2].script == configs[2].Script);
+  assert(program->rules[2].pattern.find(node.Remark));
+
+  configs[2].Script = "function rename(node) { return ''; }";
+  program = compileRegexMatchProgram(configs, 0, false);
+  assert(program->rules[2].script.empty());
+  program = compileRegexMatchProgram(configs);
+  assert(program->rules[2].script == configs[2].Script);
+
+  const std::vector<std::string> remarks = {
+      "HK 01 IPLC",   "🇯🇵 日本 东京 02", "US Los Angeles", "剩余流量：10GB",
+      "官网 example", "kelvin \xe2\x84\xaa", "bad \xff utf8", "",
+      "a.b.c",        "Line\nBreak",      "SG-新加坡-03",   "过期时间 2026"};
+  const std::vector<string_array> lists = {
+      {},
+      {""},
+      {"HK", "日本"},
+      {"(?i)hk|iplc"},
+      {"剩余", "过期", "官网", "(?i)expire"},
+      {"a.b", "\\d{2}$", "^SG", "(?i)KELVIN"},
+      {"(a)\\1", "(?x) H K", "\\Qa.b", "(*UCP)\\w+东京"},
+      {"!!GROUPID=2!!HK", "!!GROUP=Airport!!", "!!TYPE=TROJAN!!US"},
+      {"[", "(?<name>US)", "(?|(a)|(b))", "!!PORT=80!!.*"},
+      {"^$", "(?m)^Break$", "新加坡|東京", "(?i)(?:日本|jp)"},
+      {"bad", "\xff", "utf8"},
+  };
+  for (const string_array &list : lists) {
+    RemarkFilter filter(list);
+    assert(filter.empty() == list.empty());
+    for (const std::string &remark : remarks) {
+      for (ProxyType type : {ProxyType::Trojan, ProxyType::TUIC}) {
+        node.Remark = remark;
+        node.Type = type;
+        assert(filter.matches(node) == referenceAny(list, node));
+      }
+    }
+  }
+
+  std::vector<Proxy> nodes;
+  for (const std::string &remark : remarks) {
+    for (ProxyType type : {ProxyType::Trojan, ProxyType::Shadowsocks}) {
+      Proxy &added = nodes.emplace_back(node);
+      added.Remark = remark;
+      added.Type = type;
+      added.GroupId = static_cast<uint32_t>(nodes.size() % 3);
+      added.Group = nodes.size() % 2 ? "Airport A" : "Airport B";
+      added.Port = static_cast<uint16_t>(nodes.size() % 4 ? 443 : 8443);
+    }
+  }
+  const std::vector<string_array> groups = {
+      {"HK", "(?i)iplc", "HK"},
+      {"[]DIRECT", "!!GROUPID=1!!.*", "!!INSERT=!1", "HK 01 IPLC"},
+      {"!!GROUP=A$", "!!TYPE=SS|TROJAN!!日本", "!!PORT=8443"},
+      {"!!SERVER=^hk\\d+!!^$", ".*", "bad", "["},
+      {"a.b", "\\d{2}$", "(?m)^Break$", "!!GROUP=Airport!!"},
+  };
+  NodeIndex index(nodes);
+  for (const string_array &group : groups) {
+    string_array indexed = {"DIRECT", "a.b.c"}, reference = indexed;
+    for (const std::string &rule : group) {
+      index.appendRemarks(rule, indexed);
+      referenceGroup(rule, nodes, reference);
+    }
+    assert(indexed == reference);
+  }
+  assert(index.reused() == 1 && index.evaluated() == 17);
+
+  testRuleMajorOrder(nodes);
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "generator/config/regmatch_program.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+bool legacyAny(const string_array &patterns, const Proxy &node) {
+  for (const std::string &pattern : patterns) {
+    std::string real_rule;
+    if (!parseNodeMatcher(pattern, real_rule).matches(node))
+      continue;
+    if (real_rule.empty() || regFind(node.Remark, real_rule))
+      return true;
+  }
+  return false;
+}
+
+double milliseconds(Clock::time_point begin, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t node_count = 5000;
+  constexpr size_t pattern_count = 500;
+  const std::vector<std::string> regions = {"香港", "日本", "美国", "新加坡",
+                                            "台湾", "HK",   "JP",   "US"};
+
+  std::vector<Proxy> nodes(node_count);
+  for (size_t i = 0; i < node_count; ++i) {
+    nodes[i].Remark = regions[i % regions.size()] + " " +
+                      std::to_string(i) + (i % 7 ? " IPLC" : " 0.5x");
+    nodes[i].Group = "Airport";
+    nodes[i].GroupId = static_cast<int>(i % 4);
+    nodes[i].Type = ProxyType::Shadowsocks;
+  }
+
+  /// a realistic mix: mostly keywords, some caseless/alternation regexes and
+  /// a few selector rules that keep the per-pattern path
+  string_array patterns;
+  for (size_t i = 0; patterns.size() < pattern_count; ++i) {
+    switch (i % 10) {
+    case 0:
+      patterns.push_back("(?i)expire" + std::to_string(i));
+      break;
+    case 1:
+      patterns.push_back("套餐" + std::to_string(i) + "|到期" +
+                         std::to_string(i));
+      break;
+    case 2:
+      patterns.push_back("!!GROUPID=9!!node" + std::to_string(i));
+      break;
+    default:
+      patterns.push_back("keyword" + std::to_string(i));
+    }
+  }
+  patterns.push_back("0\\.5x$");
+
+  size_t legacy_dropped = 0, filter_dropped = 0;
+  const auto legacy_begin = Clock::now();
+  for (const Proxy &node : nodes)
+    legacy_dropped += legacyAny(patterns, node);
+  const auto legacy_end = Clock::now();
+
+  const auto filter_begin = Clock::now();
+  const RemarkFilter filter(patterns);
+  std::vector<bool> decisions;
+  decisions.reserve(node_count);
+  for (const Proxy &node : nodes) {
+    decisions.push_back(filter.matches(node));
+    filter_dropped += decisions.back();
+  }
+  const auto filter_end = Clock::now();
+
+  for (size_t i = 0; i < node_count; ++i) {
+    if (decisions[i] != legacyAny(patterns, nodes[i])) {
+      std::cerr << "decision mismatch for " << nodes[i].Remark << '\n';
+      return 1;
+    }
+  }
+
+  const double legacy_ms = milliseconds(legacy_begin, legacy_end);
+  const double filter_ms = milliseconds(filter_begin, filter_end);
+  std::cout << std::fixed << std::setprecision(3) << "nodes=" << node_count
+            << " patterns=" << patterns.size() << '\n'
+            << "exclude_ms legacy=" << legacy_ms << " filter=" << filter_ms
+            << '\n'
+            << "dropped legacy=" << legacy_dropped
+            << " filter=" << filter_dropped << '\n';
+
+  if (legacy_dropped != filter_dropped || filter_ms >= legacy_ms) {
+    std::cerr << "structural performance regression\n";
+    return 1;
+  }
+  return 0;
+}
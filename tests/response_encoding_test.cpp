@@ -0,0 +1,125 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif // USE_ZSTD
+
+#include "handler/response_encoding.h"
+
+namespace {
+
+std::string gunzip(const std::string &data) {
+  z_stream stream{};
+  assert(inflateInit2(&stream, 15 + 16) == Z_OK);
+  std::string out;
+  char buffer[4096];
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  int result = Z_OK;
+  while (result == Z_OK) {
+    stream.next_out = reinterpret_cast<Bytef *>(buffer);
+    stream.avail_out = sizeof(buffer);
+    result = inflate(&stream, Z_NO_FLUSH);
+    out.append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  inflateEnd(&stream);
+  assert(result == Z_STREAM_END);
+  return out;
+}
+
+std::string sampleBody() {
+  std::string body;
+  for (int i = 0; i < 2000; i++)
+    body += "  - DOMAIN-SUFFIX,example" + std::to_string(i % 37) +
+            ".com,Proxy\n";
+  return body;
+}
+
+void testNegotiation() {
+  assert(negotiateContentEncoding("") == ContentEncoding::Identity);
+  assert(negotiateContentEncoding("identity") == ContentEncoding::Identity);
+  assert(negotiateContentEncoding("deflate") == ContentEncoding::Identity);
+  assert(negotiateContentEncoding("gzip") == ContentEncoding::Gzip);
+  assert(negotiateContentEncoding("x-gzip") == ContentEncoding::Gzip);
+  assert(negotiateContentEncoding(" GZIP ;q=0.5") == ContentEncoding::Gzip);
+  assert(negotiateContentEncoding("gzip;q=0") == ContentEncoding::Identity);
+  assert(negotiateContentEncoding("gzip;q=0.000") == ContentEncoding::Identity);
+  assert(negotiateContentEncoding("*;q=0") == ContentEncoding::Identity);
+  /// a higher q-value wins over the preference order
+  assert(negotiateContentEncoding("br;q=0.4, zstd;q=0.3, gzip;q=0.9") ==
+         ContentEncoding::Gzip);
+#ifdef USE_ZSTD
+  assert(negotiateContentEncoding("gzip, deflate, br, zstd") ==
+         ContentEncoding::Zstd);
+  assert(negotiateContentEncoding("*") == ContentEncoding::Zstd);
+  assert(negotiateContentEncoding("zstd;q=0, *") != ContentEncoding::Zstd);
+#else
+  assert(negotiateContentEncoding("zstd") == ContentEncoding::Identity);
+#endif // USE_ZSTD
+#ifdef USE_BROTLI
+  assert(negotiateContentEncoding("gzip, br") == ContentEncoding::Brotli);
+#else
+  assert(negotiateContentEncoding("gzip, br") == ContentEncoding::Gzip);
+#endif // USE_BROTLI
+  assert(negotiateContentEncoding("zstd;q=0, br;q=0, gzip;q=0.1") ==
+         ContentEncoding::Gzip);
+}
+
+void testCompression() {
+  const std::string body = sampleBody();
+  std::string out;
+  assert(compressBody(body, ContentEncoding::Gzip, out));
+  assert(out.size() < body.size());
+  assert(gunzip(out) == body);
+  assert(!compressBody(body, ContentEncoding::Identity, out));
+#ifdef USE_ZSTD
+  assert(compressBody(body, ContentEncoding::Zstd, out));
+  std::string plain(body.size(), '\0');
+  assert(ZSTD_decompress(plain.data(), plain.size(), out.data(), out.size()) ==
+         body.size());
+  assert(plain == body);
+#endif // USE_ZSTD
+#ifdef USE_BROTLI
+  assert(compressBody(body, ContentEncoding::Brotli, out));
+  assert(out.size() < body.size());
+#endif // USE_BROTLI
+}
+
+void testEncodedBodies() {
+  const std::string body = sampleBody();
+  EncodedBodies encoded;
+  assert(!encoded.get(body, ContentEncoding::Identity));
+
+  std::vector<EncodedBodies::BodyPtr> seen(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < seen.size(); i++)
+    threads.emplace_back(
+        [&, i]() { seen[i] = encoded.get(body, ContentEncoding::Gzip); });
+  for (std::thread &thread : threads)
+    thread.join();
+  /// every caller gets the one compressed copy
+  for (const EncodedBodies::BodyPtr &ptr : seen)
+    assert(ptr && ptr == seen.front());
+  assert(gunzip(*seen.front()) == body);
+
+  /// a body that does not shrink is not kept
+  EncodedBodies tiny;
+  assert(!tiny.get("x", ContentEncoding::Gzip));
+  assert(!tiny.get("x", ContentEncoding::Gzip));
+}
+
+} // namespace
+
+int main() {
+  testNegotiation();
+  testCompression();
+  testEncodedBodies();
+  return 0;
+}
@@ -0,0 +1,90 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "generator/config/rule_types.h"
+
+namespace {
+
+#define basic_types                                                            \
+  "DOMAIN", "DOMAIN-SUFFIX", "DOMAIN-KEYWORD", "IP-CIDR", "SRC-IP-CIDR",       \
+      "GEOIP", "MATCH", "FINAL"
+
+/// the lists the tables replaced, checked by prefix as they were
+const std::vector<std::pair<uint8_t, std::vector<std::string>>> kLists = {
+    {RULE_TARGET_CLASH,
+     {basic_types,          "IP-CIDR6",      "SRC-PORT",
+      "DST-PORT",           "PROCESS-NAME",  "DOMAIN-REGEX",
+      "GEOSITE",            "IP-SUFFIX",     "IP-ASN",
+      "SRC-GEOIP",          "SRC-IP-ASN",    "SRC-IP-SUFFIX",
+      "IN-PORT",            "IN-TYPE",       "IN-USER",
+      "IN-NAME",            "PROCESS-PATH-REGEX", "PROCESS-PATH",
+      "PROCESS-NAME-REGEX", "UID",           "NETWORK",
+      "DSCP",               "SUB-RULE",      "RULE-SET",
+      "AND",                "OR",            "NOT"}},
+    {RULE_TARGET_SURGE2,
+     {basic_types, "IP-CIDR6", "USER-AGENT", "URL-REGEX", "PROCESS-NAME",
+      "IN-PORT", "DEST-PORT", "SRC-IP"}},
+    {RULE_TARGET_SURGE,
+     {basic_types, "IP-CIDR6", "USER-AGENT", "URL-REGEX", "AND", "OR", "NOT",
+      "PROCESS-NAME", "IN-PORT", "DEST-PORT", "SRC-IP"}},
+    {RULE_TARGET_QUANX,
+     {basic_types, "USER-AGENT", "HOST", "HOST-SUFFIX", "HOST-KEYWORD"}},
+    {RULE_TARGET_SURF,
+     {basic_types, "IP-CIDR6", "PROCESS-NAME", "IN-PORT", "DEST-PORT",
+      "SRC-IP"}},
+    {RULE_TARGET_SINGBOX,
+     {basic_types, "IP-VERSION", "INBOUND", "PROTOCOL", "NETWORK", "GEOSITE",
+      "SRC-GEOIP", "DOMAIN-REGEX", "PROCESS-NAME", "PROCESS-PATH",
+      "PACKAGE-NAME", "PORT", "PORT-RANGE", "SRC-PORT", "SRC-PORT-RANGE",
+      "USER", "USER-ID"}}};
+
+bool startsWith(const std::string &text, const std::string &prefix) {
+  return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+} // namespace
+
+int main() {
+  std::vector<std::string> names;
+  for (const auto &[target, list] : kLists)
+    names.insert(names.end(), list.begin(), list.end());
+
+  std::vector<std::string> lines = {"", ",", "X", "MATCH", "DOMAIN-WILDCARD,a",
+                                    "domain,a", " DOMAIN,a", "HOSTNAME,a",
+                                    "IP-CIDR66,1.1.1.1/32", "UNKNOWN-TYPE,a,b"};
+  for (const std::string &name : names) {
+    for (const char *suffix : {"", ",x,DIRECT", "6,x", "-X,x", "X", ",", " ,x"})
+      lines.push_back(name + suffix);
+    for (size_t length = 0; length < name.size(); length++)
+      lines.push_back(name.substr(0, length) + ",x");
+  }
+
+  for (const auto &[target, list] : kLists) {
+    for (const std::string &line : lines) {
+      const bool listed =
+          std::any_of(list.begin(), list.end(), [&](const std::string &type) {
+            return startsWith(line, type);
+          });
+      assert(ruleTypeAllowed(line, target) == listed);
+    }
+    for (const std::string &name : names) {
+      const bool exact = std::find(list.begin(), list.end(), name) != list.end();
+      assert(ruleTypeListed(ruleTypeOf(name + ",x"), target) == exact);
+    }
+  }
+
+  for (const std::string &name : names) {
+    assert(ruleTypeOf(name) != RuleType::Unknown);
+    assert(ruleTypeName(ruleTypeOf(name + ",a,b")) == name);
+  }
+  assert(ruleTypeOf("DOMAIN-WILDCARD,a") == RuleType::Unknown);
+  assert(ruleTypeOf("domain,a") == RuleType::Unknown);
+  assert(ruleTypeOf("") == RuleType::Unknown);
+  assert(ruleTypeName(RuleType::Unknown).empty());
+  return 0;
+}
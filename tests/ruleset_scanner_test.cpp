@@ -0,0 +1,161 @@
+#include <cassert>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "config/ruleset.h"
+#include "generator/config/ruleset_scanner.h"
+#include "utils/regexp.h"
+#include "utils/string.h"
+
+/// the regex pipeline scanRuleset replaced, kept verbatim as the golden reference
+static std::string referenceConvert(const std::string &content, int type) {
+  std::string output, strLine;
+
+  if (type == RULESET_SURGE)
+    return content;
+
+  if (regFind(content, "^payload:\\r?\\n")) {
+    output = regReplace(regReplace(content, "payload:\\r?\\n", "", true),
+                        R"(\s?^\s*-\s+('|"?)(.*)\1$)", "\n$2", true);
+    if (type == RULESET_CLASH_CLASSICAL)
+      return output;
+    std::stringstream ss;
+    ss << output;
+    char delimiter = getLineBreak(output);
+    output.clear();
+    string_size pos, lineSize;
+    while (getline(ss, strLine, delimiter)) {
+      strLine = trim(strLine);
+      lineSize = strLine.size();
+      if (lineSize && strLine[lineSize - 1] == '\r')
+        strLine.erase(--lineSize);
+
+      if (strFind(strLine, "//")) {
+        strLine.erase(strLine.find("//"));
+        strLine = trimWhitespace(strLine);
+      }
+
+      if (!strLine.empty() &&
+          (strLine[0] != ';' && strLine[0] != '#' &&
+           !(lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/'))) {
+        pos = strLine.find('/');
+        if (pos != std::string::npos) {
+          if (regMatch(strLine.substr(0, pos),
+                       "^(25[0-5]|2[0-4]\\d|[0-1]?\\d?\\d)(\\.(25[0-5]|2[0-4]"
+                       "\\d|[0-1]?\\d?\\d)){3}$"))
+            output += "IP-CIDR,";
+          else
+            output += "IP-CIDR6,";
+        } else {
+          if (strLine[0] == '.' ||
+              (lineSize >= 2 && strLine[0] == '+' && strLine[1] == '.')) {
+            bool keyword_flag = false;
+            while (endsWith(strLine, ".*")) {
+              keyword_flag = true;
+              strLine.erase(strLine.size() - 2);
+            }
+            output += "DOMAIN-";
+            if (keyword_flag)
+              output += "KEYWORD,";
+            else
+              output += "SUFFIX,";
+            strLine.erase(0, 2 - (strLine[0] == '.'));
+          } else
+            output += "DOMAIN,";
+        }
+      }
+      output += strLine;
+      output += '\n';
+    }
+    return output;
+  }
+  output = regReplace(regReplace(content, "^(?i:host)", "DOMAIN", true),
+                      "^(?i:ip6-cidr)", "IP-CIDR6", true);
+  output = regReplace(output,
+                      "^((?i:DOMAIN(?:-(?:SUFFIX|KEYWORD))?|IP-CIDR6?|USER-"
+                      "AGENT),)\\s*?(\\S*?)(?:,(?!no-resolve).*?)(,no-"
+                      "resolve)?$",
+                      "\\U$1\\E$2${3:-}", true);
+  return output;
+}
+
+static const int kTypes[] = {RULESET_SURGE, RULESET_QUANX, RULESET_CLASH_DOMAIN,
+                             RULESET_CLASH_IPCIDR, RULESET_CLASH_CLASSICAL};
+
+static void checkEquivalent(const std::string &content) {
+  for (int type : kTypes) {
+    std::string expected = referenceConvert(content, type);
+    std::string actual = scanRuleset(content, type);
+    if (expected != actual) {
+      std::fprintf(stderr, "mismatch for type %d on input:\n[%s]\n", type,
+                   content.c_str());
+      assert(false);
+    }
+  }
+}
+
+int main() {
+  assert(scanRuleset("payload:\n  - '.example.com'\n  - 'ads.*.*'\n  - "
+                     "'+.example.net.*'\n",
+                     RULESET_CLASH_DOMAIN) ==
+         "\nDOMAIN-SUFFIX,example.com\nDOMAIN,ads.*.*\nDOMAIN-KEYWORD,"
+         "example.net\n");
+  assert(scanRuleset("payload:\r\n  - 10.0.0.0/8\r\n  - 2001:db8::/32\r\n",
+                     RULESET_CLASH_IPCIDR) ==
+         "\nIP-CIDR,10.0.0.0/8\nIP-CIDR6,2001:db8::/32\n");
+  assert(scanRuleset("payload:\n  - DOMAIN,a.com\n  - \"IP-CIDR,1.1.1.1/32\"",
+                     RULESET_CLASH_CLASSICAL) ==
+         "\nDOMAIN,a.com\nIP-CIDR,1.1.1.1/32");
+  assert(scanRuleset("HOST-SUFFIX,example.com,Proxy\nip6-cidr,::1/128,DIRECT,"
+                     "no-resolve\nhost,a.com",
+                     RULESET_QUANX) ==
+         "DOMAIN-SUFFIX,example.com\nIP-CIDR6,::1/128,no-resolve\nDOMAIN,a.com");
+
+  const std::vector<std::string> goldens = {
+      "",
+      "payload:\n",
+      "payload:",
+      "# comment\npayload:\n  - a.com // note\n  # skipped\n\n  - b.com\n",
+      "payload:\n  -\n  - c.com\n  - 'quoted\n  - \"d.com\"\n-x\n- ''\n",
+      "payload:\n  - '.a.com'\r\n  - '1.2.3.4/32'\r\n",
+      "payload:\n- a\rb\rc",
+      "payload:\na\rb\r\r",
+      "x payload:\npayload:\n  - e.com\n",
+      "payload:\n  - 256.1.1.1/8\n  - 01.002.3.255/8\n  - 1.2.3/8\n",
+      "payload:\n   \n  - +.*\n  - .\n  - .*.*\n  - +.\n",
+      "HOST,a.com,Proxy\nHOST-KEYWORD,b,Proxy,no-resolve\nUSER-AGENT,c*,DIRECT",
+      "DOMAIN,\n  a.com,Proxy\nDOMAIN, b.com,no-resolve\nIP-CIDR,,x",
+      "domain-suffix,a.com,Proxy\r\nDOMAIN-KEYWORD,b,Proxy,no-resolve\r\n",
+      "ho\xC5\xBFt,a,b\nDOMAIN-\xE2\x84\xAA"
+      "EYWORD,k,b\nDOMAIN-\xC5\xBFUFFIX,s,b\n",
+      "payload:\n  - \xff\n",
+      "HOST,\xff,Proxy\n",
+  };
+  for (const std::string &content : goldens)
+    checkEquivalent(content);
+
+  /// token soup around every construct the old patterns were sensitive to
+  const std::vector<std::string> tokens = {
+      "payload:", "payload:\n", "payload:\r\n", "\n", "\r\n", "\r", " ", "  ",
+      "\t", "\v", "-", " - ", "  - ", "'", "\"", "a.com", ".b.org", "+.c.net",
+      ".*", "+.", ".", "1.2.3.4/24", "300.1.1.1/8", "2001:db8::/32", "/",
+      "//", "# c", ";", "host", "HOST-SUFFIX", "ho\xC5\xBFt", "ip6-cidr",
+      "IP6-CIDR", "DOMAIN", "domain-keyword", "DOMAIN-\xE2\x84\xAA" "EYWORD",
+      "DOMAIN-\xC5\xBFUFFIX", "USER-AGENT", "user-agent", "IP-CIDR", "ip-cidr6",
+      ",", "no-resolve", ",no-resolve", "Proxy", "中文", "x", "\xff",
+  };
+  std::mt19937 rng(20241018);
+  for (int round = 0; round < 60000; round++) {
+    std::string content;
+    size_t length = rng() % 24;
+    if (rng() % 2)
+      content = "payload:\n";
+    for (size_t i = 0; i < length; i++)
+      content += tokens[rng() % tokens.size()];
+    checkEquivalent(content);
+  }
+  return 0;
+}
@@ -0,0 +1,150 @@
+#include "script/script_cache.h"
+#include "script/script_quickjs.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using RenameFunction = std::function<std::string(const Proxy &)>;
+
+const std::string kRenameScript = R"(
+var regions = { HK: "香港", JP: "日本", US: "美国", SG: "新加坡" };
+function rename(node) {
+  var parts = node.Remark.split(" ");
+  var region = regions[parts[0]];
+  if (!region)
+    return "";
+  return region + " " + parts.slice(1).join(" ") + " [" + node.Group + "]";
+}
+)";
+
+double milliseconds(Clock::time_point begin, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+/// what nodeRename did before the cache: parse, compile and run the script,
+/// then resolve the function again, once per node
+std::vector<std::string> renameLegacy(qjs::Context &ctx,
+                                      const std::vector<Proxy> &nodes) {
+  std::vector<std::string> remarks;
+  remarks.reserve(nodes.size());
+  for (const Proxy &node : nodes) {
+    ctx.eval(kRenameScript);
+    auto rename = (RenameFunction)ctx.eval("rename");
+    remarks.push_back(rename(node));
+  }
+  return remarks;
+}
+
+std::vector<std::string> renameCached(qjs::Context &ctx,
+                                      const std::vector<Proxy> &nodes) {
+  std::vector<std::string> remarks;
+  remarks.reserve(nodes.size());
+  for (const Proxy &node : nodes) {
+    auto rename = (RenameFunction)script_function(ctx, kRenameScript, "rename");
+    remarks.push_back(rename(node));
+  }
+  return remarks;
+}
+
+/// a script's function stays its own after another script in the same
+/// context redefines the name, even when it is first looked up only then
+bool scriptsKeepTheirFunctions() {
+  const std::string first = "function rename(node) { return 'first'; }"
+                            "function getEmoji(node) { return 'first'; }";
+  const std::string second = "var getEmoji = (node) => 'second';"
+                             "const filter = (node) => 'second';";
+  Proxy node;
+  qjs::Runtime runtime;
+  qjs::Context ctx(runtime);
+  auto call = [&](const std::string &script, const char *name) {
+    return ((RenameFunction)script_function(ctx, script, name))(node);
+  };
+  if (call(first, "rename") != "first" || call(second, "getEmoji") != "second")
+    return false;
+  if (call(first, "getEmoji") != "first" || call(second, "filter") != "second")
+    return false;
+  /// the first script never defined filter
+  return JS_IsUndefined(script_function(ctx, first, "filter", true).v);
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t node_count = 3000;
+  const std::vector<std::string> regions = {"HK", "JP", "US", "SG", "TW"};
+
+  std::vector<Proxy> nodes(node_count);
+  for (size_t i = 0; i < node_count; ++i) {
+    nodes[i].Remark =
+        regions[i % regions.size()] + " " + std::to_string(i) + " IPLC";
+    nodes[i].Group = "Airport";
+    nodes[i].Type = ProxyType::Shadowsocks;
+  }
+
+  std::vector<std::string> legacy, cached, reused;
+  double legacy_ms = 0, cached_ms = 0, reused_ms = 0;
+  try {
+    qjs::Runtime legacy_runtime;
+    qjs::Context legacy_context(legacy_runtime);
+    const auto legacy_begin = Clock::now();
+    legacy = renameLegacy(legacy_context, nodes);
+    legacy_ms = milliseconds(legacy_begin, Clock::now());
+
+    qjs::Runtime cached_runtime;
+    qjs::Context cached_context(cached_runtime);
+    const auto cached_begin = Clock::now();
+    cached = renameCached(cached_context, nodes);
+    cached_ms = milliseconds(cached_begin, Clock::now());
+
+    /// a later request gets a fresh runtime and only loads the bytecode
+    qjs::Runtime reused_runtime;
+    qjs::Context reused_context(reused_runtime);
+    const auto reused_begin = Clock::now();
+    reused = renameCached(reused_context, nodes);
+    reused_ms = milliseconds(reused_begin, Clock::now());
+  } catch (qjs::exception &) {
+    std::cerr << "script failed\n";
+    return 1;
+  }
+
+  if (legacy != cached || legacy != reused) {
+    std::cerr << "rename mismatch\n";
+    return 1;
+  }
+  const ScriptCacheStats stats = script_cache_stats();
+  if (stats.bytecode.misses != 1 || stats.bytecode.hits != 2 * node_count - 1) {
+    std::cerr << "script compiled more than once\n";
+    return 1;
+  }
+
+  try {
+    if (!scriptsKeepTheirFunctions()) {
+      std::cerr << "script resolved another script's function\n";
+      return 1;
+    }
+  } catch (qjs::exception &) {
+    std::cerr << "script failed\n";
+    return 1;
+  }
+
+  std::cout << std::fixed << std::setprecision(3) << "nodes=" << node_count
+            << '\n'
+            << "rename_ms legacy=" << legacy_ms << " cached=" << cached_ms
+            << " new_runtime=" << reused_ms << '\n'
+            << "function_reuses=" << stats.function_reuses << '\n';
+
+  if (cached_ms >= legacy_ms || reused_ms >= legacy_ms) {
+    std::cerr << "structural performance regression\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "handler/sub_response_cache.h"
+
+using Cache = SubResponseCache<std::string>;
+using namespace std::chrono_literals;
+
+static Cache::ValuePtr value(const std::string &body) {
+  return std::make_shared<const std::string>(body);
+}
+
+static void testFreshStaleExpired() {
+  Cache cache(16, 1024 * 1024);
+  Cache::Clock::time_point now{};
+  assert(cache.get("key", now).state == Cache::State::Miss);
+
+  cache.put("key", value("body"), 4, 10s, 30s, now);
+  Cache::Lookup lookup = cache.get("key", now + 9s);
+  assert(lookup.state == Cache::State::Fresh && *lookup.value == "body");
+  assert(!lookup.refresh);
+
+  /// only the first stale hit is asked to refresh
+  lookup = cache.get("key", now + 10s);
+  assert(lookup.state == Cache::State::Stale && *lookup.value == "body");
+  assert(lookup.refresh);
+  lookup = cache.get("key", now + 11s);
+  assert(lookup.state == Cache::State::Stale && !lookup.refresh);
+
+  /// a failed refresh lets the next stale hit retry
+  cache.refreshFailed("key");
+  assert(cache.get("key", now + 12s).refresh);
+
+  /// a successful refresh replaces the entry with a fresh one
+  cache.put("key", value("new"), 3, 10s, 30s, now + 13s);
+  lookup = cache.get("key", now + 14s);
+  assert(lookup.state == Cache::State::Fresh && *lookup.value == "new");
+
+  /// past the stale window the entry is gone
+  assert(cache.get("key", now + 53s).state == Cache::State::Miss);
+  assert(cache.stats().entries == 0 && cache.stats().bytes == 0);
+
+  /// without a stale window expiry is immediate
+  cache.put("plain", value("body"), 4, 5s, 0s, now);
+  assert(cache.get("plain", now + 5s).state == Cache::State::Miss);
+
+  SubResponseCacheStats stats = cache.stats();
+  assert(stats.hits == 2 && stats.stale_hits == 3 && stats.misses == 3);
+  assert(stats.refreshes == 2);
+}
+
+static void testBounds() {
+  Cache::Clock::time_point now{};
+  Cache by_count(3, 1024 * 1024);
+  for (int i = 0; i < 3; i++)
+    by_count.put("key" + std::to_string(i), value("v"), 1, 60s, 0s, now);
+  /// touching key0 makes key1 the least recently used
+  assert(by_count.get("key0", now).state == Cache::State::Fresh);
+  by_count.put("key3", value("v"), 1, 60s, 0s, now);
+  assert(by_count.get("key1", now).state == Cache::State::Miss);
+  assert(by_count.get("key0", now).state == Cache::State::Fresh);
+  assert(by_count.stats().entries == 3 && by_count.stats().evictions == 1);
+
+  Cache by_bytes(100, 1000);
+  for (int i = 0; i < 10; i++)
+    by_bytes.put("key" + std::to_string(i), value(std::string(300, 'b')),
+                 300, 60s, 0s, now);
+  assert(by_bytes.stats().bytes <= 1000 && by_bytes.stats().entries == 3);
+  by_bytes.put("huge", value(std::string(2000, 'h')), 2000, 60s, 0s, now);
+  assert(by_bytes.get("huge", now).state == Cache::State::Miss);
+
+  by_bytes.setLimits(1, 1000);
+  assert(by_bytes.stats().entries == 1);
+  by_bytes.clear();
+  assert(by_bytes.stats().entries == 0 && by_bytes.stats().bytes == 0);
+}
+
+int main() {
+  testFreshStaleExpired();
+  testBounds();
+  return 0;
+}